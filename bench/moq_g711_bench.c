@@ -0,0 +1,315 @@
+/*
+ * moq_g711_bench - Microbenchmarks for the G.711 sample kernels
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ *
+ * Times each kernel in moq_g711.c on 160-sample (20 ms) frames for every
+ * instruction set the CPU supports, next to the table-per-sample loops the
+ * core translators use (codec_ulaw/codec_alaw: a 256-entry decode table
+ * and a 16384-entry encode table indexed by the sample's top 14 bits).
+ * Every kernel set is first checked against the scalar one over all
+ * inputs, so a speedup is never reported for wrong output.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "../moq_g711.h"
+
+#define DEFAULT_ITERATIONS 5000000
+#define FRAME 160
+
+static volatile uint64_t sink;
+
+/* Core-style lookup tables */
+static int16_t mulaw[256];
+static int16_t alaw[256];
+static uint8_t lin2mu[16384];
+static uint8_t lin2a[16384];
+
+#define CORE_MULAW(a) (mulaw[(a)])
+#define CORE_ALAW(a) (alaw[(a)])
+#define CORE_LIN2MU(a) (lin2mu[((unsigned short)(a)) >> 2])
+#define CORE_LIN2A(a) (lin2a[((unsigned short)(a)) >> 2])
+
+static double now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *op, const char *impl, long iterations, double secs, double base)
+{
+	double ns = secs * 1e9 / iterations;
+
+	printf("%-13s %-8s %8.1f ns/frame  %12.0f frames/s", op, impl, ns, iterations / secs);
+	if (base > 0) {
+		printf("  %5.2fx", base / ns);
+	}
+	printf("\n");
+}
+
+static void build_tables(void)
+{
+	int16_t pcm[16384];
+	uint8_t codes[256];
+	int i;
+
+	moq_g711_select(MOQ_G711_SCALAR);
+	for (i = 0; i < 256; i++) {
+		codes[i] = i;
+	}
+	moq_g711_ulaw_decode(codes, mulaw, 256);
+	moq_g711_alaw_decode(codes, alaw, 256);
+	for (i = 0; i < 16384; i++) {
+		pcm[i] = (int16_t)(i << 2);
+	}
+	moq_g711_ulaw_encode(pcm, lin2mu, 16384);
+	moq_g711_alaw_encode(pcm, lin2a, 16384);
+}
+
+/* Check the selected kernels against the scalar ones over every input */
+static int verify(enum moq_g711_isa isa)
+{
+	static int16_t pcm[65536], out16[2][65536];
+	static uint8_t out8[2][65536];
+	uint8_t codes[256];
+	uint64_t energy[2];
+	int i, pass;
+
+	for (i = 0; i < 65536; i++) {
+		pcm[i] = (int16_t)i;
+	}
+	for (i = 0; i < 256; i++) {
+		codes[i] = i;
+	}
+
+	for (pass = 0; pass < 2; pass++) {
+		moq_g711_select(pass ? isa : MOQ_G711_SCALAR);
+		moq_g711_ulaw_encode(pcm, out8[pass], 65536);
+		moq_g711_ulaw_decode(codes, out16[pass], 256);
+		moq_g711_alaw_decode(codes, out16[pass] + 256, 256);
+		memcpy(out16[pass] + 512, pcm, 4096 * sizeof(int16_t));
+		moq_g711_mix(out16[pass] + 512, pcm + 30000, 4096);
+		memcpy(out16[pass] + 8192, pcm, 4096 * sizeof(int16_t));
+		moq_g711_gain(out16[pass] + 8192, 4096, 3 * MOQ_G711_UNITY_GAIN);
+		energy[pass] = moq_g711_ulaw_energy(codes, 256);
+	}
+	if (memcmp(out8[0], out8[1], sizeof(out8[0])) || memcmp(out16[0], out16[1], sizeof(out16[0])) ||
+		energy[0] != energy[1]) {
+		return -1;
+	}
+
+	for (pass = 0; pass < 2; pass++) {
+		moq_g711_select(pass ? isa : MOQ_G711_SCALAR);
+		moq_g711_alaw_encode(pcm, out8[pass], 65536);
+	}
+
+	return memcmp(out8[0], out8[1], sizeof(out8[0])) ? -1 : 0;
+}
+
+static void bench_core(long iterations, const uint8_t *ulaw, const int16_t *pcm, double *base)
+{
+	int16_t out16[FRAME], acc[FRAME];
+	uint8_t out8[FRAME];
+	uint64_t total = 0;
+	double start;
+	long n;
+	int i;
+
+	start = now_sec();
+	for (n = 0; n < iterations; n++) {
+		for (i = 0; i < FRAME; i++) {
+			out16[i] = CORE_MULAW(ulaw[i]);
+		}
+		total += out16[n % FRAME];
+	}
+	base[0] = (now_sec() - start) * 1e9 / iterations;
+	report("ulaw decode", "core", iterations, base[0] * iterations / 1e9, 0);
+
+	start = now_sec();
+	for (n = 0; n < iterations; n++) {
+		for (i = 0; i < FRAME; i++) {
+			out8[i] = CORE_LIN2MU(pcm[i] + n);
+		}
+		total += out8[n % FRAME];
+	}
+	base[1] = (now_sec() - start) * 1e9 / iterations;
+	report("ulaw encode", "core", iterations, base[1] * iterations / 1e9, 0);
+
+	start = now_sec();
+	for (n = 0; n < iterations; n++) {
+		for (i = 0; i < FRAME; i++) {
+			out16[i] = CORE_ALAW(ulaw[i]);
+		}
+		total += out16[n % FRAME];
+	}
+	base[2] = (now_sec() - start) * 1e9 / iterations;
+	report("alaw decode", "core", iterations, base[2] * iterations / 1e9, 0);
+
+	start = now_sec();
+	for (n = 0; n < iterations; n++) {
+		for (i = 0; i < FRAME; i++) {
+			out8[i] = CORE_LIN2A(pcm[i] + n);
+		}
+		total += out8[n % FRAME];
+	}
+	base[3] = (now_sec() - start) * 1e9 / iterations;
+	report("alaw encode", "core", iterations, base[3] * iterations / 1e9, 0);
+
+	/* Mixing and metering as done without kernels: decode, then operate per sample */
+	memset(acc, 0, sizeof(acc));
+	start = now_sec();
+	for (n = 0; n < iterations; n++) {
+		for (i = 0; i < FRAME; i++) {
+			int v = acc[i] + CORE_MULAW(ulaw[i]);
+
+			acc[i] = v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : v;
+		}
+		total += acc[n % FRAME];
+	}
+	base[4] = (now_sec() - start) * 1e9 / iterations;
+	report("mix", "core", iterations, base[4] * iterations / 1e9, 0);
+
+	start = now_sec();
+	for (n = 0; n < iterations; n++) {
+		for (i = 0; i < FRAME; i++) {
+			int v = (acc[i] * (MOQ_G711_UNITY_GAIN / 2) + 2048) >> 12;
+
+			acc[i] = v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : v;
+		}
+		acc[n % FRAME] = (int16_t)n;
+	}
+	base[5] = (now_sec() - start) * 1e9 / iterations;
+	report("gain", "core", iterations, base[5] * iterations / 1e9, 0);
+
+	start = now_sec();
+	for (n = 0; n < iterations; n++) {
+		uint64_t energy = 0;
+
+		for (i = 0; i < FRAME; i++) {
+			int s = CORE_MULAW(ulaw[i] ^ (n & 1));
+
+			energy += (uint64_t)(s * s);
+		}
+		total += energy;
+	}
+	base[6] = (now_sec() - start) * 1e9 / iterations;
+	report("ulaw energy", "core", iterations, base[6] * iterations / 1e9, 0);
+
+	sink = total + acc[0];
+}
+
+static void bench_kernels(long iterations, const uint8_t *ulaw, const int16_t *pcm, const double *base)
+{
+	const char *name = moq_g711_name(moq_g711_current());
+	int16_t out16[FRAME], acc[FRAME];
+	uint8_t out8[FRAME];
+	uint64_t total = 0;
+	double start;
+	long n;
+
+	start = now_sec();
+	for (n = 0; n < iterations; n++) {
+		moq_g711_ulaw_decode(ulaw, out16, FRAME);
+		total += out16[n % FRAME];
+	}
+	report("ulaw decode", name, iterations, now_sec() - start, base[0]);
+
+	start = now_sec();
+	for (n = 0; n < iterations; n++) {
+		moq_g711_ulaw_encode(pcm, out8, FRAME);
+		total += out8[n % FRAME];
+	}
+	report("ulaw encode", name, iterations, now_sec() - start, base[1]);
+
+	start = now_sec();
+	for (n = 0; n < iterations; n++) {
+		moq_g711_alaw_decode(ulaw, out16, FRAME);
+		total += out16[n % FRAME];
+	}
+	report("alaw decode", name, iterations, now_sec() - start, base[2]);
+
+	start = now_sec();
+	for (n = 0; n < iterations; n++) {
+		moq_g711_alaw_encode(pcm, out8, FRAME);
+		total += out8[n % FRAME];
+	}
+	report("alaw encode", name, iterations, now_sec() - start, base[3]);
+
+	memset(acc, 0, sizeof(acc));
+	start = now_sec();
+	for (n = 0; n < iterations; n++) {
+		moq_g711_ulaw_decode(ulaw, out16, FRAME);
+		moq_g711_mix(acc, out16, FRAME);
+		total += acc[n % FRAME];
+	}
+	report("mix", name, iterations, now_sec() - start, base[4]);
+
+	start = now_sec();
+	for (n = 0; n < iterations; n++) {
+		moq_g711_gain(acc, FRAME, MOQ_G711_UNITY_GAIN / 2);
+		acc[n % FRAME] = (int16_t)n;
+	}
+	report("gain", name, iterations, now_sec() - start, base[5]);
+
+	start = now_sec();
+	for (n = 0; n < iterations; n++) {
+		total += moq_g711_ulaw_energy(ulaw, FRAME);
+	}
+	report("ulaw energy", name, iterations, now_sec() - start, base[6]);
+
+	sink = total + acc[0];
+}
+
+int main(int argc, char *argv[])
+{
+	long iterations = DEFAULT_ITERATIONS;
+	uint8_t ulaw[FRAME];
+	int16_t pcm[FRAME];
+	double base[7];
+	int isa, i;
+
+	if (argc > 1) {
+		iterations = atol(argv[1]);
+		if (iterations <= 0) {
+			fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	srand(1);
+	for (i = 0; i < FRAME; i++) {
+		ulaw[i] = rand();
+		pcm[i] = rand();
+	}
+	build_tables();
+
+	printf("G.711 kernels, %d-sample frames, %ld iterations per test\n", FRAME, iterations);
+	bench_core(iterations, ulaw, pcm, base);
+
+	for (isa = MOQ_G711_SCALAR; isa < MOQ_G711_ISA_COUNT; isa++) {
+		if (moq_g711_select(isa)) {
+			printf("%s: not supported on this CPU\n", moq_g711_name(isa));
+			continue;
+		}
+		if (verify(isa)) {
+			printf("%s: MISMATCH against scalar kernels\n", moq_g711_name(isa));
+			return 1;
+		}
+		moq_g711_select(isa);
+		bench_kernels(iterations, ulaw, pcm, base);
+	}
+
+	printf("Runtime dispatch selects: %s\n", moq_g711_name(moq_g711_init()));
+
+	return 0;
+}
@@ -0,0 +1,1227 @@
+/*
+ * moq_loadgen - Loopback load generator for chan_moq
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ *
+ * Simulates pairs of MoQ endpoints on one box. Each endpoint registers over
+ * the WebSocket signaling protocol, callers place calls to callees, callees
+ * answer, and every established call then streams MoQ media objects in both
+ * directions over UDP on loopback. Reports call setup rate and latency,
+ * signaling messages per call, per-packet one-way latency and jitter
+ * percentiles, loss and CPU cost per call. In ramp
+ * mode calls are added in steps until loss or latency thresholds are
+ * exceeded, which gives the concurrent-call ceiling.
+ *
+ * With -x, callers dial an extension (prefix + callee) in chan_moq's
+ * context instead of the callee, so each call is two channels bridged by
+ * Asterisk, and the load generator stands in for the relay chan_moq sends
+ * media through: it answers probes, learns where each session is from its
+ * ANNOUNCE and delivers objects by track, so every object crosses the
+ * driver twice. Without -x calls are routed user to user by the signaling
+ * server and media goes straight between endpoints, which measures the
+ * signaling server and the generator itself.
+ *
+ * Objects are audio at 8 kHz: the timestamp counts samples, as chan_moq's
+ * media clock does, and the send time travels in the first 8 payload bytes,
+ * which the driver passes through untouched.
+ *
+ * Media uses the driver's wire codec (moq_wire.c) and latency histograms
+ * (moq_hist.c). There are no other
+ * dependencies: the WebSocket client and JSON handling are the minimal
+ * subsets needed for the signaling protocol.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <signal.h>
+#include <getopt.h>
+#include <endian.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+#include "../moq_wire.h"
+#include "../moq_hist.h"
+
+#define MOQ_MAX_PACKET_SIZE 1500
+#define WS_BUFFER_SIZE 65536
+#define MAX_EVENTS 256
+#define SAMPLE_RATE 8000
+#define RELAY_TAG UINT64_MAX	/* epoll tag of the relay socket */
+
+enum ep_state {
+	EP_IDLE,
+	EP_REGISTERED,
+	EP_CALLING,
+	EP_UP
+};
+
+struct endpoint {
+	int index;
+	char user_id[32];
+	char session_id[64];
+	enum ep_state state;
+	int is_caller;
+	struct endpoint *peer;
+
+	/* Signaling */
+	int ws_fd;
+	unsigned char *ws_buf;
+	size_t ws_len;
+	uint64_t call_sent_us;
+
+	/* Media */
+	int udp_fd;
+	struct sockaddr_in udp_addr;
+	uint32_t track_id;		/* Received on; with a relay, sent on too */
+	struct track_route *route;	/* With a relay, where the call's session is */
+	uint64_t send_sequence;
+	uint64_t next_send_us;
+
+	/* Receive statistics for the current round */
+	int have_seq;
+	uint64_t first_seq;
+	uint64_t highest_seq;
+	uint64_t received;
+	uint64_t reordered;
+	int64_t last_transit;
+	double jitter;
+};
+
+/* A track on the relay: the session that announced it and the endpoint on the call */
+struct track_route {
+	uint32_t track_id;
+	int used;
+	int announced;
+	struct sockaddr_in addr;
+	struct endpoint *ep;
+};
+
+static struct {
+	const char *ws_host;
+	int ws_port;
+	const char *dial_prefix;
+	const char *relay_host;
+	int relay_port;
+	int no_signaling;
+	int calls;
+	int ramp_step;
+	int duration;
+	int ptime_ms;
+	int payload_bytes;
+	double loss_threshold;
+	double latency_threshold_ms;
+	pid_t target_pid;
+} opts = {
+	.ws_host = "127.0.0.1",
+	.ws_port = 8088,
+	.relay_host = "127.0.0.1",
+	.relay_port = 4433,
+	.calls = 50,
+	.duration = 10,
+	.ptime_ms = 20,
+	.payload_bytes = 160,
+	.loss_threshold = 1.0,
+	.latency_threshold_ms = 30.0,
+};
+
+static struct endpoint *endpoints;
+static int num_endpoints;
+static int epfd = -1;
+static volatile sig_atomic_t interrupted;
+
+static struct moq_hist latency_hist;
+static struct moq_hist ipdv_hist;
+static struct moq_hist setup_hist;	/* Call sent to call_answered received */
+static uint64_t ws_messages;
+static uint64_t send_errors;
+static uint64_t unrouted;		/* Objects for a track no session announced */
+
+/* Relay mode: one socket for every session, tracks in an open-addressed table */
+static int relay_fd = -1;
+static struct track_route *routes;
+static unsigned int route_mask;
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	interrupted = 1;
+}
+
+/* Process CPU time in microseconds; pid 0 means ourselves */
+static uint64_t cpu_time_us(pid_t pid)
+{
+	char path[64];
+	char buf[1024];
+	unsigned long utime, stime;
+	char *p;
+	FILE *f;
+	int i;
+
+	if (!pid) {
+		struct rusage ru;
+
+		getrusage(RUSAGE_SELF, &ru);
+		return (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 +
+			ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+	}
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+	f = fopen(path, "r");
+	if (!f) {
+		return 0;
+	}
+	if (!fgets(buf, sizeof(buf), f)) {
+		fclose(f);
+		return 0;
+	}
+	fclose(f);
+
+	/* Fields after the parenthesised command name; utime and stime are 14 and 15 */
+	p = strrchr(buf, ')');
+	if (!p) {
+		return 0;
+	}
+	p += 2;
+	for (i = 3; i < 14 && p; i++) {
+		p = strchr(p, ' ');
+		if (p) {
+			p++;
+		}
+	}
+	if (!p || sscanf(p, "%lu %lu", &utime, &stime) != 2) {
+		return 0;
+	}
+	return (uint64_t)(utime + stime) * 1000000 / sysconf(_SC_CLK_TCK);
+}
+
+/* Minimal JSON string field lookup for flat signaling messages */
+static int json_get(const char *msg, const char *key, char *out, size_t outlen)
+{
+	char pattern[64];
+	const char *p, *end;
+	size_t len;
+
+	snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+	p = strstr(msg, pattern);
+	if (!p) {
+		return -1;
+	}
+	p = strchr(p + strlen(pattern), ':');
+	if (!p) {
+		return -1;
+	}
+	p = strchr(p, '"');
+	if (!p) {
+		return -1;
+	}
+	p++;
+	end = strchr(p, '"');
+	if (!end) {
+		return -1;
+	}
+	len = (size_t)(end - p);
+	if (len >= outlen) {
+		len = outlen - 1;
+	}
+	memcpy(out, p, len);
+	out[len] = '\0';
+	return 0;
+}
+
+/* Minimal JSON unsigned number field lookup */
+static int json_get_uint(const char *msg, const char *key, uint64_t *out)
+{
+	char pattern[64];
+	const char *p;
+	char *end;
+
+	snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+	p = strstr(msg, pattern);
+	if (!p) {
+		return -1;
+	}
+	p = strchr(p + strlen(pattern), ':');
+	if (!p) {
+		return -1;
+	}
+	*out = strtoull(p + 1, &end, 10);
+	return end == p + 1 ? -1 : 0;
+}
+
+static void base64_encode(const unsigned char *in, size_t len, char *out)
+{
+	static const char tbl[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	size_t i;
+
+	for (i = 0; i + 2 < len; i += 3) {
+		*out++ = tbl[in[i] >> 2];
+		*out++ = tbl[((in[i] & 3) << 4) | (in[i + 1] >> 4)];
+		*out++ = tbl[((in[i + 1] & 15) << 2) | (in[i + 2] >> 6)];
+		*out++ = tbl[in[i + 2] & 63];
+	}
+	if (i < len) {
+		*out++ = tbl[in[i] >> 2];
+		if (i + 1 < len) {
+			*out++ = tbl[((in[i] & 3) << 4) | (in[i + 1] >> 4)];
+			*out++ = tbl[(in[i + 1] & 15) << 2];
+		} else {
+			*out++ = tbl[(in[i] & 3) << 4];
+			*out++ = '=';
+		}
+		*out++ = '=';
+	}
+	*out = '\0';
+}
+
+/* Send one masked WebSocket frame (clients must mask) */
+static int ws_send_frame(int fd, int opcode, const char *data, size_t len)
+{
+	unsigned char frame[16 + 4096];
+	size_t hdr = 0, i;
+	uint32_t mask = (uint32_t)random();
+	unsigned char *m = (unsigned char *)&mask;
+
+	if (len > 4096) {
+		return -1;
+	}
+
+	frame[hdr++] = 0x80 | (opcode & 0x0f);
+	if (len < 126) {
+		frame[hdr++] = 0x80 | len;
+	} else {
+		frame[hdr++] = 0x80 | 126;
+		frame[hdr++] = (len >> 8) & 0xff;
+		frame[hdr++] = len & 0xff;
+	}
+	memcpy(frame + hdr, m, 4);
+	hdr += 4;
+	for (i = 0; i < len; i++) {
+		frame[hdr + i] = data[i] ^ m[i & 3];
+	}
+
+	if (send(fd, frame, hdr + len, MSG_NOSIGNAL) != (ssize_t)(hdr + len)) {
+		return -1;
+	}
+	return 0;
+}
+
+static int ws_send_text(struct endpoint *ep, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static int ws_send_text(struct endpoint *ep, const char *fmt, ...)
+{
+	char msg[1024];
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(msg, sizeof(msg), fmt, ap);
+	va_end(ap);
+
+	if (len < 0 || (size_t)len >= sizeof(msg)) {
+		return -1;
+	}
+	return ws_send_frame(ep->ws_fd, 0x1, msg, len);
+}
+
+/* Blocking connect and HTTP upgrade; the socket is made non-blocking afterwards */
+static int ws_connect(struct endpoint *ep)
+{
+	struct sockaddr_in addr;
+	unsigned char nonce[16];
+	char key[32];
+	char req[512];
+	char resp[1024];
+	size_t got = 0;
+	int one = 1;
+	int fd, i;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(opts.ws_port);
+	if (inet_pton(AF_INET, opts.ws_host, &addr.sin_addr) != 1) {
+		struct hostent *he = gethostbyname(opts.ws_host);
+
+		if (!he) {
+			fprintf(stderr, "Cannot resolve %s\n", opts.ws_host);
+			return -1;
+		}
+		memcpy(&addr.sin_addr, he->h_addr_list[0], sizeof(addr.sin_addr));
+	}
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		fprintf(stderr, "Signaling connect to %s:%d failed: %s\n",
+			opts.ws_host, opts.ws_port, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	for (i = 0; i < 16; i++) {
+		nonce[i] = random() & 0xff;
+	}
+	base64_encode(nonce, sizeof(nonce), key);
+	snprintf(req, sizeof(req),
+		"GET / HTTP/1.1\r\n"
+		"Host: %s:%d\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Key: %s\r\n"
+		"Sec-WebSocket-Version: 13\r\n"
+		"Sec-WebSocket-Protocol: moq-signaling\r\n"
+		"\r\n", opts.ws_host, opts.ws_port, key);
+	if (send(fd, req, strlen(req), MSG_NOSIGNAL) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	/* Read the response headers one byte at a time so no frame data is consumed */
+	while (got < sizeof(resp) - 1) {
+		ssize_t n = recv(fd, resp + got, 1, 0);
+
+		if (n <= 0) {
+			close(fd);
+			return -1;
+		}
+		got++;
+		if (got >= 4 && !memcmp(resp + got - 4, "\r\n\r\n", 4)) {
+			break;
+		}
+	}
+	resp[got] = '\0';
+	if (strncmp(resp, "HTTP/1.1 101", 12)) {
+		fprintf(stderr, "WebSocket upgrade rejected: %.40s\n", resp);
+		close(fd);
+		return -1;
+	}
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+	ep->ws_fd = fd;
+	return 0;
+}
+
+/* Find a track's entry, adding it if create is set; NULL if absent or the table is full */
+static struct track_route *route_get(uint32_t track_id, int create)
+{
+	unsigned int i, n;
+
+	for (i = (track_id * 2654435761u) & route_mask, n = 0; n <= route_mask; i = (i + 1) & route_mask, n++) {
+		if (!routes[i].used) {
+			if (!create) {
+				return NULL;
+			}
+			routes[i].used = 1;
+			routes[i].track_id = track_id;
+			return &routes[i];
+		}
+		if (routes[i].track_id == track_id) {
+			return &routes[i];
+		}
+	}
+	return NULL;
+}
+
+/* With a relay, media goes on the track chan_moq gave the call in signaling */
+static int use_call_track(struct endpoint *ep, const char *msg)
+{
+	uint64_t track_id;
+
+	if (!opts.dial_prefix) {
+		return 0;
+	}
+	if (json_get_uint(msg, "track_id", &track_id) || !(ep->route = route_get(track_id, 1))) {
+		fprintf(stderr, "No usable track for %s: %s\n", ep->user_id, msg);
+		return -1;
+	}
+	ep->track_id = track_id;
+	ep->route->ep = ep;
+	return 0;
+}
+
+static void start_media(struct endpoint *ep)
+{
+	ep->state = EP_UP;
+	ep->next_send_us = now_us() + (random() % (opts.ptime_ms * 1000));
+}
+
+static void handle_ws_message(struct endpoint *ep, const char *msg)
+{
+	char type[32];
+	char session_id[64];
+
+	ws_messages++;
+	if (json_get(msg, "type", type, sizeof(type))) {
+		return;
+	}
+	json_get(msg, "session_id", session_id, sizeof(session_id));
+
+	if (!strcmp(type, "registered")) {
+		ep->state = EP_REGISTERED;
+	} else if (!strcmp(type, "incoming_call")) {
+		/* Callees answer immediately */
+		if (!ep->is_caller && ep->state == EP_REGISTERED && !use_call_track(ep, msg)) {
+			snprintf(ep->session_id, sizeof(ep->session_id), "%s", session_id);
+			ws_send_text(ep, "{\"type\":\"answer\",\"session_id\":\"%s\",\"from\":\"%s\"}",
+				ep->session_id, ep->user_id);
+			start_media(ep);
+		}
+	} else if (!strcmp(type, "call_answered")) {
+		if (ep->is_caller && ep->state == EP_CALLING && !strcmp(session_id, ep->session_id) &&
+			!use_call_track(ep, msg)) {
+			moq_hist_record(&setup_hist, now_us() - ep->call_sent_us);
+			start_media(ep);
+		}
+	} else if (!strcmp(type, "call_failed")) {
+		if (ep->is_caller && !strcmp(session_id, ep->session_id)) {
+			fprintf(stderr, "Call %s failed: %s\n", ep->session_id, msg);
+			ep->state = EP_REGISTERED;
+		}
+	}
+}
+
+/* Drain and parse complete frames from an endpoint's signaling socket */
+static int ws_read(struct endpoint *ep)
+{
+	for (;;) {
+		ssize_t n = recv(ep->ws_fd, ep->ws_buf + ep->ws_len, WS_BUFFER_SIZE - ep->ws_len - 1, 0);
+
+		if (n == 0) {
+			return -1;
+		}
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				break;
+			}
+			return -1;
+		}
+		ep->ws_len += n;
+
+		for (;;) {
+			unsigned char *b = ep->ws_buf;
+			size_t hdr = 2, len;
+			int opcode;
+
+			if (ep->ws_len < 2) {
+				break;
+			}
+			opcode = b[0] & 0x0f;
+			len = b[1] & 0x7f;
+			if (len == 126) {
+				if (ep->ws_len < 4) {
+					break;
+				}
+				len = (b[2] << 8) | b[3];
+				hdr = 4;
+			} else if (len == 127) {
+				if (ep->ws_len < 10) {
+					break;
+				}
+				len = be64toh(*(uint64_t *)(b + 2));
+				hdr = 10;
+			}
+			if (b[1] & 0x80) {
+				hdr += 4; /* Servers should not mask, but tolerate it */
+			}
+			if (hdr + len >= WS_BUFFER_SIZE) {
+				return -1;
+			}
+			if (ep->ws_len < hdr + len) {
+				break;
+			}
+
+			if (b[1] & 0x80) {
+				size_t i;
+
+				for (i = 0; i < len; i++) {
+					b[hdr + i] ^= b[hdr - 4 + (i & 3)];
+				}
+			}
+
+			if (opcode == 0x1) {
+				char saved = b[hdr + len];
+
+				b[hdr + len] = '\0';
+				handle_ws_message(ep, (char *)b + hdr);
+				b[hdr + len] = saved;
+			} else if (opcode == 0x9) {
+				ws_send_frame(ep->ws_fd, 0xa, (char *)b + hdr, len);
+			} else if (opcode == 0x8) {
+				return -1;
+			}
+
+			memmove(b, b + hdr + len, ep->ws_len - hdr - len);
+			ep->ws_len -= hdr + len;
+		}
+	}
+	return 0;
+}
+
+static void send_media(struct endpoint *ep, uint64_t now)
+{
+	unsigned char packet[MOQ_MAX_PACKET_SIZE];
+	unsigned char *payload = packet + MOQ_WIRE_MSG_HEADER_SIZE + MOQ_WIRE_OBJECT_HEADER_SIZE;
+	struct moq_object obj = {
+		.type = MOQ_OBJ_AUDIO_ULAW,
+		.track_id = opts.dial_prefix ? ep->track_id : ep->peer->track_id,
+		.sequence = ep->send_sequence,
+		.timestamp = ep->send_sequence * (opts.ptime_ms * SAMPLE_RATE / 1000),
+		.payload = payload,
+		.payload_len = opts.payload_bytes,
+	};
+	const struct sockaddr_in *to = &ep->peer->udp_addr;
+	int fd = ep->udp_fd;
+	int len, i;
+
+	ep->send_sequence++;
+	if (opts.dial_prefix) {
+		if (!ep->route->announced) {
+			unrouted++;
+			return;
+		}
+		to = &ep->route->addr;
+		fd = relay_fd;
+	}
+
+	/*
+	 * Build the payload in place, then the headers around it: the send time,
+	 * then a tone loud enough that voice activity detection passes it on
+	 */
+	memcpy(payload, &now, sizeof(now));
+	for (i = sizeof(now); i < opts.payload_bytes; i++) {
+		payload[i] = i & 1 ? 0x20 : 0xa0;
+	}
+	len = moq_wire_encode_object(packet, sizeof(packet), &obj);
+	if (len < 0) {
+		send_errors++;
+		return;
+	}
+
+	if (sendto(fd, packet, len, 0, (const struct sockaddr *)to, sizeof(*to)) < 0) {
+		send_errors++;
+	}
+}
+
+/* Account for an object an endpoint received */
+static void media_received(struct endpoint *ep, const struct moq_object *obj, uint64_t now)
+{
+	uint64_t seq = obj->sequence;
+	uint64_t sent_us;
+	int64_t transit;
+
+	if (obj->payload_len < sizeof(sent_us)) {
+		return;
+	}
+	memcpy(&sent_us, obj->payload, sizeof(sent_us));
+
+	if (!ep->have_seq) {
+		ep->have_seq = 1;
+		ep->first_seq = seq;
+		ep->highest_seq = seq;
+	} else if (seq > ep->highest_seq) {
+		ep->highest_seq = seq;
+	} else {
+		ep->reordered++;
+	}
+	ep->received++;
+
+	/* One-way latency is exact: both ends share CLOCK_MONOTONIC */
+	transit = (int64_t)(now - sent_us);
+	moq_hist_record(&latency_hist, transit > 0 ? (uint64_t)transit : 0);
+
+	/* RFC 3550 interarrival jitter, plus per-packet delay variation */
+	if (ep->received > 1) {
+		int64_t d = transit - ep->last_transit;
+
+		if (d < 0) {
+			d = -d;
+		}
+		ep->jitter += ((double)d - ep->jitter) / 16.0;
+		moq_hist_record(&ipdv_hist, (uint64_t)d);
+	}
+	ep->last_transit = transit;
+}
+
+static void recv_media(struct endpoint *ep)
+{
+	unsigned char packet[MOQ_MAX_PACKET_SIZE];
+
+	for (;;) {
+		ssize_t n = recv(ep->udp_fd, packet, sizeof(packet), 0);
+		struct moq_object obj;
+		const uint8_t *msg;
+		size_t msg_len;
+		uint8_t type;
+
+		if (n < 0) {
+			break;
+		}
+		if (moq_wire_decode_message(packet, n, &type, &msg, &msg_len) != MOQ_WIRE_OK ||
+			type != MOQ_MSG_OBJECT ||
+			moq_wire_decode_object(msg, msg_len, &obj) != MOQ_WIRE_OK ||
+			obj.track_id != ep->track_id) {
+			continue;
+		}
+		media_received(ep, &obj, now_us());
+	}
+}
+
+/*
+ * What chan_moq's sessions send to their relay: answer probes, note where
+ * each session's tracks are from its ANNOUNCE, and hand objects to the
+ * endpoint on the track. Receiver reports and the rest are not needed.
+ */
+static void recv_relay(void)
+{
+	unsigned char packet[MOQ_MAX_PACKET_SIZE];
+
+	for (;;) {
+		struct sockaddr_in from;
+		socklen_t fromlen = sizeof(from);
+		ssize_t n = recvfrom(relay_fd, packet, sizeof(packet), 0, (struct sockaddr *)&from, &fromlen);
+		struct track_route *route;
+		struct moq_object obj;
+		const uint8_t *msg;
+		size_t msg_len;
+		uint8_t type;
+		uint32_t track_id;
+
+		if (n < 0) {
+			break;
+		}
+		if (moq_wire_decode_message(packet, n, &type, &msg, &msg_len) != MOQ_WIRE_OK) {
+			continue;
+		}
+		if (type == MOQ_MSG_PING) {
+			packet[0] = MOQ_MSG_PONG;
+			sendto(relay_fd, packet, n, 0, (struct sockaddr *)&from, fromlen);
+		} else if (type == MOQ_MSG_ANNOUNCE && msg_len >= sizeof(track_id)) {
+			memcpy(&track_id, msg, sizeof(track_id));
+			route = route_get(ntohl(track_id), 1);
+			if (route) {
+				route->addr = from;
+				route->announced = 1;
+			}
+		} else if (type == MOQ_MSG_OBJECT && moq_wire_decode_object(msg, msg_len, &obj) == MOQ_WIRE_OK) {
+			route = route_get(obj.track_id, 0);
+			if (route && route->ep && route->ep->state == EP_UP) {
+				media_received(route->ep, &obj, now_us());
+			}
+		}
+	}
+}
+
+/* Bind the socket chan_moq's sessions use as their relay */
+static int relay_open(int size)
+{
+	struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(opts.relay_port) };
+	int buf = 4 * 1024 * 1024;
+
+	for (route_mask = 1023; route_mask < (unsigned int)size * 4; route_mask = route_mask * 2 + 1) {
+		/* Keep the table at most a quarter full */
+	}
+	routes = calloc(route_mask + 1, sizeof(*routes));
+	if (!routes || inet_pton(AF_INET, opts.relay_host, &addr.sin_addr) != 1) {
+		return -1;
+	}
+
+	relay_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (relay_fd < 0) {
+		return -1;
+	}
+	setsockopt(relay_fd, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf));
+	setsockopt(relay_fd, SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf));
+	if (bind(relay_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		fprintf(stderr, "Cannot listen as relay on %s:%d: %s\n",
+			opts.relay_host, opts.relay_port, strerror(errno));
+		close(relay_fd);
+		relay_fd = -1;
+		return -1;
+	}
+	fcntl(relay_fd, F_SETFL, fcntl(relay_fd, F_GETFL, 0) | O_NONBLOCK);
+
+	return 0;
+}
+
+static int endpoint_init(struct endpoint *ep, int index)
+{
+	socklen_t alen = sizeof(ep->udp_addr);
+
+	memset(ep, 0, sizeof(*ep));
+	ep->index = index;
+	ep->ws_fd = -1;
+	ep->is_caller = !(index & 1);
+	ep->track_id = (uint32_t)random();
+	snprintf(ep->user_id, sizeof(ep->user_id), "loadgen-%d-%d", (int)getpid(), index);
+
+	/* Through a relay every endpoint shares its socket */
+	ep->udp_fd = -1;
+	if (opts.dial_prefix) {
+		return 0;
+	}
+	ep->udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (ep->udp_fd < 0) {
+		return -1;
+	}
+	ep->udp_addr.sin_family = AF_INET;
+	ep->udp_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(ep->udp_fd, (struct sockaddr *)&ep->udp_addr, sizeof(ep->udp_addr)) < 0 ||
+		getsockname(ep->udp_fd, (struct sockaddr *)&ep->udp_addr, &alen) < 0) {
+		close(ep->udp_fd);
+		return -1;
+	}
+	fcntl(ep->udp_fd, F_SETFL, fcntl(ep->udp_fd, F_GETFL, 0) | O_NONBLOCK);
+
+	return 0;
+}
+
+static void epoll_add(int fd, uint64_t tag)
+{
+	struct epoll_event ev = { .events = EPOLLIN, .data.u64 = tag };
+
+	epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/* Run the event loop until the deadline, or until the predicate is satisfied */
+static void run_loop(uint64_t deadline, int (*done)(void))
+{
+	struct epoll_event events[MAX_EVENTS];
+
+	while (!interrupted && now_us() < deadline) {
+		uint64_t now = now_us();
+		uint64_t next = deadline;
+		int timeout_ms, n, i;
+
+		if (done && done()) {
+			return;
+		}
+
+		for (i = 0; i < num_endpoints; i++) {
+			struct endpoint *ep = &endpoints[i];
+
+			if (ep->state != EP_UP) {
+				continue;
+			}
+			while (ep->next_send_us <= now) {
+				send_media(ep, now);
+				ep->next_send_us += opts.ptime_ms * 1000;
+			}
+			if (ep->next_send_us < next) {
+				next = ep->next_send_us;
+			}
+		}
+
+		timeout_ms = next > now ? (int)((next - now) / 1000) : 0;
+		n = epoll_wait(epfd, events, MAX_EVENTS, timeout_ms);
+		for (i = 0; i < n; i++) {
+			uint64_t tag = events[i].data.u64;
+			struct endpoint *ep;
+
+			if (tag == RELAY_TAG) {
+				recv_relay();
+				continue;
+			}
+			ep = &endpoints[tag >> 1];
+			if (tag & 1) {
+				if (ws_read(ep)) {
+					fprintf(stderr, "Signaling connection for %s closed\n", ep->user_id);
+					epoll_ctl(epfd, EPOLL_CTL_DEL, ep->ws_fd, NULL);
+					close(ep->ws_fd);
+					ep->ws_fd = -1;
+				}
+			} else {
+				recv_media(ep);
+			}
+		}
+	}
+}
+
+static int pending_from, pending_to;
+
+static int all_registered(void)
+{
+	int i;
+
+	for (i = pending_from; i < pending_to; i++) {
+		if (endpoints[i].state == EP_IDLE) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int all_up(void)
+{
+	int i;
+
+	for (i = pending_from; i < pending_to; i++) {
+		if (endpoints[i].state != EP_UP) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Bring up endpoints [from, to) and establish their calls; returns calls set up */
+static int setup_calls(int from, int to, double *setup_secs)
+{
+	uint64_t start;
+	int i, up = 0;
+
+	for (i = from; i < to; i++) {
+		struct endpoint *ep = &endpoints[i];
+
+		ep->peer = &endpoints[i ^ 1];
+		if (!opts.dial_prefix) {
+			epoll_add(ep->udp_fd, (uint64_t)i << 1);
+		}
+		if (opts.no_signaling) {
+			continue;
+		}
+		if (ws_connect(ep)) {
+			return -1;
+		}
+		ep->ws_buf = malloc(WS_BUFFER_SIZE);
+		if (!ep->ws_buf) {
+			return -1;
+		}
+		epoll_add(ep->ws_fd, ((uint64_t)i << 1) | 1);
+		ws_send_text(ep, "{\"type\":\"register\",\"user_id\":\"%s\"}", ep->user_id);
+	}
+
+	pending_from = from;
+	pending_to = to;
+	start = now_us();
+
+	if (opts.no_signaling) {
+		for (i = from; i < to; i++) {
+			start_media(&endpoints[i]);
+		}
+		*setup_secs = 0;
+		return (to - from) / 2;
+	}
+
+	run_loop(now_us() + 10000000, all_registered);
+
+	start = now_us();
+	for (i = from; i < to; i += 2) {
+		struct endpoint *ep = &endpoints[i];
+
+		snprintf(ep->session_id, sizeof(ep->session_id), "loadgen-%d-%d", (int)getpid(), i);
+		ep->state = EP_CALLING;
+		ep->call_sent_us = now_us();
+		ws_send_text(ep, "{\"type\":\"call\",\"session_id\":\"%s\",\"dest\":\"%s%s\",\"from\":\"%s\"}",
+			ep->session_id, opts.dial_prefix ? opts.dial_prefix : "", ep->peer->user_id, ep->user_id);
+	}
+	run_loop(now_us() + 30000000, all_up);
+	*setup_secs = (now_us() - start) / 1e6;
+
+	for (i = from; i < to; i += 2) {
+		if (endpoints[i].state == EP_UP) {
+			up++;
+		}
+	}
+	return up;
+}
+
+static void reset_round_stats(void)
+{
+	int i;
+
+	memset(&latency_hist, 0, sizeof(latency_hist));
+	memset(&ipdv_hist, 0, sizeof(ipdv_hist));
+	for (i = 0; i < num_endpoints; i++) {
+		struct endpoint *ep = &endpoints[i];
+
+		ep->have_seq = 0;
+		ep->received = 0;
+		ep->reordered = 0;
+		ep->jitter = 0;
+	}
+}
+
+static void hangup_all(int count)
+{
+	int i;
+
+	if (opts.no_signaling) {
+		return;
+	}
+	for (i = 0; i < count; i += 2) {
+		if (endpoints[i].ws_fd >= 0 && endpoints[i].state == EP_UP) {
+			ws_send_text(&endpoints[i], "{\"type\":\"hangup\",\"session_id\":\"%s\"}",
+				endpoints[i].session_id);
+		}
+	}
+	/* Give the server a moment to deliver call_ended */
+	run_loop(now_us() + 200000, NULL);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -c CALLS     concurrent calls (endpoint pairs) [%d]\n"
+		"  -r STEP      ramp mode: add STEP calls per round up to CALLS\n"
+		"  -d SECS      media measurement time per round [%d]\n"
+		"  -p MS        packetization interval [%d]\n"
+		"  -b BYTES     payload bytes per media object, at least 8 [%d]\n"
+		"  -s HOST:PORT WebSocket signaling server [%s:%d]\n"
+		"  -x PREFIX    dial PREFIX + callee in chan_moq's context, media through chan_moq\n"
+		"  -R HOST:PORT with -x, act as chan_moq's relay on this address [%s:%d]\n"
+		"  -S           skip signaling, measure the media path only\n"
+		"  -P PID       also report CPU used by this process (e.g. asterisk)\n"
+		"  -L PCT       ramp stop threshold for loss [%.1f]\n"
+		"  -T MS        ramp stop threshold for p99 one-way latency [%.1f]\n",
+		prog, opts.calls, opts.duration, opts.ptime_ms, opts.payload_bytes,
+		opts.ws_host, opts.ws_port, opts.relay_host, opts.relay_port,
+		opts.loss_threshold, opts.latency_threshold_ms);
+}
+
+int main(int argc, char *argv[])
+{
+	int max_calls, active = 0, ceiling = 0, round = 0;
+	uint64_t setup_messages;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "c:r:d:p:b:s:x:R:SP:L:T:h")) != -1) {
+		switch (opt) {
+		case 'c':
+			opts.calls = atoi(optarg);
+			break;
+		case 'r':
+			opts.ramp_step = atoi(optarg);
+			break;
+		case 'd':
+			opts.duration = atoi(optarg);
+			break;
+		case 'p':
+			opts.ptime_ms = atoi(optarg);
+			break;
+		case 'b':
+			opts.payload_bytes = atoi(optarg);
+			break;
+		case 's': {
+			char *colon = strrchr(optarg, ':');
+
+			if (colon) {
+				*colon = '\0';
+				opts.ws_port = atoi(colon + 1);
+			}
+			opts.ws_host = optarg;
+			break;
+		}
+		case 'x':
+			opts.dial_prefix = optarg;
+			break;
+		case 'R': {
+			char *colon = strrchr(optarg, ':');
+
+			if (colon) {
+				*colon = '\0';
+				opts.relay_port = atoi(colon + 1);
+			}
+			opts.relay_host = optarg;
+			break;
+		}
+		case 'S':
+			opts.no_signaling = 1;
+			break;
+		case 'P':
+			opts.target_pid = atoi(optarg);
+			break;
+		case 'L':
+			opts.loss_threshold = atof(optarg);
+			break;
+		case 'T':
+			opts.latency_threshold_ms = atof(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (opts.calls <= 0 || opts.ptime_ms <= 0 || opts.duration <= 0 ||
+		opts.payload_bytes < (int)sizeof(uint64_t) || opts.payload_bytes > MOQ_MAX_PACKET_SIZE - 64 ||
+		(opts.dial_prefix && opts.no_signaling)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGPIPE, SIG_IGN);
+	srandom(time(NULL) ^ getpid());
+
+	max_calls = opts.calls;
+	num_endpoints = max_calls * 2;
+	endpoints = calloc(num_endpoints, sizeof(*endpoints));
+	epfd = epoll_create1(0);
+	if (!endpoints || epfd < 0) {
+		perror("setup");
+		return 1;
+	}
+	if (opts.dial_prefix) {
+		if (relay_open(num_endpoints)) {
+			return 1;
+		}
+		epoll_add(relay_fd, RELAY_TAG);
+	}
+	for (i = 0; i < num_endpoints; i++) {
+		if (endpoint_init(&endpoints[i], i)) {
+			fprintf(stderr, "Failed to create endpoint %d: %s\n", i, strerror(errno));
+			return 1;
+		}
+	}
+
+	printf("%5s %6s %9s %8s %8s %8s %8s %8s %8s %7s %6s %9s %9s\n",
+		"round", "calls", "setup/s", "lat p50", "lat p99", "lat max",
+		"ipdv p50", "ipdv p99", "jit p99", "loss %", "reord", "cpu%/call", "tgt%/call");
+
+	while (!interrupted && active < max_calls) {
+		int target = opts.ramp_step ? active + opts.ramp_step : max_calls;
+		uint64_t expected = 0, received = 0, reordered = 0;
+		uint64_t cpu_self, cpu_target, wall;
+		double setup_secs, loss, jitter_p99 = 0;
+		double *jitters;
+		int up, wanted, streams = 0;
+
+		if (target > max_calls) {
+			target = max_calls;
+		}
+		wanted = target - active;
+		up = setup_calls(active * 2, target * 2, &setup_secs);
+		if (up < 0) {
+			return 1;
+		}
+		if (up < wanted) {
+			fprintf(stderr, "Only %d of %d new calls were set up\n", up, wanted);
+		}
+		active = target;
+		round++;
+
+		/* Let the new calls settle before measuring */
+		run_loop(now_us() + 500000, NULL);
+		reset_round_stats();
+		cpu_self = cpu_time_us(0);
+		cpu_target = cpu_time_us(opts.target_pid);
+		wall = now_us();
+		run_loop(now_us() + (uint64_t)opts.duration * 1000000, NULL);
+		wall = now_us() - wall;
+		cpu_self = cpu_time_us(0) - cpu_self;
+		cpu_target = opts.target_pid ? cpu_time_us(opts.target_pid) - cpu_target : 0;
+
+		jitters = calloc(active * 2, sizeof(*jitters));
+		for (i = 0; i < active * 2; i++) {
+			struct endpoint *ep = &endpoints[i];
+
+			if (!ep->have_seq) {
+				continue;
+			}
+			expected += ep->highest_seq - ep->first_seq + 1;
+			received += ep->received;
+			reordered += ep->reordered;
+			if (jitters) {
+				jitters[streams++] = ep->jitter;
+			}
+		}
+		if (jitters && streams) {
+			int j, k;
+
+			/* Insertion sort is fine for per-stream values */
+			for (j = 1; j < streams; j++) {
+				double v = jitters[j];
+
+				for (k = j - 1; k >= 0 && jitters[k] > v; k--) {
+					jitters[k + 1] = jitters[k];
+				}
+				jitters[k + 1] = v;
+			}
+			jitter_p99 = jitters[(streams * 99) / 100];
+		}
+		free(jitters);
+
+		loss = expected > received ? 100.0 * (expected - received) / expected : 0.0;
+		printf("%5d %6d %9.1f %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f %7.3f %6llu %9.4f %9.4f\n",
+			round, active, setup_secs > 0 ? up / setup_secs : 0.0,
+			moq_hist_percentile(&latency_hist, 50) / 1000.0,
+			moq_hist_percentile(&latency_hist, 99) / 1000.0,
+			latency_hist.max / 1000.0,
+			moq_hist_percentile(&ipdv_hist, 50) / 1000.0,
+			moq_hist_percentile(&ipdv_hist, 99) / 1000.0,
+			jitter_p99 / 1000.0, loss, (unsigned long long)reordered,
+			100.0 * cpu_self / wall / active,
+			100.0 * cpu_target / wall / active);
+		fflush(stdout);
+
+		if (loss > opts.loss_threshold ||
+			moq_hist_percentile(&latency_hist, 99) / 1000.0 > opts.latency_threshold_ms ||
+			up < wanted) {
+			printf("Thresholds exceeded at %d calls\n", active);
+			break;
+		}
+		ceiling = active;
+	}
+
+	printf("\nConcurrent-call ceiling: %d%s\n", ceiling,
+		ceiling == max_calls ? " (limit not reached, raise -c)" : "");
+	if (setup_hist.total) {
+		printf("Call setup latency: p50 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+			moq_hist_percentile(&setup_hist, 50) / 1000.0,
+			moq_hist_percentile(&setup_hist, 99) / 1000.0, setup_hist.max / 1000.0);
+	}
+	printf("Media send errors: %llu\n", (unsigned long long)send_errors);
+	if (opts.dial_prefix) {
+		printf("Objects for tracks no session announced: %llu\n", (unsigned long long)unrouted);
+	}
+
+	/* Servers that broadcast pay most at hangup, so count through teardown */
+	setup_messages = ws_messages;
+	hangup_all(active * 2);
+	printf("Signaling messages received: %llu (%.1f per call: %.1f setup, %.1f teardown)\n",
+		(unsigned long long)ws_messages, active ? (double)ws_messages / active : 0.0,
+		active ? (double)setup_messages / active : 0.0,
+		active ? (double)(ws_messages - setup_messages) / active : 0.0);
+	for (i = 0; i < num_endpoints; i++) {
+		if (endpoints[i].ws_fd >= 0) {
+			close(endpoints[i].ws_fd);
+		}
+		if (endpoints[i].udp_fd >= 0) {
+			close(endpoints[i].udp_fd);
+		}
+		free(endpoints[i].ws_buf);
+	}
+	free(endpoints);
+	free(routes);
+	if (relay_fd >= 0) {
+		close(relay_fd);
+	}
+	close(epfd);
+
+	return 0;
+}
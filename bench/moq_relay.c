@@ -0,0 +1,330 @@
+/*
+ * moq_relay - Stand-in MoQ relay for testing relay selection and failover
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ *
+ * A minimal UDP hub that behaves enough like an upstream relay for chan_moq
+ * to probe it and send media through it. PING messages are answered with
+ * PONG; any other datagram registers its sender as a client, and media
+ * objects, fragments and receiver reports are forwarded to every other
+ * client heard from recently. An optional fixed delay is added to
+ * everything the relay sends, so several instances on loopback look like
+ * relays at different distances:
+ *
+ *   ./bench/moq_relay -p 4433 -d 40 &
+ *   ./bench/moq_relay -p 4434 -d 5 &
+ *
+ * Stopping one with SIGSTOP simulates an outage (its probes go unanswered
+ * and chan_moq moves its calls elsewhere); SIGCONT brings it back. SIGUSR1
+ * sends GOAWAY to every client instead, as a relay about to restart would.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <getopt.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "../moq_wire.h"
+
+#define DEFAULT_PORT 4433
+#define MAX_CLIENTS 256
+#define CLIENT_TIMEOUT_MS 5000
+#define MAX_DATAGRAM 2048
+#define QUEUE_SIZE 4096		/* Datagrams held back by the delay */
+#define STATS_INTERVAL_MS 5000
+
+struct client {
+	struct sockaddr_in addr;
+	uint64_t last_seen_ms;
+};
+
+struct queued {
+	uint64_t due_ms;
+	struct sockaddr_in to;
+	uint16_t len;
+	uint8_t data[MAX_DATAGRAM];
+};
+
+static struct {
+	int port;
+	int delay_ms;
+	int quiet;
+} opts = {
+	.port = DEFAULT_PORT,
+};
+
+static struct client clients[MAX_CLIENTS];
+static int client_count;
+
+/* FIFO of delayed datagrams; a fixed delay keeps it in due order */
+static struct queued *queue;
+static unsigned int queue_head, queue_len;
+
+static struct {
+	uint64_t pings, forwarded, dropped;
+} stats;
+
+static volatile sig_atomic_t running = 1;
+static volatile sig_atomic_t goaway;
+
+static void handle_signal(int sig)
+{
+	if (sig == SIGUSR1) {
+		goaway = 1;
+	} else {
+		running = 0;
+	}
+}
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int same_addr(const struct sockaddr_in *a, const struct sockaddr_in *b)
+{
+	return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+static void relay_send(int fd, const struct sockaddr_in *to, const uint8_t *data, size_t len, uint64_t now)
+{
+	struct queued *q;
+
+	if (!opts.delay_ms) {
+		sendto(fd, data, len, 0, (const struct sockaddr *)to, sizeof(*to));
+		return;
+	}
+
+	if (queue_len == QUEUE_SIZE) {
+		stats.dropped++;
+		return;
+	}
+	q = &queue[(queue_head + queue_len) % QUEUE_SIZE];
+	q->due_ms = now + opts.delay_ms;
+	q->to = *to;
+	q->len = len;
+	memcpy(q->data, data, len);
+	queue_len++;
+}
+
+/* Send whatever has waited long enough; returns ms until the next is due, or -1 */
+static int flush_queue(int fd, uint64_t now)
+{
+	struct queued *q;
+
+	while (queue_len) {
+		q = &queue[queue_head];
+		if (q->due_ms > now) {
+			return (int)(q->due_ms - now);
+		}
+		sendto(fd, q->data, q->len, 0, (const struct sockaddr *)&q->to, sizeof(q->to));
+		queue_head = (queue_head + 1) % QUEUE_SIZE;
+		queue_len--;
+	}
+
+	return -1;
+}
+
+static void touch_client(const struct sockaddr_in *from, uint64_t now)
+{
+	int i, oldest = 0;
+
+	for (i = 0; i < client_count; i++) {
+		if (same_addr(&clients[i].addr, from)) {
+			clients[i].last_seen_ms = now;
+			return;
+		}
+		if (clients[i].last_seen_ms < clients[oldest].last_seen_ms) {
+			oldest = i;
+		}
+	}
+
+	if (client_count < MAX_CLIENTS) {
+		oldest = client_count++;
+	}
+	clients[oldest].addr = *from;
+	clients[oldest].last_seen_ms = now;
+	if (!opts.quiet) {
+		printf("client %s:%d\n", inet_ntoa(from->sin_addr), ntohs(from->sin_port));
+		fflush(stdout);
+	}
+}
+
+static void handle_datagram(int fd, const uint8_t *buf, size_t len, const struct sockaddr_in *from, uint64_t now)
+{
+	const uint8_t *payload;
+	size_t payload_len;
+	struct moq_probe probe;
+	uint8_t reply[MOQ_WIRE_MSG_HEADER_SIZE + MOQ_WIRE_PROBE_SIZE];
+	uint8_t type;
+	int i, reply_len;
+
+	if (moq_wire_decode_message(buf, len, &type, &payload, &payload_len) != MOQ_WIRE_OK) {
+		return;
+	}
+
+	if (type == MOQ_MSG_PING) {
+		if (moq_wire_decode_probe(payload, payload_len, &probe) == MOQ_WIRE_OK) {
+			reply_len = moq_wire_encode_probe(reply, sizeof(reply), MOQ_MSG_PONG, &probe);
+			relay_send(fd, from, reply, reply_len, now);
+			stats.pings++;
+		}
+		return;
+	}
+
+	touch_client(from, now);
+
+	if (type != MOQ_MSG_OBJECT && type != MOQ_MSG_OBJECT_FRAGMENT && type != MOQ_MSG_RECEIVER_REPORT) {
+		return;
+	}
+	for (i = 0; i < client_count; i++) {
+		if (same_addr(&clients[i].addr, from) || now - clients[i].last_seen_ms > CLIENT_TIMEOUT_MS) {
+			continue;
+		}
+		relay_send(fd, &clients[i].addr, buf, len, now);
+		stats.forwarded++;
+	}
+}
+
+/* Tell every recent client we are going away */
+static void send_goaway(int fd, uint64_t now)
+{
+	uint8_t msg[MOQ_WIRE_MSG_HEADER_SIZE];
+	int i, len;
+
+	len = moq_wire_encode_message(msg, sizeof(msg), MOQ_MSG_GOAWAY, NULL, 0);
+	for (i = 0; i < client_count; i++) {
+		if (now - clients[i].last_seen_ms <= CLIENT_TIMEOUT_MS) {
+			relay_send(fd, &clients[i].addr, msg, len, now);
+		}
+	}
+	if (!opts.quiet) {
+		printf("sent GOAWAY to clients\n");
+		fflush(stdout);
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -p PORT      UDP port to listen on [%d]\n"
+		"  -d MS        delay added to everything the relay sends [%d]\n"
+		"  -q           quiet, no per-client or periodic output\n",
+		prog, opts.port, opts.delay_ms);
+}
+
+int main(int argc, char *argv[])
+{
+	struct sockaddr_in addr = { 0, }, from;
+	socklen_t from_len;
+	uint8_t buf[MAX_DATAGRAM];
+	struct pollfd pfd;
+	uint64_t now, next_stats;
+	ssize_t len;
+	int fd, opt, timeout;
+
+	while ((opt = getopt(argc, argv, "p:d:qh")) != -1) {
+		switch (opt) {
+		case 'p':
+			opts.port = atoi(optarg);
+			break;
+		case 'd':
+			opts.delay_ms = atoi(optarg);
+			break;
+		case 'q':
+			opts.quiet = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (opts.port <= 0 || opts.port > 65535 || opts.delay_ms < 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	queue = calloc(QUEUE_SIZE, sizeof(*queue));
+	if (!queue) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return 1;
+	}
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(opts.port);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("bind");
+		return 1;
+	}
+
+	signal(SIGINT, handle_signal);
+	signal(SIGTERM, handle_signal);
+	signal(SIGUSR1, handle_signal);
+
+	printf("Relay on UDP port %d, delay %d ms\n", opts.port, opts.delay_ms);
+	fflush(stdout);
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	next_stats = now_ms() + STATS_INTERVAL_MS;
+
+	while (running) {
+		timeout = flush_queue(fd, now_ms());
+		if (timeout < 0 || timeout > 100) {
+			timeout = 100;
+		}
+		if (poll(&pfd, 1, timeout) < 0 && errno != EINTR) {
+			perror("poll");
+			break;
+		}
+
+		/* Drain the socket before going back to the queue */
+		for (;;) {
+			from_len = sizeof(from);
+			len = recvfrom(fd, buf, sizeof(buf), MSG_DONTWAIT, (struct sockaddr *)&from, &from_len);
+			if (len <= 0) {
+				break;
+			}
+			handle_datagram(fd, buf, len, &from, now_ms());
+		}
+
+		now = now_ms();
+		if (goaway) {
+			goaway = 0;
+			send_goaway(fd, now);
+		}
+		if (!opts.quiet && now >= next_stats) {
+			printf("pings %llu forwarded %llu dropped %llu clients %d queued %u\n",
+				(unsigned long long)stats.pings, (unsigned long long)stats.forwarded,
+				(unsigned long long)stats.dropped, client_count, queue_len);
+			fflush(stdout);
+			next_stats = now + STATS_INTERVAL_MS;
+		}
+	}
+
+	close(fd);
+	free(queue);
+	return 0;
+}
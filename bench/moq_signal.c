@@ -0,0 +1,563 @@
+/*
+ * moq_signal - Stand-in for chan_moq's built-in signaling server
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ *
+ * Serves the WebSocket signaling protocol with the registrar and call
+ * router chan_moq uses (moq_registrar.c), without an Asterisk: users
+ * register, calls between them are offered to the callee alone, and
+ * answers, hangups and WebRTC negotiation go to the other party only.
+ * Calls to extensions are not possible here, so a call to anyone not
+ * registered fails. This lets the routing be compared on one box with
+ * signaling_server.py, which sends answers and hangups to everyone:
+ *
+ *   ./bench/moq_signal -p 8088 &
+ *   ./bench/moq_loadgen -c 500 -P $!
+ *
+ * and the same with "python3 signaling_server.py" in its place. The server
+ * reports the messages it received and sent once a second while busy.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <getopt.h>
+#include <endian.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <openssl/sha.h>
+
+#include "../moq_registrar.h"
+
+#define DEFAULT_PORT 8088
+#define WS_BUFFER_SIZE 65536
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define MAX_EVENTS 256
+#define MAX_MESSAGE 4096
+
+struct conn {
+	int fd;
+	int upgraded;
+	char user_id[MOQ_REGISTRAR_ID_SIZE];
+	unsigned char *buf;
+	size_t len;
+};
+
+static struct {
+	int port;
+	int quiet;
+} opts = {
+	.port = DEFAULT_PORT,
+};
+
+static struct moq_registrar registrar;
+
+static struct {
+	uint64_t received, sent, calls, failed;
+} stats;
+
+static volatile sig_atomic_t running = 1;
+
+static void handle_signal(int sig)
+{
+	(void)sig;
+	running = 0;
+}
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Minimal JSON string field lookup for flat signaling messages */
+static int json_get(const char *msg, const char *key, char *out, size_t outlen)
+{
+	char pattern[64];
+	const char *p, *end;
+	size_t len;
+
+	snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+	p = strstr(msg, pattern);
+	if (!p) {
+		return -1;
+	}
+	p = strchr(p + strlen(pattern), ':');
+	if (!p) {
+		return -1;
+	}
+	p = strchr(p, '"');
+	if (!p) {
+		return -1;
+	}
+	p++;
+	end = strchr(p, '"');
+	if (!end) {
+		return -1;
+	}
+	len = (size_t)(end - p);
+	if (len >= outlen) {
+		len = outlen - 1;
+	}
+	memcpy(out, p, len);
+	out[len] = '\0';
+	return 0;
+}
+
+static void base64_encode(const unsigned char *in, size_t len, char *out)
+{
+	static const char tbl[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	size_t i;
+
+	for (i = 0; i + 2 < len; i += 3) {
+		*out++ = tbl[in[i] >> 2];
+		*out++ = tbl[((in[i] & 3) << 4) | (in[i + 1] >> 4)];
+		*out++ = tbl[((in[i + 1] & 15) << 2) | (in[i + 2] >> 6)];
+		*out++ = tbl[in[i + 2] & 63];
+	}
+	if (i < len) {
+		*out++ = tbl[in[i] >> 2];
+		if (i + 1 < len) {
+			*out++ = tbl[((in[i] & 3) << 4) | (in[i + 1] >> 4)];
+			*out++ = tbl[(in[i + 1] & 15) << 2];
+		} else {
+			*out++ = tbl[(in[i] & 3) << 4];
+			*out++ = '=';
+		}
+		*out++ = '=';
+	}
+	*out = '\0';
+}
+
+/* Send one unmasked frame (servers must not mask); sockets block on send */
+static int ws_send_frame(struct conn *conn, int opcode, const char *data, size_t len)
+{
+	unsigned char frame[4 + MAX_MESSAGE];
+	size_t hdr = 0;
+
+	if (!conn || len > MAX_MESSAGE) {
+		return -1;
+	}
+
+	frame[hdr++] = 0x80 | (opcode & 0x0f);
+	if (len < 126) {
+		frame[hdr++] = len;
+	} else {
+		frame[hdr++] = 126;
+		frame[hdr++] = (len >> 8) & 0xff;
+		frame[hdr++] = len & 0xff;
+	}
+	memcpy(frame + hdr, data, len);
+
+	if (send(conn->fd, frame, hdr + len, MSG_NOSIGNAL) != (ssize_t)(hdr + len)) {
+		return -1;
+	}
+	if (opcode == 0x1) {
+		stats.sent++;
+	}
+	return 0;
+}
+
+static int ws_send_text(struct conn *conn, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static int ws_send_text(struct conn *conn, const char *fmt, ...)
+{
+	char msg[MAX_MESSAGE];
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(msg, sizeof(msg), fmt, ap);
+	va_end(ap);
+
+	if (len < 0 || (size_t)len >= sizeof(msg)) {
+		return -1;
+	}
+	return ws_send_frame(conn, 0x1, msg, len);
+}
+
+/* The media key fields of a message, as JSON members to append to another */
+static void media_key_fields(const char *msg, char *out, size_t outlen)
+{
+	char key[256], cipher[32];
+	int len = 0;
+
+	*out = '\0';
+	if (!json_get(msg, "media_key", key, sizeof(key))) {
+		len = snprintf(out, outlen, ",\"media_key\":\"%s\"", key);
+	}
+	if (len >= 0 && (size_t)len < outlen && !json_get(msg, "media_cipher", cipher, sizeof(cipher))) {
+		snprintf(out + len, outlen - len, ",\"media_cipher\":\"%s\"", cipher);
+	}
+}
+
+/* A departing user's calls end; the other party is told, whether a user or not */
+static void call_ended(void *data, const char *session_id, const char *peer, void *peer_conn)
+{
+	(void)data;
+	(void)peer;
+	ws_send_text(peer_conn, "{\"type\":\"call_ended\",\"session_id\":\"%s\"}", session_id);
+}
+
+static void unregister(struct conn *conn)
+{
+	if (*conn->user_id) {
+		moq_registrar_unregister(&registrar, conn->user_id, conn, call_ended, NULL);
+		conn->user_id[0] = '\0';
+	}
+}
+
+static void handle_message(struct conn *conn, const char *msg)
+{
+	char type[32], user_id[MOQ_REGISTRAR_ID_SIZE], session_id[MOQ_REGISTRAR_ID_SIZE];
+	char peer[MOQ_REGISTRAR_ID_SIZE], key[320];
+	enum moq_presence presence;
+	struct conn *other;
+	void *replaced;
+
+	stats.received++;
+	if (json_get(msg, "type", type, sizeof(type))) {
+		return;
+	}
+	if (json_get(msg, "session_id", session_id, sizeof(session_id))) {
+		session_id[0] = '\0';
+	}
+
+	if (!strcmp(type, "register")) {
+		if (json_get(msg, "user_id", user_id, sizeof(user_id))) {
+			user_id[0] = '\0';
+		}
+		if (strcmp(conn->user_id, user_id)) {
+			unregister(conn);
+		}
+		if (moq_registrar_register(&registrar, user_id, conn, &replaced)) {
+			ws_send_text(conn, "{\"type\":\"register_failed\",\"reason\":\"invalid_user\"}");
+			return;
+		}
+		snprintf(conn->user_id, sizeof(conn->user_id), "%s", user_id);
+		ws_send_text(conn, "{\"type\":\"registered\",\"user_id\":\"%s\",\"status\":\"success\"}", user_id);
+	} else if (!strcmp(type, "call")) {
+		if (!*conn->user_id || !*session_id || json_get(msg, "dest", user_id, sizeof(user_id))) {
+			return;
+		}
+		other = moq_registrar_lookup(&registrar, user_id, NULL);
+		if (!other || moq_registrar_route_add(&registrar, session_id, conn->user_id, user_id)) {
+			stats.failed++;
+			ws_send_text(conn, "{\"type\":\"call_failed\",\"session_id\":\"%s\",\"reason\":\"%s\"}",
+				session_id, other ? "invalid_session" : "user_not_found");
+			return;
+		}
+		stats.calls++;
+		media_key_fields(msg, key, sizeof(key));
+		ws_send_text(other, "{\"type\":\"incoming_call\",\"session_id\":\"%s\",\"from\":\"%s\"%s}",
+			session_id, conn->user_id, key);
+		ws_send_text(conn, "{\"type\":\"ringing\",\"session_id\":\"%s\"}", session_id);
+	} else if (!strcmp(type, "answer") || !strcmp(type, "hangup") || !strcmp(type, "call_ended")) {
+		int hangup = strcmp(type, "answer");
+
+		if (!*conn->user_id || moq_registrar_route_peer(&registrar, session_id, conn->user_id,
+			peer, sizeof(peer), (void **)&other)) {
+			return;
+		}
+		if (hangup) {
+			if (moq_registrar_route_remove(&registrar, session_id)) {
+				return;
+			}
+			ws_send_text(other, "{\"type\":\"call_ended\",\"session_id\":\"%s\"}", session_id);
+		} else {
+			media_key_fields(msg, key, sizeof(key));
+			ws_send_text(other, "{\"type\":\"call_answered\",\"session_id\":\"%s\"%s}", session_id, key);
+		}
+	} else if (!strcmp(type, "sdp_offer") || !strcmp(type, "sdp_answer") || !strcmp(type, "ice_candidate")) {
+		const char *body = strchr(msg, '{');
+
+		if (!*conn->user_id || !body || json_get(msg, "dest", user_id, sizeof(user_id))) {
+			return;
+		}
+		other = moq_registrar_lookup(&registrar, user_id, NULL);
+		ws_send_text(other, "{\"from\":\"%s\",%s", conn->user_id, body + 1);
+	} else if (!strcmp(type, "presence")) {
+		if (json_get(msg, "user_id", user_id, sizeof(user_id))) {
+			user_id[0] = '\0';
+		}
+		moq_registrar_lookup(&registrar, user_id, &presence);
+		ws_send_text(conn, "{\"type\":\"presence\",\"user_id\":\"%s\",\"status\":\"%s\"}",
+			user_id, moq_presence_name(presence));
+	}
+}
+
+/* Answer the HTTP upgrade once its headers are in; returns -1 to drop the client */
+static int ws_handshake(struct conn *conn)
+{
+	unsigned char digest[SHA_DIGEST_LENGTH];
+	char key[128], accept[64], resp[512];
+	const char *end, *p;
+	size_t len;
+	int n;
+
+	conn->buf[conn->len] = '\0';
+	end = strstr((char *)conn->buf, "\r\n\r\n");
+	if (!end) {
+		return 0;
+	}
+	p = strcasestr((char *)conn->buf, "Sec-WebSocket-Key:");
+	if (!p || p > end) {
+		return -1;
+	}
+	p += strlen("Sec-WebSocket-Key:");
+	while (*p == ' ') {
+		p++;
+	}
+	len = strcspn(p, "\r\n");
+	if (len + strlen(WS_GUID) >= sizeof(key)) {
+		return -1;
+	}
+	memcpy(key, p, len);
+	strcpy(key + len, WS_GUID);
+	SHA1((unsigned char *)key, strlen(key), digest);
+	base64_encode(digest, sizeof(digest), accept);
+
+	n = snprintf(resp, sizeof(resp),
+		"HTTP/1.1 101 Switching Protocols\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Accept: %s\r\n"
+		"%s"
+		"\r\n", accept,
+		strcasestr((char *)conn->buf, "Sec-WebSocket-Protocol:") ? "Sec-WebSocket-Protocol: moq-signaling\r\n" : "");
+	if (send(conn->fd, resp, n, MSG_NOSIGNAL) != n) {
+		return -1;
+	}
+
+	len = end + 4 - (char *)conn->buf;
+	memmove(conn->buf, conn->buf + len, conn->len - len);
+	conn->len -= len;
+	conn->upgraded = 1;
+	return 0;
+}
+
+/* Parse the complete frames received; returns -1 once the client is done */
+static int ws_frames(struct conn *conn)
+{
+	for (;;) {
+		unsigned char *b = conn->buf;
+		size_t hdr = 2, len, i;
+		int opcode;
+
+		if (conn->len < 2) {
+			return 0;
+		}
+		opcode = b[0] & 0x0f;
+		len = b[1] & 0x7f;
+		if (len == 126) {
+			if (conn->len < 4) {
+				return 0;
+			}
+			len = (b[2] << 8) | b[3];
+			hdr = 4;
+		} else if (len == 127) {
+			if (conn->len < 10) {
+				return 0;
+			}
+			len = be64toh(*(uint64_t *)(b + 2));
+			hdr = 10;
+		}
+		if (!(b[1] & 0x80) || hdr + 4 + len >= WS_BUFFER_SIZE) {
+			return -1;	/* Clients must mask */
+		}
+		hdr += 4;
+		if (conn->len < hdr + len) {
+			return 0;
+		}
+		for (i = 0; i < len; i++) {
+			b[hdr + i] ^= b[hdr - 4 + (i & 3)];
+		}
+
+		if (opcode == 0x1) {
+			char saved = b[hdr + len];
+
+			b[hdr + len] = '\0';
+			handle_message(conn, (char *)b + hdr);
+			b[hdr + len] = saved;
+		} else if (opcode == 0x9) {
+			ws_send_frame(conn, 0xa, (char *)b + hdr, len);
+		} else if (opcode == 0x8) {
+			return -1;
+		}
+
+		memmove(b, b + hdr + len, conn->len - hdr - len);
+		conn->len -= hdr + len;
+	}
+}
+
+static void conn_close(struct conn *conn)
+{
+	unregister(conn);
+	close(conn->fd);
+	free(conn->buf);
+	free(conn);
+}
+
+static int conn_read(struct conn *conn)
+{
+	for (;;) {
+		ssize_t n = recv(conn->fd, conn->buf + conn->len, WS_BUFFER_SIZE - conn->len - 1, MSG_DONTWAIT);
+
+		if (n == 0) {
+			return -1;
+		}
+		if (n < 0) {
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		}
+		conn->len += n;
+		if (!conn->upgraded && ws_handshake(conn)) {
+			return -1;
+		}
+		if (conn->upgraded && ws_frames(conn)) {
+			return -1;
+		}
+		if (conn->len >= WS_BUFFER_SIZE - 1) {
+			return -1;
+		}
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -p PORT      TCP port to listen on [%d]\n"
+		"  -q           quiet, no periodic output\n",
+		prog, opts.port);
+}
+
+int main(int argc, char *argv[])
+{
+	struct sockaddr_in addr = { 0, };
+	struct epoll_event ev, events[MAX_EVENTS];
+	uint64_t now, next_stats, last_received = 0;
+	int fd, epfd, opt, n, i, one = 1;
+
+	while ((opt = getopt(argc, argv, "p:qh")) != -1) {
+		switch (opt) {
+		case 'p':
+			opts.port = atoi(optarg);
+			break;
+		case 'q':
+			opts.quiet = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (opts.port <= 0 || opts.port > 65535) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (moq_registrar_init(&registrar)) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return 1;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(opts.port);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1024) < 0) {
+		perror("bind");
+		return 1;
+	}
+
+	epfd = epoll_create1(0);
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if (epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev)) {
+		perror("epoll");
+		return 1;
+	}
+
+	signal(SIGINT, handle_signal);
+	signal(SIGTERM, handle_signal);
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("Signaling on TCP port %d\n", opts.port);
+	fflush(stdout);
+	next_stats = now_ms() + 1000;
+
+	while (running) {
+		n = epoll_wait(epfd, events, MAX_EVENTS, 100);
+		if (n < 0 && errno != EINTR) {
+			perror("epoll_wait");
+			break;
+		}
+		for (i = 0; i < n; i++) {
+			struct conn *conn = events[i].data.ptr;
+
+			if (!conn) {
+				int client = accept(fd, NULL, NULL);
+
+				if (client < 0) {
+					continue;
+				}
+				conn = calloc(1, sizeof(*conn));
+				if (conn) {
+					conn->buf = malloc(WS_BUFFER_SIZE);
+				}
+				if (!conn || !conn->buf) {
+					free(conn);
+					close(client);
+					continue;
+				}
+				setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+				conn->fd = client;
+				ev.events = EPOLLIN;
+				ev.data.ptr = conn;
+				epoll_ctl(epfd, EPOLL_CTL_ADD, client, &ev);
+				continue;
+			}
+			if (conn_read(conn)) {
+				epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+				conn_close(conn);
+			}
+		}
+
+		now = now_ms();
+		if (now >= next_stats) {
+			if (!opts.quiet && stats.received != last_received) {
+				printf("received %llu sent %llu users %zu calls %llu routed %zu failed %llu\n",
+					(unsigned long long)stats.received, (unsigned long long)stats.sent,
+					registrar.user_count, (unsigned long long)stats.calls, registrar.route_count,
+					(unsigned long long)stats.failed);
+				fflush(stdout);
+				last_received = stats.received;
+			}
+			next_stats = now + 1000;
+		}
+	}
+
+	close(fd);
+	close(epfd);
+	moq_registrar_destroy(&registrar);
+	return 0;
+}
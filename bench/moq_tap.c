@@ -0,0 +1,623 @@
+/*
+ * moq_tap - Inspect, convert and replay chan_moq media tap segments
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ *
+ * Works on the segment files chan_moq writes with tap=yes (see moq_tap.h).
+ * Segments of one session are given in order, which is also the order their
+ * names sort in:
+ *
+ *   ./bench/moq_tap info   /var/spool/asterisk/moq-tap/<session>-*.moqtap
+ *   ./bench/moq_tap dump   -s 30 -n 20 <segments>
+ *   ./bench/moq_tap wav    -o call.wav <segments>
+ *   ./bench/moq_tap replay -t 127.0.0.1:4433 -s 30 -x 2 <segments>
+ *
+ * wav decodes the audio track to 16-bit PCM, received audio on the left
+ * and sent audio on the right (or mono with -d). Objects are placed by
+ * their media timestamps, so silence suppressed by DTX or lost objects come
+ * out as silence of the right length; a sender whose clock jumps is
+ * realigned on capture time. replay sends the recorded objects as MoQ
+ * datagrams, paced like the original, fragmenting those too large for one
+ * datagram. dump, wav and replay start at -s seconds into the recording,
+ * found through the index rather than by scanning.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "../moq_wire.h"
+#include "../moq_g711.h"
+#include "../moq_tap.h"
+
+#define SAMPLE_RATE 8000
+#define MAX_DATAGRAM 1472		/* Ethernet MTU less IPv4 and UDP headers */
+#define REALIGN_SAMPLES SAMPLE_RATE	/* Timestamp and capture time may drift this far apart */
+
+static struct {
+	const char *output;
+	const char *target;
+	int direction;			/* -1 for both */
+	double start;
+	double speed;
+	long count;
+	long track_id;
+	long video_track_id;
+} opts = {
+	.direction = -1,
+	.speed = 1.0,
+	.count = -1,
+	.track_id = -1,
+	.video_track_id = -1,
+};
+
+static struct moq_tap_segment *segments;
+static int segment_count;
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static const char *type_name(uint8_t type)
+{
+	switch (MOQ_OBJ_TYPE(type)) {
+	case MOQ_OBJ_AUDIO_ULAW:
+		return "ulaw";
+	case MOQ_OBJ_AUDIO_CN:
+		return "cn";
+	case MOQ_OBJ_VIDEO_H264:
+		return "h264";
+	case MOQ_OBJ_VIDEO_VP8:
+		return "vp8";
+	default:
+		return "?";
+	}
+}
+
+static int is_video(uint8_t type)
+{
+	return MOQ_OBJ_TYPE(type) == MOQ_OBJ_VIDEO_H264 || MOQ_OBJ_TYPE(type) == MOQ_OBJ_VIDEO_VP8;
+}
+
+static int load_segments(int argc, char *argv[])
+{
+	int i;
+
+	if (!argc) {
+		fprintf(stderr, "No segments given\n");
+		return -1;
+	}
+	segments = calloc(argc, sizeof(*segments));
+	if (!segments) {
+		fprintf(stderr, "Out of memory\n");
+		return -1;
+	}
+	for (i = 0; i < argc; i++) {
+		if (moq_tap_map(argv[i], &segments[i])) {
+			fprintf(stderr, "%s: %s\n", argv[i],
+				errno == EINVAL ? "not a media tap segment" : strerror(errno));
+			return -1;
+		}
+		if (i && strcmp(segments[i].header->session_id, segments[0].header->session_id)) {
+			fprintf(stderr, "%s: belongs to session %s, not %s\n", argv[i],
+				segments[i].header->session_id, segments[0].header->session_id);
+			return -1;
+		}
+		segment_count++;
+	}
+
+	return 0;
+}
+
+/* Capture time of the first record, the origin of -s and of dump's times */
+static uint64_t first_time_us(void)
+{
+	int i;
+
+	for (i = 0; i < segment_count; i++) {
+		if (segments[i].count) {
+			return segments[i].index[0].time_us;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Position of the first record at or after -s seconds: the segment, and the
+ * entry within it. Whole segments are skipped on their last entry's time.
+ */
+static void seek_start(int *segment, uint32_t *entry)
+{
+	uint64_t target = first_time_us() + (uint64_t)(opts.start * 1e6);
+	int i;
+
+	for (i = 0; i < segment_count; i++) {
+		const struct moq_tap_segment *seg = &segments[i];
+
+		if (seg->count && seg->index[seg->count - 1].time_us >= target) {
+			*segment = i;
+			*entry = moq_tap_seek(seg, target);
+			return;
+		}
+	}
+	*segment = segment_count;
+	*entry = 0;
+}
+
+/* Step to the next record wanted by -d, across segments; NULL at the end */
+static const struct moq_tap_record *next_record(int *segment, uint32_t *entry)
+{
+	const struct moq_tap_record *record;
+
+	while (*segment < segment_count) {
+		if (*entry >= segments[*segment].count) {
+			(*segment)++;
+			*entry = 0;
+			continue;
+		}
+		record = moq_tap_record(&segments[*segment], (*entry)++);
+		if (!record) {
+			fprintf(stderr, "Segment %d: bad index entry %u, skipped\n", *segment, *entry - 1);
+			continue;
+		}
+		if (opts.direction < 0 || record->direction == opts.direction) {
+			return record;
+		}
+	}
+
+	return NULL;
+}
+
+static int cmd_info(void)
+{
+	int i;
+
+	for (i = 0; i < segment_count; i++) {
+		const struct moq_tap_segment *seg = &segments[i];
+		const struct moq_tap_header *header = seg->header;
+		uint64_t counts[2][2] = { { 0, }, };
+		uint64_t first = 0, last = 0;
+		time_t created = header->created_us / 1000000;
+		char when[32];
+		uint32_t n;
+
+		for (n = 0; n < seg->count; n++) {
+			counts[seg->index[n].direction & 1][is_video(seg->index[n].type)]++;
+		}
+		if (seg->count) {
+			first = seg->index[0].time_us;
+			last = seg->index[seg->count - 1].time_us;
+		}
+		strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&created));
+
+		printf("Segment %u of session %s (remote %s)\n", header->segment, header->session_id,
+			header->remote_id);
+		printf("  Created:   %s\n", when);
+		printf("  State:     %s\n", header->closed ? "complete" : "being written");
+		printf("  Records:   %u of %u (rx %llu audio, %llu video; tx %llu audio, %llu video)\n",
+			seg->count, header->index_cap,
+			(unsigned long long)counts[MOQ_TAP_RX][0], (unsigned long long)counts[MOQ_TAP_RX][1],
+			(unsigned long long)counts[MOQ_TAP_TX][0], (unsigned long long)counts[MOQ_TAP_TX][1]);
+		printf("  Data:      %llu of %zu bytes\n",
+			(unsigned long long)(header->data_end - header->data_offset), seg->size);
+		printf("  Duration:  %.3f s\n", (last - first) / 1e6);
+	}
+
+	return 0;
+}
+
+static int cmd_dump(void)
+{
+	const struct moq_tap_record *record;
+	uint64_t origin = first_time_us();
+	uint32_t entry;
+	int segment;
+	long n = 0;
+
+	seek_start(&segment, &entry);
+	printf("%12s %3s %-5s %10s %12s %12s %6s\n", "time", "dir", "type", "track", "sequence",
+		"timestamp", "bytes");
+	while ((opts.count < 0 || n < opts.count) && (record = next_record(&segment, &entry))) {
+		printf("%12.6f %3s %-5s %10u %12llu %12llu %6u%s\n", (record->time_us - origin) / 1e6,
+			record->direction == MOQ_TAP_RX ? "rx" : "tx", type_name(record->type),
+			record->track_id, (unsigned long long)record->sequence,
+			(unsigned long long)record->timestamp, record->payload_len,
+			record->type & MOQ_OBJ_FLAG_ENCRYPTED ? " sealed" : "");
+		n++;
+	}
+
+	return 0;
+}
+
+/* One channel of the WAV output, anchored on the media clock of its sender */
+struct track {
+	int16_t *samples;
+	size_t len, cap;
+	int anchored;
+	uint64_t anchor_ts;
+	int64_t anchor_pos;
+};
+
+static int track_put(struct track *t, int64_t pos, const uint8_t *ulaw, size_t len)
+{
+	size_t end = pos + len;
+
+	if (end > t->cap) {
+		size_t cap = t->cap ? t->cap : SAMPLE_RATE * 60;
+		int16_t *samples;
+
+		while (cap < end) {
+			cap *= 2;
+		}
+		samples = realloc(t->samples, cap * sizeof(*samples));
+		if (!samples) {
+			return -1;
+		}
+		memset(samples + t->cap, 0, (cap - t->cap) * sizeof(*samples));
+		t->samples = samples;
+		t->cap = cap;
+	}
+	moq_g711_ulaw_decode(ulaw, t->samples + pos, len);
+	if (end > t->len) {
+		t->len = end;
+	}
+
+	return 0;
+}
+
+static void put_le16(uint8_t *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+	put_le16(p, v);
+	put_le16(p + 2, v >> 16);
+}
+
+static int write_wav(FILE *f, struct track *tracks, int channels)
+{
+	uint8_t header[44];
+	size_t frames = 0, i;
+	int16_t frame[2];
+	int c;
+
+	for (c = 0; c < channels; c++) {
+		if (tracks[c].len > frames) {
+			frames = tracks[c].len;
+		}
+	}
+
+	memcpy(header, "RIFF", 4);
+	put_le32(header + 4, 36 + frames * channels * 2);
+	memcpy(header + 8, "WAVEfmt ", 8);
+	put_le32(header + 16, 16);
+	put_le16(header + 20, 1);
+	put_le16(header + 22, channels);
+	put_le32(header + 24, SAMPLE_RATE);
+	put_le32(header + 28, SAMPLE_RATE * channels * 2);
+	put_le16(header + 32, channels * 2);
+	put_le16(header + 34, 16);
+	memcpy(header + 36, "data", 4);
+	put_le32(header + 40, frames * channels * 2);
+	if (fwrite(header, sizeof(header), 1, f) != 1) {
+		return -1;
+	}
+
+	for (i = 0; i < frames; i++) {
+		for (c = 0; c < channels; c++) {
+			uint8_t *p = (uint8_t *)&frame[c];
+
+			put_le16(p, i < tracks[c].len ? (uint16_t)tracks[c].samples[i] : 0);
+		}
+		if (fwrite(frame, 2, channels, f) != (size_t)channels) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int cmd_wav(void)
+{
+	struct track tracks[2] = { { 0, }, };
+	const struct moq_tap_record *record;
+	uint64_t origin = first_time_us() + (uint64_t)(opts.start * 1e6);
+	uint64_t objects = 0, realigned = 0;
+	uint32_t entry;
+	int segment, channels = opts.direction < 0 ? 2 : 1;
+	int res = -1;
+	FILE *f;
+
+	if (!opts.output) {
+		fprintf(stderr, "wav needs -o <file>\n");
+		return -1;
+	}
+
+	moq_g711_init();
+	seek_start(&segment, &entry);
+	while ((record = next_record(&segment, &entry))) {
+		struct track *t = &tracks[opts.direction < 0 ? record->direction & 1 : 0];
+		int64_t pos, time_pos;
+
+		/* Comfort noise and video leave silence; sealed payloads cannot be decoded */
+		if (record->type != MOQ_OBJ_AUDIO_ULAW || record->time_us < origin) {
+			continue;
+		}
+
+		time_pos = (int64_t)((record->time_us - origin) * SAMPLE_RATE / 1000000);
+		pos = t->anchor_pos + (int64_t)(record->timestamp - t->anchor_ts);
+		if (!t->anchored || pos < 0 || pos > time_pos + REALIGN_SAMPLES ||
+			pos < time_pos - REALIGN_SAMPLES) {
+			realigned += t->anchored;
+			t->anchored = 1;
+			t->anchor_ts = record->timestamp;
+			t->anchor_pos = time_pos;
+			pos = time_pos;
+		}
+		if (track_put(t, pos, (const uint8_t *)(record + 1), record->payload_len)) {
+			fprintf(stderr, "Out of memory\n");
+			goto done;
+		}
+		objects++;
+	}
+
+	f = fopen(opts.output, "wb");
+	if (!f) {
+		fprintf(stderr, "%s: %s\n", opts.output, strerror(errno));
+		goto done;
+	}
+	if (write_wav(f, tracks, channels) || fclose(f)) {
+		fprintf(stderr, "%s: write failed\n", opts.output);
+		goto done;
+	}
+	printf("Wrote %s: %d channel%s, %.3f s from %llu audio objects (%llu realigned)\n",
+		opts.output, channels, channels > 1 ? "s" : "",
+		(double)(tracks[0].len > tracks[1].len ? tracks[0].len : tracks[1].len) / SAMPLE_RATE,
+		(unsigned long long)objects, (unsigned long long)realigned);
+	res = 0;
+
+done:
+	free(tracks[0].samples);
+	free(tracks[1].samples);
+	return res;
+}
+
+static int parse_target(const char *target, struct sockaddr_in *addr)
+{
+	char host[64];
+	const char *colon = strrchr(target, ':');
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family = AF_INET;
+	if (!colon || colon - target >= (long)sizeof(host) || atoi(colon + 1) <= 0 ||
+		atoi(colon + 1) > 65535) {
+		return -1;
+	}
+	memcpy(host, target, colon - target);
+	host[colon - target] = '\0';
+	addr->sin_port = htons(atoi(colon + 1));
+
+	return inet_pton(AF_INET, host, &addr->sin_addr) == 1 ? 0 : -1;
+}
+
+/* Send one object, in as many fragments as it takes; returns datagrams sent */
+static int send_object(int fd, const struct sockaddr_in *to, const struct moq_object *obj)
+{
+	uint8_t buf[MAX_DATAGRAM];
+	struct moq_fragment frag;
+	size_t chunk, room = MAX_DATAGRAM - MOQ_WIRE_MSG_HEADER_SIZE - MOQ_WIRE_FRAGMENT_HEADER_SIZE;
+	uint16_t count, i;
+	int len;
+
+	if (MOQ_WIRE_MSG_HEADER_SIZE + MOQ_WIRE_OBJECT_HEADER_SIZE + obj->payload_len <= MAX_DATAGRAM) {
+		len = moq_wire_encode_object(buf, sizeof(buf), obj);
+		if (len < 0) {
+			return 0;
+		}
+		sendto(fd, buf, len, 0, (const struct sockaddr *)to, sizeof(*to));
+		return 1;
+	}
+
+	count = (obj->payload_len + room - 1) / room;
+	chunk = moq_wire_fragment_chunk(obj->payload_len, count);
+	frag.type = obj->type;
+	frag.track_id = obj->track_id;
+	frag.sequence = obj->sequence;
+	frag.timestamp = obj->timestamp;
+	frag.object_size = obj->payload_len;
+	frag.count = count;
+	for (i = 0; i < count; i++) {
+		frag.index = i;
+		frag.data = obj->payload + i * chunk;
+		frag.data_len = i + 1 < count ? chunk : obj->payload_len - i * chunk;
+		len = moq_wire_encode_fragment(buf, sizeof(buf), &frag);
+		if (len > 0) {
+			sendto(fd, buf, len, 0, (const struct sockaddr *)to, sizeof(*to));
+		}
+	}
+
+	return count;
+}
+
+static int cmd_replay(void)
+{
+	const struct moq_tap_record *record;
+	struct sockaddr_in to;
+	uint64_t origin = 0, started = 0, objects = 0, datagrams = 0;
+	uint32_t entry;
+	int segment, fd;
+
+	if (!opts.target || parse_target(opts.target, &to)) {
+		fprintf(stderr, "replay needs -t <ipv4>:<port>\n");
+		return -1;
+	}
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	seek_start(&segment, &entry);
+	while ((opts.count < 0 || (long)objects < opts.count) && (record = next_record(&segment, &entry))) {
+		struct moq_object obj = {
+			.type = record->type,
+			.track_id = record->track_id,
+			.sequence = record->sequence,
+			.timestamp = record->timestamp,
+			.payload = (const uint8_t *)(record + 1),
+			.payload_len = record->payload_len,
+		};
+		uint64_t due, now;
+
+		if (!started) {
+			origin = record->time_us;
+			started = now_us();
+		}
+
+		/* Keep the original spacing, scaled by -x */
+		due = started + (uint64_t)((record->time_us > origin ? record->time_us - origin : 0) / opts.speed);
+		now = now_us();
+		if (due > now) {
+			struct timespec ts = { (due - now) / 1000000, (due - now) % 1000000 * 1000 };
+
+			nanosleep(&ts, NULL);
+		}
+
+		if (is_video(obj.type)) {
+			if (opts.video_track_id >= 0) {
+				obj.track_id = opts.video_track_id;
+			}
+		} else if (opts.track_id >= 0) {
+			obj.track_id = opts.track_id;
+		}
+		datagrams += send_object(fd, &to, &obj);
+		objects++;
+	}
+
+	printf("Replayed %llu objects in %llu datagrams to %s over %.3f s\n",
+		(unsigned long long)objects, (unsigned long long)datagrams, opts.target,
+		started ? (now_us() - started) / 1e6 : 0.0);
+	close(fd);
+
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s <command> [options] <segment>...\n"
+		"Commands:\n"
+		"  info         segment headers, record counts and durations\n"
+		"  dump         one line per record\n"
+		"  wav          decode the audio to a 16-bit WAV file (-o)\n"
+		"  replay       send the objects to -t as MoQ datagrams, paced as recorded\n"
+		"Options:\n"
+		"  -d rx|tx     only one direction (wav: mono instead of rx left, tx right)\n"
+		"  -s SECONDS   start this far into the recording\n"
+		"  -n COUNT     stop after this many records (dump, replay)\n"
+		"  -o FILE      output file (wav)\n"
+		"  -t HOST:PORT where to replay to (replay)\n"
+		"  -x SPEED     replay speed factor [1.0]\n"
+		"  -T TRACK     replay audio on this track ID instead of the recorded one\n"
+		"  -V TRACK     replay video on this track ID instead of the recorded one\n",
+		prog);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *command;
+	int opt, res;
+
+	if (argc < 2 || !strcmp(argv[1], "-h")) {
+		usage(argv[0]);
+		return argc < 2;
+	}
+	command = argv[1];
+	optind = 2;
+
+	while ((opt = getopt(argc, argv, "d:s:n:o:t:x:T:V:h")) != -1) {
+		switch (opt) {
+		case 'd':
+			if (!strcmp(optarg, "rx")) {
+				opts.direction = MOQ_TAP_RX;
+			} else if (!strcmp(optarg, "tx")) {
+				opts.direction = MOQ_TAP_TX;
+			} else {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 's':
+			opts.start = atof(optarg);
+			break;
+		case 'n':
+			opts.count = atol(optarg);
+			break;
+		case 'o':
+			opts.output = optarg;
+			break;
+		case 't':
+			opts.target = optarg;
+			break;
+		case 'x':
+			opts.speed = atof(optarg);
+			break;
+		case 'T':
+			opts.track_id = strtol(optarg, NULL, 0);
+			break;
+		case 'V':
+			opts.video_track_id = strtol(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (opts.start < 0 || opts.speed <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (load_segments(argc - optind, argv + optind)) {
+		return 1;
+	}
+
+	if (!strcmp(command, "info")) {
+		res = cmd_info();
+	} else if (!strcmp(command, "dump")) {
+		res = cmd_dump();
+	} else if (!strcmp(command, "wav")) {
+		res = cmd_wav();
+	} else if (!strcmp(command, "replay")) {
+		res = cmd_replay();
+	} else {
+		usage(argv[0]);
+		res = -1;
+	}
+
+	while (segment_count--) {
+		moq_tap_unmap(&segments[segment_count]);
+	}
+	free(segments);
+
+	return res ? 1 : 0;
+}
@@ -0,0 +1,538 @@
+/*
+ * moq_xdp - AF_XDP media path against the socket path
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ *
+ * A sink receives MoQ media objects on a range of UDP ports, one thread per
+ * port as chan_moq runs one media thread per session, either through
+ * ordinary sockets with recvmmsg() or through moq_xdp.c. A source in
+ * another network namespace (or on another box) streams objects to every
+ * port at a fixed rate, stamped with the wall clock:
+ *
+ *   ./bench/moq_xdp sink -p 20000 -n 100 -d 10              # socket path
+ *   ./bench/moq_xdp sink -x -i veth0 -p 20000 -n 100 -d 10  # AF_XDP
+ *   ./bench/moq_xdp source -a 10.77.0.1 -p 20000 -n 100 -r 5000 -d 10
+ *
+ * The sink reports objects received, one-way latency percentiles (both
+ * ends must share a clock) and CPU time per object. With -e the sink sends
+ * each object back to the source, which then reports round-trip latency,
+ * so the transmit path is measured too. bench/moq_xdp_veth.sh runs both
+ * paths over a veth pair between two namespaces.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#include "../moq_wire.h"
+#include "../moq_hist.h"
+#include "../moq_xdp.h"
+
+#define RECV_BATCH 16		/* As chan_moq */
+#define SLOT_SIZE 2048
+#define MAX_PORTS 4096
+#define TRACK_ID 1
+
+struct port {
+	int index;
+	int fd;
+	struct sockaddr_in peer;
+	struct moq_xdp_chan *chan;
+	pthread_t thread;
+	uint64_t received;
+	uint64_t echoed;
+	uint64_t echo_errors;
+	uint64_t next_sequence;
+	uint64_t lost;
+};
+
+static struct {
+	int xdp;
+	const char *ifname;
+	unsigned int queues;
+	enum moq_xdp_mode mode;
+	const char *addr;
+	const char *echo;
+	int port;
+	int ports;
+	int rate;
+	int size;
+	int duration;
+} opts = {
+	.ifname = "veth0",
+	.queues = 1,
+	.mode = MOQ_XDP_AUTO,
+	.port = 20000,
+	.ports = 1,
+	.rate = 1000,
+	.size = 160,
+	.duration = 10,
+};
+
+static struct moq_xdp *xdp;
+static struct moq_hist latency;
+static volatile sig_atomic_t running = 1;
+
+static void handle_signal(int sig)
+{
+	(void)sig;
+	running = 0;
+}
+
+static uint64_t wallclock_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t monotonic_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static double cpu_seconds(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+		(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static int open_port(struct port *p, int port)
+{
+	struct sockaddr_in addr = { 0, };
+	int size = 4 * 1024 * 1024;
+
+	p->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+	if (p->fd < 0) {
+		perror("socket");
+		return -1;
+	}
+	setsockopt(p->fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(p->fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		fprintf(stderr, "bind to port %d: %s\n", port, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Account one datagram and echo it if asked to; same work on both paths */
+static void sink_datagram(struct port *p, const uint8_t *buf, size_t len, uint64_t now)
+{
+	const uint8_t *payload;
+	size_t payload_len;
+	struct moq_object obj;
+	uint8_t type;
+
+	if (moq_wire_decode_message(buf, len, &type, &payload, &payload_len) != MOQ_WIRE_OK ||
+		type != MOQ_MSG_OBJECT || moq_wire_decode_object(payload, payload_len, &obj) != MOQ_WIRE_OK) {
+		return;
+	}
+	p->received++;
+	if (obj.sequence > p->next_sequence) {
+		p->lost += obj.sequence - p->next_sequence;
+	}
+	if (obj.sequence >= p->next_sequence) {
+		p->next_sequence = obj.sequence + 1;
+	}
+	moq_hist_record(&latency, now > obj.timestamp ? now - obj.timestamp : 0);
+
+	if (opts.echo) {
+		struct iovec iov = { .iov_base = (void *)buf, .iov_len = len };
+
+		if ((p->chan && moq_xdp_send(p->chan, &iov, 1) == 1) ||
+			sendto(p->fd, buf, len, 0, (struct sockaddr *)&p->peer, sizeof(p->peer)) >= 0) {
+			p->echoed++;
+		} else {
+			p->echo_errors++;
+		}
+	}
+}
+
+static void *sink_thread(void *data)
+{
+	struct port *p = data;
+	struct mmsghdr msgs[RECV_BATCH];
+	struct iovec iov[RECV_BATCH];
+	struct moq_xdp_packet packets[RECV_BATCH];
+	struct pollfd pfd[2];
+	uint8_t *slots;
+	int i, n, nfds = 1;
+
+	slots = malloc(RECV_BATCH * SLOT_SIZE);
+	if (!slots) {
+		return NULL;
+	}
+	for (i = 0; i < RECV_BATCH; i++) {
+		iov[i].iov_base = slots + i * SLOT_SIZE;
+		iov[i].iov_len = SLOT_SIZE;
+		memset(&msgs[i], 0, sizeof(msgs[i]));
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	pfd[0].fd = p->fd;
+	pfd[0].events = POLLIN;
+	if (p->chan) {
+		pfd[1].fd = moq_xdp_chan_fd(p->chan);
+		pfd[1].events = POLLIN;
+		nfds = 2;
+	}
+
+	while (running) {
+		if (poll(pfd, nfds, 100) <= 0) {
+			continue;
+		}
+		if (p->chan) {
+			/* Parsed in place in the UMEM */
+			while ((n = moq_xdp_recv(p->chan, packets, RECV_BATCH)) > 0) {
+				for (i = 0; i < n; i++) {
+					sink_datagram(p, packets[i].data, packets[i].len, wallclock_us());
+				}
+			}
+		}
+		while ((n = recvmmsg(p->fd, msgs, RECV_BATCH, MSG_DONTWAIT, NULL)) > 0) {
+			for (i = 0; i < n; i++) {
+				sink_datagram(p, iov[i].iov_base, msgs[i].msg_len, wallclock_us());
+			}
+		}
+	}
+
+	free(slots);
+	return NULL;
+}
+
+static int run_sink(void)
+{
+	struct port *ports;
+	struct moq_xdp_stats xstats;
+	uint64_t received = 0, lost = 0, echoed = 0, echo_errors = 0;
+	uint64_t start;
+	double cpu, elapsed;
+	char err[256];
+	int i, res;
+
+	ports = calloc(opts.ports, sizeof(*ports));
+	if (!ports) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	if (opts.xdp && (res = moq_xdp_open(&xdp, opts.ifname, opts.queues, opts.mode, 0, err, sizeof(err)))) {
+		fprintf(stderr, "AF_XDP on %s: %s\n", opts.ifname, err);
+		return 1;
+	}
+	for (i = 0; i < opts.ports; i++) {
+		struct port *p = &ports[i];
+
+		p->index = i;
+		if (open_port(p, opts.port + i)) {
+			return 1;
+		}
+		if (opts.echo) {
+			p->peer.sin_family = AF_INET;
+			p->peer.sin_port = htons(opts.port + i);
+			if (inet_pton(AF_INET, opts.echo, &p->peer.sin_addr) != 1) {
+				fprintf(stderr, "Invalid echo address %s\n", opts.echo);
+				return 1;
+			}
+		}
+		if (xdp) {
+			p->chan = moq_xdp_chan_open(xdp, p->fd);
+			if (!p->chan) {
+				fprintf(stderr, "AF_XDP channel for port %d: %s\n", opts.port + i, strerror(errno));
+				return 1;
+			}
+			if (opts.echo) {
+				moq_xdp_chan_connect(p->chan, &p->peer);
+			}
+		}
+	}
+
+	printf("Sink on UDP ports %d-%d via %s%s%s\n", opts.port, opts.port + opts.ports - 1,
+		xdp ? "AF_XDP, " : "sockets", xdp ? moq_xdp_describe(xdp) : "", opts.echo ? ", echoing" : "");
+	fflush(stdout);
+
+	cpu = cpu_seconds();
+	start = monotonic_us();
+	for (i = 0; i < opts.ports; i++) {
+		if (pthread_create(&ports[i].thread, NULL, sink_thread, &ports[i])) {
+			fprintf(stderr, "Cannot start thread %d\n", i);
+			running = 0;
+			opts.ports = i;
+			break;
+		}
+	}
+	while (running && monotonic_us() - start < (uint64_t)opts.duration * 1000000) {
+		usleep(100000);
+	}
+	running = 0;
+	for (i = 0; i < opts.ports; i++) {
+		pthread_join(ports[i].thread, NULL);
+	}
+	elapsed = (monotonic_us() - start) / 1e6;
+	cpu = cpu_seconds() - cpu;
+
+	for (i = 0; i < opts.ports; i++) {
+		received += ports[i].received;
+		lost += ports[i].lost;
+		echoed += ports[i].echoed;
+		echo_errors += ports[i].echo_errors;
+		moq_xdp_chan_close(ports[i].chan);
+		close(ports[i].fd);
+	}
+
+	printf("Received: %llu objects (%.0f/s), %llu lost\n", (unsigned long long)received,
+		received / elapsed, (unsigned long long)lost);
+	printf("One-way latency: p50 %llu us, p99 %llu us, p99.9 %llu us, max %llu us\n",
+		(unsigned long long)moq_hist_percentile(&latency, 50),
+		(unsigned long long)moq_hist_percentile(&latency, 99),
+		(unsigned long long)moq_hist_percentile(&latency, 99.9),
+		(unsigned long long)latency.max);
+	printf("CPU: %.2f s (%.2f us per object)\n", cpu, received ? cpu * 1e6 / received : 0.0);
+	if (opts.echo) {
+		printf("Echoed: %llu, %llu failed\n", (unsigned long long)echoed, (unsigned long long)echo_errors);
+	}
+	if (xdp) {
+		moq_xdp_get_stats(xdp, &xstats);
+		printf("AF_XDP: rx %llu, dropped %llu, invalid %llu, tx %llu, tx via socket %llu\n",
+			(unsigned long long)xstats.rx_packets, (unsigned long long)xstats.rx_dropped,
+			(unsigned long long)xstats.rx_invalid, (unsigned long long)xstats.tx_packets,
+			(unsigned long long)xstats.tx_busy);
+		printf("Kernel drops: RX ring full %llu, fill ring empty %llu\n",
+			(unsigned long long)xstats.rx_ring_full, (unsigned long long)xstats.fill_empty);
+		moq_xdp_close(xdp);
+	}
+
+	free(ports);
+	return 0;
+}
+
+static void source_drain(struct port *ports, struct moq_hist *rtt)
+{
+	uint8_t buf[SLOT_SIZE];
+	const uint8_t *payload;
+	size_t payload_len;
+	struct moq_object obj;
+	uint8_t type;
+	ssize_t len;
+	int i;
+
+	for (i = 0; i < opts.ports; i++) {
+		while ((len = recv(ports[i].fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+			if (moq_wire_decode_message(buf, len, &type, &payload, &payload_len) == MOQ_WIRE_OK &&
+				type == MOQ_MSG_OBJECT &&
+				moq_wire_decode_object(payload, payload_len, &obj) == MOQ_WIRE_OK) {
+				uint64_t now = wallclock_us();
+
+				moq_hist_record(rtt, now > obj.timestamp ? now - obj.timestamp : 0);
+				ports[i].received++;
+			}
+		}
+	}
+}
+
+static int run_source(void)
+{
+	struct port *ports;
+	struct sockaddr_in to = { 0, };
+	struct moq_hist *rtt;
+	uint8_t *payload, msg[SLOT_SIZE];
+	struct moq_object obj;
+	uint64_t start, now, due, sent = 0, errors = 0, echoes = 0;
+	int i, len;
+
+	ports = calloc(opts.ports, sizeof(*ports));
+	rtt = calloc(1, sizeof(*rtt));
+	payload = calloc(1, opts.size);
+	if (!ports || !rtt || !payload) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	to.sin_family = AF_INET;
+	if (!opts.addr || inet_pton(AF_INET, opts.addr, &to.sin_addr) != 1) {
+		fprintf(stderr, "A sink address (-a) is needed\n");
+		return 1;
+	}
+	for (i = 0; i < opts.ports; i++) {
+		if (open_port(&ports[i], opts.port + i)) {
+			return 1;
+		}
+	}
+	memset(payload, 0xff, opts.size);
+
+	printf("Source to %s ports %d-%d, %d objects/s each of %d bytes\n", opts.addr, opts.port,
+		opts.port + opts.ports - 1, opts.rate, opts.size);
+	fflush(stdout);
+
+	/* Every port gets its objects on one schedule: object k is due at k / rate */
+	start = monotonic_us();
+	for (due = 0; running; due++) {
+		uint64_t at = start + due * 1000000 / opts.rate;
+
+		if (at - start >= (uint64_t)opts.duration * 1000000) {
+			break;
+		}
+		while ((now = monotonic_us()) < at) {
+			source_drain(ports, rtt);
+			if (at - now > 200) {
+				usleep(100);
+			}
+		}
+		for (i = 0; i < opts.ports; i++) {
+			memset(&obj, 0, sizeof(obj));
+			obj.type = MOQ_OBJ_AUDIO_ULAW;
+			obj.track_id = TRACK_ID;
+			obj.sequence = due;
+			obj.timestamp = wallclock_us();
+			obj.payload = payload;
+			obj.payload_len = opts.size;
+			obj.payload_size = opts.size;
+			len = moq_wire_encode_object(msg, sizeof(msg), &obj);
+			to.sin_port = htons(opts.port + i);
+			if (len > 0 && sendto(ports[i].fd, msg, len, 0, (struct sockaddr *)&to, sizeof(to)) == len) {
+				sent++;
+			} else {
+				errors++;
+			}
+		}
+	}
+
+	/* Give the last echoes time to come back */
+	start = monotonic_us();
+	while (monotonic_us() - start < 200000) {
+		source_drain(ports, rtt);
+		usleep(1000);
+	}
+	for (i = 0; i < opts.ports; i++) {
+		echoes += ports[i].received;
+		close(ports[i].fd);
+	}
+
+	printf("Sent: %llu objects, %llu errors\n", (unsigned long long)sent, (unsigned long long)errors);
+	if (echoes) {
+		printf("Echoes: %llu; round trip p50 %llu us, p99 %llu us, p99.9 %llu us, max %llu us\n",
+			(unsigned long long)echoes,
+			(unsigned long long)moq_hist_percentile(rtt, 50),
+			(unsigned long long)moq_hist_percentile(rtt, 99),
+			(unsigned long long)moq_hist_percentile(rtt, 99.9),
+			(unsigned long long)rtt->max);
+	}
+
+	free(payload);
+	free(rtt);
+	free(ports);
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s sink [options]      receive on ports PORT .. PORT + N - 1\n"
+		"       %s source -a ADDR [options]\n"
+		"  -p PORT      first UDP port [%d]\n"
+		"  -n N         number of ports, one thread each in the sink [%d]\n"
+		"  -d SECONDS   duration [%d]\n"
+		"Sink:\n"
+		"  -x           receive through AF_XDP instead of sockets\n"
+		"  -i IFACE     interface for AF_XDP [%s]\n"
+		"  -q QUEUES    receive queues to serve, from 0 [%u]\n"
+		"  -M MODE      XDP attach mode: auto, native or generic [auto]\n"
+		"  -e ADDR      echo every object back to the source at ADDR\n"
+		"Source:\n"
+		"  -a ADDR      sink address\n"
+		"  -r RATE      objects per second per port [%d]\n"
+		"  -s SIZE      payload bytes [%d]\n",
+		prog, prog, opts.port, opts.ports, opts.duration, opts.ifname, opts.queues,
+		opts.rate, opts.size);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *cmd;
+	int opt, mode;
+
+	if (argc < 2 || (strcmp(argv[1], "sink") && strcmp(argv[1], "source"))) {
+		usage(argv[0]);
+		return 1;
+	}
+	cmd = argv[1];
+	optind = 2;
+	while ((opt = getopt(argc, argv, "xi:q:M:e:a:p:n:r:s:d:h")) != -1) {
+		switch (opt) {
+		case 'x':
+			opts.xdp = 1;
+			break;
+		case 'i':
+			opts.ifname = optarg;
+			break;
+		case 'q':
+			opts.queues = atoi(optarg);
+			break;
+		case 'M':
+			if ((mode = moq_xdp_mode_from_name(optarg)) < 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			opts.mode = mode;
+			break;
+		case 'e':
+			opts.echo = optarg;
+			break;
+		case 'a':
+			opts.addr = optarg;
+			break;
+		case 'p':
+			opts.port = atoi(optarg);
+			break;
+		case 'n':
+			opts.ports = atoi(optarg);
+			break;
+		case 'r':
+			opts.rate = atoi(optarg);
+			break;
+		case 's':
+			opts.size = atoi(optarg);
+			break;
+		case 'd':
+			opts.duration = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (opts.port <= 0 || opts.ports <= 0 || opts.ports > MAX_PORTS || opts.port + opts.ports > 65536 ||
+		opts.rate <= 0 || opts.size <= 0 || opts.size > 1400 || opts.duration <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	signal(SIGINT, handle_signal);
+	signal(SIGTERM, handle_signal);
+
+	return !strcmp(cmd, "sink") ? run_sink() : run_source();
+}
@@ -0,0 +1,80 @@
+#!/bin/bash
+#
+# Compare the AF_XDP media path with the socket path over a veth pair.
+#
+# Creates two network namespaces joined by a veth pair (moqa/veth0
+# 10.77.0.1 and moqb/veth1 10.77.0.2), runs bench/moq_xdp as a sink in moqa
+# and as a source in moqb, once through sockets and once per XDP attach
+# mode, and removes everything again. Needs root and Linux 5.9 or later.
+#
+#   sudo ./bench/moq_xdp_veth.sh [-n ports] [-r rate] [-d seconds] [-e]
+#
+# -e has the sink echo every object, so the source also reports round-trip
+# latency through the transmit path. veth has no zero-copy support, so this
+# measures the copy-mode software path: a NIC with AF_XDP zero-copy support
+# does better than these numbers.
+
+set -e
+
+BENCH="$(dirname "$0")/moq_xdp"
+PORTS=50
+RATE=1000
+DURATION=5
+ECHO=
+
+while getopts "n:r:d:eh" opt; do
+	case $opt in
+		n) PORTS=$OPTARG ;;
+		r) RATE=$OPTARG ;;
+		d) DURATION=$OPTARG ;;
+		e) ECHO=1 ;;
+		*) echo "Usage: $0 [-n ports] [-r objects/s per port] [-d seconds] [-e]"; exit 1 ;;
+	esac
+done
+
+if [ ! -x "$BENCH" ]; then
+	echo "Build it first: make bench/moq_xdp"
+	exit 1
+fi
+
+cleanup() {
+	ip netns del moqa 2>/dev/null || true
+	ip netns del moqb 2>/dev/null || true
+}
+trap cleanup EXIT
+cleanup
+
+ip netns add moqa
+ip netns add moqb
+ip link add veth0 netns moqa type veth peer name veth1 netns moqb
+ip -n moqa addr add 10.77.0.1/24 dev veth0
+ip -n moqb addr add 10.77.0.2/24 dev veth1
+ip -n moqa link set veth0 up
+ip -n moqb link set veth1 up
+ip -n moqa link set lo up
+ip -n moqb link set lo up
+# Static neighbours, so the first objects are not held back by ARP
+mac_a=$(ip -n moqa -br link show veth0 | awk '{print $3}')
+mac_b=$(ip -n moqb -br link show veth1 | awk '{print $3}')
+ip -n moqa neigh replace 10.77.0.2 lladdr "$mac_b" dev veth0 nud permanent
+ip -n moqb neigh replace 10.77.0.1 lladdr "$mac_a" dev veth1 nud permanent
+
+run() {
+	local label=$1
+	shift
+
+	echo "=== $label ==="
+	ip netns exec moqa "$BENCH" sink -p 20000 -n "$PORTS" -d $((DURATION + 2)) \
+		${ECHO:+-e 10.77.0.2} "$@" &
+	local sink=$!
+	sleep 1
+	ip netns exec moqb "$BENCH" source -a 10.77.0.1 -p 20000 -n "$PORTS" -r "$RATE" -d "$DURATION"
+	wait $sink
+	echo
+	# Closed AF_XDP sockets release their queue asynchronously
+	sleep 1
+}
+
+run "sockets"
+run "AF_XDP, generic" -x -i veth0 -M generic
+run "AF_XDP, native" -x -i veth0 -M native
@@ -13,6 +13,44 @@
 	<support_level>extended</support_level>
  ***/
 
+/*** DOCUMENTATION
+	<manager name="MoQShowSessions" language="en_US">
+		<synopsis>
+			List active MoQ sessions with their media statistics.
+		</synopsis>
+		<syntax>
+			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
+		</syntax>
+		<description>
+			<para>Sends a <literal>MoQSession</literal> event per active session,
+			followed by <literal>MoQSessionListComplete</literal>.</para>
+		</description>
+	</manager>
+	<manager name="MoQShowStats" language="en_US">
+		<synopsis>
+			Show aggregate MoQ media statistics.
+		</synopsis>
+		<syntax>
+			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
+		</syntax>
+		<description>
+			<para>Totals for all sessions since the module was loaded, including
+			active ones.</para>
+		</description>
+	</manager>
+	<managerEvent language="en_US" name="MoQSessionStats">
+		<managerEventInstance class="EVENT_FLAG_REPORTING">
+			<synopsis>Raised with the final media statistics when a MoQ session ends.</synopsis>
+		</managerEventInstance>
+	</managerEvent>
+	<managerEvent language="en_US" name="MoQDrain">
+		<managerEventInstance class="EVENT_FLAG_SYSTEM">
+			<synopsis>Raised when a drain of MoQ calls starts, completes, reaches its
+			deadline or is cancelled.</synopsis>
+		</managerEventInstance>
+	</managerEvent>
+ ***/
+
 /* Define module self symbol for external compilation */
 #define AST_MODULE_SELF_SYM __internal_chan_moq_self
 #define AST_MODULE "chan_moq"
@@ -26,6 +64,8 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <endian.h>
+#include <limits.h>
+#include <sys/ioctl.h>
 
 /* Asterisk headers after system and third-party libraries */
 #include <asterisk.h>
@@ -38,6 +78,7 @@
 #include <asterisk/callerid.h>
 #include <asterisk/frame.h>
 #include <asterisk/utils.h>
+#include <asterisk/paths.h>
 #include <asterisk/lock.h>
 #include <asterisk/astobj2.h>
 #include <asterisk/format_cache.h>
@@ -47,6 +88,26 @@
 #include <asterisk/sched.h>
 #include <asterisk/io.h>
 #include <asterisk/causes.h>
+#include <asterisk/linkedlists.h>
+#include <asterisk/cli.h>
+#include <asterisk/manager.h>
+#include <asterisk/bridge.h>
+#include <asterisk/bridge_technology.h>
+#include <asterisk/bridge_channel.h>
+#include <asterisk/bridge_features.h>
+
+/* Wire format codec, latency histograms and tracepoints (no Asterisk dependencies) */
+#include "moq_wire.h"
+#include "moq_hist.h"
+#include "moq_clock.h"
+#include "moq_reasm.h"
+#include "moq_vad.h"
+#include "moq_g711.h"
+#include "moq_crypto.h"
+#include "moq_tap.h"
+#include "moq_registrar.h"
+#include "moq_xdp.h"
+#include "moq_trace.h"
 
 #define MOQ_CONFIG "moq.conf"
 #define DEFAULT_WS_PORT 8088
@@ -54,6 +115,32 @@
 #define MOQ_QUIC_PORT 4433
 #define MOQ_MAX_PACKET_SIZE 1500
 #define MOQ_BUFFER_SIZE 8192
+#define MOQ_MAX_DATAGRAM (MOQ_MAX_PACKET_SIZE - 28)	/* Less IPv4 and UDP headers */
+#define MOQ_RECV_BATCH 16		/* Datagrams read per recvmmsg() */
+#define MOQ_RECV_SLOT_SIZE 2048		/* Room per received datagram */
+#define MOQ_SEND_BATCH 16		/* Fragments sent per sendmmsg() */
+#define MOQ_MAX_OBJECT_SIZE (1024 * 1024)		/* Largest fragmented object (video frame) */
+#define MOQ_REASM_BUDGET (2 * MOQ_MAX_OBJECT_SIZE)	/* Reassembly memory per session */
+#define MOQ_REASM_TIMEOUT_US 500000
+#define DEFAULT_POOL_SIZE 8
+#define DEFAULT_POOL_LOW_WATER 2
+#define MOQ_SAMPLE_RATE 8000		/* Media clock rate of the audio track (ulaw) */
+#define MOQ_VIDEO_RATE 90000		/* Media clock rate of the video track */
+#define DEFAULT_RR_INTERVAL 1000	/* Milliseconds between receiver reports */
+#define MIN_RR_INTERVAL 100
+#define MOQ_MAX_RTT_US 10000000		/* RTT samples above this are discarded */
+#define DEFAULT_CN_INTERVAL 200		/* Milliseconds between comfort noise updates */
+#define MOQ_CN_FRAME_SAMPLES 160	/* Generated comfort noise frame, 20 ms */
+#define MOQ_MAX_RELAYS 16
+#define DEFAULT_RELAY_PROBE_INTERVAL 500	/* Milliseconds between relay probes */
+#define MIN_RELAY_PROBE_INTERVAL 50
+#define DEFAULT_RELAY_TIMEOUT 2000	/* Milliseconds without a reply before a relay is down */
+#define MOQ_RELAY_GOAWAY_US 60000000	/* How long a relay that sent GOAWAY is avoided */
+#define DEFAULT_DRAIN_TIMEOUT 300	/* Seconds calls may continue once draining */
+#define MOQ_HANDOFF_TTL 60		/* Seconds a handoff stays valid after the drain deadline */
+#define MOQ_UNLOAD_WAIT_MS 5000		/* How long unload waits for hung up calls to end */
+#define DEFAULT_TAP_SEGMENT_SIZE 16	/* MiB per media tap segment */
+#define MOQ_SETUP_SAMPLES 1024
 
 /* Channel states */
 enum moq_state {
@@ -71,27 +158,6 @@ enum moq_object_type {
 	MOQ_OBJECT_TRACK = 2
 };
 
-/* MoQ message types */
-enum moq_message_type {
-	MOQ_MSG_SUBSCRIBE = 0x01,
-	MOQ_MSG_SUBSCRIBE_OK = 0x02,
-	MOQ_MSG_SUBSCRIBE_ERROR = 0x03,
-	MOQ_MSG_ANNOUNCE = 0x04,
-	MOQ_MSG_ANNOUNCE_OK = 0x05,
-	MOQ_MSG_UNSUBSCRIBE = 0x06,
-	MOQ_MSG_OBJECT = 0x07,
-	MOQ_MSG_GOAWAY = 0x08
-};
-
-/* MoQ media frame header */
-struct moq_media_header {
-	uint8_t type;
-	uint32_t track_id;
-	uint64_t sequence;
-	uint64_t timestamp;
-	uint16_t payload_size;
-} __attribute__((packed));
-
 /* QUIC connection structure (simplified) */
 struct moq_quic_conn {
 	int socket_fd;
@@ -103,8 +169,69 @@ struct moq_quic_conn {
 	size_t recv_buffer_len;
 	uint32_t connection_id;
 	int connected;
+	
+	/* Receive batch: recv_buffer holds MOQ_RECV_BATCH slots filled by one recvmmsg() */
+	struct mmsghdr recv_msgs[MOQ_RECV_BATCH];
+	struct iovec recv_iov[MOQ_RECV_BATCH];
+	char recv_control[MOQ_RECV_BATCH][CMSG_SPACE(sizeof(struct timespec))];
+	int recv_count;			/* Datagrams in the batch */
+	int recv_next;			/* Next one to hand out */
+	uint8_t *recv_datagram;		/* Slot of the message last returned */
+	
+	/* AF_XDP channel for the socket's port, if enabled; a batch comes from one or the other */
+	struct moq_xdp_chan *xdp;
+	struct moq_xdp_packet recv_packets[MOQ_RECV_BATCH];
+	int recv_xdp;			/* The batch is in recv_packets, in the UMEM */
+};
+
+/*
+ * Media statistics. Counters are bumped by the media thread, the channel
+ * write path and the native bridge (a send error, for one, can come from
+ * any of them), so they are updated with relaxed atomic read-modify-write
+ * operations and aggregated on demand with relaxed loads. Nothing is
+ * ordered by a counter; only the counts themselves must not be lost.
+ */
+struct moq_stats {
+	uint64_t rx_packets;
+	uint64_t rx_bytes;
+	uint64_t rx_lost;
+	uint64_t rx_reordered;
+	uint64_t rx_jitter;		/* Interarrival jitter estimate, microseconds */
+	uint64_t tx_packets;
+	uint64_t tx_bytes;
+	uint64_t tx_errors;
+	uint64_t tx_eagain;		/* Objects dropped because the socket was full */
+	uint64_t rtt;			/* Smoothed round-trip time, microseconds */
+	uint64_t remote_lost;		/* Cumulative loss reported by the peer */
+	uint64_t remote_jitter;		/* Jitter reported by the peer, microseconds */
+	uint64_t rr_sent;
+	uint64_t rr_received;
+	int64_t clock_skew;		/* Peer media clock against ours, ppm */
+	uint64_t samples_stretched;
+	uint64_t samples_dropped;
+	uint64_t video_rx_objects;
+	uint64_t video_tx_objects;
+	uint64_t reasm_timeouts;	/* Fragmented objects never completed */
+	uint64_t reasm_evicted;		/* Partial objects dropped for memory */
+	uint64_t fwd_packets;		/* Objects relayed by the native bridge */
+	uint64_t tx_suppressed;		/* Silent frames not sent (DTX) */
+	uint64_t tx_cn;			/* Comfort noise objects sent */
+	uint64_t rx_cn;			/* Comfort noise objects received */
+	uint64_t cn_generated;		/* Comfort noise frames played out */
+	int64_t tx_level;		/* Level of the last audio frame sent, dBov */
+	int64_t rx_level;		/* Level of the last audio frame received, dBov */
+	uint64_t rx_auth_failed;	/* Objects dropped as unauthentic or unprotected */
 };
 
+#define MOQ_STAT_ADD(stats, field, val) \
+	__atomic_fetch_add(&(stats)->field, (val), __ATOMIC_RELAXED)
+#define MOQ_STAT_SUB(stats, field, val) \
+	__atomic_fetch_sub(&(stats)->field, (val), __ATOMIC_RELAXED)
+#define MOQ_STAT_SET(stats, field, val) \
+	__atomic_store_n(&(stats)->field, (val), __ATOMIC_RELAXED)
+#define MOQ_STAT_GET(stats, field) \
+	__atomic_load_n(&(stats)->field, __ATOMIC_RELAXED)
+
 /* MoQ session structure */
 struct moq_session {
 	struct ast_channel *owner;
@@ -114,6 +241,7 @@ struct moq_session {
 	struct ast_sockaddr media_addr;
 	int media_socket;
 	struct lws *ws;
+	int routed;			/* Signaled through our own registrar, not an external server */
 	pthread_t media_thread;
 	int running;
 	ast_mutex_t lock;
@@ -122,16 +250,110 @@ struct moq_session {
 	
 	/* MoQ/QUIC specific */
 	struct moq_quic_conn *quic_conn;
+	int relay;			/* Upstream relay in use, protected by moq_lock */
 	uint32_t track_id;
 	uint64_t send_sequence;
 	uint64_t recv_sequence;
 	uint64_t last_timestamp;
+	
+	/* Media clocks: tx owned by the channel write path, rx by the media thread */
+	struct moq_clock_tx tx_clock;
+	struct moq_clock_rx rx_clock;
+	
+	/* Video track, multiplexed with audio by track_id */
+	uint32_t video_track_id;
+	uint64_t video_send_sequence;
+	struct moq_clock_tx video_clock;
+	uint64_t video_timestamp;	/* Shared by all objects of one video frame */
+	int video_frame_open;
+	struct moq_reasm reasm;		/* Owned by the media thread */
+	
+	/* Native bridge: objects received here are relayed straight to the peer */
+	struct moq_session *bridge_peer;	/* Protected by lock */
+	int fwd_valid[2];		/* Per track (audio, video), media thread only */
+	uint64_t fwd_in_sequence[2];
+	uint64_t fwd_out_sequence[2];
+	
+	/* Discontinuous transmission: vad is owned by the write path, cn by the media thread */
+	struct moq_vad vad;
+	int tx_silent;			/* Suppressing silence since the last speech frame */
+	uint64_t tx_cn_next_us;		/* Monotonic time the next comfort noise update is due */
+	struct moq_cn cn;
+	int cn_active;			/* Peer is silent, play comfort noise */
+	uint64_t cn_next_us;		/* Monotonic time the next noise frame is due */
+	uint64_t cn_playout;		/* Playout timestamp of the next noise frame, samples */
+	
+	/*
+	 * Media payload protection. Each side seals with its own key, sent to the
+	 * peer in signaling; tx belongs to the write path and rx to the media
+	 * thread, and each is only used once its ready flag is set (atomically,
+	 * after the context is keyed).
+	 */
+	struct moq_crypto tx_crypto;
+	struct moq_crypto rx_crypto;
+	enum moq_cipher tx_cipher;
+	uint8_t tx_key[MOQ_CRYPTO_KEY_MAX];
+	size_t tx_key_len;		/* 0 unless protection is offered on this call */
+	int tx_protected;		/* Peer has our key; seal everything sent */
+	int rx_protected;		/* We have the peer's key; drop anything unsealed */
+	uint8_t *tx_scratch;		/* Sealed copy of objects that get fragmented */
+	enum moq_cipher rx_cipher;
+	uint8_t rx_key[MOQ_CRYPTO_KEY_MAX];	/* Peer's key, kept to hand the call over */
+	size_t rx_key_len;
+	
+	/* Media tap, written by the receive and send sides; opened and closed with the call */
+	struct moq_tap *tap;
+	int bridge_tapped;		/* The bridge peer taps what we relay to it */
+	
+	/* Media thread lifecycle (threads park between calls while pooled) */
+	ast_cond_t cond;
+	int parked;
+	int shutdown;
+	uint64_t ended_us;		/* Monotonic time the call ended, for the reaper */
+	
+	/* Call-setup latency measurement */
+	struct timeval setup_start;
+	int first_frame_seen;
+	
+	/* Media statistics (receive side state is owned by the media thread) */
+	struct moq_stats stats;
+	int64_t last_transit;
+	double jitter;
+	
+	/* Receiver report state (media thread only) */
+	uint64_t rr_next_us;		/* Monotonic time the next report is due */
+	uint32_t rr_peer_sent;		/* sent_us of the last report from the peer */
+	uint64_t rr_peer_received_us;	/* Monotonic time it arrived, 0 if none yet */
+	double srtt;
+	
+	AST_LIST_ENTRY(moq_session) pool_entry;
+	AST_LIST_ENTRY(moq_session) list_entry;
+	AST_LIST_ENTRY(moq_session) reap_entry;
 };
 
 /* Global configuration */
 static struct {
 	char context[AST_MAX_CONTEXT];
 	int ws_port;
+	int pool_size;
+	int pool_low_water;
+	int rr_interval;
+	int vad;
+	int cn_interval;
+	int media_encryption;
+	enum moq_cipher media_cipher;
+	int relay_probe_interval;
+	int relay_timeout;
+	char successor[256];
+	int drain_timeout;
+	char handoff_secret[128];
+	int tap;
+	char tap_dir[256];
+	int tap_segment_size;
+	char xdp_interface[32];
+	enum moq_xdp_mode xdp_mode;
+	int xdp_queues;
+	int xdp_frames;
 	struct lws_context *ws_context;
 	pthread_t ws_thread;
 	int running;
@@ -139,6 +361,138 @@ static struct {
 
 AST_MUTEX_DEFINE_STATIC(moq_lock);
 
+/* Media pipeline stages with latency histograms */
+enum moq_latency_stage {
+	MOQ_LAT_RX_PARSE,		/* Kernel socket receipt to object parsed */
+	MOQ_LAT_PARSE_QUEUE,		/* Object parsed to ast_queue_frame() done */
+	MOQ_LAT_WRITE_SEND,		/* moq_write() entry to sendto() done */
+	MOQ_LAT_SIGNAL_CHANNEL,		/* Signaling message received to channel created */
+	MOQ_LAT_HANGUP,			/* moq_hangup() entry to return */
+	MOQ_LAT_TEARDOWN,		/* Call ended to session recycled or freed by the reaper */
+	MOQ_LAT_STAGES
+};
+
+static const char *const moq_latency_names[MOQ_LAT_STAGES] = {
+	[MOQ_LAT_RX_PARSE] = "receive -> parse",
+	[MOQ_LAT_PARSE_QUEUE] = "parse -> queue",
+	[MOQ_LAT_WRITE_SEND] = "write -> send",
+	[MOQ_LAT_SIGNAL_CHANNEL] = "signaling -> channel",
+	[MOQ_LAT_HANGUP] = "hangup",
+	[MOQ_LAT_TEARDOWN] = "hangup -> reaped",
+};
+
+static struct moq_hist moq_latency[MOQ_LAT_STAGES];
+
+/* AF_XDP media path if xdp_interface is set; outlives every session */
+static struct moq_xdp *moq_xdp_path;
+
+/* Active sessions and totals of ended sessions, protected by moq_lock */
+static AST_LIST_HEAD_NOLOCK(, moq_session) moq_sessions;
+static int moq_session_count;
+static struct moq_stats moq_ended_totals;
+
+/* Pre-warmed session pool */
+static struct {
+	AST_LIST_HEAD_NOLOCK(, moq_session) idle;
+	int count;
+	ast_cond_t cond;
+	pthread_t thread;
+	int running;
+	unsigned int hits;
+	unsigned int misses;
+} moq_pool;
+
+AST_MUTEX_DEFINE_STATIC(moq_pool_lock);
+
+/*
+ * Sessions whose calls have ended, torn down off the channel thread. The
+ * reaper takes them in batches, waits for their media threads to stop,
+ * which they all do at once, then closes taps and recycles or frees them.
+ * Protected by moq_reaper_lock, which is taken with no other lock held.
+ */
+static struct {
+	AST_LIST_HEAD_NOLOCK(, moq_session) queue;
+	unsigned int queued;		/* Sessions in the queue */
+	unsigned int reaped;
+	unsigned int batches;
+	unsigned int max_batch;
+	ast_cond_t cond;
+	pthread_t thread;
+	int running;
+} moq_reaper;
+
+AST_MUTEX_DEFINE_STATIC(moq_reaper_lock);
+
+/* Recent call-setup latencies (moq_request to first media frame), protected by moq_lock */
+static struct {
+	unsigned int samples[MOQ_SETUP_SAMPLES];
+	unsigned int count;
+	unsigned int next;
+} moq_setup_latency;
+
+/* Upstream relay, probed continuously for health and round-trip time */
+struct moq_relay {
+	char name[64 + 7];		/* host:port as configured (host up to 63 characters) */
+	struct sockaddr_in addr;
+	int healthy;			/* Replied within relay_timeout */
+	double srtt;			/* Smoothed probe RTT, microseconds */
+	uint64_t last_reply_us;		/* Monotonic time of the last reply, 0 if none yet */
+	unsigned int probes;
+	unsigned int replies;
+	unsigned int failovers;		/* Sessions moved off it mid-call */
+	uint64_t goaway_us;		/* Monotonic time it sent GOAWAY, 0 if it has not */
+};
+
+/*
+ * Configured relays, fixed once the module is loaded; probe state is
+ * protected by moq_relay_lock, which is taken after moq_lock if both are.
+ */
+static struct {
+	struct moq_relay list[MOQ_MAX_RELAYS];
+	int count;
+	int fd;				/* Probe socket */
+	uint32_t probe_seq;
+	pthread_t thread;
+	int running;
+} moq_relays;
+
+AST_MUTEX_DEFINE_STATIC(moq_relay_lock);
+
+/*
+ * Graceful drain before a restart: new calls are refused, peers are sent
+ * GOAWAY with the successor to reconnect to, and calls still up at the
+ * deadline are hung up. Protected by moq_lock.
+ */
+static struct {
+	int active;
+	char successor[256];
+	int timeout;			/* Seconds calls may continue, 0 for no deadline */
+	struct timeval started;
+	unsigned int notified;		/* Sessions sent GOAWAY */
+	unsigned int handed_off;	/* Of those, with state for the successor */
+	unsigned int forced;		/* Calls hung up at the deadline */
+	pthread_t thread;
+	ast_cond_t cond;
+} moq_drain;
+
+/*
+ * Handoffs already resumed, kept until they expire so the same signed
+ * state cannot start the call a second time. Protected by moq_lock.
+ */
+struct moq_handoff_used {
+	AST_LIST_ENTRY(moq_handoff_used) entry;
+	time_t expires;
+	char session_id[64];
+};
+
+static AST_LIST_HEAD_NOLOCK(, moq_handoff_used) moq_handoffs_used;
+
+/*
+ * Users registered on the signaling server and the calls routed between
+ * them. Has its own lock; never held while taking moq_lock.
+ */
+static struct moq_registrar moq_registrar;
+
 /* Forward declarations */
 static struct ast_channel *moq_request(const char *type, struct ast_format_cap *cap,
 	const struct ast_assigned_ids *assignedids, const struct ast_channel *requestor,
@@ -165,14 +519,31 @@ static struct ast_channel_tech moq_tech = {
 	.fixup = moq_fixup,
 };
 
+/* Monotonic clock in microseconds, for measuring pipeline stages */
+static inline uint64_t moq_monotonic_us(void)
+{
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Wall clock in microseconds, the clock receive timestamps are taken on */
+static inline uint64_t moq_wallclock_us(void)
+{
+	struct timeval now = ast_tvnow();
+	
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
 /* Utility function to generate session ID */
 static void generate_session_id(char *buf, size_t len)
 {
 	snprintf(buf, len, "moq-%08x-%04x", (unsigned int)time(NULL), (unsigned int)ast_random());
 }
 
-/* Create QUIC connection (simplified implementation) */
-static struct moq_quic_conn *moq_quic_create(const char *host, int port)
+/* Create QUIC connection (simplified implementation); its relay is set per call */
+static struct moq_quic_conn *moq_quic_create(void)
 {
 	struct moq_quic_conn *conn = ast_calloc(1, sizeof(*conn));
 	if (!conn) {
@@ -191,9 +562,25 @@ static struct moq_quic_conn *moq_quic_create(const char *host, int port)
 	int flags = fcntl(conn->socket_fd, F_GETFL, 0);
 	fcntl(conn->socket_fd, F_SETFL, flags | O_NONBLOCK);
 	
-	/* Allocate buffers */
-	conn->send_buffer = ast_malloc(MOQ_BUFFER_SIZE);
-	conn->recv_buffer = ast_malloc(MOQ_BUFFER_SIZE);
+	/* Have the kernel stamp datagrams on arrival, for receive latency */
+	int on = 1;
+	setsockopt(conn->socket_fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+	
+	/* Take a port now rather than on connect, so AF_XDP can steer it from the start */
+	if (moq_xdp_path) {
+		struct sockaddr_in any = { .sin_family = AF_INET };
+		
+		if (bind(conn->socket_fd, (struct sockaddr *)&any, sizeof(any)) ||
+			!(conn->xdp = moq_xdp_chan_open(moq_xdp_path, conn->socket_fd))) {
+			ast_log(LOG_WARNING, "MoQ connection not on the AF_XDP path: %s\n", strerror(errno));
+		}
+	}
+	
+	/* Allocate buffers: the send buffer doubles as MOQ_SEND_BATCH datagram slots */
+	conn->send_buffer_len = MOQ_SEND_BATCH * MOQ_MAX_PACKET_SIZE;
+	conn->recv_buffer_len = MOQ_RECV_BATCH * MOQ_RECV_SLOT_SIZE;
+	conn->send_buffer = ast_malloc(conn->send_buffer_len);
+	conn->recv_buffer = ast_malloc(conn->recv_buffer_len);
 	if (!conn->send_buffer || !conn->recv_buffer) {
 		ast_log(LOG_ERROR, "Failed to allocate QUIC buffers\n");
 		if (conn->send_buffer) ast_free(conn->send_buffer);
@@ -203,14 +590,14 @@ static struct moq_quic_conn *moq_quic_create(const char *host, int port)
 		return NULL;
 	}
 	
-	/* Set up peer address */
-	struct sockaddr_in *addr = (struct sockaddr_in *)&conn->peer_addr;
-	addr->sin_family = AF_INET;
-	addr->sin_port = htons(port);
-	if (inet_pton(AF_INET, host, &addr->sin_addr) <= 0) {
-		addr->sin_addr.s_addr = INADDR_ANY;
+	int i;
+	for (i = 0; i < MOQ_RECV_BATCH; i++) {
+		conn->recv_iov[i].iov_base = conn->recv_buffer + i * MOQ_RECV_SLOT_SIZE;
+		conn->recv_iov[i].iov_len = MOQ_RECV_SLOT_SIZE;
+		conn->recv_msgs[i].msg_hdr.msg_iov = &conn->recv_iov[i];
+		conn->recv_msgs[i].msg_hdr.msg_iovlen = 1;
+		conn->recv_msgs[i].msg_hdr.msg_control = conn->recv_control[i];
 	}
-	conn->peer_addr_len = sizeof(struct sockaddr_in);
 	
 	/* Generate connection ID */
 	conn->connection_id = (uint32_t)ast_random();
@@ -229,6 +616,9 @@ static void moq_quic_destroy(struct moq_quic_conn *conn)
 		return;
 	}
 	
+	/* Stop steering before the port can be reused */
+	moq_xdp_chan_close(conn->xdp);
+	
 	if (conn->socket_fd >= 0) {
 		close(conn->socket_fd);
 	}
@@ -244,728 +634,4419 @@ static void moq_quic_destroy(struct moq_quic_conn *conn)
 	ast_free(conn);
 }
 
-/* Send MoQ message over QUIC */
-static int moq_quic_send_message(struct moq_quic_conn *conn, uint8_t msg_type, 
-	const uint8_t *payload, size_t payload_len)
+/*
+ * Point a connection at a relay. The socket is connected to it, so the
+ * switch is atomic for threads sending at the same time, and datagrams from
+ * anywhere else are no longer received. Media is only sent while the
+ * connection is marked connected, which a failed connect() clears.
+ */
+static int moq_quic_set_peer(struct moq_quic_conn *conn, const struct sockaddr_in *addr)
 {
-	if (!conn || conn->socket_fd < 0) {
+	if (connect(conn->socket_fd, (const struct sockaddr *)addr, sizeof(*addr))) {
+		ast_log(LOG_ERROR, "Failed to connect MoQ socket to relay: %s\n", strerror(errno));
+		__atomic_store_n(&conn->connected, 0, __ATOMIC_RELEASE);
 		return -1;
 	}
 	
-	/* Simple message format: [type(1)][length(2)][payload] */
-	if (payload_len + 3 > MOQ_BUFFER_SIZE) {
-		ast_log(LOG_ERROR, "MoQ message too large: %zu bytes\n", payload_len);
-		return -1;
-	}
-	
-	uint8_t *buf = conn->send_buffer;
-	buf[0] = msg_type;
-	buf[1] = (payload_len >> 8) & 0xFF;
-	buf[2] = payload_len & 0xFF;
-	
-	if (payload && payload_len > 0) {
-		memcpy(buf + 3, payload, payload_len);
-	}
-	
-	ssize_t sent = sendto(conn->socket_fd, buf, payload_len + 3, 0,
-		(struct sockaddr *)&conn->peer_addr, conn->peer_addr_len);
-	
-	if (sent < 0) {
-		ast_log(LOG_ERROR, "Failed to send MoQ message: %s\n", strerror(errno));
-		return -1;
+	memcpy(&conn->peer_addr, addr, sizeof(*addr));
+	conn->peer_addr_len = sizeof(*addr);
+	if (conn->xdp) {
+		moq_xdp_chan_connect(conn->xdp, addr);
 	}
+	__atomic_store_n(&conn->connected, 1, __ATOMIC_RELEASE);
 	
 	return 0;
 }
 
-/* Receive MoQ message from QUIC */
-static int moq_quic_recv_message(struct moq_quic_conn *conn, uint8_t *msg_type,
-	uint8_t *payload, size_t *payload_len, size_t max_payload_len)
+/*
+ * Send one datagram to the connection's peer. The media thread sends its
+ * control messages from its own buffer through here, so they never touch
+ * the send buffer owned by the channel write path.
+ */
+static int moq_quic_send_datagram(struct moq_quic_conn *conn, const uint8_t *buf, size_t len)
 {
-	if (!conn || conn->socket_fd < 0) {
-		return -1;
-	}
-	
-	struct sockaddr_storage from;
-	socklen_t fromlen = sizeof(from);
-	
-	ssize_t received = recvfrom(conn->socket_fd, conn->recv_buffer, 
-		MOQ_BUFFER_SIZE, 0, (struct sockaddr *)&from, &fromlen);
+	ssize_t sent;
 	
-	if (received < 0) {
-		if (errno == EAGAIN || errno == EWOULDBLOCK) {
-			return 0; /* No data available */
+	if (conn->xdp) {
+		struct iovec iov = { .iov_base = (void *)buf, .iov_len = len };
+		
+		if (moq_xdp_send(conn->xdp, &iov, 1) == 1) {
+			return 0;
 		}
-		ast_log(LOG_ERROR, "Failed to receive MoQ message: %s\n", strerror(errno));
-		return -1;
 	}
 	
-	if (received < 3) {
-		ast_log(LOG_WARNING, "Received truncated MoQ message\n");
+	sent = send(conn->socket_fd, buf, len, 0);
+	if (sent < 0) {
+		int err = errno;
+		
+		/* A full socket buffer is accounted as a drop by the caller, not logged */
+		if (err != EAGAIN && err != EWOULDBLOCK) {
+			ast_log(LOG_ERROR, "Failed to send MoQ message: %s\n", strerror(err));
+		}
+		errno = err;
 		return -1;
 	}
 	
-	/* Parse message */
-	*msg_type = conn->recv_buffer[0];
-	uint16_t len = (conn->recv_buffer[1] << 8) | conn->recv_buffer[2];
+	return 0;
+}
+
+/* Send the first len bytes of the connection's send buffer */
+static int moq_quic_send_buffer(struct moq_quic_conn *conn, size_t len)
+{
+	return moq_quic_send_datagram(conn, conn->send_buffer, len);
+}
+
+/*
+ * Send count datagrams to the connection's peer with as few system calls as
+ * possible: from the UMEM when on the AF_XDP path, with the socket taking
+ * whatever does not fit there.
+ */
+static int moq_quic_send_batch(struct moq_quic_conn *conn, struct iovec *iov, int count)
+{
+	struct mmsghdr msgs[MOQ_SEND_BATCH];
+	int i, sent;
 	
-	if (len > received - 3) {
-		ast_log(LOG_WARNING, "Invalid MoQ message length\n");
-		return -1;
+	if (conn->xdp) {
+		sent = moq_xdp_send(conn->xdp, iov, count);
+		iov += sent;
+		count -= sent;
 	}
 	
-	if (len > max_payload_len) {
-		ast_log(LOG_WARNING, "MoQ message payload too large\n");
-		return -1;
+	for (i = 0; i < count; i++) {
+		memset(&msgs[i], 0, sizeof(msgs[i]));
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
 	}
 	
-	*payload_len = len;
-	if (len > 0 && payload) {
-		memcpy(payload, conn->recv_buffer + 3, len);
+	for (i = 0; i < count; i += sent) {
+		sent = sendmmsg(conn->socket_fd, msgs + i, count - i, 0);
+		if (sent <= 0) {
+			int err = sent < 0 ? errno : EAGAIN;
+			
+			if (err != EAGAIN && err != EWOULDBLOCK) {
+				ast_log(LOG_ERROR, "Failed to send MoQ messages: %s\n", strerror(err));
+			}
+			errno = err;
+			return -1;
+		}
 	}
 	
-	return 1; /* Message received */
+	return 0;
 }
 
-/* Send MoQ media object */
-static int moq_send_media_object(struct moq_session *session, const uint8_t *data, 
-	size_t len, uint64_t timestamp)
+/* Send MoQ message over QUIC */
+static int moq_quic_send_message(struct moq_quic_conn *conn, uint8_t msg_type, 
+	const uint8_t *payload, size_t payload_len)
 {
-	if (!session || !session->quic_conn) {
+	if (!conn || conn->socket_fd < 0) {
 		return -1;
 	}
 	
-	/* Construct MoQ media header */
-	struct moq_media_header header;
-	header.type = MOQ_MSG_OBJECT;
-	header.track_id = htonl(session->track_id);
-	header.sequence = htobe64(session->send_sequence++);
-	header.timestamp = htobe64(timestamp);
-	header.payload_size = htons(len);
-	
-	/* Allocate buffer for header + payload */
-	size_t total_len = sizeof(header) + len;
-	uint8_t *packet = ast_malloc(total_len);
-	if (!packet) {
+	int len = moq_wire_encode_message(conn->send_buffer, MOQ_BUFFER_SIZE, msg_type,
+		payload, payload_len);
+	if (len < 0) {
+		ast_log(LOG_ERROR, "Failed to encode MoQ message (%zu bytes): %s\n",
+			payload_len, moq_wire_strerror(len));
 		return -1;
 	}
 	
-	memcpy(packet, &header, sizeof(header));
-	memcpy(packet + sizeof(header), data, len);
-	
-	/* Send via QUIC */
-	int ret = moq_quic_send_message(session->quic_conn, MOQ_MSG_OBJECT, 
-		packet, total_len);
-	
-	ast_free(packet);
-	return ret;
+	return moq_quic_send_buffer(conn, len);
 }
 
-/* Receive MoQ media object */
-static int moq_recv_media_object(struct moq_session *session, uint8_t *data,
-	size_t *len, size_t max_len, uint64_t *timestamp)
+/*
+ * Receive MoQ message from QUIC. Datagrams are read a batch at a time and
+ * handed out one per call. On success the payload points into the
+ * connection's receive buffer, or into the UMEM for a batch taken from the
+ * AF_XDP path, and stays valid until the next batch is read, that is until
+ * moq_quic_recv_pending() has returned 0 and this is called again, and
+ * rx_us holds the kernel's (or the AF_XDP worker's) wall-clock arrival time
+ * in microseconds.
+ */
+static int moq_quic_recv_message(struct moq_quic_conn *conn, uint8_t *msg_type,
+	const uint8_t **payload, size_t *payload_len, uint64_t *rx_us)
 {
-	if (!session || !session->quic_conn) {
+	if (!conn || conn->socket_fd < 0) {
 		return -1;
 	}
 	
-	uint8_t msg_type;
-	uint8_t buffer[MOQ_BUFFER_SIZE];
-	size_t msg_len;
-	
-	int ret = moq_quic_recv_message(session->quic_conn, &msg_type, 
-		buffer, &msg_len, sizeof(buffer));
-	
-	if (ret <= 0) {
-		return ret;
+	if (conn->recv_next >= conn->recv_count) {
+		int i;
+		
+		conn->recv_next = conn->recv_count = 0;
+		
+		/* Steered datagrams first, parsed where the NIC put them; the socket gets the rest */
+		conn->recv_xdp = conn->xdp &&
+			(conn->recv_count = moq_xdp_recv(conn->xdp, conn->recv_packets, MOQ_RECV_BATCH)) > 0;
+		if (conn->recv_xdp) {
+			goto have_batch;
+		}
+		
+		for (i = 0; i < MOQ_RECV_BATCH; i++) {
+			conn->recv_msgs[i].msg_hdr.msg_controllen = sizeof(conn->recv_control[i]);
+		}
+		
+		int received = recvmmsg(conn->socket_fd, conn->recv_msgs, MOQ_RECV_BATCH, 0, NULL);
+		
+		if (received < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return 0; /* No data available */
+			}
+			ast_log(LOG_ERROR, "Failed to receive MoQ message: %s\n", strerror(errno));
+			return -1;
+		}
+		conn->recv_count = received;
+		if (!received) {
+			return 0;
+		}
 	}
 	
-	if (msg_type != MOQ_MSG_OBJECT) {
-		ast_log(LOG_DEBUG, "Received non-media MoQ message type: %d\n", msg_type);
-		return 0;
-	}
+have_batch:;
+	int slot = conn->recv_next++;
 	
-	if (msg_len < sizeof(struct moq_media_header)) {
-		ast_log(LOG_WARNING, "Received incomplete MoQ media object\n");
-		return -1;
+	if (conn->recv_xdp) {
+		struct moq_xdp_packet *packet = &conn->recv_packets[slot];
+		
+		*rx_us = packet->rx_us;
+		conn->recv_datagram = packet->data;
+		goto decode;
 	}
 	
-	/* Parse header */
-	struct moq_media_header header;
-	memcpy(&header, buffer, sizeof(header));
-	
-	uint32_t track_id = ntohl(header.track_id);
-	uint64_t sequence = be64toh(header.sequence);
-	*timestamp = be64toh(header.timestamp);
-	uint16_t payload_size = ntohs(header.payload_size);
-	
-	if (track_id != session->track_id) {
-		ast_log(LOG_DEBUG, "Received media for different track: %u\n", track_id);
-		return 0;
-	}
+	struct msghdr *mh = &conn->recv_msgs[slot].msg_hdr;
 	
-	/* Check for lost packets */
-	if (sequence > session->recv_sequence + 1) {
-		ast_log(LOG_WARNING, "Lost %llu MoQ packets\n", 
-			(unsigned long long)(sequence - session->recv_sequence - 1));
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(mh);
+	if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+		struct timespec ts;
+		
+		memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+		*rx_us = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	} else {
+		struct timeval now = ast_tvnow();
+		
+		*rx_us = (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
 	}
-	session->recv_sequence = sequence;
-	
-	/* Extract payload */
-	size_t payload_offset = sizeof(header);
-	size_t available_payload = msg_len - payload_offset;
 	
-	if (payload_size != available_payload) {
-		ast_log(LOG_WARNING, "MoQ payload size mismatch: expected %u, got %zu\n",
-			payload_size, available_payload);
-		payload_size = available_payload;
+	conn->recv_datagram = conn->recv_iov[slot].iov_base;
+	if (mh->msg_flags & MSG_TRUNC) {
+		ast_log(LOG_WARNING, "Received oversized MoQ datagram\n");
+		return -1;
 	}
 	
-	if (payload_size > max_len) {
-		ast_log(LOG_WARNING, "MoQ payload too large: %u > %zu\n", payload_size, max_len);
-		payload_size = max_len;
+decode:;
+	int res = moq_wire_decode_message(conn->recv_datagram,
+		conn->recv_xdp ? conn->recv_packets[slot].len : conn->recv_msgs[slot].msg_len,
+		msg_type, payload, payload_len);
+	if (res != MOQ_WIRE_OK) {
+		ast_log(LOG_WARNING, "Received invalid MoQ message: %s\n", moq_wire_strerror(res));
+		return -1;
 	}
 	
-	*len = payload_size;
-	memcpy(data, buffer + payload_offset, payload_size);
-	
-	return 1;
+	return 1; /* Message received */
 }
 
-/* Send WebSocket message */
-static int moq_ws_send_message(struct lws *wsi, const char *message)
+/* Whether datagrams of the last batch are still waiting to be handed out */
+static int moq_quic_recv_pending(const struct moq_quic_conn *conn)
 {
-	size_t len = strlen(message);
-	unsigned char *buf = ast_malloc(LWS_PRE + len);
-	if (!buf) {
-		return -1;
-	}
-
-	memcpy(&buf[LWS_PRE], message, len);
-	int written = lws_write(wsi, &buf[LWS_PRE], len, LWS_WRITE_TEXT);
-	ast_free(buf);
-
-	return (written < 0) ? -1 : 0;
+	return conn->recv_next < conn->recv_count;
 }
 
-/* Send call message via WebSocket */
-static int moq_send_call(struct moq_session *session, const char *dest)
+/* Update receive statistics for an object on the session's own track (media thread only) */
+static void moq_stats_rx_object(struct moq_session *session, const struct moq_object *obj)
 {
-	struct json_object *jobj = json_object_new_object();
-	json_object_object_add(jobj, "type", json_object_new_string("call"));
-	json_object_object_add(jobj, "session_id", json_object_new_string(session->session_id));
-	json_object_object_add(jobj, "dest", json_object_new_string(dest));
+	struct moq_stats *stats = &session->stats;
+	int64_t transit;
+	
+	if (stats->rx_packets && obj->sequence <= session->recv_sequence) {
+		/* Late arrival; it was counted as lost when the gap was seen */
+		MOQ_STAT_ADD(stats, rx_reordered, 1);
+		if (stats->rx_lost) {
+			MOQ_STAT_SUB(stats, rx_lost, 1);
+		}
+	} else {
+		if (obj->sequence > session->recv_sequence + 1) {
+			uint64_t gap = obj->sequence - session->recv_sequence - 1;
+			
+			MOQ_STAT_ADD(stats, rx_lost, gap);
+			ast_debug(1, "MoQ session %s: lost %llu packets\n",
+				session->session_id, (unsigned long long)gap);
+		}
+		session->recv_sequence = obj->sequence;
+	}
 	
-	const char *msg = json_object_to_json_string(jobj);
-	int ret = moq_ws_send_message(session->ws, msg);
-	json_object_put(jobj);
+	/* RFC 3550 interarrival jitter against the sender's media clock, in microseconds */
+	transit = (int64_t)moq_monotonic_us() - (int64_t)(obj->timestamp * 1000000 / MOQ_SAMPLE_RATE);
+	if (stats->rx_packets) {
+		int64_t d = transit - session->last_transit;
+		
+		session->jitter += ((double)(d < 0 ? -d : d) - session->jitter) / 16.0;
+		MOQ_STAT_SET(stats, rx_jitter, (uint64_t)session->jitter);
+	}
+	session->last_transit = transit;
 	
-	return ret;
+	MOQ_STAT_ADD(stats, rx_packets, 1);
+	MOQ_STAT_ADD(stats, rx_bytes, obj->payload_len);
 }
 
-/* Send answer message via WebSocket */
-static int moq_send_answer(struct moq_session *session)
+/* Account the outcome of sending one media object (channel write path only) */
+static void moq_stats_tx_result(struct moq_session *session, int res, size_t len)
 {
-	struct json_object *jobj = json_object_new_object();
-	json_object_object_add(jobj, "type", json_object_new_string("answer"));
-	json_object_object_add(jobj, "session_id", json_object_new_string(session->session_id));
-	
-	const char *msg = json_object_to_json_string(jobj);
-	int ret = moq_ws_send_message(session->ws, msg);
-	json_object_put(jobj);
-	
-	return ret;
+	if (!res) {
+		MOQ_STAT_ADD(&session->stats, tx_packets, 1);
+		MOQ_STAT_ADD(&session->stats, tx_bytes, len);
+	} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+		MOQ_STAT_ADD(&session->stats, tx_eagain, 1);
+	} else {
+		MOQ_STAT_ADD(&session->stats, tx_errors, 1);
+	}
 }
 
-/* Send hangup message via WebSocket */
-static int moq_send_hangup(struct moq_session *session)
+/*
+ * Send a receiver report for the session's track (media thread only). The
+ * last report from the peer is echoed back with the time it was held, so
+ * the peer can work out the round-trip time.
+ */
+static void moq_send_receiver_report(struct moq_session *session, uint64_t now_us)
 {
-	struct json_object *jobj = json_object_new_object();
-	json_object_object_add(jobj, "type", json_object_new_string("hangup"));
-	json_object_object_add(jobj, "session_id", json_object_new_string(session->session_id));
-	
-	const char *msg = json_object_to_json_string(jobj);
-	int ret = moq_ws_send_message(session->ws, msg);
-	json_object_put(jobj);
+	uint8_t buf[MOQ_WIRE_MSG_HEADER_SIZE + MOQ_WIRE_RECEIVER_REPORT_SIZE];
+	uint64_t lost = MOQ_STAT_GET(&session->stats, rx_lost);
+	uint64_t jitter = MOQ_STAT_GET(&session->stats, rx_jitter);
+	struct moq_receiver_report rr = {
+		.track_id = session->track_id,
+		.highest_sequence = session->recv_sequence,
+		.cumulative_lost = lost > UINT32_MAX ? UINT32_MAX : (uint32_t)lost,
+		.jitter_us = jitter > UINT32_MAX ? UINT32_MAX : (uint32_t)jitter,
+		.sent_us = (uint32_t)now_us,
+	};
+	int len;
+	
+	/* Zero means "no report" in last_report_us, so never send it as a time */
+	if (!rr.sent_us) {
+		rr.sent_us = 1;
+	}
+	if (session->rr_peer_received_us) {
+		rr.last_report_us = session->rr_peer_sent;
+		rr.delay_since_last_report_us = (uint32_t)(now_us - session->rr_peer_received_us);
+	}
 	
-	return ret;
+	len = moq_wire_encode_receiver_report(buf, sizeof(buf), &rr);
+	if (len > 0 && !moq_quic_send_datagram(session->quic_conn, buf, len)) {
+		MOQ_STAT_ADD(&session->stats, rr_sent, 1);
+	}
 }
 
-/* Media thread - handles MoQ media transport */
-static void *moq_media_thread(void *data)
+/* Process a receiver report from the peer about the track we send (media thread only) */
+static void moq_handle_receiver_report(struct moq_session *session, const uint8_t *msg,
+	size_t len)
 {
-	struct moq_session *session = data;
-	unsigned char buffer[MOQ_MAX_PACKET_SIZE];
-	struct ast_frame frame;
-	uint64_t timestamp;
+	struct moq_stats *stats = &session->stats;
+	struct moq_receiver_report rr;
+	uint64_t now_us = moq_monotonic_us();
 	
-	ast_log(LOG_NOTICE, "MoQ media thread started for session %s\n", session->session_id);
+	if (moq_wire_decode_receiver_report(msg, len, &rr) != MOQ_WIRE_OK) {
+		ast_log(LOG_WARNING, "Received invalid MoQ receiver report\n");
+		return;
+	}
 	
-	while (session->running) {
-		/* Receive media via MoQ/QUIC */
-		size_t len = sizeof(buffer);
-		
-		fd_set fds;
-		struct timeval tv = {0, 20000}; /* 20ms timeout for low latency */
+	if (rr.track_id != session->track_id) {
+		ast_debug(1, "Received receiver report for different track: %u\n", rr.track_id);
+		return;
+	}
+	
+	session->rr_peer_sent = rr.sent_us;
+	session->rr_peer_received_us = now_us;
+	
+	MOQ_STAT_ADD(stats, rr_received, 1);
+	MOQ_STAT_SET(stats, remote_lost, rr.cumulative_lost);
+	MOQ_STAT_SET(stats, remote_jitter, rr.jitter_us);
+	
+	/* RTT = now - LSR - DLSR, all in the low 32 bits of our own clock */
+	if (rr.last_report_us) {
+		uint32_t rtt = (uint32_t)now_us - rr.last_report_us - rr.delay_since_last_report_us;
 		
-		if (session->quic_conn && session->quic_conn->socket_fd >= 0) {
-			FD_ZERO(&fds);
-			FD_SET(session->quic_conn->socket_fd, &fds);
-			
-			int ret = select(session->quic_conn->socket_fd + 1, &fds, NULL, NULL, &tv);
-			if (ret > 0 && FD_ISSET(session->quic_conn->socket_fd, &fds)) {
-				/* Receive MoQ media object */
-				ret = moq_recv_media_object(session, buffer, &len, sizeof(buffer), &timestamp);
-				
-				if (ret > 0 && len > 0 && session->owner) {
-					/* Queue frame to Asterisk */
-					memset(&frame, 0, sizeof(frame));
-					frame.frametype = AST_FRAME_VOICE;
-					frame.subclass.format = ast_format_ulaw;
-					frame.data.ptr = buffer;
-					frame.datalen = len;
-					frame.samples = len;
-					frame.delivery.tv_sec = timestamp / 1000000;
-					frame.delivery.tv_usec = timestamp % 1000000;
-					
-					ast_mutex_lock(&session->lock);
-					if (session->owner) {
-						ast_queue_frame(session->owner, &frame);
-					}
-					ast_mutex_unlock(&session->lock);
-				}
-			}
-		} else {
-			/* Fallback to UDP if QUIC not available */
-			FD_ZERO(&fds);
-			FD_SET(session->media_socket, &fds);
-			
-			int ret = select(session->media_socket + 1, &fds, NULL, NULL, &tv);
-			if (ret > 0 && FD_ISSET(session->media_socket, &fds)) {
-				struct sockaddr_in from;
-				socklen_t fromlen = sizeof(from);
-				
-				ssize_t received = recvfrom(session->media_socket, buffer, 
-					sizeof(buffer), 0, (struct sockaddr *)&from, &fromlen);
-				
-				if (received > 0 && session->owner) {
-					memset(&frame, 0, sizeof(frame));
-					frame.frametype = AST_FRAME_VOICE;
-					frame.subclass.format = ast_format_ulaw;
-					frame.data.ptr = buffer;
-					frame.datalen = received;
-					frame.samples = received;
-					
-					ast_mutex_lock(&session->lock);
-					if (session->owner) {
-						ast_queue_frame(session->owner, &frame);
-					}
-					ast_mutex_unlock(&session->lock);
-				}
+		if (rtt <= MOQ_MAX_RTT_US) {
+			if (session->srtt) {
+				session->srtt += ((double)rtt - session->srtt) / 8.0;
+			} else {
+				session->srtt = rtt ? rtt : 1;
 			}
+			MOQ_STAT_SET(stats, rtt, (uint64_t)session->srtt);
 		}
 	}
 	
-	ast_log(LOG_NOTICE, "MoQ media thread stopped for session %s\n", session->session_id);
-	return NULL;
+	ast_debug(3, "MoQ session %s: receiver report seq %llu lost %u jitter %u us rtt %llu us\n",
+		session->session_id, (unsigned long long)rr.highest_sequence,
+		rr.cumulative_lost, rr.jitter_us, (unsigned long long)MOQ_STAT_GET(stats, rtt));
 }
 
-/* Create new MoQ session */
-static struct moq_session *moq_session_new(const char *dest)
+/*
+ * Send an object too large for one datagram as a series of fragments, encoded
+ * into the slots of the send buffer and sent MOQ_SEND_BATCH at a time.
+ */
+static int moq_send_fragmented_object(struct moq_session *session, const struct moq_object *obj)
 {
-	struct moq_session *session = ast_calloc(1, sizeof(*session));
-	if (!session) {
-		return NULL;
+	struct moq_quic_conn *conn = session->quic_conn;
+	struct iovec iov[MOQ_SEND_BATCH];
+	int batched = 0;
+	size_t max_chunk = MOQ_MAX_DATAGRAM - MOQ_WIRE_MSG_HEADER_SIZE - MOQ_WIRE_FRAGMENT_HEADER_SIZE;
+	size_t count = (obj->payload_len + max_chunk - 1) / max_chunk;
+	struct moq_fragment frag = {
+		.type = obj->type,
+		.track_id = obj->track_id,
+		.sequence = obj->sequence,
+		.timestamp = obj->timestamp,
+		.object_size = obj->payload_len,
+		.count = count,
+	};
+	size_t chunk, offset;
+	
+	if (obj->payload_len > MOQ_MAX_OBJECT_SIZE || count > MOQ_REASM_MAX_FRAGMENTS) {
+		ast_log(LOG_WARNING, "MoQ object of %zu bytes is too large to send\n", obj->payload_len);
+		errno = EMSGSIZE;
+		return -1;
+	}
+	
+	chunk = moq_wire_fragment_chunk(frag.object_size, frag.count);
+	for (offset = 0; offset < obj->payload_len; offset += chunk, frag.index++) {
+		frag.data = obj->payload + offset;
+		frag.data_len = obj->payload_len - offset < chunk ? obj->payload_len - offset : chunk;
+		
+		uint8_t *slot = conn->send_buffer + batched * MOQ_MAX_PACKET_SIZE;
+		int len = moq_wire_encode_fragment(slot, MOQ_MAX_PACKET_SIZE, &frag);
+		if (len < 0) {
+			ast_log(LOG_ERROR, "Failed to encode MoQ fragment: %s\n", moq_wire_strerror(len));
+			return -1;
+		}
+		iov[batched].iov_base = slot;
+		iov[batched].iov_len = len;
+		
+		/* Once one fragment is lost the object is, so stop at the first failure */
+		if (++batched == MOQ_SEND_BATCH || offset + chunk >= obj->payload_len) {
+			if (moq_quic_send_batch(conn, iov, batched)) {
+				return -1;
+			}
+			batched = 0;
+		}
+	}
+	
+	return 0;
+}
+
+/*
+ * Seal an object's payload for the peer (channel write path only). Objects
+ * that fit one datagram are sealed straight into the send buffer where
+ * moq_wire_encode_object() expects their payload; larger ones into the
+ * session's scratch buffer, to be fragmented from there.
+ */
+static int moq_seal_media_object(struct moq_session *session, struct moq_object *obj)
+{
+	uint8_t *out = session->quic_conn->send_buffer + MOQ_WIRE_MSG_HEADER_SIZE + MOQ_WIRE_OBJECT_HEADER_SIZE;
+	int len;
+	
+	if (MOQ_WIRE_MSG_HEADER_SIZE + MOQ_WIRE_OBJECT_HEADER_SIZE + obj->payload_len +
+		MOQ_CRYPTO_TAG_SIZE > MOQ_MAX_DATAGRAM) {
+		if (obj->payload_len + MOQ_CRYPTO_TAG_SIZE > MOQ_MAX_OBJECT_SIZE) {
+			ast_log(LOG_WARNING, "MoQ object of %zu bytes is too large to send\n", obj->payload_len);
+			errno = EMSGSIZE;
+			return -1;
+		}
+		if (!session->tx_scratch) {
+			session->tx_scratch = ast_malloc(MOQ_MAX_OBJECT_SIZE);
+			if (!session->tx_scratch) {
+				return -1;
+			}
+		}
+		out = session->tx_scratch;
+	}
+	
+	obj->type |= MOQ_OBJ_FLAG_ENCRYPTED;
+	len = moq_crypto_seal(&session->tx_crypto, obj, out);
+	if (len < 0) {
+		ast_log(LOG_ERROR, "Failed to seal MoQ media object\n");
+		errno = EINVAL;
+		return -1;
+	}
+	obj->payload = out;
+	obj->payload_len = len;
+	
+	return 0;
+}
+
+/*
+ * Send MoQ media object on a track, encoded straight into the connection's
+ * send buffer, or fragmented when it does not fit one datagram. Once the
+ * peer has our key the payload is sealed first; the tap gets it before that.
+ */
+static int moq_send_media_object(struct moq_session *session, uint32_t track_id, uint8_t type,
+	uint64_t sequence, const uint8_t *data, size_t len, uint64_t timestamp)
+{
+	if (!session || !session->quic_conn) {
+		return -1;
+	}
+	
+	struct moq_object obj = {
+		.type = type,
+		.track_id = track_id,
+		.sequence = sequence,
+		.timestamp = timestamp,
+		.payload = data,
+		.payload_len = len,
+	};
+	
+	moq_tap_write(session->tap, MOQ_TAP_TX, &obj, moq_wallclock_us());
+	
+	if (__atomic_load_n(&session->tx_protected, __ATOMIC_ACQUIRE) &&
+		moq_seal_media_object(session, &obj)) {
+		return -1;
+	}
+	
+	if (MOQ_WIRE_MSG_HEADER_SIZE + MOQ_WIRE_OBJECT_HEADER_SIZE + obj.payload_len > MOQ_MAX_DATAGRAM) {
+		return moq_send_fragmented_object(session, &obj);
+	}
+	
+	int total_len = moq_wire_encode_object(session->quic_conn->send_buffer, MOQ_BUFFER_SIZE, &obj);
+	if (total_len < 0) {
+		ast_log(LOG_ERROR, "Failed to encode MoQ media object (%zu bytes): %s\n",
+			obj.payload_len, moq_wire_strerror(total_len));
+		return -1;
+	}
+	
+	/* Send via QUIC */
+	return moq_quic_send_buffer(session->quic_conn, total_len);
+}
+
+/* Link two sessions for native relaying, holding a reference to the peer; each lock is taken on its own */
+static void moq_bridge_link(struct moq_session *session, struct moq_session *peer)
+{
+	struct moq_session *old;
+	
+	ast_mutex_lock(&session->lock);
+	old = session->bridge_peer;
+	session->bridge_peer = ao2_bump(peer);
+	session->bridge_tapped = peer->tap != NULL;
+	session->fwd_valid[0] = 0;
+	session->fwd_valid[1] = 0;
+	ast_mutex_unlock(&session->lock);
+	
+	ao2_cleanup(old);
+}
+
+/*
+ * Stop relaying in both directions. Once this returns neither media thread
+ * can still be using the other session, as relaying happens under the
+ * relaying session's lock.
+ */
+static void moq_bridge_unlink(struct moq_session *session)
+{
+	struct moq_session *peer;
+	
+	ast_mutex_lock(&session->lock);
+	peer = session->bridge_peer;
+	session->bridge_peer = NULL;
+	ast_mutex_unlock(&session->lock);
+	
+	if (peer) {
+		int linked;
+		
+		ast_mutex_lock(&peer->lock);
+		linked = peer->bridge_peer == session;
+		if (linked) {
+			peer->bridge_peer = NULL;
+		}
+		ast_mutex_unlock(&peer->lock);
+		ast_debug(1, "MoQ native bridge %s <-> %s stopped\n",
+			session->session_id, peer->session_id);
+		
+		/* The caller still holds its own reference to session */
+		if (linked) {
+			ao2_ref(session, -1);
+		}
+		ao2_ref(peer, -1);
+	}
+}
+
+/*
+ * Relay a received object or fragment to the natively bridged peer session
+ * (media thread only). The datagram is forwarded as received, with only its
+ * track and sequence rewritten to the peer's outgoing track; fragments of
+ * one object keep sharing a sequence. Returns 1 if it was relayed.
+ * Protected media is never relayed, as its header is authenticated.
+ */
+static int moq_bridge_forward(struct moq_session *session, int video, uint64_t sequence,
+	const uint8_t *msg, size_t msg_len)
+{
+	/* The message lies in a slot of our own receive buffer, right after its header */
+	uint8_t *datagram = session->quic_conn->recv_datagram;
+	struct moq_session *peer;
+	uint64_t out;
+	int res;
+	
+	ast_mutex_lock(&session->lock);
+	peer = session->bridge_peer;
+	if (!peer || !peer->quic_conn || msg != datagram + MOQ_WIRE_MSG_HEADER_SIZE ||
+		__atomic_load_n(&session->rx_protected, __ATOMIC_ACQUIRE)) {
+		ast_mutex_unlock(&session->lock);
+		return 0;
+	}
+	
+	/* The peer's write path is idle while bridged, but share its counters safely */
+	if (!session->fwd_valid[video] || session->fwd_in_sequence[video] != sequence) {
+		session->fwd_out_sequence[video] = __atomic_fetch_add(
+			video ? &peer->video_send_sequence : &peer->send_sequence, 1, __ATOMIC_RELAXED);
+		session->fwd_in_sequence[video] = sequence;
+		session->fwd_valid[video] = 1;
+	}
+	out = session->fwd_out_sequence[video];
+	
+	moq_wire_rewrite_object(datagram, MOQ_WIRE_MSG_HEADER_SIZE + msg_len,
+		video ? peer->video_track_id : peer->track_id, out);
+	res = moq_quic_send_datagram(peer->quic_conn, datagram, MOQ_WIRE_MSG_HEADER_SIZE + msg_len);
+	ast_mutex_unlock(&session->lock);
+	
+	if (!res) {
+		MOQ_STAT_ADD(&session->stats, fwd_packets, 1);
+	}
+	
+	return 1;
+}
+
+/*
+ * An object we relayed is media the bridge peer sent: tap it there, as it
+ * went out (media thread only, after moq_bridge_forward()).
+ */
+static void moq_bridge_tap(struct moq_session *session, const struct moq_object *obj,
+	uint64_t time_us)
+{
+	int video = obj->track_id == session->video_track_id;
+	struct moq_session *peer;
+	struct moq_object out;
+	
+	ast_mutex_lock(&session->lock);
+	peer = session->bridge_peer;
+	if (peer && peer->tap && session->fwd_valid[video]) {
+		out = *obj;
+		out.track_id = video ? peer->video_track_id : peer->track_id;
+		out.sequence = session->fwd_out_sequence[video];
+		moq_tap_write(peer->tap, MOQ_TAP_TX, &out, time_us);
+	}
+	ast_mutex_unlock(&session->lock);
+}
+
+/*
+ * Authenticate and decrypt a received object in place (media thread only).
+ * Once we have the peer's key everything must be sealed with it, so an
+ * unprotected object cannot be slipped in; before that, sealed objects
+ * cannot be read. Returns 1 if the object is usable, 0 if it was dropped.
+ */
+static int moq_open_media_object(struct moq_session *session, struct moq_object *obj)
+{
+	int protected = __atomic_load_n(&session->rx_protected, __ATOMIC_ACQUIRE);
+	int len;
+	
+	if (!protected && !(obj->type & MOQ_OBJ_FLAG_ENCRYPTED)) {
+		return 1;
+	}
+	
+	/* The payload lies in our own receive or reassembly buffer */
+	if (!protected || !(obj->type & MOQ_OBJ_FLAG_ENCRYPTED) ||
+		(len = moq_crypto_open(&session->rx_crypto, obj, (uint8_t *)obj->payload)) < 0) {
+		MOQ_STAT_ADD(&session->stats, rx_auth_failed, 1);
+		ast_debug(3, "MoQ session %s: dropped %s object %llu on track %u\n", session->session_id,
+			protected ? "unauthentic" : "undecryptable", (unsigned long long)obj->sequence,
+			obj->track_id);
+		return 0;
+	}
+	
+	obj->type &= ~MOQ_OBJ_FLAG_ENCRYPTED;
+	obj->payload_len = len;
+	obj->payload_size = len;
+	
+	return 1;
+}
+
+/*
+ * The relay a session goes through is shutting down: stop choosing it, so
+ * the relay thread moves its sessions elsewhere while it still forwards.
+ */
+static void moq_handle_goaway(struct moq_session *session, const uint8_t *msg, size_t msg_len)
+{
+	struct moq_relay *relay;
+	
+	ast_mutex_lock(&moq_lock);
+	relay = &moq_relays.list[session->relay];
+	ast_mutex_unlock(&moq_lock);
+	
+	ast_mutex_lock(&moq_relay_lock);
+	if (!relay->goaway_us) {
+		ast_log(LOG_NOTICE, "MoQ relay %s is going away%s%.*s\n", relay->name,
+			msg_len ? ", successor " : "", (int)msg_len, (const char *)msg);
+	}
+	relay->goaway_us = moq_monotonic_us();
+	ast_mutex_unlock(&moq_relay_lock);
+}
+
+/*
+ * Receive MoQ media object on the audio or video track. The object payload
+ * points into the QUIC receive buffer, or the reassembler for fragmented
+ * objects, and stays valid until the next receive.
+ */
+static int moq_recv_media_object(struct moq_session *session, struct moq_object *obj,
+	uint64_t *rx_us)
+{
+	if (!session || !session->quic_conn) {
+		return -1;
+	}
+	
+	uint8_t msg_type;
+	const uint8_t *msg;
+	size_t msg_len;
+	int forwarded = 0;
+	
+	int ret = moq_quic_recv_message(session->quic_conn, &msg_type, &msg, &msg_len, rx_us);
+	
+	if (ret <= 0) {
+		return ret;
+	}
+	
+	if (msg_type == MOQ_MSG_RECEIVER_REPORT) {
+		moq_handle_receiver_report(session, msg, msg_len);
+		return 0;
+	}
+	
+	if (msg_type == MOQ_MSG_GOAWAY) {
+		moq_handle_goaway(session, msg, msg_len);
+		return 0;
+	}
+	
+	if (msg_type == MOQ_MSG_OBJECT_FRAGMENT) {
+		struct moq_fragment frag;
+		
+		if (moq_wire_decode_fragment(msg, msg_len, &frag) != MOQ_WIRE_OK) {
+			ast_log(LOG_WARNING, "Received invalid MoQ object fragment\n");
+			return -1;
+		}
+		if (frag.track_id != session->track_id && frag.track_id != session->video_track_id) {
+			ast_log(LOG_DEBUG, "Received fragment for different track: %u\n", frag.track_id);
+			return 0;
+		}
+		if (session->bridge_peer && moq_bridge_forward(session,
+			frag.track_id == session->video_track_id, frag.sequence, msg, msg_len)) {
+			/* Relayed as is; only a tap still needs the whole object */
+			if (!session->tap && !session->bridge_tapped) {
+				return 0;
+			}
+			forwarded = 1;
+		}
+		ret = moq_reasm_add(&session->reasm, &frag, moq_monotonic_us(), obj);
+		MOQ_STAT_SET(&session->stats, reasm_evicted, session->reasm.evicted);
+		if (ret <= 0) {
+			return ret;
+		}
+	} else if (msg_type != MOQ_MSG_OBJECT) {
+		ast_log(LOG_DEBUG, "Received non-media MoQ message type: %d\n", msg_type);
+		return 0;
+	} else if (moq_wire_decode_object(msg, msg_len, obj) != MOQ_WIRE_OK) {
+		ast_log(LOG_WARNING, "Received incomplete MoQ media object\n");
+		return -1;
+	}
+	
+	if (obj->track_id == session->video_track_id) {
+		MOQ_STAT_ADD(&session->stats, video_rx_objects, 1);
+		if (forwarded || (msg_type == MOQ_MSG_OBJECT && session->bridge_peer &&
+			moq_bridge_forward(session, 1, obj->sequence, msg, msg_len))) {
+			moq_tap_write(session->tap, MOQ_TAP_RX, obj, *rx_us);
+			if (session->bridge_tapped) {
+				moq_bridge_tap(session, obj, *rx_us);
+			}
+			return 0;
+		}
+		if (!moq_open_media_object(session, obj)) {
+			return 0;
+		}
+		moq_tap_write(session->tap, MOQ_TAP_RX, obj, *rx_us);
+		return 1;
+	}
+	
+	if (obj->track_id != session->track_id) {
+		ast_log(LOG_DEBUG, "Received media for different track: %u\n", obj->track_id);
+		return 0;
+	}
+	
+	/* Forged objects must not move the sequence and jitter state */
+	if (!moq_open_media_object(session, obj)) {
+		return 0;
+	}
+	
+	moq_stats_rx_object(session, obj);
+	moq_tap_write(session->tap, MOQ_TAP_RX, obj, *rx_us);
+	
+	if (forwarded || (msg_type == MOQ_MSG_OBJECT && session->bridge_peer &&
+		moq_bridge_forward(session, 0, obj->sequence, msg, msg_len))) {
+		if (session->bridge_tapped) {
+			moq_bridge_tap(session, obj, *rx_us);
+		}
+		return 0;
+	}
+	
+	if (obj->payload_size != obj->payload_len) {
+		ast_log(LOG_WARNING, "MoQ payload size mismatch: expected %u, got %zu\n",
+			obj->payload_size, obj->payload_len);
+	}
+	
+	return 1;
+}
+
+/* Send WebSocket message */
+static int moq_ws_send_message(struct lws *wsi, const char *message)
+{
+	size_t len = strlen(message);
+	unsigned char *buf;
+
+	/* Outbound sessions have no connection of their own, and a closed one is cleared */
+	if (!wsi) {
+		return -1;
+	}
+
+	buf = ast_malloc(LWS_PRE + len);
+	if (!buf) {
+		return -1;
+	}
+
+	memcpy(&buf[LWS_PRE], message, len);
+	int written = lws_write(wsi, &buf[LWS_PRE], len, LWS_WRITE_TEXT);
+	ast_free(buf);
+
+	return (written < 0) ? -1 : 0;
+}
+
+/* Offer the key we seal our media with, if protection is enabled for this call */
+static void moq_add_media_key(struct moq_session *session, struct json_object *jobj)
+{
+	char key[MOQ_CRYPTO_KEY_MAX * 4 / 3 + 4];
+	
+	if (!session->tx_key_len) {
+		return;
+	}
+	
+	ast_base64encode(key, session->tx_key, session->tx_key_len, sizeof(key));
+	json_object_object_add(jobj, "media_key", json_object_new_string(key));
+	json_object_object_add(jobj, "media_cipher",
+		json_object_new_string(moq_cipher_name(session->tx_cipher)));
+}
+
+/* Tell the user which relay tracks carry the call, so it can send and subscribe */
+static void moq_add_media_tracks(struct moq_session *session, struct json_object *jobj)
+{
+	json_object_object_add(jobj, "track_id", json_object_new_int64(session->track_id));
+	json_object_object_add(jobj, "video_track_id", json_object_new_int64(session->video_track_id));
+}
+
+/*
+ * Take the key the peer seals its media with from a signaling message. From
+ * then on we only accept media sealed with it, and seal ours, since the peer
+ * only sends a key when it has ours too. A session is keyed once per call.
+ */
+static void moq_set_peer_key(struct moq_session *session, struct json_object *jobj)
+{
+	struct json_object *key_obj = json_object_object_get(jobj, "media_key");
+	struct json_object *cipher_obj = json_object_object_get(jobj, "media_cipher");
+	uint8_t key[MOQ_CRYPTO_KEY_MAX + 1];
+	int cipher, len;
+	
+	if (!session->tx_key_len || !key_obj ||
+		__atomic_load_n(&session->rx_protected, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+	
+	cipher = cipher_obj ? moq_cipher_from_name(json_object_get_string(cipher_obj)) : MOQ_CIPHER_AES_128_GCM;
+	len = ast_base64decode(key, json_object_get_string(key_obj), sizeof(key));
+	if (cipher < 0 || len != (int)moq_crypto_key_size(cipher) ||
+		moq_crypto_init(&session->rx_crypto, cipher, key, 0)) {
+		ast_log(LOG_WARNING, "MoQ session %s: unusable media key from peer, media is not protected\n",
+			session->session_id);
+		return;
+	}
+	session->rx_cipher = cipher;
+	memcpy(session->rx_key, key, len);
+	session->rx_key_len = len;
+	memset(key, 0, sizeof(key));
+	
+	__atomic_store_n(&session->rx_protected, 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&session->tx_protected, 1, __ATOMIC_RELEASE);
+	ast_debug(1, "MoQ session %s: media protected, tx %s, rx %s\n", session->session_id,
+		moq_cipher_name(session->tx_cipher), moq_cipher_name(cipher));
+}
+
+/* Offer a call to the user it is routed to, as the server would */
+static int moq_send_call(struct moq_session *session, const char *from)
+{
+	struct json_object *jobj = json_object_new_object();
+	json_object_object_add(jobj, "type", json_object_new_string("incoming_call"));
+	json_object_object_add(jobj, "session_id", json_object_new_string(session->session_id));
+	json_object_object_add(jobj, "from", json_object_new_string(from));
+	moq_add_media_tracks(session, jobj);
+	moq_add_media_key(session, jobj);
+	
+	const char *msg = json_object_to_json_string(jobj);
+	int ret = moq_ws_send_message(session->ws, msg);
+	json_object_put(jobj);
+	
+	return ret;
+}
+
+/* Send answer message via WebSocket, in the server's terms if we routed the call */
+static int moq_send_answer(struct moq_session *session)
+{
+	struct json_object *jobj = json_object_new_object();
+	json_object_object_add(jobj, "type", json_object_new_string(session->routed ? "call_answered" : "answer"));
+	json_object_object_add(jobj, "session_id", json_object_new_string(session->session_id));
+	moq_add_media_tracks(session, jobj);
+	moq_add_media_key(session, jobj);
+	
+	const char *msg = json_object_to_json_string(jobj);
+	int ret = moq_ws_send_message(session->ws, msg);
+	json_object_put(jobj);
+	
+	return ret;
+}
+
+/*
+ * Send hangup message via WebSocket. A call we routed is only reported
+ * ended if the other party has not ended it first.
+ */
+static int moq_send_hangup(struct moq_session *session)
+{
+	if (session->routed && moq_registrar_route_remove(&moq_registrar, session->session_id)) {
+		return 0;
+	}
+	
+	struct json_object *jobj = json_object_new_object();
+	json_object_object_add(jobj, "type", json_object_new_string(session->routed ? "call_ended" : "hangup"));
+	json_object_object_add(jobj, "session_id", json_object_new_string(session->session_id));
+	
+	const char *msg = json_object_to_json_string(jobj);
+	int ret = moq_ws_send_message(session->ws, msg);
+	json_object_put(jobj);
+	
+	return ret;
+}
+
+/* Record the call-setup latency of a session on its first media frame (session lock held) */
+static void moq_session_first_frame(struct moq_session *session)
+{
+	int64_t latency = ast_tvdiff_us(ast_tvnow(), session->setup_start);
+	
+	session->first_frame_seen = 1;
+	if (latency < 0) {
+		latency = 0;
+	}
+	
+	ast_mutex_lock(&moq_lock);
+	moq_setup_latency.samples[moq_setup_latency.next] = (unsigned int)latency;
+	moq_setup_latency.next = (moq_setup_latency.next + 1) % MOQ_SETUP_SAMPLES;
+	if (moq_setup_latency.count < MOQ_SETUP_SAMPLES) {
+		moq_setup_latency.count++;
+	}
+	ast_mutex_unlock(&moq_lock);
+	
+	ast_debug(1, "MoQ session %s: first media frame after %lld us\n",
+		session->session_id, (long long)latency);
+}
+
+/*
+ * Copy a ulaw payload dropping (correction < 0) or repeating one sample, at
+ * the point where the waveform changes least so the edit is not audible.
+ * out must have room for len + 1 bytes. Returns the new length.
+ */
+static size_t moq_ulaw_adjust(const uint8_t *in, size_t len, uint8_t *out, int correction)
+{
+	int16_t pcm[MOQ_MAX_PACKET_SIZE];
+	size_t i, pos = 0;
+	int best = INT_MAX;
+	
+	moq_g711_ulaw_decode(in, pcm, len);
+	for (i = 1; i < len; i++) {
+		int delta = abs(pcm[i] - pcm[i - 1]);
+		
+		if (delta < best) {
+			best = delta;
+			pos = i;
+		}
+	}
+	
+	memcpy(out, in, pos);
+	if (correction < 0) {
+		memcpy(out + pos, in + pos + 1, len - pos - 1);
+		return len - 1;
+	}
+	out[pos] = in[pos];
+	memcpy(out + pos + 1, in + pos, len - pos);
+	return len + 1;
+}
+
+/* Queue a received video object to the channel as one video frame (media thread only) */
+static void moq_queue_video_object(struct moq_session *session, const struct moq_object *obj)
+{
+	struct ast_frame frame = { 0, };
+	
+	switch (MOQ_OBJ_TYPE(obj->type)) {
+	case MOQ_OBJ_VIDEO_H264:
+		frame.subclass.format = ast_format_h264;
+		break;
+	case MOQ_OBJ_VIDEO_VP8:
+		frame.subclass.format = ast_format_vp8;
+		break;
+	default:
+		ast_debug(1, "MoQ session %s: unsupported video object type 0x%02x\n",
+			session->session_id, obj->type);
+		return;
+	}
+	
+	frame.frametype = AST_FRAME_VIDEO;
+	frame.subclass.frame_ending = !!(obj->type & MOQ_OBJ_FLAG_FRAME_END);
+	frame.data.ptr = (void *)obj->payload;
+	frame.datalen = obj->payload_len;
+	frame.ts = obj->timestamp * 1000 / MOQ_VIDEO_RATE;
+	frame.seqno = (int)(obj->sequence & 0xffff);
+	ast_set_flag(&frame, AST_FRFLAG_HAS_TIMING_INFO);
+	
+	ast_mutex_lock(&session->lock);
+	if (session->owner) {
+		ast_queue_frame(session->owner, &frame);
+	}
+	ast_mutex_unlock(&session->lock);
+}
+
+/*
+ * A comfort noise object starts or refreshes the peer's silence (media
+ * thread only). Noise is generated locally from the next playout time on;
+ * refreshes only update its level so the generated timeline stays smooth.
+ */
+static void moq_handle_comfort_noise(struct moq_session *session, const struct moq_object *obj)
+{
+	uint64_t now_us = moq_monotonic_us();
+	uint64_t playout;
+	
+	MOQ_STAT_ADD(&session->stats, rx_cn, 1);
+	moq_cn_set_level(&session->cn, obj->payload_len ? obj->payload[0] : 127);
+	
+	/* Keeps the drift estimate going; corrections wait for speech, which has samples to correct */
+	moq_clock_rx_observe(&session->rx_clock, now_us, obj->timestamp, &playout);
+	
+	if (!session->cn_active) {
+		session->cn_active = 1;
+		session->cn_playout = playout;
+		session->cn_next_us = now_us;
+		ast_debug(3, "MoQ session %s: peer silent, comfort noise at -%u dBov\n",
+			session->session_id, (unsigned int)session->cn.level);
+	}
+}
+
+/*
+ * Play out comfort noise frames that have fallen due while the peer is
+ * silent (media thread only). Returns microseconds until the next one.
+ */
+static uint64_t moq_queue_comfort_noise(struct moq_session *session, uint64_t now_us)
+{
+	uint8_t noise[MOQ_CN_FRAME_SAMPLES];
+	struct ast_frame frame;
+	
+	/* After a stall, resume from now rather than catching up with a burst */
+	if (now_us > session->cn_next_us + 5 * MOQ_CN_FRAME_SAMPLES * 1000000ULL / MOQ_SAMPLE_RATE) {
+		session->cn_next_us = now_us;
+	}
+	
+	while (session->cn_next_us <= now_us) {
+		moq_cn_generate(&session->cn, noise, sizeof(noise));
+		
+		memset(&frame, 0, sizeof(frame));
+		frame.frametype = AST_FRAME_VOICE;
+		frame.subclass.format = ast_format_ulaw;
+		frame.data.ptr = noise;
+		frame.datalen = sizeof(noise);
+		frame.samples = sizeof(noise);
+		frame.ts = session->cn_playout * 1000 / MOQ_SAMPLE_RATE;
+		frame.len = frame.samples * 1000 / MOQ_SAMPLE_RATE;
+		ast_set_flag(&frame, AST_FRFLAG_HAS_TIMING_INFO);
+		
+		ast_mutex_lock(&session->lock);
+		if (session->owner) {
+			ast_queue_frame(session->owner, &frame);
+		}
+		ast_mutex_unlock(&session->lock);
+		
+		MOQ_STAT_ADD(&session->stats, cn_generated, 1);
+		session->cn_playout += MOQ_CN_FRAME_SAMPLES;
+		session->cn_next_us += MOQ_CN_FRAME_SAMPLES * 1000000ULL / MOQ_SAMPLE_RATE;
+	}
+	
+	return session->cn_next_us - now_us;
+}
+
+/* Media thread - handles MoQ media transport */
+static void *moq_media_thread(void *data)
+{
+	struct moq_session *session = data;
+	unsigned char buffer[MOQ_MAX_PACKET_SIZE];
+	struct ast_frame frame;
+	struct moq_object obj;
+	uint64_t rx_us;
+	
+	for (;;) {
+		/* Park until the session is activated by a call, or torn down */
+		ast_mutex_lock(&session->lock);
+		session->parked = 1;
+		ast_cond_broadcast(&session->cond);
+		while (!session->running && !session->shutdown) {
+			ast_cond_wait(&session->cond, &session->lock);
+		}
+		session->parked = 0;
+		if (session->shutdown) {
+			ast_mutex_unlock(&session->lock);
+			break;
+		}
+		ast_mutex_unlock(&session->lock);
+		
+		ast_log(LOG_NOTICE, "MoQ media thread started for session %s\n", session->session_id);
+		
+		session->rr_next_us = moq_monotonic_us() + moq_config.rr_interval * 1000ULL;
+		
+		while (session->running) {
+			fd_set fds;
+			struct timeval tv = {0, 20000}; /* 20ms timeout for low latency */
+			
+			if (session->quic_conn && session->quic_conn->socket_fd >= 0) {
+				/* Periodic receiver report, piggybacking on the select timeout */
+				if (moq_config.rr_interval &&
+					__atomic_load_n(&session->quic_conn->connected, __ATOMIC_ACQUIRE)) {
+					uint64_t now_us = moq_monotonic_us();
+					
+					if (now_us >= session->rr_next_us) {
+						moq_send_receiver_report(session, now_us);
+						session->rr_next_us = now_us + moq_config.rr_interval * 1000ULL;
+					}
+				}
+				
+				/* Give up on fragmented objects that will never complete */
+				if (session->reasm.used) {
+					moq_reasm_expire(&session->reasm, moq_monotonic_us());
+					MOQ_STAT_SET(&session->stats, reasm_timeouts, session->reasm.timed_out);
+				}
+				
+				/* Fill the peer's silence, waking up in time for the next noise frame */
+				if (session->cn_active) {
+					uint64_t wait_us = moq_queue_comfort_noise(session, moq_monotonic_us());
+					
+					if (wait_us < (uint64_t)tv.tv_usec) {
+						tv.tv_usec = wait_us;
+					}
+				}
+				
+				int max_fd = session->quic_conn->socket_fd;
+				
+				FD_ZERO(&fds);
+				FD_SET(session->quic_conn->socket_fd, &fds);
+				if (session->quic_conn->xdp) {
+					int xdp_fd = moq_xdp_chan_fd(session->quic_conn->xdp);
+					
+					FD_SET(xdp_fd, &fds);
+					if (xdp_fd > max_fd) {
+						max_fd = xdp_fd;
+					}
+				}
+				
+				int ret = select(max_fd + 1, &fds, NULL, NULL, &tv);
+				if (ret > 0) {
+					/* Handle the whole batch of datagrams read after one wakeup */
+					do {
+						ret = moq_recv_media_object(session, &obj, &rx_us);
+						
+						if (ret > 0 && obj.track_id == session->video_track_id) {
+							moq_queue_video_object(session, &obj);
+						} else if (ret > 0 && MOQ_OBJ_TYPE(obj.type) == MOQ_OBJ_AUDIO_CN) {
+							moq_handle_comfort_noise(session, &obj);
+						} else if (ret > 0 && obj.payload_len > 0 && session->owner) {
+							struct timeval parsed = ast_tvnow();
+							uint64_t parsed_us = (uint64_t)parsed.tv_sec * 1000000 + parsed.tv_usec;
+							uint64_t rx_to_parse = parsed_us > rx_us ? parsed_us - rx_us : 0;
+							uint64_t queue_start = moq_monotonic_us();
+							uint64_t playout;
+							int correction;
+							
+							moq_hist_record(&moq_latency[MOQ_LAT_RX_PARSE], rx_to_parse);
+							MOQ_TRACE4(frame_received, session->session_id, obj.sequence,
+								obj.payload_len, rx_to_parse);
+							
+							/* Speech resumed */
+							session->cn_active = 0;
+							MOQ_STAT_SET(&session->stats, rx_level,
+								(int64_t)moq_vad_level(obj.payload, obj.payload_len));
+							
+							/* Queue frame to Asterisk straight from the receive buffer */
+							memset(&frame, 0, sizeof(frame));
+							frame.frametype = AST_FRAME_VOICE;
+							frame.subclass.format = ast_format_ulaw;
+							frame.data.ptr = (void *)obj.payload;
+							frame.datalen = obj.payload_len;
+							
+							/*
+							 * Compensate clock drift by one sample, copying only when needed. A
+							 * frame too short or too long to adjust leaves the correction due
+							 * for the next one.
+							 */
+							if (obj.payload_len > 1 && obj.payload_len < sizeof(buffer)) {
+								correction = moq_clock_rx_update(&session->rx_clock, queue_start,
+									obj.timestamp, &playout);
+							} else {
+								moq_clock_rx_observe(&session->rx_clock, queue_start,
+									obj.timestamp, &playout);
+								correction = 0;
+							}
+							if (correction) {
+								frame.data.ptr = buffer;
+								frame.datalen = moq_ulaw_adjust(obj.payload, obj.payload_len,
+									buffer, correction);
+								MOQ_STAT_SET(&session->stats, samples_stretched, session->rx_clock.stretched);
+								MOQ_STAT_SET(&session->stats, samples_dropped, session->rx_clock.dropped);
+							}
+							MOQ_STAT_SET(&session->stats, clock_skew, (int64_t)session->rx_clock.skew_ppm);
+							
+							/* Timing for the jitterbuffer, on our side of the drift compensation */
+							frame.samples = frame.datalen;
+							frame.ts = playout * 1000 / MOQ_SAMPLE_RATE;
+							frame.len = frame.samples * 1000 / MOQ_SAMPLE_RATE;
+							frame.seqno = (int)(obj.sequence & 0xffff);
+							ast_set_flag(&frame, AST_FRFLAG_HAS_TIMING_INFO);
+							
+							ast_mutex_lock(&session->lock);
+							if (session->owner) {
+								ast_queue_frame(session->owner, &frame);
+								if (!session->first_frame_seen) {
+									moq_session_first_frame(session);
+								}
+							}
+							ast_mutex_unlock(&session->lock);
+							
+							uint64_t queue_us = moq_monotonic_us() - queue_start;
+							moq_hist_record(&moq_latency[MOQ_LAT_PARSE_QUEUE], queue_us);
+							MOQ_TRACE3(frame_queued, session->session_id, obj.sequence, queue_us);
+						}
+					} while (moq_quic_recv_pending(session->quic_conn));
+				}
+			} else {
+				/* Fallback to UDP if QUIC not available */
+				FD_ZERO(&fds);
+				FD_SET(session->media_socket, &fds);
+				
+				int ret = select(session->media_socket + 1, &fds, NULL, NULL, &tv);
+				if (ret > 0 && FD_ISSET(session->media_socket, &fds)) {
+					struct sockaddr_in from;
+					socklen_t fromlen = sizeof(from);
+					
+					ssize_t received = recvfrom(session->media_socket, buffer, 
+						sizeof(buffer), 0, (struct sockaddr *)&from, &fromlen);
+					
+					if (received > 0) {
+						MOQ_STAT_ADD(&session->stats, rx_packets, 1);
+						MOQ_STAT_ADD(&session->stats, rx_bytes, received);
+					}
+					
+					if (received > 0 && session->owner) {
+						memset(&frame, 0, sizeof(frame));
+						frame.frametype = AST_FRAME_VOICE;
+						frame.subclass.format = ast_format_ulaw;
+						frame.data.ptr = buffer;
+						frame.datalen = received;
+						frame.samples = received;
+						
+						ast_mutex_lock(&session->lock);
+						if (session->owner) {
+							ast_queue_frame(session->owner, &frame);
+							if (!session->first_frame_seen) {
+								moq_session_first_frame(session);
+							}
+						}
+						ast_mutex_unlock(&session->lock);
+					}
+				}
+			}
+		}
+		
+		ast_log(LOG_NOTICE, "MoQ media thread stopped for session %s\n", session->session_id);
+	}
+	
+	return NULL;
+}
+
+/*
+ * Release every resource held by a session once the last reference goes,
+ * including its media thread, which by then is parked and exits at once.
+ */
+static void moq_session_destructor(void *obj)
+{
+	struct moq_session *session = obj;
+	
+	if (session->media_thread != AST_PTHREADT_NULL) {
+		ast_mutex_lock(&session->lock);
+		session->shutdown = 1;
+		ast_cond_broadcast(&session->cond);
+		ast_mutex_unlock(&session->lock);
+		pthread_join(session->media_thread, NULL);
+	}
+	
+	if (session->quic_conn) {
+		moq_quic_destroy(session->quic_conn);
+	}
+	
+	if (session->media_socket >= 0) {
+		close(session->media_socket);
+	}
+	
+	moq_reasm_clear(&session->reasm);
+	moq_crypto_destroy(&session->tx_crypto);
+	moq_crypto_destroy(&session->rx_crypto);
+	if (session->tx_scratch) {
+		ast_free(session->tx_scratch);
+	}
+	ast_cond_destroy(&session->cond);
+	ast_mutex_destroy(&session->lock);
+}
+
+/*
+ * Allocate a session with everything that is expensive to set up: sockets,
+ * transport buffers and a parked media thread. Per-call state is filled in
+ * by moq_session_new(). Sessions are reference counted: the pool, the
+ * active list and the channel each hold one, and the media thread runs on
+ * the channel's, which the reaper takes over when the call ends.
+ */
+static struct moq_session *moq_session_alloc(void)
+{
+	struct moq_session *session = ao2_alloc_options(sizeof(*session), moq_session_destructor,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!session) {
+		return NULL;
 	}
 	
-	generate_session_id(session->session_id, sizeof(session->session_id));
-	ast_copy_string(session->remote_id, dest, sizeof(session->remote_id));
-	session->state = MOQ_STATE_DOWN;
 	ast_mutex_init(&session->lock);
+	ast_cond_init(&session->cond, NULL);
+	session->media_thread = AST_PTHREADT_NULL;
+	session->media_socket = -1;
+	moq_reasm_init(&session->reasm, MOQ_MAX_OBJECT_SIZE, MOQ_REASM_BUDGET, MOQ_REASM_TIMEOUT_US);
+	
+	/* Create QUIC connection for MoQ transport */
+	session->quic_conn = moq_quic_create();
+	if (!session->quic_conn) {
+		ast_log(LOG_WARNING, "Failed to create QUIC connection, using UDP fallback\n");
+	}
+	
+	/* Create fallback UDP socket */
+	session->media_socket = socket(AF_INET, SOCK_DGRAM, 0);
+	if (session->media_socket < 0) {
+		ast_log(LOG_ERROR, "Failed to create media socket\n");
+		ao2_ref(session, -1);
+		return NULL;
+	}
+	
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = INADDR_ANY;
+	addr.sin_port = 0; /* Let kernel assign port */
+	
+	if (bind(session->media_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		ast_log(LOG_ERROR, "Failed to bind media socket\n");
+		ao2_ref(session, -1);
+		return NULL;
+	}
+	
+	/* Start the media thread parked, so call setup only has to wake it */
+	if (pthread_create(&session->media_thread, NULL, moq_media_thread, session)) {
+		ast_log(LOG_ERROR, "Failed to create media thread\n");
+		session->media_thread = AST_PTHREADT_NULL;
+		ao2_ref(session, -1);
+		return NULL;
+	}
+	
+	return session;
+}
+
+/* Discard anything still queued on a socket from a previous call */
+static void moq_drain_socket(int fd)
+{
+	unsigned char scratch[MOQ_MAX_PACKET_SIZE];
+	
+	if (fd < 0) {
+		return;
+	}
+	
+	while (recv(fd, scratch, sizeof(scratch), MSG_DONTWAIT) > 0) {
+		/* Keep draining */
+	}
+}
+
+/* Return a stopped session to the pool; returns 0 if the pool took it */
+static int moq_pool_release(struct moq_session *session)
+{
+	ast_mutex_lock(&moq_pool_lock);
+	if (!moq_pool.running || moq_pool.count >= moq_config.pool_size) {
+		ast_mutex_unlock(&moq_pool_lock);
+		return -1;
+	}
+	ast_mutex_unlock(&moq_pool_lock);
+	
+	/* Reset per-call state outside the pool lock */
+	moq_drain_socket(session->media_socket);
+	if (session->quic_conn) {
+		moq_drain_socket(session->quic_conn->socket_fd);
+		if (session->quic_conn->xdp) {
+			moq_xdp_chan_drain(session->quic_conn->xdp);
+		}
+		session->quic_conn->recv_count = 0;
+		session->quic_conn->recv_next = 0;
+		session->quic_conn->recv_xdp = 0;
+		session->quic_conn->connected = 0;
+		session->quic_conn->connection_id = (uint32_t)ast_random();
+	}
+	moq_reasm_clear(&session->reasm);
+	
+	/* No key outlives its call, even in an idle session */
+	__atomic_store_n(&session->tx_protected, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&session->rx_protected, 0, __ATOMIC_RELAXED);
+	moq_crypto_clear(&session->tx_crypto);
+	moq_crypto_clear(&session->rx_crypto);
+	memset(session->tx_key, 0, sizeof(session->tx_key));
+	memset(session->rx_key, 0, sizeof(session->rx_key));
+	session->tx_key_len = 0;
+	session->rx_key_len = 0;
+	
+	session->owner = NULL;
+	session->ws = NULL;
+	session->state = MOQ_STATE_DOWN;
+	memset(&session->media_addr, 0, sizeof(session->media_addr));
+	
+	ast_mutex_lock(&moq_pool_lock);
+	if (!moq_pool.running || moq_pool.count >= moq_config.pool_size) {
+		ast_mutex_unlock(&moq_pool_lock);
+		return -1;
+	}
+	AST_LIST_INSERT_HEAD(&moq_pool.idle, session, pool_entry);
+	moq_pool.count++;
+	ast_mutex_unlock(&moq_pool_lock);
+	
+	return 0;
+}
+
+/* Pool refill thread - keeps pre-warmed sessions above the low-water mark */
+static void *moq_pool_thread(void *data)
+{
+	ast_mutex_lock(&moq_pool_lock);
+	while (moq_pool.running) {
+		int failed = 0;
+		
+		while (moq_pool.running && moq_pool.count < moq_config.pool_size) {
+			struct moq_session *session;
+			
+			ast_mutex_unlock(&moq_pool_lock);
+			session = moq_session_alloc();
+			ast_mutex_lock(&moq_pool_lock);
+			
+			if (!session) {
+				failed = 1;
+				break;
+			}
+			if (!moq_pool.running) {
+				ast_mutex_unlock(&moq_pool_lock);
+				ao2_ref(session, -1);
+				ast_mutex_lock(&moq_pool_lock);
+				break;
+			}
+			AST_LIST_INSERT_TAIL(&moq_pool.idle, session, pool_entry);
+			moq_pool.count++;
+		}
+		
+		if (failed) {
+			/* Back off before retrying after an allocation failure */
+			struct timeval tv = ast_tvadd(ast_tvnow(), ast_tv(1, 0));
+			struct timespec ts = { .tv_sec = tv.tv_sec, .tv_nsec = tv.tv_usec * 1000 };
+			
+			ast_cond_timedwait(&moq_pool.cond, &moq_pool_lock, &ts);
+			continue;
+		}
+		
+		while (moq_pool.running && moq_pool.count >= moq_config.pool_low_water) {
+			ast_cond_wait(&moq_pool.cond, &moq_pool_lock);
+		}
+	}
+	ast_mutex_unlock(&moq_pool_lock);
+	
+	return NULL;
+}
+
+/* Start the refill thread; the pool fills in the background */
+static int moq_pool_start(void)
+{
+	AST_LIST_HEAD_INIT_NOLOCK(&moq_pool.idle);
+	moq_pool.count = 0;
+	moq_pool.hits = 0;
+	moq_pool.misses = 0;
+	ast_cond_init(&moq_pool.cond, NULL);
+	moq_pool.running = 1;
+	
+	if (ast_pthread_create_background(&moq_pool.thread, NULL, moq_pool_thread, NULL)) {
+		ast_log(LOG_ERROR, "Failed to create session pool thread\n");
+		moq_pool.running = 0;
+		moq_pool.thread = AST_PTHREADT_NULL;
+		ast_cond_destroy(&moq_pool.cond);
+		return -1;
+	}
+	
+	return 0;
+}
+
+/* Stop the refill thread and free all pooled sessions */
+static void moq_pool_stop(void)
+{
+	struct moq_session *session;
+	
+	if (moq_pool.thread == AST_PTHREADT_NULL) {
+		return;
+	}
+	
+	ast_mutex_lock(&moq_pool_lock);
+	moq_pool.running = 0;
+	ast_cond_broadcast(&moq_pool.cond);
+	ast_mutex_unlock(&moq_pool_lock);
+	pthread_join(moq_pool.thread, NULL);
+	moq_pool.thread = AST_PTHREADT_NULL;
+	
+	while ((session = AST_LIST_REMOVE_HEAD(&moq_pool.idle, pool_entry))) {
+		moq_pool.count--;
+		ao2_ref(session, -1);
+	}
+	
+	ast_cond_destroy(&moq_pool.cond);
+}
+
+/* Wake a session's parked media thread */
+static int moq_session_start_media(struct moq_session *session)
+{
+	if (session->media_thread == AST_PTHREADT_NULL) {
+		return -1;
+	}
+	
+	ast_mutex_lock(&session->lock);
+	session->running = 1;
+	ast_cond_broadcast(&session->cond);
+	ast_mutex_unlock(&session->lock);
+	
+	return 0;
+}
+
+/* Parse a relay given as host:port (IPv4, port defaults to MOQ_QUIC_PORT) */
+static int moq_relay_parse(const char *value, struct moq_relay *relay)
+{
+	char host[64];
+	char *colon;
+	int port = MOQ_QUIC_PORT;
+	
+	ast_copy_string(host, value, sizeof(host));
+	colon = strrchr(host, ':');
+	if (colon) {
+		*colon = '\0';
+		port = atoi(colon + 1);
+	}
+	
+	memset(relay, 0, sizeof(*relay));
+	relay->addr.sin_family = AF_INET;
+	relay->addr.sin_port = htons(port);
+	if (port <= 0 || port > 65535 || inet_pton(AF_INET, host, &relay->addr.sin_addr) <= 0) {
+		return -1;
+	}
+	snprintf(relay->name, sizeof(relay->name), "%s:%d", host, port);
+	
+	return 0;
+}
+
+/*
+ * Relay for a new session: the healthy one with the lowest RTT or, when none
+ * is known to be healthy, the first configured (relay lock held).
+ */
+static int moq_relay_best(int fallback)
+{
+	int i, best = -1;
+	
+	for (i = 0; i < moq_relays.count; i++) {
+		if (moq_relays.list[i].healthy &&
+			(best < 0 || moq_relays.list[i].srtt < moq_relays.list[best].srtt)) {
+			best = i;
+		}
+	}
+	
+	return best < 0 ? fallback : best;
+}
+
+/*
+ * Move a session's transport to a relay, announcing its tracks there so the
+ * relay can start delivering to the new address at once (moq_lock held, or
+ * the session not yet listed).
+ */
+static int moq_session_use_relay(struct moq_session *session, int relay)
+{
+	uint32_t tracks[2] = { htonl(session->track_id), htonl(session->video_track_id) };
+	uint8_t buf[MOQ_WIRE_MSG_HEADER_SIZE + sizeof(tracks)];
+	int len;
+	
+	if (!session->quic_conn || moq_quic_set_peer(session->quic_conn, &moq_relays.list[relay].addr)) {
+		return -1;
+	}
+	session->relay = relay;
+	
+	len = moq_wire_encode_message(buf, sizeof(buf), MOQ_MSG_ANNOUNCE,
+		(const uint8_t *)tracks, sizeof(tracks));
+	if (len > 0) {
+		moq_quic_send_datagram(session->quic_conn, buf, len);
+	}
+	
+	return 0;
+}
+
+/*
+ * Move sessions off relays that are not healthy, onto the best one that is.
+ * Sessions stay put when no relay is healthy, as there is nowhere better.
+ */
+static void moq_relay_failover(void)
+{
+	struct moq_session *session;
+	int target;
+	
+	ast_mutex_lock(&moq_lock);
+	AST_LIST_TRAVERSE(&moq_sessions, session, list_entry) {
+		int from = session->relay;
+		int stay;
+		
+		ast_mutex_lock(&moq_relay_lock);
+		target = moq_relay_best(-1);
+		stay = moq_relays.list[from].healthy;
+		ast_mutex_unlock(&moq_relay_lock);
+		if (target < 0) {
+			break;
+		}
+		if (stay || target == from || !session->quic_conn) {
+			continue;
+		}
+		
+		if (!moq_session_use_relay(session, target)) {
+			ast_log(LOG_NOTICE, "MoQ session %s failed over from relay %s to %s\n",
+				session->session_id, moq_relays.list[from].name, moq_relays.list[target].name);
+			ast_mutex_lock(&moq_relay_lock);
+			moq_relays.list[from].failovers++;
+			ast_mutex_unlock(&moq_relay_lock);
+		}
+	}
+	ast_mutex_unlock(&moq_lock);
+}
+
+/* Probe every relay once (relay thread only) */
+static void moq_relay_send_probes(uint64_t now_us)
+{
+	uint8_t buf[MOQ_WIRE_MSG_HEADER_SIZE + MOQ_WIRE_PROBE_SIZE];
+	struct moq_probe probe = {
+		.sent_us = (uint32_t)now_us,
+	};
+	int i, len;
+	
+	moq_relays.probe_seq++;
+	for (i = 0; i < moq_relays.count; i++) {
+		/* The relay index rides in the top byte, so a reply is matched without a lookup */
+		probe.probe_id = ((uint32_t)i << 24) | (moq_relays.probe_seq & 0xffffff);
+		len = moq_wire_encode_probe(buf, sizeof(buf), MOQ_MSG_PING, &probe);
+		if (len > 0 && sendto(moq_relays.fd, buf, len, 0,
+			(const struct sockaddr *)&moq_relays.list[i].addr, sizeof(moq_relays.list[i].addr)) == len) {
+			ast_mutex_lock(&moq_relay_lock);
+			moq_relays.list[i].probes++;
+			ast_mutex_unlock(&moq_relay_lock);
+		}
+	}
+}
+
+/* Take in the replies waiting on the probe socket (relay thread only) */
+static void moq_relay_recv_probes(void)
+{
+	uint8_t buf[MOQ_MAX_PACKET_SIZE];
+	struct sockaddr_in from;
+	socklen_t fromlen = sizeof(from);
+	struct moq_probe probe;
+	const uint8_t *msg;
+	size_t msg_len;
+	uint8_t type;
+	ssize_t received;
+	
+	while ((received = recvfrom(moq_relays.fd, buf, sizeof(buf), MSG_DONTWAIT,
+		(struct sockaddr *)&from, &fromlen)) > 0) {
+		uint64_t now_us = moq_monotonic_us();
+		struct moq_relay *relay;
+		uint32_t rtt;
+		unsigned int i;
+		
+		fromlen = sizeof(from);
+		if (moq_wire_decode_message(buf, received, &type, &msg, &msg_len) != MOQ_WIRE_OK ||
+			type != MOQ_MSG_PONG || moq_wire_decode_probe(msg, msg_len, &probe) != MOQ_WIRE_OK) {
+			continue;
+		}
+		
+		i = probe.probe_id >> 24;
+		if (i >= (unsigned int)moq_relays.count) {
+			continue;
+		}
+		relay = &moq_relays.list[i];
+		if (from.sin_addr.s_addr != relay->addr.sin_addr.s_addr || from.sin_port != relay->addr.sin_port) {
+			continue;
+		}
+		
+		rtt = (uint32_t)now_us - probe.sent_us;
+		if (rtt > MOQ_MAX_RTT_US) {
+			continue;
+		}
+		
+		ast_mutex_lock(&moq_relay_lock);
+		relay->srtt = relay->srtt ? relay->srtt + ((double)rtt - relay->srtt) / 8.0 : (rtt ? rtt : 1);
+		relay->last_reply_us = now_us;
+		relay->replies++;
+		ast_mutex_unlock(&moq_relay_lock);
+	}
+}
+
+/* Mark relays up or down by how recently they replied; returns 1 if any is down */
+static int moq_relay_update_health(uint64_t now_us)
+{
+	int i, down = 0;
+	
+	ast_mutex_lock(&moq_relay_lock);
+	for (i = 0; i < moq_relays.count; i++) {
+		struct moq_relay *relay = &moq_relays.list[i];
+		int replied = relay->last_reply_us &&
+			now_us - relay->last_reply_us <= moq_config.relay_timeout * 1000ULL;
+		int healthy;
+		
+		/* A relay that sent GOAWAY is welcome again once it has restarted, or after a while */
+		if (relay->goaway_us && (!replied || now_us - relay->goaway_us > MOQ_RELAY_GOAWAY_US)) {
+			relay->goaway_us = 0;
+		}
+		healthy = replied && !relay->goaway_us;
+		
+		if (healthy && !relay->healthy) {
+			ast_log(LOG_NOTICE, "MoQ relay %s is up (rtt %.0f us)\n", relay->name, relay->srtt);
+		} else if (!replied && relay->srtt) {
+			ast_log(LOG_WARNING, "MoQ relay %s stopped responding\n", relay->name);
+			/* Start over when it comes back rather than trusting an old RTT */
+			relay->srtt = 0;
+		}
+		relay->healthy = healthy;
+		down |= !healthy;
+	}
+	ast_mutex_unlock(&moq_relay_lock);
+	
+	return down;
+}
+
+/* Relay prober: RTT probes every relay_probe_interval, failing sessions over as relays go down */
+static void *moq_relay_thread(void *data)
+{
+	uint64_t next_us = 0;
+	
+	while (moq_relays.running) {
+		uint64_t now_us = moq_monotonic_us();
+		struct timeval tv = {0, 100000};
+		fd_set fds;
+		
+		if (now_us >= next_us) {
+			if (moq_relay_update_health(now_us)) {
+				moq_relay_failover();
+			}
+			moq_relay_send_probes(now_us);
+			next_us = now_us + moq_config.relay_probe_interval * 1000ULL;
+		}
+		if (next_us - now_us < (uint64_t)tv.tv_usec) {
+			tv.tv_usec = next_us - now_us;
+		}
+		
+		FD_ZERO(&fds);
+		FD_SET(moq_relays.fd, &fds);
+		if (select(moq_relays.fd + 1, &fds, NULL, NULL, &tv) > 0) {
+			moq_relay_recv_probes();
+		}
+	}
+	
+	return NULL;
+}
+
+/* Start probing relays; with probing disabled, sessions always use the first one */
+static int moq_relay_start(void)
+{
+	moq_relays.fd = -1;
+	moq_relays.thread = AST_PTHREADT_NULL;
+	if (!moq_config.relay_probe_interval) {
+		return 0;
+	}
+	
+	moq_relays.fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (moq_relays.fd < 0) {
+		ast_log(LOG_ERROR, "Failed to create MoQ relay probe socket: %s\n", strerror(errno));
+		return -1;
+	}
+	
+	moq_relays.running = 1;
+	if (ast_pthread_create_background(&moq_relays.thread, NULL, moq_relay_thread, NULL)) {
+		ast_log(LOG_ERROR, "Failed to create MoQ relay probe thread\n");
+		moq_relays.running = 0;
+		moq_relays.thread = AST_PTHREADT_NULL;
+		close(moq_relays.fd);
+		moq_relays.fd = -1;
+		return -1;
+	}
+	
+	return 0;
+}
+
+static void moq_relay_stop(void)
+{
+	if (moq_relays.thread != AST_PTHREADT_NULL) {
+		moq_relays.running = 0;
+		pthread_join(moq_relays.thread, NULL);
+		moq_relays.thread = AST_PTHREADT_NULL;
+	}
+	if (moq_relays.fd >= 0) {
+		close(moq_relays.fd);
+		moq_relays.fd = -1;
+	}
+}
+
+/* Pick the key this session seals its media with; it is offered to the peer in signaling */
+static int moq_session_new_key(struct moq_session *session, enum moq_cipher cipher)
+{
+	session->tx_cipher = cipher;
+	if (moq_crypto_generate(cipher, session->tx_key) ||
+		moq_crypto_init(&session->tx_crypto, cipher, session->tx_key, 1)) {
+		ast_log(LOG_WARNING, "Failed to set up MoQ media encryption, media will not be protected\n");
+		return -1;
+	}
+	session->tx_key_len = moq_crypto_key_size(cipher);
+	
+	return 0;
+}
+
+/* Create new MoQ session, taking a pre-warmed one from the pool when available */
+static struct moq_session *moq_session_new(const char *dest)
+{
+	struct moq_session *session;
+	int relay;
+	
+	ast_mutex_lock(&moq_pool_lock);
+	session = AST_LIST_REMOVE_HEAD(&moq_pool.idle, pool_entry);
+	if (session) {
+		moq_pool.count--;
+		moq_pool.hits++;
+	} else {
+		moq_pool.misses++;
+	}
+	if (moq_pool.count < moq_config.pool_low_water) {
+		ast_cond_signal(&moq_pool.cond);
+	}
+	ast_mutex_unlock(&moq_pool_lock);
+	
+	if (!session) {
+		session = moq_session_alloc();
+		if (!session) {
+			return NULL;
+		}
+	}
+	
+	session->setup_start = ast_tvnow();
+	session->first_frame_seen = 0;
+	generate_session_id(session->session_id, sizeof(session->session_id));
+	ast_copy_string(session->remote_id, dest, sizeof(session->remote_id));
+	session->state = MOQ_STATE_DOWN;
+	session->routed = 0;
+	
+	/* Initialize MoQ/QUIC parameters */
+	session->track_id = (uint32_t)ast_random();
+	session->send_sequence = 0;
+	session->recv_sequence = 0;
+	session->last_timestamp = 0;
+	moq_clock_tx_init(&session->tx_clock, MOQ_SAMPLE_RATE);
+	moq_clock_rx_init(&session->rx_clock, MOQ_SAMPLE_RATE);
+	do {
+		session->video_track_id = (uint32_t)ast_random();
+	} while (session->video_track_id == session->track_id);
+	session->video_send_sequence = 0;
+	session->video_frame_open = 0;
+	moq_clock_tx_init(&session->video_clock, MOQ_VIDEO_RATE);
+	moq_reasm_clear(&session->reasm);
+	moq_vad_init(&session->vad);
+	session->tx_silent = 0;
+	moq_cn_init(&session->cn, session->track_id);
+	session->cn_active = 0;
+	
+	/* Fresh media key every call, offered to the peer in signaling */
+	__atomic_store_n(&session->tx_protected, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&session->rx_protected, 0, __ATOMIC_RELAXED);
+	session->tx_key_len = 0;
+	session->rx_key_len = 0;
+	if (moq_config.media_encryption) {
+		moq_session_new_key(session, moq_config.media_cipher);
+	}
+	
+	/* Go through the lowest-latency healthy relay */
+	ast_mutex_lock(&moq_relay_lock);
+	relay = moq_relay_best(0);
+	ast_mutex_unlock(&moq_relay_lock);
+	if (session->quic_conn && moq_session_use_relay(session, relay)) {
+		ast_log(LOG_WARNING, "MoQ session %s could not use relay %s\n",
+			session->session_id, moq_relays.list[relay].name);
+	}
+	
+	/* Mirror the call's media into its own tap segments */
+	session->tap = NULL;
+	session->bridge_tapped = 0;
+	if (moq_config.tap) {
+		session->tap = moq_tap_open(moq_config.tap_dir, session->session_id, dest,
+			(size_t)moq_config.tap_segment_size * 1024 * 1024);
+		if (!session->tap) {
+			ast_log(LOG_WARNING, "MoQ session %s: cannot tap media into %s: %s\n",
+				session->session_id, moq_config.tap_dir, strerror(errno));
+		}
+	}
+	
+	memset(&session->stats, 0, sizeof(session->stats));
+	session->last_transit = 0;
+	session->jitter = 0;
+	session->rr_peer_sent = 0;
+	session->rr_peer_received_us = 0;
+	session->srtt = 0;
+	
+	ast_mutex_lock(&moq_lock);
+	AST_LIST_INSERT_TAIL(&moq_sessions, ao2_bump(session), list_entry);
+	moq_session_count++;
+	ast_mutex_unlock(&moq_lock);
+	
+	ast_log(LOG_NOTICE, "Created MoQ session %s for destination %s (track_id: %u, relay: %s)\n", 
+		session->session_id, dest, session->track_id, moq_relays.list[relay].name);
+	
+	return session;
+}
+
+/* Take a copy of a session's counters */
+static void moq_stats_snapshot(const struct moq_stats *src, struct moq_stats *dst)
+{
+	dst->rx_packets = MOQ_STAT_GET(src, rx_packets);
+	dst->rx_bytes = MOQ_STAT_GET(src, rx_bytes);
+	dst->rx_lost = MOQ_STAT_GET(src, rx_lost);
+	dst->rx_reordered = MOQ_STAT_GET(src, rx_reordered);
+	dst->rx_jitter = MOQ_STAT_GET(src, rx_jitter);
+	dst->tx_packets = MOQ_STAT_GET(src, tx_packets);
+	dst->tx_bytes = MOQ_STAT_GET(src, tx_bytes);
+	dst->tx_errors = MOQ_STAT_GET(src, tx_errors);
+	dst->tx_eagain = MOQ_STAT_GET(src, tx_eagain);
+	dst->rtt = MOQ_STAT_GET(src, rtt);
+	dst->remote_lost = MOQ_STAT_GET(src, remote_lost);
+	dst->remote_jitter = MOQ_STAT_GET(src, remote_jitter);
+	dst->rr_sent = MOQ_STAT_GET(src, rr_sent);
+	dst->rr_received = MOQ_STAT_GET(src, rr_received);
+	dst->clock_skew = MOQ_STAT_GET(src, clock_skew);
+	dst->samples_stretched = MOQ_STAT_GET(src, samples_stretched);
+	dst->samples_dropped = MOQ_STAT_GET(src, samples_dropped);
+	dst->video_rx_objects = MOQ_STAT_GET(src, video_rx_objects);
+	dst->video_tx_objects = MOQ_STAT_GET(src, video_tx_objects);
+	dst->reasm_timeouts = MOQ_STAT_GET(src, reasm_timeouts);
+	dst->reasm_evicted = MOQ_STAT_GET(src, reasm_evicted);
+	dst->fwd_packets = MOQ_STAT_GET(src, fwd_packets);
+	dst->tx_suppressed = MOQ_STAT_GET(src, tx_suppressed);
+	dst->tx_cn = MOQ_STAT_GET(src, tx_cn);
+	dst->rx_cn = MOQ_STAT_GET(src, rx_cn);
+	dst->cn_generated = MOQ_STAT_GET(src, cn_generated);
+	dst->tx_level = MOQ_STAT_GET(src, tx_level);
+	dst->rx_level = MOQ_STAT_GET(src, rx_level);
+	dst->rx_auth_failed = MOQ_STAT_GET(src, rx_auth_failed);
+}
+
+/* Add counters into a total; jitter and RTT are gauges, so the maximum is kept */
+static void moq_stats_accumulate(struct moq_stats *total, const struct moq_stats *stats)
+{
+	total->rx_packets += stats->rx_packets;
+	total->rx_bytes += stats->rx_bytes;
+	total->rx_lost += stats->rx_lost;
+	total->rx_reordered += stats->rx_reordered;
+	total->tx_packets += stats->tx_packets;
+	total->tx_bytes += stats->tx_bytes;
+	total->tx_errors += stats->tx_errors;
+	total->tx_eagain += stats->tx_eagain;
+	total->remote_lost += stats->remote_lost;
+	total->rr_sent += stats->rr_sent;
+	total->rr_received += stats->rr_received;
+	total->samples_stretched += stats->samples_stretched;
+	total->samples_dropped += stats->samples_dropped;
+	total->video_rx_objects += stats->video_rx_objects;
+	total->video_tx_objects += stats->video_tx_objects;
+	total->reasm_timeouts += stats->reasm_timeouts;
+	total->reasm_evicted += stats->reasm_evicted;
+	total->fwd_packets += stats->fwd_packets;
+	total->tx_suppressed += stats->tx_suppressed;
+	total->tx_cn += stats->tx_cn;
+	total->rx_cn += stats->rx_cn;
+	total->cn_generated += stats->cn_generated;
+	total->rx_auth_failed += stats->rx_auth_failed;
+	if (stats->rx_jitter > total->rx_jitter) {
+		total->rx_jitter = stats->rx_jitter;
+	}
+	if (stats->remote_jitter > total->remote_jitter) {
+		total->remote_jitter = stats->remote_jitter;
+	}
+	if (stats->rtt > total->rtt) {
+		total->rtt = stats->rtt;
+	}
+}
+
+/* Bytes waiting in a session's socket receive and send queues */
+static void moq_session_queue_depths(struct moq_session *session, int *rx_queue, int *tx_queue)
+{
+	int fd = session->quic_conn ? session->quic_conn->socket_fd : session->media_socket;
+	
+	*rx_queue = 0;
+	*tx_queue = 0;
+	if (fd >= 0) {
+		ioctl(fd, FIONREAD, rx_queue);
+		ioctl(fd, TIOCOUTQ, tx_queue);
+	}
+}
+
+/* Remove a session from the active list, dropping the list's reference */
+static void moq_session_unlink(struct moq_session *session)
+{
+	ast_mutex_lock(&moq_lock);
+	AST_LIST_REMOVE(&moq_sessions, session, list_entry);
+	moq_session_count--;
+	ast_mutex_unlock(&moq_lock);
+	
+	ao2_ref(session, -1);
+}
+
+/* Fold the final counters of a session whose media has stopped into the totals */
+static void moq_session_report(struct moq_session *session)
+{
+	struct moq_stats stats;
+	
+	moq_stats_snapshot(&session->stats, &stats);
+	
+	ast_mutex_lock(&moq_lock);
+	moq_stats_accumulate(&moq_ended_totals, &stats);
+	ast_mutex_unlock(&moq_lock);
+	
+	manager_event(EVENT_FLAG_REPORTING, "MoQSessionStats",
+		"SessionID: %s\r\n"
+		"Remote: %s\r\n"
+		"RxPackets: %llu\r\n"
+		"RxBytes: %llu\r\n"
+		"RxLost: %llu\r\n"
+		"RxReordered: %llu\r\n"
+		"RxJitterUs: %llu\r\n"
+		"TxPackets: %llu\r\n"
+		"TxBytes: %llu\r\n"
+		"TxErrors: %llu\r\n"
+		"TxDropped: %llu\r\n"
+		"RttUs: %llu\r\n"
+		"RemoteLost: %llu\r\n"
+		"RemoteJitterUs: %llu\r\n"
+		"ClockSkewPpm: %lld\r\n"
+		"SamplesStretched: %llu\r\n"
+		"SamplesDropped: %llu\r\n"
+		"VideoRxObjects: %llu\r\n"
+		"VideoTxObjects: %llu\r\n"
+		"ReassemblyTimeouts: %llu\r\n"
+		"ReassemblyEvicted: %llu\r\n"
+		"RelayedObjects: %llu\r\n"
+		"TxSuppressed: %llu\r\n"
+		"ComfortNoiseSent: %llu\r\n"
+		"ComfortNoiseReceived: %llu\r\n"
+		"ComfortNoiseFrames: %llu\r\n"
+		"TxCipher: %s\r\n"
+		"RxCipher: %s\r\n"
+		"RxAuthFailed: %llu\r\n",
+		session->session_id, session->remote_id,
+		(unsigned long long)stats.rx_packets, (unsigned long long)stats.rx_bytes,
+		(unsigned long long)stats.rx_lost, (unsigned long long)stats.rx_reordered,
+		(unsigned long long)stats.rx_jitter,
+		(unsigned long long)stats.tx_packets, (unsigned long long)stats.tx_bytes,
+		(unsigned long long)stats.tx_errors, (unsigned long long)stats.tx_eagain,
+		(unsigned long long)stats.rtt, (unsigned long long)stats.remote_lost,
+		(unsigned long long)stats.remote_jitter, (long long)stats.clock_skew,
+		(unsigned long long)stats.samples_stretched, (unsigned long long)stats.samples_dropped,
+		(unsigned long long)stats.video_rx_objects, (unsigned long long)stats.video_tx_objects,
+		(unsigned long long)stats.reasm_timeouts, (unsigned long long)stats.reasm_evicted,
+		(unsigned long long)stats.fwd_packets,
+		(unsigned long long)stats.tx_suppressed, (unsigned long long)stats.tx_cn,
+		(unsigned long long)stats.rx_cn, (unsigned long long)stats.cn_generated,
+		session->tx_protected ? moq_cipher_name(session->tx_cipher) : "",
+		session->rx_protected ? moq_cipher_name(session->rx_crypto.cipher) : "",
+		(unsigned long long)stats.rx_auth_failed);
+}
+
+/*
+ * Finish tearing down a session once its call has ended: wait for the
+ * media thread to park, report the counters and close the tap, then
+ * recycle it into the pool when there is room. Consumes a reference.
+ */
+static void moq_session_reap(struct moq_session *session)
+{
+	ast_mutex_lock(&session->lock);
+	while (session->media_thread != AST_PTHREADT_NULL && !session->parked) {
+		ast_cond_wait(&session->cond, &session->lock);
+	}
+	ast_mutex_unlock(&session->lock);
+	
+	moq_session_report(session);
+	
+	/* Neither side writes to the tap any more, and the bridge peer was unlinked on hangup */
+	if (session->tap) {
+		ast_log(LOG_NOTICE, "MoQ session %s: tapped %llu objects (%llu bytes) in %u segments%s%s\n",
+			session->session_id, (unsigned long long)session->tap->objects,
+			(unsigned long long)session->tap->bytes, session->tap->segments,
+			session->tap->failed ? ", stopped early: " : "",
+			session->tap->failed ? strerror(session->tap->failed) : "");
+		moq_tap_close(session->tap);
+		session->tap = NULL;
+	}
+	
+	moq_hist_record(&moq_latency[MOQ_LAT_TEARDOWN], moq_monotonic_us() - session->ended_us);
+	
+	/* Only a session nobody else still looks at can be handed to a new call */
+	if (ao2_ref(session, 0) == 1 && !moq_pool_release(session)) {
+		return;
+	}
+	
+	ao2_ref(session, -1);
+}
+
+/* Reaper thread - tears down ended sessions in batches */
+static void *moq_reaper_thread(void *data)
+{
+	AST_LIST_HEAD_NOLOCK(, moq_session) batch;
+	struct moq_session *session;
+	unsigned int count;
+	
+	ast_mutex_lock(&moq_reaper_lock);
+	for (;;) {
+		while (moq_reaper.running && AST_LIST_EMPTY(&moq_reaper.queue)) {
+			ast_cond_wait(&moq_reaper.cond, &moq_reaper_lock);
+		}
+		if (AST_LIST_EMPTY(&moq_reaper.queue)) {
+			break;
+		}
+		
+		/* Take everything queued; the media threads of a batch stop in parallel */
+		AST_LIST_HEAD_INIT_NOLOCK(&batch);
+		AST_LIST_APPEND_LIST(&batch, &moq_reaper.queue, reap_entry);
+		count = moq_reaper.queued;
+		moq_reaper.queued = 0;
+		ast_mutex_unlock(&moq_reaper_lock);
+		
+		while ((session = AST_LIST_REMOVE_HEAD(&batch, reap_entry))) {
+			moq_session_reap(session);
+		}
+		
+		ast_mutex_lock(&moq_reaper_lock);
+		moq_reaper.reaped += count;
+		moq_reaper.batches++;
+		if (count > moq_reaper.max_batch) {
+			moq_reaper.max_batch = count;
+		}
+	}
+	ast_mutex_unlock(&moq_reaper_lock);
+	
+	return NULL;
+}
+
+static int moq_reaper_start(void)
+{
+	AST_LIST_HEAD_INIT_NOLOCK(&moq_reaper.queue);
+	moq_reaper.queued = 0;
+	moq_reaper.reaped = 0;
+	moq_reaper.batches = 0;
+	moq_reaper.max_batch = 0;
+	ast_cond_init(&moq_reaper.cond, NULL);
+	moq_reaper.running = 1;
+	
+	if (ast_pthread_create_background(&moq_reaper.thread, NULL, moq_reaper_thread, NULL)) {
+		ast_log(LOG_ERROR, "Failed to create session reaper thread\n");
+		moq_reaper.running = 0;
+		moq_reaper.thread = AST_PTHREADT_NULL;
+		ast_cond_destroy(&moq_reaper.cond);
+		return -1;
+	}
+	
+	return 0;
+}
+
+/* Stop the reaper once it has torn down everything queued; later sessions are reaped inline */
+static void moq_reaper_stop(void)
+{
+	if (moq_reaper.thread == AST_PTHREADT_NULL) {
+		return;
+	}
+	
+	ast_mutex_lock(&moq_reaper_lock);
+	moq_reaper.running = 0;
+	ast_cond_signal(&moq_reaper.cond);
+	ast_mutex_unlock(&moq_reaper_lock);
+	pthread_join(moq_reaper.thread, NULL);
+	moq_reaper.thread = AST_PTHREADT_NULL;
+	
+	ast_cond_destroy(&moq_reaper.cond);
+}
+
+/*
+ * End a session: it stops media and leaves the active list at once, and
+ * the reaper does the rest, so the channel thread never waits for the
+ * media thread. Consumes the caller's reference.
+ */
+static void moq_session_destroy(struct moq_session *session)
+{
+	int queued = 0;
+	
+	if (!session) {
+		return;
+	}
+	
+	ast_log(LOG_NOTICE, "Destroying MoQ session %s\n", session->session_id);
+	
+	ast_mutex_lock(&session->lock);
+	session->running = 0;
+	ast_mutex_unlock(&session->lock);
+	session->ended_us = moq_monotonic_us();
+	
+	moq_session_unlink(session);
+	
+	ast_mutex_lock(&moq_reaper_lock);
+	if (moq_reaper.running) {
+		AST_LIST_INSERT_TAIL(&moq_reaper.queue, session, reap_entry);
+		moq_reaper.queued++;
+		ast_cond_signal(&moq_reaper.cond);
+		queued = 1;
+	}
+	ast_mutex_unlock(&moq_reaper_lock);
+	
+	if (!queued) {
+		moq_session_reap(session);
+	}
+}
+
+/* Whether the module is draining, copying the successor peers are sent to if so */
+static int moq_draining(char *successor, size_t len)
+{
+	int active;
+	
+	ast_mutex_lock(&moq_lock);
+	active = moq_drain.active;
+	if (active && successor) {
+		ast_copy_string(successor, moq_drain.successor, len);
+	}
+	ast_mutex_unlock(&moq_lock);
+	
+	return active;
+}
+
+static int moq_session_exists(const char *session_id)
+{
+	struct moq_session *session;
+	
+	ast_mutex_lock(&moq_lock);
+	AST_LIST_TRAVERSE(&moq_sessions, session, list_entry) {
+		if (!strcmp(session->session_id, session_id)) {
+			break;
+		}
+	}
+	ast_mutex_unlock(&moq_lock);
+	
+	return session != NULL;
+}
+
+/*
+ * Sessions signaled over wsi, which has closed, forget it; with wsi NULL
+ * this applies to every session. Given a soft hangup reason, their channels
+ * are asked to hang up too. Returns the number asked.
+ */
+static int moq_hangup_sessions(struct lws *wsi, int reason)
+{
+	struct moq_session *session;
+	struct ast_channel **chans;
+	int count = 0, i;
+	
+	ast_mutex_lock(&moq_lock);
+	chans = ast_calloc(moq_session_count + 1, sizeof(*chans));
+	AST_LIST_TRAVERSE(&moq_sessions, session, list_entry) {
+		if (wsi && session->ws != wsi) {
+			continue;
+		}
+		if (wsi) {
+			session->ws = NULL;
+		}
+		ast_mutex_lock(&session->lock);
+		if (reason && chans && session->owner) {
+			chans[count++] = ast_channel_ref(session->owner);
+		}
+		ast_mutex_unlock(&session->lock);
+	}
+	ast_mutex_unlock(&moq_lock);
+	
+	/* Outside moq_lock, which the hangup path takes with the channel locked */
+	for (i = 0; i < count; i++) {
+		ast_softhangup(chans[i], reason);
+		ast_channel_unref(chans[i]);
+	}
+	ast_free(chans);
+	
+	return count;
+}
+
+/* Tell a peer why its call or resume was refused, and where to go instead */
+static int moq_send_refusal(struct lws *wsi, const char *type, const char *session_id,
+	const char *reason, const char *successor)
+{
+	struct json_object *jobj = json_object_new_object();
+	json_object_object_add(jobj, "type", json_object_new_string(type));
+	if (session_id) {
+		json_object_object_add(jobj, "session_id", json_object_new_string(session_id));
+	}
+	json_object_object_add(jobj, "reason", json_object_new_string(reason));
+	if (!ast_strlen_zero(successor)) {
+		json_object_object_add(jobj, "successor", json_object_new_string(successor));
+	}
+	
+	const char *msg = json_object_to_json_string(jobj);
+	int ret = moq_ws_send_message(wsi, msg);
+	json_object_put(jobj);
+	
+	return ret;
+}
+
+static int64_t moq_json_int64(struct json_object *jobj, const char *name)
+{
+	struct json_object *field = json_object_object_get(jobj, name);
+	
+	return field ? json_object_get_int64(field) : 0;
+}
+
+/*
+ * State a successor needs to carry on a call: the session identity, how
+ * far its tracks have got and the key the peer seals with. It is signed
+ * with handoff_secret, which the successor shares, and travels to the
+ * peer in the GOAWAY; the peer presents it to the successor to resume.
+ */
+static struct json_object *moq_handoff_create(struct moq_session *session, time_t expires)
+{
+	struct json_object *state = json_object_new_object();
+	struct json_object *handoff;
+	struct timeval now = ast_tvnow();
+	uint64_t now_us = moq_monotonic_us();
+	uint8_t mac[MOQ_CRYPTO_MAC_SIZE];
+	char encoded[MOQ_CRYPTO_KEY_MAX * 4 / 3 + 4];
+	const char *text;
+	
+	json_object_object_add(state, "session_id", json_object_new_string(session->session_id));
+	json_object_object_add(state, "remote_id", json_object_new_string(session->remote_id));
+	json_object_object_add(state, "track_id", json_object_new_int64(session->track_id));
+	json_object_object_add(state, "video_track_id", json_object_new_int64(session->video_track_id));
+	json_object_object_add(state, "sequence",
+		json_object_new_int64(__atomic_load_n(&session->send_sequence, __ATOMIC_RELAXED)));
+	json_object_object_add(state, "video_sequence",
+		json_object_new_int64(__atomic_load_n(&session->video_send_sequence, __ATOMIC_RELAXED)));
+	json_object_object_add(state, "timestamp", json_object_new_int64(session->tx_clock.started ?
+		moq_clock_tx_now(&session->tx_clock, now_us) : 0));
+	json_object_object_add(state, "video_timestamp", json_object_new_int64(session->video_clock.started ?
+		moq_clock_tx_now(&session->video_clock, now_us) : 0));
+	json_object_object_add(state, "issued_ms",
+		json_object_new_int64((int64_t)now.tv_sec * 1000 + now.tv_usec / 1000));
+	json_object_object_add(state, "expires", json_object_new_int64(expires));
+	if (session->rx_key_len) {
+		ast_base64encode(encoded, session->rx_key, session->rx_key_len, sizeof(encoded));
+		json_object_object_add(state, "media_key", json_object_new_string(encoded));
+		json_object_object_add(state, "media_cipher",
+			json_object_new_string(moq_cipher_name(session->rx_cipher)));
+	}
+	
+	text = json_object_to_json_string(state);
+	if (moq_crypto_mac((const uint8_t *)moq_config.handoff_secret, strlen(moq_config.handoff_secret),
+		(const uint8_t *)text, strlen(text), mac)) {
+		json_object_put(state);
+		return NULL;
+	}
+	ast_base64encode(encoded, mac, sizeof(mac), sizeof(encoded));
+	
+	handoff = json_object_new_object();
+	json_object_object_add(handoff, "state", json_object_new_string(text));
+	json_object_object_add(handoff, "mac", json_object_new_string(encoded));
+	json_object_put(state);
+	
+	return handoff;
+}
+
+/*
+ * Whether a handoff for a session was resumed before, forgetting those that
+ * have expired since, as they are refused for that anyway.
+ */
+static int moq_handoff_was_used(const char *session_id)
+{
+	struct moq_handoff_used *used;
+	time_t now = time(NULL);
+	int found = 0;
+	
+	ast_mutex_lock(&moq_lock);
+	AST_LIST_TRAVERSE_SAFE_BEGIN(&moq_handoffs_used, used, entry) {
+		if (used->expires < now) {
+			AST_LIST_REMOVE_CURRENT(entry);
+			ast_free(used);
+		} else if (!strcmp(used->session_id, session_id)) {
+			found = 1;
+		}
+	}
+	AST_LIST_TRAVERSE_SAFE_END;
+	ast_mutex_unlock(&moq_lock);
+	
+	return found;
+}
+
+/* Remember a handoff that resumed a call, until it expires */
+static void moq_handoff_mark_used(struct json_object *state)
+{
+	struct moq_handoff_used *used = ast_calloc(1, sizeof(*used));
+	
+	if (!used) {
+		return;
+	}
+	used->expires = moq_json_int64(state, "expires");
+	ast_copy_string(used->session_id, json_object_get_string(json_object_object_get(state, "session_id")),
+		sizeof(used->session_id));
+	
+	ast_mutex_lock(&moq_lock);
+	AST_LIST_INSERT_TAIL(&moq_handoffs_used, used, entry);
+	ast_mutex_unlock(&moq_lock);
+}
+
+/* Forget every handoff used, on unload */
+static void moq_handoff_forget_all(void)
+{
+	struct moq_handoff_used *used;
+	
+	ast_mutex_lock(&moq_lock);
+	while ((used = AST_LIST_REMOVE_HEAD(&moq_handoffs_used, entry))) {
+		ast_free(used);
+	}
+	ast_mutex_unlock(&moq_lock);
+}
+
+/* Check a handoff presented by a peer; returns why it is refused, or NULL with its state parsed */
+static const char *moq_handoff_verify(struct json_object *handoff, struct json_object **state)
+{
+	struct json_object *state_obj = handoff ? json_object_object_get(handoff, "state") : NULL;
+	struct json_object *mac_obj = handoff ? json_object_object_get(handoff, "mac") : NULL;
+	struct json_object *id_obj;
+	uint8_t mac[MOQ_CRYPTO_MAC_SIZE + 1];
+	const char *text;
+	
+	*state = NULL;
+	if (ast_strlen_zero(moq_config.handoff_secret)) {
+		return "not_accepted";
+	}
+	if (!state_obj || !mac_obj) {
+		return "invalid";
+	}
+	
+	text = json_object_get_string(state_obj);
+	if (ast_base64decode(mac, json_object_get_string(mac_obj), sizeof(mac)) != MOQ_CRYPTO_MAC_SIZE ||
+		moq_crypto_mac_verify((const uint8_t *)moq_config.handoff_secret,
+			strlen(moq_config.handoff_secret), (const uint8_t *)text, strlen(text), mac)) {
+		return "invalid";
+	}
+	
+	*state = json_tokener_parse(text);
+	id_obj = *state ? json_object_object_get(*state, "session_id") : NULL;
+	if (!id_obj || ast_strlen_zero(json_object_get_string(id_obj))) {
+		return "invalid";
+	}
+	if (moq_json_int64(*state, "expires") < time(NULL)) {
+		return "expired";
+	}
+	if (moq_session_exists(json_object_get_string(id_obj))) {
+		return "active";
+	}
+	if (moq_handoff_was_used(json_object_get_string(id_obj))) {
+		return "used";
+	}
+	
+	return NULL;
+}
+
+/*
+ * Pick up a call handed over by a draining instance. Sequences and media
+ * clocks carry on from where it left them, moved on by the time since the
+ * handoff was issued, so the peer sees one continuous stream. The peer
+ * keeps sealing with its key; we seal with a fresh one, sent with the
+ * answer, so no nonce is ever used twice under a key.
+ */
+static int moq_session_resume(struct moq_session *session, struct json_object *state)
+{
+	struct timeval now = ast_tvnow();
+	uint64_t now_us = moq_monotonic_us();
+	int64_t elapsed_ms = (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000 -
+		moq_json_int64(state, "issued_ms");
+	struct json_object *cipher_obj = json_object_object_get(state, "media_cipher");
+	int cipher;
+	
+	if (elapsed_ms < 0) {
+		elapsed_ms = 0;
+	}
+	
+	session->track_id = (uint32_t)moq_json_int64(state, "track_id");
+	session->video_track_id = (uint32_t)moq_json_int64(state, "video_track_id");
+	if (!session->track_id || session->track_id == session->video_track_id) {
+		return -1;
+	}
+	
+	/* Audio goes in 20 ms frames; video is assumed to send at most one object per ms */
+	session->send_sequence = moq_json_int64(state, "sequence") +
+		elapsed_ms * MOQ_SAMPLE_RATE / 1000 / MOQ_CN_FRAME_SAMPLES;
+	session->video_send_sequence = moq_json_int64(state, "video_sequence") + elapsed_ms;
+	moq_clock_tx_resume(&session->tx_clock, now_us,
+		moq_json_int64(state, "timestamp") + elapsed_ms * MOQ_SAMPLE_RATE / 1000);
+	moq_clock_tx_resume(&session->video_clock, now_us,
+		moq_json_int64(state, "video_timestamp") + elapsed_ms * MOQ_VIDEO_RATE / 1000);
+	moq_cn_init(&session->cn, session->track_id);
+	
+	if (json_object_object_get(state, "media_key")) {
+		cipher = cipher_obj ? moq_cipher_from_name(json_object_get_string(cipher_obj)) : -1;
+		if (!session->tx_key_len && (cipher < 0 || moq_session_new_key(session, cipher))) {
+			return -1;
+		}
+		moq_set_peer_key(session, state);
+		if (!__atomic_load_n(&session->rx_protected, __ATOMIC_ACQUIRE)) {
+			return -1;
+		}
+	}
+	
+	/* The relay only knows the tracks picked when the session was set up */
+	ast_mutex_lock(&moq_lock);
+	if (session->quic_conn) {
+		moq_session_use_relay(session, session->relay);
+	}
+	ast_mutex_unlock(&moq_lock);
+	
+	return 0;
+}
+
+/*
+ * Tell a session's relay and peer that we are going away (moq_lock held).
+ * Returns 1 if the peer was given the call's state for the successor.
+ */
+static int moq_session_goaway(struct moq_session *session, time_t deadline)
+{
+	size_t uri_len = strlen(moq_drain.successor);
+	uint8_t buf[MOQ_WIRE_MSG_HEADER_SIZE + sizeof(moq_drain.successor)];
+	struct json_object *handoff = NULL;
+	int len;
+	
+	if (session->quic_conn) {
+		len = moq_wire_encode_message(buf, sizeof(buf), MOQ_MSG_GOAWAY,
+			(const uint8_t *)moq_drain.successor, uri_len);
+		if (len > 0) {
+			moq_quic_send_datagram(session->quic_conn, buf, len);
+		}
+	}
+	
+	if (uri_len && !ast_strlen_zero(moq_config.handoff_secret)) {
+		handoff = moq_handoff_create(session, (deadline ? deadline : time(NULL)) + MOQ_HANDOFF_TTL);
+	}
+	
+	struct json_object *jobj = json_object_new_object();
+	json_object_object_add(jobj, "type", json_object_new_string("goaway"));
+	json_object_object_add(jobj, "session_id", json_object_new_string(session->session_id));
+	json_object_object_add(jobj, "successor", json_object_new_string(moq_drain.successor));
+	json_object_object_add(jobj, "deadline", json_object_new_int64(deadline));
+	if (handoff) {
+		json_object_object_add(jobj, "handoff", handoff);
+	}
+	
+	const char *msg = json_object_to_json_string(jobj);
+	moq_ws_send_message(session->ws, msg);
+	json_object_put(jobj);
+	
+	return handoff != NULL;
+}
+
+/* Wait for the calls to end, hanging up whatever is left at the deadline */
+static void *moq_drain_thread(void *data)
+{
+	int complete = 0, deadline = 0, forced;
+	
+	ast_mutex_lock(&moq_lock);
+	while (moq_drain.active) {
+		struct timeval tv = ast_tvadd(ast_tvnow(), ast_tv(1, 0));
+		struct timespec ts = { .tv_sec = tv.tv_sec, .tv_nsec = tv.tv_usec * 1000 };
+		
+		if (!moq_session_count) {
+			complete = 1;
+			break;
+		}
+		if (moq_drain.timeout &&
+			ast_tvdiff_ms(ast_tvnow(), moq_drain.started) >= moq_drain.timeout * 1000LL) {
+			deadline = 1;
+			break;
+		}
+		ast_cond_timedwait(&moq_drain.cond, &moq_lock, &ts);
+	}
+	ast_mutex_unlock(&moq_lock);
+	
+	if (complete) {
+		ast_log(LOG_NOTICE, "MoQ drain complete, no calls left\n");
+		manager_event(EVENT_FLAG_SYSTEM, "MoQDrain", "Status: Complete\r\n");
+	} else if (deadline) {
+		forced = moq_hangup_sessions(NULL, AST_SOFTHANGUP_SHUTDOWN);
+		ast_mutex_lock(&moq_lock);
+		moq_drain.forced += forced;
+		ast_mutex_unlock(&moq_lock);
+		ast_log(LOG_NOTICE, "MoQ drain deadline reached, hanging up %d calls\n", forced);
+		manager_event(EVENT_FLAG_SYSTEM, "MoQDrain", "Status: Deadline\r\nCalls: %d\r\n", forced);
+	}
+	
+	return NULL;
+}
+
+/* Start draining; returns -1 if already draining */
+static int moq_drain_start(const char *successor, int timeout)
+{
+	struct moq_session *session;
+	unsigned int notified, handed_off;
+	time_t deadline;
+	
+	ast_mutex_lock(&moq_lock);
+	if (moq_drain.active) {
+		ast_mutex_unlock(&moq_lock);
+		return -1;
+	}
+	moq_drain.active = 1;
+	ast_copy_string(moq_drain.successor, successor, sizeof(moq_drain.successor));
+	moq_drain.timeout = timeout;
+	moq_drain.started = ast_tvnow();
+	moq_drain.notified = 0;
+	moq_drain.handed_off = 0;
+	moq_drain.forced = 0;
+	ast_cond_init(&moq_drain.cond, NULL);
+	
+	deadline = timeout ? moq_drain.started.tv_sec + timeout : 0;
+	AST_LIST_TRAVERSE(&moq_sessions, session, list_entry) {
+		moq_drain.handed_off += moq_session_goaway(session, deadline);
+		moq_drain.notified++;
+	}
+	notified = moq_drain.notified;
+	handed_off = moq_drain.handed_off;
+	
+	if (ast_pthread_create_background(&moq_drain.thread, NULL, moq_drain_thread, NULL)) {
+		ast_log(LOG_ERROR, "Failed to create MoQ drain thread, calls will not be hung up at the deadline\n");
+		moq_drain.thread = AST_PTHREADT_NULL;
+	}
+	ast_mutex_unlock(&moq_lock);
+	
+	ast_log(LOG_NOTICE, "MoQ draining: refusing new calls, %u calls sent GOAWAY (%u with handoff), successor %s\n",
+		notified, handed_off, S_OR(successor, "(none)"));
+	manager_event(EVENT_FLAG_SYSTEM, "MoQDrain",
+		"Status: Started\r\n"
+		"Successor: %s\r\n"
+		"Timeout: %d\r\n"
+		"Calls: %u\r\n"
+		"HandedOff: %u\r\n",
+		successor, timeout, notified, handed_off);
+	
+	return 0;
+}
+
+/* Accept calls again; returns -1 if not draining */
+static int moq_drain_cancel(void)
+{
+	pthread_t thread;
+	int active;
+	
+	ast_mutex_lock(&moq_lock);
+	active = moq_drain.active;
+	moq_drain.active = 0;
+	thread = moq_drain.thread;
+	moq_drain.thread = AST_PTHREADT_NULL;
+	if (active) {
+		ast_cond_signal(&moq_drain.cond);
+	}
+	ast_mutex_unlock(&moq_lock);
+	
+	if (!active) {
+		return -1;
+	}
+	if (thread != AST_PTHREADT_NULL) {
+		pthread_join(thread, NULL);
+	}
+	ast_cond_destroy(&moq_drain.cond);
+	
+	manager_event(EVENT_FLAG_SYSTEM, "MoQDrain", "Status: Cancelled\r\n");
+	
+	return 0;
+}
+
+/*
+ * Create the channel for a call from a peer and start its dialplan, at
+ * exten in the configured context if the call was routed to one. Given
+ * the state handed over by a draining instance, the call resumes where
+ * that left off. Returns 0, or -1 if no channel was started.
+ */
+static int moq_incoming_call(struct lws *wsi, struct json_object *jobj, const char *session_id,
+	const char *from, const char *exten, struct json_object *state, uint64_t received_us)
+{
+	struct ast_format_cap *cap = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
+	struct ast_channel *chan;
+	struct moq_session *session;
+	
+	if (!cap) {
+		return -1;
+	}
+	ast_format_cap_append(cap, ast_format_ulaw, 0);
+	ast_format_cap_append(cap, ast_format_h264, 0);
+	ast_format_cap_append(cap, ast_format_vp8, 0);
+	
+	chan = ast_channel_alloc(1, AST_STATE_RING, from, NULL, NULL,
+		exten, exten ? moq_config.context : NULL, NULL, NULL, 0, "MOQ/%s", session_id);
+	if (!chan) {
+		ao2_ref(cap, -1);
+		return -1;
+	}
+	
+	ast_channel_tech_set(chan, &moq_tech);
+	ast_channel_nativeformats_set(chan, cap);
+	ast_channel_set_writeformat(chan, ast_format_ulaw);
+	ast_channel_set_readformat(chan, ast_format_ulaw);
+	ast_channel_set_rawwriteformat(chan, ast_format_ulaw);
+	ast_channel_set_rawreadformat(chan, ast_format_ulaw);
+	ao2_ref(cap, -1);
+	
+	session = moq_session_new(from);
+	if (!session) {
+		ast_hangup(chan);
+		return -1;
+	}
+	ast_copy_string(session->session_id, session_id, sizeof(session->session_id));
+	if (!state) {
+		moq_set_peer_key(session, jobj);
+	} else if (moq_session_resume(session, state)) {
+		ast_log(LOG_WARNING, "Unusable state to resume MoQ session %s\n", session_id);
+		moq_session_destroy(session);
+		ast_hangup(chan);
+		return -1;
+	}
+	session->ws = wsi;
+	session->routed = exten != NULL;
+	session->owner = chan;
+	ast_channel_tech_pvt_set(chan, session);
+	
+	/* Dialplan tells resumed calls apart, to answer and reconnect them at once */
+	if (state) {
+		pbx_builtin_setvar_helper(chan, "MOQ_RESUMED", "1");
+	}
+	
+	uint64_t setup_us = moq_monotonic_us() - received_us;
+	moq_hist_record(&moq_latency[MOQ_LAT_SIGNAL_CHANNEL], setup_us);
+	MOQ_TRACE2(channel_created, session->session_id, setup_us);
+	
+	ast_channel_unlock(chan);
+	
+	if (ast_pbx_start(chan)) {
+		ast_log(LOG_ERROR, "Failed to start PBX\n");
+		ast_hangup(chan);
+	}
+	
+	return 0;
+}
+
+/* A peer moved here by a draining instance asks to carry on its call */
+static void moq_handle_resume(struct lws *wsi, struct json_object *jobj, uint64_t received_us)
+{
+	struct json_object *state;
+	const char *reason, *session_id = NULL;
+	char successor[sizeof(moq_drain.successor)] = "";
+	
+	reason = moq_handoff_verify(json_object_object_get(jobj, "handoff"), &state);
+	if (state && json_object_object_get(state, "session_id")) {
+		session_id = json_object_get_string(json_object_object_get(state, "session_id"));
+	}
+	if (!reason && moq_draining(successor, sizeof(successor))) {
+		reason = "draining";
+	}
+	if (!reason && moq_incoming_call(wsi, jobj, session_id,
+		S_OR(json_object_get_string(json_object_object_get(state, "remote_id")), ""), NULL, state, received_us)) {
+		reason = "failed";
+	}
+	
+	if (reason) {
+		ast_log(LOG_WARNING, "Refusing to resume MoQ session %s: %s\n", S_OR(session_id, "(unknown)"), reason);
+		moq_send_refusal(wsi, "resume_failed", session_id, reason, successor);
+	} else {
+		moq_handoff_mark_used(state);
+		ast_log(LOG_NOTICE, "Resumed MoQ session %s handed over by a draining instance\n", session_id);
+	}
+	if (state) {
+		json_object_put(state);
+	}
+}
+
+/* Signaling state of a connection to the built-in server */
+struct moq_ws_conn {
+	char user_id[MOQ_REGISTRAR_ID_SIZE];	/* Registered as, "" until then */
+};
+
+/* Send a signaling message and release it */
+static int moq_ws_send_json(struct lws *wsi, struct json_object *jobj)
+{
+	int ret = moq_ws_send_message(wsi, json_object_to_json_string(jobj));
+	
+	json_object_put(jobj);
+	
+	return ret;
+}
+
+/* Media keys are opaque to the router, passed on to the other party as offered */
+static void moq_copy_media_key(struct json_object *to, struct json_object *from)
+{
+	static const char *const fields[] = { "media_key", "media_cipher" };
+	struct json_object *field;
+	size_t i;
+	
+	for (i = 0; i < ARRAY_LEN(fields); i++) {
+		if ((field = json_object_object_get(from, fields[i]))) {
+			json_object_object_add(to, fields[i], json_object_get(field));
+		}
+	}
+}
+
+static struct json_object *moq_signaling_message(const char *type, const char *session_id)
+{
+	struct json_object *jobj = json_object_new_object();
+	
+	json_object_object_add(jobj, "type", json_object_new_string(type));
+	json_object_object_add(jobj, "session_id", json_object_new_string(session_id));
+	
+	return jobj;
+}
+
+/*
+ * Reference to the channel of the session with this ID, or NULL. Given a
+ * signaling message, the session first takes the peer's media key from it.
+ */
+static struct ast_channel *moq_session_owner_ref(const char *session_id, struct json_object *jobj)
+{
+	struct moq_session *session;
+	struct ast_channel *chan = NULL;
+	
+	ast_mutex_lock(&moq_lock);
+	AST_LIST_TRAVERSE(&moq_sessions, session, list_entry) {
+		if (strcmp(session->session_id, session_id)) {
+			continue;
+		}
+		if (jobj) {
+			moq_set_peer_key(session, jobj);
+		}
+		ast_mutex_lock(&session->lock);
+		if (session->owner) {
+			chan = ast_channel_ref(session->owner);
+		}
+		ast_mutex_unlock(&session->lock);
+		break;
+	}
+	ast_mutex_unlock(&moq_lock);
+	
+	return chan;
+}
+
+/*
+ * The answer to one of our calls carries the callee's media key. Calls we
+ * routed ourselves are also answered by it; elsewhere the dialplan's own
+ * signaling does that.
+ */
+static void moq_session_answered(const char *session_id, struct json_object *jobj, int answer)
+{
+	struct ast_channel *chan = moq_session_owner_ref(session_id, jobj);
+	
+	if (!chan) {
+		return;
+	}
+	if (answer) {
+		ast_queue_control(chan, AST_CONTROL_ANSWER);
+	}
+	ast_channel_unref(chan);
+}
+
+/* The other party ended one of our calls; called without moq_lock held */
+static void moq_session_remote_hangup(const char *session_id)
+{
+	struct ast_channel *chan = moq_session_owner_ref(session_id, NULL);
+	
+	if (!chan) {
+		return;
+	}
+	ast_queue_hangup_with_cause(chan, AST_CAUSE_NORMAL_CLEARING);
+	ast_channel_unref(chan);
+}
+
+/* Calls of ours a departing user was in, to hang up once the registrar is unlocked */
+struct moq_ended_calls {
+	char (*session_ids)[MOQ_REGISTRAR_ID_SIZE];
+	size_t count;
+	size_t size;
+};
+
+static void moq_ws_call_ended(void *data, const char *session_id, const char *peer, void *peer_conn)
+{
+	struct moq_ended_calls *ended = data;
+	
+	if (*peer) {
+		moq_ws_send_json(peer_conn, moq_signaling_message("call_ended", session_id));
+		return;
+	}
+	
+	if (ended->count == ended->size) {
+		size_t size = ended->size ? ended->size * 2 : 8;
+		void *session_ids = ast_realloc(ended->session_ids, size * sizeof(*ended->session_ids));
+		
+		if (!session_ids) {
+			ast_log(LOG_WARNING, "MoQ session %s outlives its caller\n", session_id);
+			return;
+		}
+		ended->session_ids = session_ids;
+		ended->size = size;
+	}
+	ast_copy_string(ended->session_ids[ended->count++], session_id, MOQ_REGISTRAR_ID_SIZE);
+}
+
+/* The user of a connection goes offline and the calls it was in end */
+static void moq_ws_unregister(struct lws *wsi, struct moq_ws_conn *conn)
+{
+	struct moq_ended_calls ended = { NULL, 0, 0 };
+	size_t i;
+	
+	if (!*conn->user_id) {
+		return;
+	}
+	
+	moq_registrar_unregister(&moq_registrar, conn->user_id, wsi, moq_ws_call_ended, &ended);
+	for (i = 0; i < ended.count; i++) {
+		moq_session_remote_hangup(ended.session_ids[i]);
+	}
+	ast_free(ended.session_ids);
+	
+	ast_log(LOG_NOTICE, "MoQ user %s unregistered\n", conn->user_id);
+	conn->user_id[0] = '\0';
+}
+
+static void moq_handle_register(struct lws *wsi, struct moq_ws_conn *conn, struct json_object *jobj)
+{
+	const char *user_id = S_OR(json_object_get_string(json_object_object_get(jobj, "user_id")), "");
+	struct json_object *reply;
+	void *replaced;
+	
+	if (strcmp(conn->user_id, user_id)) {
+		moq_ws_unregister(wsi, conn);
+	}
+	if (moq_registrar_register(&moq_registrar, user_id, wsi, &replaced)) {
+		moq_send_refusal(wsi, "register_failed", NULL, "invalid_user", NULL);
+		return;
+	}
+	ast_copy_string(conn->user_id, user_id, sizeof(conn->user_id));
+	
+	/* The old connection keeps its name, but no longer receives this user's calls */
+	if (replaced) {
+		ast_log(LOG_NOTICE, "MoQ user %s registered again on a new connection\n", user_id);
+	} else {
+		ast_log(LOG_NOTICE, "MoQ user %s registered\n", user_id);
+	}
+	
+	reply = json_object_new_object();
+	json_object_object_add(reply, "type", json_object_new_string("registered"));
+	json_object_object_add(reply, "user_id", json_object_new_string(user_id));
+	json_object_object_add(reply, "status", json_object_new_string("success"));
+	moq_ws_send_json(wsi, reply);
+}
+
+/*
+ * A user places a call: to another user, who alone is offered it, or
+ * else to an extension in our context, which gets a channel.
+ */
+static void moq_handle_call(struct lws *wsi, struct moq_ws_conn *conn, struct json_object *jobj,
+	uint64_t received_us)
+{
+	const char *session_id = json_object_get_string(json_object_object_get(jobj, "session_id"));
+	const char *dest = json_object_get_string(json_object_object_get(jobj, "dest"));
+	char successor[sizeof(moq_drain.successor)] = "";
+	struct json_object *offer;
+	struct lws *dest_wsi;
+	
+	if (ast_strlen_zero(session_id) || ast_strlen_zero(dest)) {
+		return;
+	}
+	if (!*conn->user_id) {
+		moq_send_refusal(wsi, "call_failed", session_id, "not_registered", NULL);
+		return;
+	}
+	if (moq_draining(successor, sizeof(successor))) {
+		moq_send_refusal(wsi, "call_failed", session_id, "draining", successor);
+		return;
+	}
+	
+	dest_wsi = moq_registrar_lookup(&moq_registrar, dest, NULL);
+	if (dest_wsi) {
+		if (moq_registrar_route_add(&moq_registrar, session_id, conn->user_id, dest)) {
+			moq_send_refusal(wsi, "call_failed", session_id, "invalid_session", NULL);
+			return;
+		}
+		offer = moq_signaling_message("incoming_call", session_id);
+		json_object_object_add(offer, "from", json_object_new_string(conn->user_id));
+		moq_copy_media_key(offer, jobj);
+		moq_ws_send_json(dest_wsi, offer);
+	} else if (ast_exists_extension(NULL, moq_config.context, dest, 1, conn->user_id)) {
+		if (moq_registrar_route_add(&moq_registrar, session_id, conn->user_id, "")) {
+			moq_send_refusal(wsi, "call_failed", session_id, "invalid_session", NULL);
+			return;
+		}
+		if (moq_incoming_call(wsi, jobj, session_id, conn->user_id, dest, NULL, received_us)) {
+			moq_registrar_route_remove(&moq_registrar, session_id);
+			moq_send_refusal(wsi, "call_failed", session_id, "failed", NULL);
+			return;
+		}
+	} else {
+		ast_log(LOG_NOTICE, "MoQ call %s from %s failed: %s not found\n", session_id, conn->user_id, dest);
+		moq_send_refusal(wsi, "call_failed", session_id, "user_not_found", NULL);
+		return;
+	}
+	
+	moq_ws_send_json(wsi, moq_signaling_message("ringing", session_id));
+}
+
+/* A party of a routed call answers or ends it; the other party alone hears of it */
+static void moq_handle_call_progress(struct lws *wsi, struct moq_ws_conn *conn,
+	struct json_object *jobj, int hangup)
+{
+	const char *session_id = json_object_get_string(json_object_object_get(jobj, "session_id"));
+	char peer[MOQ_REGISTRAR_ID_SIZE];
+	struct json_object *msg;
+	void *peer_wsi;
+	
+	if (!*conn->user_id || ast_strlen_zero(session_id) ||
+		moq_registrar_route_peer(&moq_registrar, session_id, conn->user_id, peer, sizeof(peer), &peer_wsi)) {
+		return;
+	}
+	/* Whichever side ends a call first reports it */
+	if (hangup && moq_registrar_route_remove(&moq_registrar, session_id)) {
+		return;
+	}
+	
+	if (!*peer) {
+		if (hangup) {
+			moq_session_remote_hangup(session_id);
+		} else {
+			moq_session_answered(session_id, jobj, 1);
+		}
+		return;
+	}
+	
+	msg = moq_signaling_message(hangup ? "call_ended" : "call_answered", session_id);
+	if (!hangup) {
+		moq_copy_media_key(msg, jobj);
+	}
+	moq_ws_send_json(peer_wsi, msg);
+}
+
+/* WebRTC negotiation between users passes through as is, marked with the sender */
+static void moq_handle_forward(struct moq_ws_conn *conn, struct json_object *jobj)
+{
+	struct lws *dest_wsi;
+	
+	if (!*conn->user_id) {
+		return;
+	}
+	dest_wsi = moq_registrar_lookup(&moq_registrar,
+		json_object_get_string(json_object_object_get(jobj, "dest")), NULL);
+	if (dest_wsi) {
+		json_object_object_add(jobj, "from", json_object_new_string(conn->user_id));
+		moq_ws_send_message(dest_wsi, json_object_to_json_string(jobj));
+	}
+}
+
+static void moq_handle_presence(struct lws *wsi, struct json_object *jobj)
+{
+	const char *user_id = S_OR(json_object_get_string(json_object_object_get(jobj, "user_id")), "");
+	struct json_object *reply = json_object_new_object();
+	enum moq_presence presence;
+	
+	moq_registrar_lookup(&moq_registrar, user_id, &presence);
+	json_object_object_add(reply, "type", json_object_new_string("presence"));
+	json_object_object_add(reply, "user_id", json_object_new_string(user_id));
+	json_object_object_add(reply, "status", json_object_new_string(moq_presence_name(presence)));
+	moq_ws_send_json(wsi, reply);
+}
+
+/*
+ * Registration and call routing, so users can call each other and the PBX
+ * without a separate signaling server. Returns -1 for unknown types.
+ */
+static int moq_handle_signaling(struct lws *wsi, struct moq_ws_conn *conn, const char *type,
+	struct json_object *jobj, uint64_t received_us)
+{
+	if (!strcmp(type, "register")) {
+		moq_handle_register(wsi, conn, jobj);
+	} else if (!strcmp(type, "call")) {
+		moq_handle_call(wsi, conn, jobj, received_us);
+	} else if (!strcmp(type, "answer")) {
+		moq_handle_call_progress(wsi, conn, jobj, 0);
+	} else if (!strcmp(type, "hangup") || !strcmp(type, "call_ended")) {
+		moq_handle_call_progress(wsi, conn, jobj, 1);
+	} else if (!strcmp(type, "sdp_offer") || !strcmp(type, "sdp_answer") || !strcmp(type, "ice_candidate")) {
+		moq_handle_forward(conn, jobj);
+	} else if (!strcmp(type, "presence")) {
+		moq_handle_presence(wsi, jobj);
+	} else {
+		return -1;
+	}
+	
+	return 0;
+}
+
+/* WebSocket callback */
+static int moq_ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
+	void *user, void *in, size_t len)
+{
+	switch (reason) {
+		case LWS_CALLBACK_ESTABLISHED:
+			ast_log(LOG_NOTICE, "WebSocket connection established\n");
+			break;
+			
+		case LWS_CALLBACK_RECEIVE:
+			ast_log(LOG_DEBUG, "WebSocket received: %.*s\n", (int)len, (char *)in);
+			uint64_t received_us = moq_monotonic_us();
+			
+			/* Parse JSON message */
+			struct json_object *jobj = json_tokener_parse(in);
+			if (jobj) {
+				struct json_object *type_obj = json_object_object_get(jobj, "type");
+				if (type_obj) {
+					const char *type = json_object_get_string(type_obj);
+					ast_log(LOG_NOTICE, "WebSocket message type: %s\n", type);
+					MOQ_TRACE1(signaling_received, type);
+					
+					/* Handle incoming call, answer, hangup, etc. */
+					if (strcmp(type, "incoming_call") == 0) {
+						struct json_object *session_id_obj = json_object_object_get(jobj, "session_id");
+						struct json_object *from_obj = json_object_object_get(jobj, "from");
+						char successor[sizeof(moq_drain.successor)];
+						
+						if (session_id_obj && from_obj) {
+							const char *session_id = json_object_get_string(session_id_obj);
+							
+							/* Send new calls to the successor while draining */
+							if (moq_draining(successor, sizeof(successor))) {
+								moq_send_refusal(wsi, "call_failed", session_id, "draining", successor);
+							} else {
+								moq_incoming_call(wsi, jobj, session_id,
+									json_object_get_string(from_obj), NULL, NULL, received_us);
+							}
+						}
+					} else if (strcmp(type, "resume") == 0) {
+						moq_handle_resume(wsi, jobj, received_us);
+					} else if (strcmp(type, "call_answered") == 0) {
+						struct json_object *session_id_obj = json_object_object_get(jobj, "session_id");
+						
+						if (session_id_obj) {
+							moq_session_answered(json_object_get_string(session_id_obj), jobj, 0);
+						}
+					} else if (moq_handle_signaling(wsi, user, type, jobj, received_us)) {
+						ast_log(LOG_DEBUG, "Ignoring WebSocket message type: %s\n", type);
+					}
+				}
+				json_object_put(jobj);
+			}
+			break;
+			
+		case LWS_CALLBACK_CLOSED:
+			ast_log(LOG_NOTICE, "WebSocket connection closed\n");
+			moq_ws_unregister(wsi, user);
+			/* Peers that moved to the successor close this connection; their calls end with it */
+			moq_hangup_sessions(wsi, moq_draining(NULL, 0) ? AST_SOFTHANGUP_SHUTDOWN : 0);
+			break;
+			
+		default:
+			break;
+	}
+	
+	return 0;
+}
+
+/* WebSocket protocols */
+static struct lws_protocols protocols[] = {
+	{
+		"moq-signaling",
+		moq_ws_callback,
+		sizeof(struct moq_ws_conn),
+		4096,
+		0, NULL, 0
+	},
+	{ NULL, NULL, 0, 0, 0, NULL, 0 }
+};
+
+/* WebSocket thread */
+static void *moq_ws_thread(void *data)
+{
+	ast_log(LOG_NOTICE, "WebSocket signaling thread started on port %d\n", moq_config.ws_port);
+	
+	while (moq_config.running) {
+		lws_service(moq_config.ws_context, 50);
+	}
+	
+	ast_log(LOG_NOTICE, "WebSocket signaling thread stopped\n");
+	return NULL;
+}
+
+/* Channel technology implementations */
+static struct ast_channel *moq_request(const char *type, struct ast_format_cap *cap,
+	const struct ast_assigned_ids *assignedids, const struct ast_channel *requestor,
+	const char *addr, int *cause)
+{
+	struct ast_channel *chan;
+	struct moq_session *session;
+	
+	ast_log(LOG_NOTICE, "MoQ channel request: %s\n", addr);
+	
+	if (moq_draining(NULL, 0)) {
+		ast_log(LOG_NOTICE, "Refusing MoQ call to %s while draining\n", addr);
+		*cause = AST_CAUSE_REQUESTED_CHAN_UNAVAIL;
+		return NULL;
+	}
+	
+	/* Calls go to users registered with us, over the connection they registered on */
+	if (!moq_registrar_lookup(&moq_registrar, addr, NULL)) {
+		ast_log(LOG_NOTICE, "Refusing MoQ call to %s: not registered\n", addr);
+		*cause = AST_CAUSE_SUBSCRIBER_ABSENT;
+		return NULL;
+	}
+	
+	session = moq_session_new(addr);
+	if (!session) {
+		ast_log(LOG_ERROR, "Failed to create MoQ session\n");
+		*cause = AST_CAUSE_CONGESTION;
+		return NULL;
+	}
+	
+	chan = ast_channel_alloc(1, AST_STATE_DOWN, NULL, NULL, NULL, NULL, NULL,
+		assignedids, requestor, 0, "MOQ/%s", addr);
+	
+	if (!chan) {
+		ast_log(LOG_ERROR, "Failed to allocate channel\n");
+		moq_session_destroy(session);
+		*cause = AST_CAUSE_CONGESTION;
+		return NULL;
+	}
+	
+	ast_channel_tech_set(chan, &moq_tech);
+	ast_channel_nativeformats_set(chan, cap);
+	
+	/* The read/write formats are the audio ones; video passes through natively */
+	struct ast_format *fmt = ast_format_cap_get_best_by_type(cap, AST_MEDIA_TYPE_AUDIO);
+	if (!fmt) {
+		fmt = ao2_bump(ast_format_ulaw);
+	}
+	ast_channel_set_writeformat(chan, fmt);
+	ast_channel_set_readformat(chan, fmt);
+	ast_channel_set_rawwriteformat(chan, fmt);
+	ast_channel_set_rawreadformat(chan, fmt);
+	ao2_ref(fmt, -1);
+	
+	session->owner = chan;
+	ast_channel_tech_pvt_set(chan, session);
+	
+	ast_channel_unlock(chan);
+	
+	return chan;
+}
+
+static int moq_call(struct ast_channel *ast, const char *dest, int timeout)
+{
+	struct moq_session *session = ast_channel_tech_pvt(ast);
+	
+	if (!session) {
+		ast_log(LOG_ERROR, "No session found for channel\n");
+		return -1;
+	}
+	
+	ast_log(LOG_NOTICE, "MoQ calling: %s\n", dest);
+	
+	session->state = MOQ_STATE_CALLING;
+	ast_setstate(ast, AST_STATE_RINGING);
+	
+	/*
+	 * Route the call before looking the user up: should it go offline in
+	 * between, the call then ends. Looked up under moq_lock so a closing
+	 * connection cannot be missed by moq_hangup_sessions.
+	 */
+	if (moq_registrar_route_add(&moq_registrar, session->session_id, "", dest)) {
+		ast_log(LOG_WARNING, "Failed to route MoQ call %s\n", session->session_id);
+		return -1;
+	}
+	session->routed = 1;
+	ast_mutex_lock(&moq_lock);
+	session->ws = moq_registrar_lookup(&moq_registrar, dest, NULL);
+	ast_mutex_unlock(&moq_lock);
+	if (!session->ws) {
+		ast_log(LOG_NOTICE, "MoQ user %s went offline\n", dest);
+		return -1;
+	}
+	moq_send_call(session, S_COR(ast_channel_caller(ast)->id.number.valid,
+		ast_channel_caller(ast)->id.number.str, "asterisk"));
+	
+	/* Start media thread */
+	if (moq_session_start_media(session)) {
+		ast_log(LOG_ERROR, "Failed to start media thread\n");
+		return -1;
+	}
+	
+	ast_queue_control(ast, AST_CONTROL_RINGING);
+	
+	return 0;
+}
+
+static int moq_hangup(struct ast_channel *ast)
+{
+	struct moq_session *session = ast_channel_tech_pvt(ast);
+	uint64_t start_us = moq_monotonic_us();
+	
+	if (!session) {
+		return 0;
+	}
+	
+	ast_log(LOG_NOTICE, "MoQ hangup: %s\n", session->session_id);
+	
+	session->state = MOQ_STATE_HANGUP;
+	
+	/* Send hangup via WebSocket */
+	moq_send_hangup(session);
+	
+	/* The bridge normally stops relaying on leave; never let a peer outlive us */
+	moq_bridge_unlink(session);
+	
+	ast_mutex_lock(&session->lock);
+	session->owner = NULL;
+	ast_mutex_unlock(&session->lock);
+	
+	/* The channel's reference goes to the reaper, which waits for the media thread */
+	ast_channel_tech_pvt_set(ast, NULL);
+	moq_session_destroy(session);
+	
+	moq_hist_record(&moq_latency[MOQ_LAT_HANGUP], moq_monotonic_us() - start_us);
+	
+	return 0;
+}
+
+static struct ast_frame *moq_read(struct ast_channel *ast)
+{
+	/* Frames are queued by media thread */
+	return &ast_null_frame;
+}
+
+/*
+ * Send a video frame (H.264 or VP8 passthrough) on the session's video track.
+ * Every object of one picture carries the timestamp of its first, and the
+ * last is flagged with the frame-ending marker.
+ */
+static int moq_write_video(struct moq_session *session, struct ast_frame *frame)
+{
+	uint8_t type;
+	int res;
+	
+	if (ast_format_cmp(frame->subclass.format, ast_format_h264) == AST_FORMAT_CMP_EQUAL) {
+		type = MOQ_OBJ_VIDEO_H264;
+	} else if (ast_format_cmp(frame->subclass.format, ast_format_vp8) == AST_FORMAT_CMP_EQUAL) {
+		type = MOQ_OBJ_VIDEO_VP8;
+	} else {
+		return 0;
+	}
+	
+	if (!session->quic_conn ||
+		!__atomic_load_n(&session->quic_conn->connected, __ATOMIC_ACQUIRE) || !frame->datalen) {
+		return 0;
+	}
 	
-	/* Initialize MoQ/QUIC parameters */
-	session->track_id = (uint32_t)ast_random();
-	session->send_sequence = 0;
-	session->recv_sequence = 0;
-	session->last_timestamp = 0;
+	if (!session->video_frame_open) {
+		session->video_timestamp = moq_clock_tx_now(&session->video_clock, moq_monotonic_us());
+	}
+	session->video_frame_open = !frame->subclass.frame_ending;
+	if (frame->subclass.frame_ending) {
+		type |= MOQ_OBJ_FLAG_FRAME_END;
+	}
 	
-	/* Create QUIC connection for MoQ transport */
-	session->quic_conn = moq_quic_create("127.0.0.1", MOQ_QUIC_PORT);
-	if (!session->quic_conn) {
-		ast_log(LOG_WARNING, "Failed to create QUIC connection, using UDP fallback\n");
+	res = moq_send_media_object(session, session->video_track_id, type,
+		__atomic_fetch_add(&session->video_send_sequence, 1, __ATOMIC_RELAXED),
+		frame->data.ptr, frame->datalen,
+		session->video_timestamp);
+	moq_stats_tx_result(session, res, frame->datalen);
+	if (!res) {
+		MOQ_STAT_ADD(&session->stats, video_tx_objects, 1);
 	}
 	
-	/* Create fallback UDP socket */
-	session->media_socket = socket(AF_INET, SOCK_DGRAM, 0);
-	if (session->media_socket < 0) {
-		ast_log(LOG_ERROR, "Failed to create media socket\n");
-		if (session->quic_conn) {
-			moq_quic_destroy(session->quic_conn);
+	return 0;
+}
+
+/*
+ * Discontinuous transmission (channel write path only). Returns 1 if the
+ * frame is silence and must not be sent. The first silent frame after
+ * speech, and one every cn_interval after that, is replaced by a comfort
+ * noise object; the rest are dropped without using up a sequence number,
+ * so the peer sees no loss, only a gap in timestamps.
+ */
+static int moq_write_dtx(struct moq_session *session, double frame_level,
+	uint64_t timestamp, uint64_t now_us)
+{
+	uint8_t level;
+	int res;
+	
+	if (moq_vad_process(&session->vad, frame_level)) {
+		session->tx_silent = 0;
+		return 0;
+	}
+	
+	MOQ_STAT_ADD(&session->stats, tx_suppressed, 1);
+	if (session->tx_silent && (!moq_config.cn_interval || now_us < session->tx_cn_next_us)) {
+		return 1;
+	}
+	
+	level = moq_vad_noise_level(&session->vad);
+	res = moq_send_media_object(session, session->track_id, MOQ_OBJ_AUDIO_CN,
+		__atomic_fetch_add(&session->send_sequence, 1, __ATOMIC_RELAXED),
+		&level, sizeof(level), timestamp);
+	moq_stats_tx_result(session, res, sizeof(level));
+	if (!res) {
+		MOQ_STAT_ADD(&session->stats, tx_cn, 1);
+	}
+	
+	session->tx_silent = 1;
+	session->tx_cn_next_us = now_us + moq_config.cn_interval * 1000ULL;
+	
+	return 1;
+}
+
+static int moq_write(struct ast_channel *ast, struct ast_frame *frame)
+{
+	struct moq_session *session = ast_channel_tech_pvt(ast);
+	uint64_t write_start = moq_monotonic_us();
+	
+	if (!session) {
+		return -1;
+	}
+	
+	if (frame->frametype == AST_FRAME_VIDEO) {
+		return moq_write_video(session, frame);
+	}
+	
+	if (frame->frametype != AST_FRAME_VOICE) {
+		return 0;
+	}
+	
+	MOQ_TRACE2(write_begin, session->session_id, frame->datalen);
+	
+	/* Timestamp in samples from the session's monotonic media clock */
+	uint64_t timestamp = moq_clock_tx_stamp(&session->tx_clock, write_start,
+		frame->samples > 0 ? frame->samples : frame->datalen);
+	
+	/* Send media via MoQ/QUIC if available */
+	if (session->quic_conn && __atomic_load_n(&session->quic_conn->connected, __ATOMIC_ACQUIRE)) {
+		if (frame->datalen &&
+			ast_format_cmp(frame->subclass.format, ast_format_ulaw) == AST_FORMAT_CMP_EQUAL) {
+			double level = moq_vad_level(frame->data.ptr, frame->datalen);
+			
+			MOQ_STAT_SET(&session->stats, tx_level, (int64_t)level);
+			if (moq_config.vad && moq_write_dtx(session, level, timestamp, write_start)) {
+				session->last_timestamp = timestamp;
+				return 0;
+			}
 		}
-		ast_free(session);
-		return NULL;
+		
+		int res = moq_send_media_object(session, session->track_id, MOQ_OBJ_AUDIO_ULAW,
+			__atomic_fetch_add(&session->send_sequence, 1, __ATOMIC_RELAXED),
+			frame->data.ptr, frame->datalen, timestamp);
+		uint64_t send_us = moq_monotonic_us() - write_start;
+		
+		moq_stats_tx_result(session, res, frame->datalen);
+		moq_hist_record(&moq_latency[MOQ_LAT_WRITE_SEND], send_us);
+		MOQ_TRACE4(object_sent, session->session_id, session->send_sequence - 1, send_us, res);
+	} else if (session->media_socket >= 0 && 
+		session->media_addr.ss.ss_family == AF_INET) {
+		/* Fallback to UDP */
+		ssize_t sent = sendto(session->media_socket, frame->data.ptr, frame->datalen, MSG_DONTWAIT,
+			(const struct sockaddr *)&session->media_addr.ss, sizeof(struct sockaddr_in));
+		
+		moq_stats_tx_result(session, sent < 0 ? -1 : 0, frame->datalen);
 	}
 	
-	struct sockaddr_in addr;
-	memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-	addr.sin_addr.s_addr = INADDR_ANY;
-	addr.sin_port = 0; /* Let kernel assign port */
+	session->last_timestamp = timestamp;
 	
-	if (bind(session->media_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-		ast_log(LOG_ERROR, "Failed to bind media socket\n");
-		close(session->media_socket);
-		if (session->quic_conn) {
-			moq_quic_destroy(session->quic_conn);
+	return 0;
+}
+
+static int moq_answer(struct ast_channel *ast)
+{
+	struct moq_session *session = ast_channel_tech_pvt(ast);
+	
+	if (!session) {
+		return -1;
+	}
+	
+	ast_log(LOG_NOTICE, "MoQ answer: %s\n", session->session_id);
+	
+	session->state = MOQ_STATE_UP;
+	ast_setstate(ast, AST_STATE_UP);
+	
+	/* Send answer via WebSocket */
+	moq_send_answer(session);
+	
+	/* Start media thread if not already running */
+	if (!session->running) {
+		if (moq_session_start_media(session)) {
+			ast_log(LOG_ERROR, "Failed to start media thread\n");
+			return -1;
 		}
-		ast_free(session);
-		return NULL;
 	}
 	
-	session->running = 1;
+	return 0;
+}
+
+static int moq_indicate(struct ast_channel *ast, int condition, const void *data, size_t datalen)
+{
+	switch (condition) {
+		case AST_CONTROL_RINGING:
+			ast_log(LOG_DEBUG, "MoQ indicate: ringing\n");
+			return 0;
+		case AST_CONTROL_PROGRESS:
+			ast_log(LOG_DEBUG, "MoQ indicate: progress\n");
+			return 0;
+		case AST_CONTROL_PROCEEDING:
+			ast_log(LOG_DEBUG, "MoQ indicate: proceeding\n");
+			return 0;
+		default:
+			return -1;
+	}
+}
+
+static int moq_fixup(struct ast_channel *oldchan, struct ast_channel *newchan)
+{
+	struct moq_session *session = ast_channel_tech_pvt(newchan);
 	
-	ast_log(LOG_NOTICE, "Created MoQ session %s for destination %s (track_id: %u)\n", 
-		session->session_id, dest, session->track_id);
+	if (session) {
+		ast_mutex_lock(&session->lock);
+		session->owner = newchan;
+		ast_mutex_unlock(&session->lock);
+	}
 	
-	return session;
+	return 0;
 }
 
-/* Destroy MoQ session */
-static void moq_session_destroy(struct moq_session *session)
+/* Whether a bridged channel can have its media relayed below the core */
+static int moq_bridge_channel_capable(struct ast_bridge_channel *bridge_channel)
 {
-	if (!session) {
-		return;
+	struct ast_channel *chan = bridge_channel->chan;
+	struct moq_session *session;
+	
+	if (ast_channel_tech(chan) != &moq_tech) {
+		return 0;
 	}
 	
-	ast_log(LOG_NOTICE, "Destroying MoQ session %s\n", session->session_id);
+	session = ast_channel_tech_pvt(chan);
+	if (!session || !session->quic_conn ||
+		!__atomic_load_n(&session->quic_conn->connected, __ATOMIC_ACQUIRE)) {
+		return 0;
+	}
 	
-	session->running = 0;
+	/* Sealed objects authenticate their header, so they cannot be relayed with a new one */
+	if (__atomic_load_n(&session->tx_protected, __ATOMIC_ACQUIRE) ||
+		__atomic_load_n(&session->rx_protected, __ATOMIC_ACQUIRE)) {
+		return 0;
+	}
 	
-	if (session->media_thread) {
-		pthread_join(session->media_thread, NULL);
+	/* Recording, audiohooks, framehooks and DTMF features need frames in the core */
+	if (ast_channel_has_hook_requiring_audio(chan) ||
+		ast_channel_has_audio_frame_or_monitor(chan)) {
+		return 0;
+	}
+	if (bridge_channel->features && bridge_channel->features->dtmf_hooks &&
+		ao2_container_count(bridge_channel->features->dtmf_hooks)) {
+		return 0;
 	}
 	
-	if (session->quic_conn) {
-		moq_quic_destroy(session->quic_conn);
+	return 1;
+}
+
+static int moq_bridge_compatible(struct ast_bridge *bridge)
+{
+	struct ast_bridge_channel *bc0, *bc1;
+	
+	if (bridge->num_channels != 2) {
+		return 0;
 	}
 	
-	if (session->media_socket >= 0) {
-		close(session->media_socket);
+	bc0 = AST_LIST_FIRST(&bridge->channels);
+	bc1 = AST_LIST_LAST(&bridge->channels);
+	if (!moq_bridge_channel_capable(bc0) || !moq_bridge_channel_capable(bc1)) {
+		return 0;
 	}
 	
-	ast_mutex_destroy(&session->lock);
-	ast_free(session);
+	/* Objects are relayed untranslated, so both ends must use the same formats */
+	if (ast_format_cmp(ast_channel_rawreadformat(bc0->chan),
+			ast_channel_rawwriteformat(bc1->chan)) != AST_FORMAT_CMP_EQUAL ||
+		ast_format_cmp(ast_channel_rawreadformat(bc1->chan),
+			ast_channel_rawwriteformat(bc0->chan)) != AST_FORMAT_CMP_EQUAL) {
+		return 0;
+	}
+	
+	return 1;
 }
 
-/* WebSocket callback */
-static int moq_ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
-	void *user, void *in, size_t len)
+static int moq_bridge_join(struct ast_bridge *bridge, struct ast_bridge_channel *bridge_channel)
 {
-	switch (reason) {
-		case LWS_CALLBACK_ESTABLISHED:
-			ast_log(LOG_NOTICE, "WebSocket connection established\n");
-			break;
-			
-		case LWS_CALLBACK_RECEIVE:
-			ast_log(LOG_DEBUG, "WebSocket received: %.*s\n", (int)len, (char *)in);
-			
-			/* Parse JSON message */
-			struct json_object *jobj = json_tokener_parse(in);
-			if (jobj) {
-				struct json_object *type_obj = json_object_object_get(jobj, "type");
-				if (type_obj) {
-					const char *type = json_object_get_string(type_obj);
-					ast_log(LOG_NOTICE, "WebSocket message type: %s\n", type);
-					
-					/* Handle incoming call, answer, hangup, etc. */
-					if (strcmp(type, "incoming_call") == 0) {
-						struct json_object *session_id_obj = json_object_object_get(jobj, "session_id");
-						struct json_object *from_obj = json_object_object_get(jobj, "from");
-						
-						if (session_id_obj && from_obj) {
-							const char *session_id = json_object_get_string(session_id_obj);
-							const char *from = json_object_get_string(from_obj);
-							
-							/* Create incoming channel */
-							struct ast_format_cap *cap = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
-							if (cap) {
-								ast_format_cap_append(cap, ast_format_ulaw, 0);
-								
-							struct ast_channel *chan = ast_channel_alloc(1, AST_STATE_RING,
-								from, NULL, NULL, NULL, NULL, NULL, NULL, 0, "MOQ/%s", session_id);
-								
-								if (chan) {
-									ast_channel_tech_set(chan, &moq_tech);
-									ast_channel_nativeformats_set(chan, cap);
-									ast_channel_set_writeformat(chan, ast_format_ulaw);
-									ast_channel_set_readformat(chan, ast_format_ulaw);
-									ast_channel_set_rawwriteformat(chan, ast_format_ulaw);
-									ast_channel_set_rawreadformat(chan, ast_format_ulaw);
-									
-									struct moq_session *session = moq_session_new(from);
-									if (session) {
-										ast_copy_string(session->session_id, session_id, sizeof(session->session_id));
-										session->ws = wsi;
-										session->owner = chan;
-										ast_channel_tech_pvt_set(chan, session);
-										
-										ast_channel_unlock(chan);
-										
-										if (ast_pbx_start(chan)) {
-											ast_log(LOG_ERROR, "Failed to start PBX\n");
-											ast_hangup(chan);
-										}
-									} else {
-										ast_hangup(chan);
-									}
-								}
-								
-								ao2_ref(cap, -1);
-							}
-						}
-					}
-				}
-				json_object_put(jobj);
-			}
-			break;
-			
-		case LWS_CALLBACK_CLOSED:
-			ast_log(LOG_NOTICE, "WebSocket connection closed\n");
-			break;
-			
-		default:
-			break;
+	struct ast_bridge_channel *bc0, *bc1;
+	struct moq_session *s0, *s1;
+	
+	if (bridge->num_channels != 2) {
+		return 0;
+	}
+	
+	bc0 = AST_LIST_FIRST(&bridge->channels);
+	bc1 = AST_LIST_LAST(&bridge->channels);
+	s0 = ast_channel_tech_pvt(bc0->chan);
+	s1 = ast_channel_tech_pvt(bc1->chan);
+	if (!s0 || !s1) {
+		return -1;
 	}
 	
+	moq_bridge_link(s0, s1);
+	moq_bridge_link(s1, s0);
+	ast_debug(1, "MoQ native bridge %s <-> %s started\n", s0->session_id, s1->session_id);
+	
 	return 0;
 }
 
-/* WebSocket protocols */
-static struct lws_protocols protocols[] = {
-	{
-		"moq-signaling",
-		moq_ws_callback,
-		0,
-		4096,
-		0, NULL, 0
-	},
-	{ NULL, NULL, 0, 0, 0, NULL, 0 }
+static void moq_bridge_unsuspend(struct ast_bridge *bridge, struct ast_bridge_channel *bridge_channel)
+{
+	moq_bridge_join(bridge, bridge_channel);
+}
+
+static void moq_bridge_leave(struct ast_bridge *bridge, struct ast_bridge_channel *bridge_channel)
+{
+	struct moq_session *session = ast_channel_tech_pvt(bridge_channel->chan);
+	
+	if (session && ast_channel_tech(bridge_channel->chan) == &moq_tech) {
+		moq_bridge_unlink(session);
+	}
+}
+
+static void moq_bridge_stop(struct ast_bridge *bridge)
+{
+	struct ast_bridge_channel *bc0 = AST_LIST_FIRST(&bridge->channels);
+	struct moq_session *session;
+	
+	if (bc0 && (session = ast_channel_tech_pvt(bc0->chan))) {
+		moq_bridge_unlink(session);
+	}
+}
+
+/* Media never reaches the core while relaying; pass anything else through */
+static int moq_bridge_write(struct ast_bridge *bridge, struct ast_bridge_channel *bridge_channel,
+	struct ast_frame *frame)
+{
+	return ast_bridge_queue_everyone_else(bridge, bridge_channel, frame);
+}
+
+static struct ast_bridge_technology moq_bridge_tech = {
+	.name = "moq_native",
+	.capabilities = AST_BRIDGE_CAPABILITY_NATIVE,
+	.preference = AST_BRIDGE_PREFERENCE_BASE_NATIVE,
+	.join = moq_bridge_join,
+	.leave = moq_bridge_leave,
+	.unsuspend = moq_bridge_unsuspend,
+	.suspend = moq_bridge_leave,
+	.stop = moq_bridge_stop,
+	.compatible = moq_bridge_compatible,
+	.write = moq_bridge_write,
+};
+
+static int moq_uint_cmp(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *)a;
+	unsigned int y = *(const unsigned int *)b;
+	
+	return (x > y) - (x < y);
+}
+
+/* CLI: moq show pool */
+static char *handle_moq_show_pool(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	unsigned int samples[MOQ_SETUP_SAMPLES];
+	unsigned int count;
+	unsigned int hits, misses;
+	unsigned int queued, reaped, batches, max_batch;
+	int idle;
+	
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "moq show pool";
+		e->usage =
+			"Usage: moq show pool\n"
+			"       Shows the pre-warmed session pool, the reaper tearing down\n"
+			"       ended sessions and recent call-setup latency (channel request\n"
+			"       to first media frame).\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+	
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+	
+	ast_mutex_lock(&moq_pool_lock);
+	idle = moq_pool.count;
+	hits = moq_pool.hits;
+	misses = moq_pool.misses;
+	ast_mutex_unlock(&moq_pool_lock);
+	
+	ast_mutex_lock(&moq_reaper_lock);
+	queued = moq_reaper.queued;
+	reaped = moq_reaper.reaped;
+	batches = moq_reaper.batches;
+	max_batch = moq_reaper.max_batch;
+	ast_mutex_unlock(&moq_reaper_lock);
+	
+	ast_mutex_lock(&moq_lock);
+	count = moq_setup_latency.count;
+	memcpy(samples, moq_setup_latency.samples, count * sizeof(samples[0]));
+	ast_mutex_unlock(&moq_lock);
+	
+	ast_cli(a->fd, "Idle sessions:   %d (size %d, low-water %d)\n",
+		idle, moq_config.pool_size, moq_config.pool_low_water);
+	ast_cli(a->fd, "Pool hits:       %u\n", hits);
+	ast_cli(a->fd, "Pool misses:     %u\n", misses);
+	ast_cli(a->fd, "Reaping:         %u\n", queued);
+	ast_cli(a->fd, "Reaped:          %u in %u batches, largest %u\n", reaped, batches, max_batch);
+	
+	if (!count) {
+		ast_cli(a->fd, "Setup latency:   no samples\n");
+		return CLI_SUCCESS;
+	}
+	
+	qsort(samples, count, sizeof(samples[0]), moq_uint_cmp);
+	ast_cli(a->fd, "Setup latency:   %u samples, p50 %u us, p90 %u us, p99 %u us, max %u us\n",
+		count, samples[count / 2], samples[(count * 90) / 100],
+		samples[(count * 99) / 100], samples[count - 1]);
+	
+	return CLI_SUCCESS;
+}
+
+static char *handle_moq_show_relays(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct moq_session *session;
+	int sessions[MOQ_MAX_RELAYS] = { 0, };
+	int i;
+	
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "moq show relays";
+		e->usage =
+			"Usage: moq show relays\n"
+			"       Shows the upstream relays with their health, probe RTT and\n"
+			"       the sessions using each. New sessions go to the healthy relay\n"
+			"       with the lowest RTT.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+	
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+	
+#define FORMAT "%-24s %-8s %10s %8s %8s %8s %9s\n"
+	ast_cli(a->fd, FORMAT, "Relay", "State", "RTT (us)", "Probes", "Replies", "Sessions", "Failovers");
+	ast_mutex_lock(&moq_lock);
+	AST_LIST_TRAVERSE(&moq_sessions, session, list_entry) {
+		sessions[session->relay]++;
+	}
+	ast_mutex_lock(&moq_relay_lock);
+	for (i = 0; i < moq_relays.count; i++) {
+		struct moq_relay *relay = &moq_relays.list[i];
+		char rtt[16], probes[16], replies[16], count[16], failovers[16];
+		
+		snprintf(rtt, sizeof(rtt), "%.0f", relay->srtt);
+		snprintf(probes, sizeof(probes), "%u", relay->probes);
+		snprintf(replies, sizeof(replies), "%u", relay->replies);
+		snprintf(count, sizeof(count), "%d", sessions[i]);
+		snprintf(failovers, sizeof(failovers), "%u", relay->failovers);
+		ast_cli(a->fd, FORMAT, relay->name,
+			!moq_config.relay_probe_interval ? "unprobed" : relay->healthy ? "up" :
+			relay->goaway_us ? "leaving" : "down",
+			relay->healthy ? rtt : "-", probes, replies, count, failovers);
+	}
+	ast_mutex_unlock(&moq_relay_lock);
+	ast_mutex_unlock(&moq_lock);
+#undef FORMAT
+	
+	return CLI_SUCCESS;
+}
+
+#define FORMAT "%-32s %-10s %6s %12s\n"
+struct moq_show_users_args {
+	int fd;
+	uint64_t now_us;
 };
 
-/* WebSocket thread */
-static void *moq_ws_thread(void *data)
+static void moq_show_user(void *data, const struct moq_registrar_user *user)
 {
-	ast_log(LOG_NOTICE, "WebSocket signaling thread started on port %d\n", moq_config.ws_port);
+	struct moq_show_users_args *args = data;
+	unsigned long long secs = 0;
+	char calls[16], age[32];
 	
-	while (moq_config.running) {
-		lws_service(moq_config.ws_context, 50);
+	if (args->now_us > user->registered_us) {
+		secs = (args->now_us - user->registered_us) / 1000000;
 	}
-	
-	ast_log(LOG_NOTICE, "WebSocket signaling thread stopped\n");
-	return NULL;
+	snprintf(calls, sizeof(calls), "%u", user->calls);
+	snprintf(age, sizeof(age), "%llu:%02llu:%02llu", secs / 3600, secs / 60 % 60, secs % 60);
+	ast_cli(args->fd, FORMAT, user->user_id,
+		moq_presence_name(user->calls ? MOQ_PRESENCE_BUSY : MOQ_PRESENCE_AVAILABLE), calls, age);
 }
 
-/* Channel technology implementations */
-static struct ast_channel *moq_request(const char *type, struct ast_format_cap *cap,
-	const struct ast_assigned_ids *assignedids, const struct ast_channel *requestor,
-	const char *addr, int *cause)
+static char *handle_moq_show_users(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
-	struct ast_channel *chan;
-	struct moq_session *session;
-	
-	ast_log(LOG_NOTICE, "MoQ channel request: %s\n", addr);
-	
-	session = moq_session_new(addr);
-	if (!session) {
-		ast_log(LOG_ERROR, "Failed to create MoQ session\n");
-		*cause = AST_CAUSE_CONGESTION;
+	struct moq_show_users_args args;
+	size_t count;
+	
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "moq show users";
+		e->usage =
+			"Usage: moq show users\n"
+			"       Shows the users registered on the signaling server, whether\n"
+			"       they are in a call and for how long they have been registered.\n";
+		return NULL;
+	case CLI_GENERATE:
 		return NULL;
 	}
 	
-	chan = ast_channel_alloc(1, AST_STATE_DOWN, NULL, NULL, NULL, NULL, NULL,
-		assignedids, requestor, 0, "MOQ/%s", addr);
-	
-	if (!chan) {
-		ast_log(LOG_ERROR, "Failed to allocate channel\n");
-		moq_session_destroy(session);
-		*cause = AST_CAUSE_CONGESTION;
-		return NULL;
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
 	}
 	
-	ast_channel_tech_set(chan, &moq_tech);
-	ast_channel_nativeformats_set(chan, cap);
+	args.fd = a->fd;
+	args.now_us = moq_wallclock_us();
+	ast_cli(a->fd, FORMAT, "User", "Presence", "Calls", "Registered");
+	count = moq_registrar_foreach_user(&moq_registrar, moq_show_user, &args);
+	ast_cli(a->fd, "%zu registered MoQ user%s\n", count, count == 1 ? "" : "s");
 	
-	struct ast_format *fmt = ast_format_cap_get_format(cap, 0);
-	ast_channel_set_writeformat(chan, fmt);
-	ast_channel_set_readformat(chan, fmt);
-	ast_channel_set_rawwriteformat(chan, fmt);
-	ast_channel_set_rawreadformat(chan, fmt);
-	ao2_ref(fmt, -1);
+	return CLI_SUCCESS;
+}
+#undef FORMAT
+
+static char *handle_moq_drain(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	const char *successor;
+	int timeout;
+	
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "moq drain {start|cancel|status}";
+		e->usage =
+			"Usage: moq drain start [<successor> [<seconds>]]\n"
+			"       moq drain cancel\n"
+			"       moq drain status\n"
+			"       Drains the module before a restart. New calls are refused and\n"
+			"       every peer is sent GOAWAY naming the successor to reconnect to\n"
+			"       (successor in moq.conf by default), with the state needed to\n"
+			"       resume its call there when handoff_secret is set. Calls carry on\n"
+			"       until they end, or are hung up after <seconds> (drain_timeout,\n"
+			"       0 for no deadline). cancel accepts new calls again.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
 	
-	session->owner = chan;
-	ast_channel_tech_pvt_set(chan, session);
+	if (!strcasecmp(a->argv[2], "start")) {
+		successor = a->argc > 3 ? a->argv[3] : moq_config.successor;
+		timeout = moq_config.drain_timeout;
+		if (a->argc > 5 || (a->argc == 5 && (sscanf(a->argv[4], "%d", &timeout) != 1 || timeout < 0))) {
+			return CLI_SHOWUSAGE;
+		}
+		if (moq_drain_start(successor, timeout)) {
+			ast_cli(a->fd, "Already draining\n");
+			return CLI_SUCCESS;
+		}
+	} else if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	} else if (!strcasecmp(a->argv[2], "cancel")) {
+		ast_cli(a->fd, moq_drain_cancel() ? "Not draining\n" : "Drain cancelled, accepting new calls\n");
+		return CLI_SUCCESS;
+	}
 	
-	ast_channel_unlock(chan);
+	ast_mutex_lock(&moq_lock);
+	if (!moq_drain.active) {
+		ast_cli(a->fd, "Not draining\n");
+	} else {
+		long long elapsed = ast_tvdiff_ms(ast_tvnow(), moq_drain.started) / 1000;
+		
+		ast_cli(a->fd, "Draining for:    %lld s\n", elapsed);
+		ast_cli(a->fd, "Successor:       %s\n", S_OR(moq_drain.successor, "(none)"));
+		if (!moq_drain.timeout) {
+			ast_cli(a->fd, "Deadline:        none\n");
+		} else if (elapsed < moq_drain.timeout) {
+			ast_cli(a->fd, "Deadline:        in %lld s\n", moq_drain.timeout - elapsed);
+		} else {
+			ast_cli(a->fd, "Deadline:        passed\n");
+		}
+		ast_cli(a->fd, "Calls up:        %d\n", moq_session_count);
+		ast_cli(a->fd, "Sent GOAWAY:     %u (%u with handoff)\n", moq_drain.notified, moq_drain.handed_off);
+		ast_cli(a->fd, "Hung up:         %u at the deadline\n", moq_drain.forced);
+	}
+	ast_mutex_unlock(&moq_lock);
 	
-	return chan;
+	return CLI_SUCCESS;
 }
 
-static int moq_call(struct ast_channel *ast, const char *dest, int timeout)
+static const char *moq_state_str(enum moq_state state)
 {
-	struct moq_session *session = ast_channel_tech_pvt(ast);
-	
-	if (!session) {
-		ast_log(LOG_ERROR, "No session found for channel\n");
-		return -1;
+	switch (state) {
+	case MOQ_STATE_DOWN:
+		return "Down";
+	case MOQ_STATE_CALLING:
+		return "Calling";
+	case MOQ_STATE_RINGING:
+		return "Ringing";
+	case MOQ_STATE_UP:
+		return "Up";
+	case MOQ_STATE_HANGUP:
+		return "Hangup";
 	}
+	return "Unknown";
+}
+
+/* Complete an active session ID (called with the CLI word and match index) */
+static char *moq_complete_session_id(const char *word, int state)
+{
+	struct moq_session *session;
+	size_t wordlen = strlen(word);
+	char *ret = NULL;
+	int which = 0;
+	
+	ast_mutex_lock(&moq_lock);
+	AST_LIST_TRAVERSE(&moq_sessions, session, list_entry) {
+		if (!strncasecmp(word, session->session_id, wordlen) && ++which > state) {
+			ret = ast_strdup(session->session_id);
+			break;
+		}
+	}
+	ast_mutex_unlock(&moq_lock);
 	
-	ast_log(LOG_NOTICE, "MoQ calling: %s\n", dest);
-	
-	session->state = MOQ_STATE_CALLING;
-	ast_setstate(ast, AST_STATE_RINGING);
+	return ret;
+}
+
+/* CLI: moq show sessions */
+static char *handle_moq_show_sessions(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct moq_session *session;
 	
-	/* Send call via WebSocket */
-	if (moq_config.ws_context) {
-		moq_send_call(session, dest);
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "moq show sessions";
+		e->usage =
+			"Usage: moq show sessions\n"
+			"       Lists active MoQ sessions with their media counters.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
 	}
 	
-	/* Start media thread */
-	if (pthread_create(&session->media_thread, NULL, moq_media_thread, session)) {
-		ast_log(LOG_ERROR, "Failed to create media thread\n");
-		return -1;
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
 	}
 	
-	ast_queue_control(ast, AST_CONTROL_RINGING);
+#define FORMAT "%-26s %-16s %-8s %10s %10s %8s %8s %10s %10s\n"
+	ast_cli(a->fd, FORMAT, "Session", "Remote", "State", "Rx Pkts", "Tx Pkts",
+		"Lost", "Reorder", "Jitter(us)", "RTT(us)");
 	
-	return 0;
+	ast_mutex_lock(&moq_lock);
+	AST_LIST_TRAVERSE(&moq_sessions, session, list_entry) {
+		struct moq_stats stats;
+		char rx[24], tx[24], lost[24], reorder[24], jitter[24], rtt[24];
+		
+		moq_stats_snapshot(&session->stats, &stats);
+		snprintf(rx, sizeof(rx), "%llu", (unsigned long long)stats.rx_packets);
+		snprintf(tx, sizeof(tx), "%llu", (unsigned long long)stats.tx_packets);
+		snprintf(lost, sizeof(lost), "%llu", (unsigned long long)stats.rx_lost);
+		snprintf(reorder, sizeof(reorder), "%llu", (unsigned long long)stats.rx_reordered);
+		snprintf(jitter, sizeof(jitter), "%llu", (unsigned long long)stats.rx_jitter);
+		if (stats.rr_received) {
+			snprintf(rtt, sizeof(rtt), "%llu", (unsigned long long)stats.rtt);
+		} else {
+			ast_copy_string(rtt, "-", sizeof(rtt));
+		}
+		ast_cli(a->fd, FORMAT, session->session_id, session->remote_id,
+			moq_state_str(session->state), rx, tx, lost, reorder, jitter, rtt);
+	}
+	ast_cli(a->fd, "%d active MoQ session%s\n", moq_session_count,
+		moq_session_count == 1 ? "" : "s");
+	ast_mutex_unlock(&moq_lock);
+#undef FORMAT
+	
+	return CLI_SUCCESS;
 }
 
-static int moq_hangup(struct ast_channel *ast)
+/* CLI: moq show session <id> */
+static char *handle_moq_show_session(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
-	struct moq_session *session = ast_channel_tech_pvt(ast);
-	
-	if (!session) {
-		return 0;
+	struct moq_session *session;
+	int found = 0;
+	
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "moq show session";
+		e->usage =
+			"Usage: moq show session <id>\n"
+			"       Shows transport details and media statistics of one session.\n";
+		return NULL;
+	case CLI_GENERATE:
+		if (a->pos == 3) {
+			return moq_complete_session_id(a->word, a->n);
+		}
+		return NULL;
 	}
 	
-	ast_log(LOG_NOTICE, "MoQ hangup: %s\n", session->session_id);
-	
-	session->state = MOQ_STATE_HANGUP;
-	
-	/* Send hangup via WebSocket */
-	moq_send_hangup(session);
+	if (a->argc != 4) {
+		return CLI_SHOWUSAGE;
+	}
 	
-	ast_mutex_lock(&session->lock);
-	session->owner = NULL;
-	ast_mutex_unlock(&session->lock);
+	ast_mutex_lock(&moq_lock);
+	AST_LIST_TRAVERSE(&moq_sessions, session, list_entry) {
+		struct moq_stats stats;
+		int rx_queue, tx_queue;
+		
+		if (strcasecmp(session->session_id, a->argv[3])) {
+			continue;
+		}
+		
+		moq_stats_snapshot(&session->stats, &stats);
+		moq_session_queue_depths(session, &rx_queue, &tx_queue);
+		
+		ast_cli(a->fd, "Session:          %s\n", session->session_id);
+		ast_cli(a->fd, "Remote:           %s\n", session->remote_id);
+		ast_cli(a->fd, "Channel:          %s\n", session->owner ? ast_channel_name(session->owner) : "<none>");
+		ast_cli(a->fd, "State:            %s\n", moq_state_str(session->state));
+		ast_cli(a->fd, "Track ID:         %u\n", session->track_id);
+		ast_cli(a->fd, "Transport:        %s\n",
+			session->quic_conn && session->quic_conn->connected ? "MoQ/QUIC" : "UDP fallback");
+		ast_cli(a->fd, "Relay:            %s\n", moq_relays.list[session->relay].name);
+		ast_cli(a->fd, "Rx packets:       %llu\n", (unsigned long long)stats.rx_packets);
+		ast_cli(a->fd, "Rx bytes:         %llu\n", (unsigned long long)stats.rx_bytes);
+		ast_cli(a->fd, "Rx lost:          %llu\n", (unsigned long long)stats.rx_lost);
+		ast_cli(a->fd, "Rx reordered:     %llu\n", (unsigned long long)stats.rx_reordered);
+		ast_cli(a->fd, "Rx jitter:        %llu us\n", (unsigned long long)stats.rx_jitter);
+		ast_cli(a->fd, "Rx queue:         %d bytes\n", rx_queue);
+		ast_cli(a->fd, "Tx packets:       %llu\n", (unsigned long long)stats.tx_packets);
+		ast_cli(a->fd, "Tx bytes:         %llu\n", (unsigned long long)stats.tx_bytes);
+		ast_cli(a->fd, "Tx errors:        %llu\n", (unsigned long long)stats.tx_errors);
+		ast_cli(a->fd, "Tx dropped:       %llu (socket full)\n", (unsigned long long)stats.tx_eagain);
+		ast_cli(a->fd, "Tx queue:         %d bytes\n", tx_queue);
+		ast_cli(a->fd, "RTT:              %llu us\n", (unsigned long long)stats.rtt);
+		ast_cli(a->fd, "Remote lost:      %llu\n", (unsigned long long)stats.remote_lost);
+		ast_cli(a->fd, "Remote jitter:    %llu us\n", (unsigned long long)stats.remote_jitter);
+		ast_cli(a->fd, "Reports sent:     %llu\n", (unsigned long long)stats.rr_sent);
+		ast_cli(a->fd, "Reports received: %llu\n", (unsigned long long)stats.rr_received);
+		ast_cli(a->fd, "Clock skew:       %lld ppm\n", (long long)stats.clock_skew);
+		ast_cli(a->fd, "Samples stretched: %llu\n", (unsigned long long)stats.samples_stretched);
+		ast_cli(a->fd, "Samples dropped:  %llu\n", (unsigned long long)stats.samples_dropped);
+		ast_cli(a->fd, "Video track ID:   %u\n", session->video_track_id);
+		ast_cli(a->fd, "Video rx objects: %llu\n", (unsigned long long)stats.video_rx_objects);
+		ast_cli(a->fd, "Video tx objects: %llu\n", (unsigned long long)stats.video_tx_objects);
+		ast_cli(a->fd, "Reassembly:       %llu timed out, %llu evicted\n",
+			(unsigned long long)stats.reasm_timeouts, (unsigned long long)stats.reasm_evicted);
+		ast_cli(a->fd, "Native bridge:    %s\n",
+			session->bridge_peer ? session->bridge_peer->session_id : "<none>");
+		ast_cli(a->fd, "Relayed objects:  %llu\n", (unsigned long long)stats.fwd_packets);
+		ast_cli(a->fd, "Tx suppressed:    %llu (silence)\n", (unsigned long long)stats.tx_suppressed);
+		ast_cli(a->fd, "Comfort noise:    %llu sent, %llu received, %llu frames played\n",
+			(unsigned long long)stats.tx_cn, (unsigned long long)stats.rx_cn,
+			(unsigned long long)stats.cn_generated);
+		ast_cli(a->fd, "Audio level:      tx %lld dBov, rx %lld dBov\n",
+			(long long)stats.tx_level, (long long)stats.rx_level);
+		ast_cli(a->fd, "Encryption:       tx %s, rx %s\n",
+			session->tx_protected ? moq_cipher_name(session->tx_cipher) : "off",
+			session->rx_protected ? moq_cipher_name(session->rx_crypto.cipher) : "off");
+		ast_cli(a->fd, "Auth failures:    %llu\n", (unsigned long long)stats.rx_auth_failed);
+		if (session->tap) {
+			pthread_mutex_lock(&session->tap->lock);
+			ast_cli(a->fd, "Tap:              %s, %llu objects, %llu bytes%s%s\n",
+				session->tap->map ? session->tap->path : "stopped",
+				(unsigned long long)session->tap->objects, (unsigned long long)session->tap->bytes,
+				session->tap->failed ? ", " : "",
+				session->tap->failed ? strerror(session->tap->failed) : "");
+			pthread_mutex_unlock(&session->tap->lock);
+		} else {
+			ast_cli(a->fd, "Tap:              off\n");
+		}
+		found = 1;
+		break;
+	}
+	ast_mutex_unlock(&moq_lock);
 	
-	ast_channel_tech_pvt_set(ast, NULL);
-	moq_session_destroy(session);
+	if (!found) {
+		ast_cli(a->fd, "No such MoQ session '%s'\n", a->argv[3]);
+		return CLI_FAILURE;
+	}
 	
-	return 0;
+	return CLI_SUCCESS;
 }
 
-static struct ast_frame *moq_read(struct ast_channel *ast)
+/* Aggregate counters of ended and active sessions, plus current queue depths */
+static int moq_stats_aggregate(struct moq_stats *total, int *rx_queue, int *tx_queue)
 {
-	/* Frames are queued by media thread */
-	return &ast_null_frame;
+	struct moq_session *session;
+	int count;
+	
+	*rx_queue = 0;
+	*tx_queue = 0;
+	
+	ast_mutex_lock(&moq_lock);
+	*total = moq_ended_totals;
+	total->rx_jitter = 0;
+	total->remote_jitter = 0;
+	total->rtt = 0;
+	AST_LIST_TRAVERSE(&moq_sessions, session, list_entry) {
+		struct moq_stats stats;
+		int rxq, txq;
+		
+		moq_stats_snapshot(&session->stats, &stats);
+		moq_stats_accumulate(total, &stats);
+		moq_session_queue_depths(session, &rxq, &txq);
+		*rx_queue += rxq;
+		*tx_queue += txq;
+	}
+	count = moq_session_count;
+	ast_mutex_unlock(&moq_lock);
+	
+	return count;
 }
 
-static int moq_write(struct ast_channel *ast, struct ast_frame *frame)
+/* CLI: moq show stats */
+static char *handle_moq_show_stats(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
-	struct moq_session *session = ast_channel_tech_pvt(ast);
+	struct moq_stats total;
+	int rx_queue, tx_queue, count;
+	
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "moq show stats";
+		e->usage =
+			"Usage: moq show stats\n"
+			"       Shows media statistics aggregated over all sessions since\n"
+			"       the module was loaded. Jitter and RTT are the maximum over\n"
+			"       active sessions.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
 	
-	if (!session) {
-		return -1;
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
 	}
 	
-	if (frame->frametype != AST_FRAME_VOICE) {
-		return 0;
+	count = moq_stats_aggregate(&total, &rx_queue, &tx_queue);
+	
+	ast_cli(a->fd, "Active sessions:  %d\n", count);
+	ast_cli(a->fd, "Rx packets:       %llu\n", (unsigned long long)total.rx_packets);
+	ast_cli(a->fd, "Rx bytes:         %llu\n", (unsigned long long)total.rx_bytes);
+	ast_cli(a->fd, "Rx lost:          %llu\n", (unsigned long long)total.rx_lost);
+	ast_cli(a->fd, "Rx reordered:     %llu\n", (unsigned long long)total.rx_reordered);
+	ast_cli(a->fd, "Rx max jitter:    %llu us\n", (unsigned long long)total.rx_jitter);
+	ast_cli(a->fd, "Rx queued:        %d bytes\n", rx_queue);
+	ast_cli(a->fd, "Tx packets:       %llu\n", (unsigned long long)total.tx_packets);
+	ast_cli(a->fd, "Tx bytes:         %llu\n", (unsigned long long)total.tx_bytes);
+	ast_cli(a->fd, "Tx errors:        %llu\n", (unsigned long long)total.tx_errors);
+	ast_cli(a->fd, "Tx dropped:       %llu (socket full)\n", (unsigned long long)total.tx_eagain);
+	ast_cli(a->fd, "Tx queued:        %d bytes\n", tx_queue);
+	ast_cli(a->fd, "Max RTT:          %llu us\n", (unsigned long long)total.rtt);
+	ast_cli(a->fd, "Remote lost:      %llu\n", (unsigned long long)total.remote_lost);
+	ast_cli(a->fd, "Remote max jitter: %llu us\n", (unsigned long long)total.remote_jitter);
+	ast_cli(a->fd, "Reports sent:     %llu\n", (unsigned long long)total.rr_sent);
+	ast_cli(a->fd, "Reports received: %llu\n", (unsigned long long)total.rr_received);
+	ast_cli(a->fd, "Samples stretched: %llu\n", (unsigned long long)total.samples_stretched);
+	ast_cli(a->fd, "Samples dropped:  %llu\n", (unsigned long long)total.samples_dropped);
+	ast_cli(a->fd, "Video rx objects: %llu\n", (unsigned long long)total.video_rx_objects);
+	ast_cli(a->fd, "Video tx objects: %llu\n", (unsigned long long)total.video_tx_objects);
+	ast_cli(a->fd, "Reassembly:       %llu timed out, %llu evicted\n",
+		(unsigned long long)total.reasm_timeouts, (unsigned long long)total.reasm_evicted);
+	ast_cli(a->fd, "Relayed objects:  %llu (native bridge)\n", (unsigned long long)total.fwd_packets);
+	ast_cli(a->fd, "Tx suppressed:    %llu (silence)\n", (unsigned long long)total.tx_suppressed);
+	ast_cli(a->fd, "Comfort noise:    %llu sent, %llu received, %llu frames played\n",
+		(unsigned long long)total.tx_cn, (unsigned long long)total.rx_cn,
+		(unsigned long long)total.cn_generated);
+	ast_cli(a->fd, "Auth failures:    %llu\n", (unsigned long long)total.rx_auth_failed);
+	if (moq_xdp_path) {
+		struct moq_xdp_stats xdp;
+		
+		moq_xdp_get_stats(moq_xdp_path, &xdp);
+		ast_cli(a->fd, "AF_XDP:           %s (%s)\n", moq_config.xdp_interface, moq_xdp_describe(moq_xdp_path));
+		ast_cli(a->fd, "AF_XDP rx:        %llu, %llu dropped, %llu invalid\n",
+			(unsigned long long)xdp.rx_packets, (unsigned long long)xdp.rx_dropped,
+			(unsigned long long)xdp.rx_invalid);
+		ast_cli(a->fd, "AF_XDP tx:        %llu, %llu left to the socket\n",
+			(unsigned long long)xdp.tx_packets, (unsigned long long)xdp.tx_busy);
+		ast_cli(a->fd, "AF_XDP kernel drops: %llu rx ring full, %llu fill ring empty\n",
+			(unsigned long long)xdp.rx_ring_full, (unsigned long long)xdp.fill_empty);
 	}
 	
-	/* Calculate timestamp in microseconds */
-	uint64_t timestamp;
-	if (frame->delivery.tv_sec || frame->delivery.tv_usec) {
-		timestamp = (uint64_t)frame->delivery.tv_sec * 1000000 + 
-			frame->delivery.tv_usec;
-	} else {
-		struct timeval now;
-		gettimeofday(&now, NULL);
-		timestamp = (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+	return CLI_SUCCESS;
+}
+
+/* CLI: moq show latency */
+static char *handle_moq_show_latency(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct moq_hist hist;
+	int i;
+	
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "moq show latency";
+		e->usage =
+			"Usage: moq show latency\n"
+			"       Shows latency percentiles, in microseconds, for each media\n"
+			"       pipeline stage since the module was loaded or last reset.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
 	}
 	
-	/* Send media via MoQ/QUIC if available */
-	if (session->quic_conn && session->quic_conn->connected) {
-		if (moq_send_media_object(session, frame->data.ptr, frame->datalen, 
-			timestamp) < 0) {
-			ast_log(LOG_WARNING, "Failed to send MoQ media object\n");
-		}
-	} else if (session->media_socket >= 0 && 
-		session->media_addr.ss.ss_family == AF_INET) {
-		/* Fallback to UDP */
-				sendto(session->media_socket, frame->data.ptr, frame->datalen, 0,
-			(const struct sockaddr *)&session->media_addr.ss, sizeof(struct sockaddr_in));
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
 	}
 	
-	session->last_timestamp = timestamp;
+#define FORMAT "%-22s %10s %8s %8s %8s %8s %8s %8s\n"
+#define FORMAT2 "%-22s %10llu %8llu %8llu %8llu %8llu %8llu %8llu\n"
+	ast_cli(a->fd, FORMAT, "Stage", "Count", "Mean", "p50", "p90", "p99", "p99.9", "Max");
+	for (i = 0; i < MOQ_LAT_STAGES; i++) {
+		moq_hist_snapshot(&moq_latency[i], &hist);
+		ast_cli(a->fd, FORMAT2, moq_latency_names[i],
+			(unsigned long long)hist.total,
+			(unsigned long long)(hist.total ? hist.sum / hist.total : 0),
+			(unsigned long long)moq_hist_percentile(&hist, 50),
+			(unsigned long long)moq_hist_percentile(&hist, 90),
+			(unsigned long long)moq_hist_percentile(&hist, 99),
+			(unsigned long long)moq_hist_percentile(&hist, 99.9),
+			(unsigned long long)hist.max);
+	}
+#undef FORMAT
+#undef FORMAT2
 	
-	return 0;
+	return CLI_SUCCESS;
 }
 
-static int moq_answer(struct ast_channel *ast)
+/* CLI: moq reset latency */
+static char *handle_moq_reset_latency(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
-	struct moq_session *session = ast_channel_tech_pvt(ast);
-	
-	if (!session) {
-		return -1;
+	int i;
+	
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "moq reset latency";
+		e->usage =
+			"Usage: moq reset latency\n"
+			"       Clears the media pipeline latency histograms.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
 	}
 	
-	ast_log(LOG_NOTICE, "MoQ answer: %s\n", session->session_id);
-	
-	session->state = MOQ_STATE_UP;
-	ast_setstate(ast, AST_STATE_UP);
-	
-	/* Send answer via WebSocket */
-	moq_send_answer(session);
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
 	
-	/* Start media thread if not already running */
-	if (!session->media_thread) {
-		if (pthread_create(&session->media_thread, NULL, moq_media_thread, session)) {
-			ast_log(LOG_ERROR, "Failed to create media thread\n");
-			return -1;
-		}
+	for (i = 0; i < MOQ_LAT_STAGES; i++) {
+		moq_hist_reset(&moq_latency[i]);
 	}
+	ast_cli(a->fd, "MoQ latency histograms reset\n");
 	
-	return 0;
+	return CLI_SUCCESS;
 }
 
-static int moq_indicate(struct ast_channel *ast, int condition, const void *data, size_t datalen)
+static struct ast_cli_entry moq_cli[] = {
+	AST_CLI_DEFINE(handle_moq_show_pool, "Show MoQ session pool and setup latency"),
+	AST_CLI_DEFINE(handle_moq_show_relays, "Show MoQ upstream relays"),
+	AST_CLI_DEFINE(handle_moq_show_users, "Show users registered for MoQ signaling"),
+	AST_CLI_DEFINE(handle_moq_show_sessions, "List active MoQ sessions"),
+	AST_CLI_DEFINE(handle_moq_show_session, "Show details of a MoQ session"),
+	AST_CLI_DEFINE(handle_moq_show_stats, "Show aggregate MoQ media statistics"),
+	AST_CLI_DEFINE(handle_moq_show_latency, "Show MoQ media pipeline latency"),
+	AST_CLI_DEFINE(handle_moq_reset_latency, "Reset MoQ media pipeline latency"),
+	AST_CLI_DEFINE(handle_moq_drain, "Drain MoQ calls before a restart"),
+};
+
+/* AMI: MoQShowSessions */
+static int manager_moq_show_sessions(struct mansession *s, const struct message *m)
 {
-	switch (condition) {
-		case AST_CONTROL_RINGING:
-			ast_log(LOG_DEBUG, "MoQ indicate: ringing\n");
-			return 0;
-		case AST_CONTROL_PROGRESS:
-			ast_log(LOG_DEBUG, "MoQ indicate: progress\n");
-			return 0;
-		case AST_CONTROL_PROCEEDING:
-			ast_log(LOG_DEBUG, "MoQ indicate: proceeding\n");
-			return 0;
-		default:
-			return -1;
+	const char *id = astman_get_header(m, "ActionID");
+	char id_text[256] = "";
+	struct moq_session *session;
+	int count = 0;
+	
+	if (!ast_strlen_zero(id)) {
+		snprintf(id_text, sizeof(id_text), "ActionID: %s\r\n", id);
+	}
+	
+	astman_send_listack(s, m, "MoQ session list will follow", "start");
+	
+	ast_mutex_lock(&moq_lock);
+	AST_LIST_TRAVERSE(&moq_sessions, session, list_entry) {
+		struct moq_stats stats;
+		int rx_queue, tx_queue;
+		
+		moq_stats_snapshot(&session->stats, &stats);
+		moq_session_queue_depths(session, &rx_queue, &tx_queue);
+		astman_append(s,
+			"Event: MoQSession\r\n"
+			"%s"
+			"SessionID: %s\r\n"
+			"Remote: %s\r\n"
+			"Channel: %s\r\n"
+			"State: %s\r\n"
+			"Relay: %s\r\n"
+			"RxPackets: %llu\r\n"
+			"RxBytes: %llu\r\n"
+			"RxLost: %llu\r\n"
+			"RxReordered: %llu\r\n"
+			"RxJitterUs: %llu\r\n"
+			"RxQueue: %d\r\n"
+			"TxPackets: %llu\r\n"
+			"TxBytes: %llu\r\n"
+			"TxErrors: %llu\r\n"
+			"TxDropped: %llu\r\n"
+			"TxQueue: %d\r\n"
+			"RttUs: %llu\r\n"
+			"RemoteLost: %llu\r\n"
+			"RemoteJitterUs: %llu\r\n"
+			"ClockSkewPpm: %lld\r\n"
+			"SamplesStretched: %llu\r\n"
+			"SamplesDropped: %llu\r\n"
+			"VideoRxObjects: %llu\r\n"
+			"VideoTxObjects: %llu\r\n"
+			"ReassemblyTimeouts: %llu\r\n"
+			"ReassemblyEvicted: %llu\r\n"
+			"BridgePeer: %s\r\n"
+			"RelayedObjects: %llu\r\n"
+			"TxSuppressed: %llu\r\n"
+			"ComfortNoiseSent: %llu\r\n"
+			"ComfortNoiseReceived: %llu\r\n"
+			"ComfortNoiseFrames: %llu\r\n"
+			"TxLevel: %lld\r\n"
+			"RxLevel: %lld\r\n"
+			"TxCipher: %s\r\n"
+			"RxCipher: %s\r\n"
+			"RxAuthFailed: %llu\r\n"
+			"\r\n",
+			id_text, session->session_id, session->remote_id,
+			session->owner ? ast_channel_name(session->owner) : "",
+			moq_state_str(session->state), moq_relays.list[session->relay].name,
+			(unsigned long long)stats.rx_packets, (unsigned long long)stats.rx_bytes,
+			(unsigned long long)stats.rx_lost, (unsigned long long)stats.rx_reordered,
+			(unsigned long long)stats.rx_jitter, rx_queue,
+			(unsigned long long)stats.tx_packets, (unsigned long long)stats.tx_bytes,
+			(unsigned long long)stats.tx_errors, (unsigned long long)stats.tx_eagain,
+			tx_queue, (unsigned long long)stats.rtt, (unsigned long long)stats.remote_lost,
+			(unsigned long long)stats.remote_jitter, (long long)stats.clock_skew,
+			(unsigned long long)stats.samples_stretched, (unsigned long long)stats.samples_dropped,
+			(unsigned long long)stats.video_rx_objects, (unsigned long long)stats.video_tx_objects,
+			(unsigned long long)stats.reasm_timeouts, (unsigned long long)stats.reasm_evicted,
+			session->bridge_peer ? session->bridge_peer->session_id : "",
+			(unsigned long long)stats.fwd_packets, (unsigned long long)stats.tx_suppressed,
+			(unsigned long long)stats.tx_cn, (unsigned long long)stats.rx_cn,
+			(unsigned long long)stats.cn_generated,
+			(long long)stats.tx_level, (long long)stats.rx_level,
+			session->tx_protected ? moq_cipher_name(session->tx_cipher) : "",
+			session->rx_protected ? moq_cipher_name(session->rx_crypto.cipher) : "",
+			(unsigned long long)stats.rx_auth_failed);
+		count++;
 	}
+	ast_mutex_unlock(&moq_lock);
+	
+	astman_send_list_complete_start(s, m, "MoQSessionListComplete", count);
+	astman_send_list_complete_end(s);
+	
+	return 0;
 }
 
-static int moq_fixup(struct ast_channel *oldchan, struct ast_channel *newchan)
+/* AMI: MoQShowStats */
+static int manager_moq_show_stats(struct mansession *s, const struct message *m)
 {
-	struct moq_session *session = ast_channel_tech_pvt(newchan);
+	const char *id = astman_get_header(m, "ActionID");
+	char id_text[256] = "";
+	struct moq_stats total;
+	int rx_queue, tx_queue, count;
 	
-	if (session) {
-		ast_mutex_lock(&session->lock);
-		session->owner = newchan;
-		ast_mutex_unlock(&session->lock);
+	if (!ast_strlen_zero(id)) {
+		snprintf(id_text, sizeof(id_text), "ActionID: %s\r\n", id);
 	}
 	
+	count = moq_stats_aggregate(&total, &rx_queue, &tx_queue);
+	
+	astman_append(s,
+		"Response: Success\r\n"
+		"%s"
+		"ActiveSessions: %d\r\n"
+		"RxPackets: %llu\r\n"
+		"RxBytes: %llu\r\n"
+		"RxLost: %llu\r\n"
+		"RxReordered: %llu\r\n"
+		"RxMaxJitterUs: %llu\r\n"
+		"RxQueue: %d\r\n"
+		"TxPackets: %llu\r\n"
+		"TxBytes: %llu\r\n"
+		"TxErrors: %llu\r\n"
+		"TxDropped: %llu\r\n"
+		"TxQueue: %d\r\n"
+		"MaxRttUs: %llu\r\n"
+		"RemoteLost: %llu\r\n"
+		"RemoteMaxJitterUs: %llu\r\n"
+		"VideoRxObjects: %llu\r\n"
+		"VideoTxObjects: %llu\r\n"
+		"ReassemblyTimeouts: %llu\r\n"
+		"ReassemblyEvicted: %llu\r\n"
+		"RelayedObjects: %llu\r\n"
+		"TxSuppressed: %llu\r\n"
+		"ComfortNoiseSent: %llu\r\n"
+		"ComfortNoiseReceived: %llu\r\n"
+		"ComfortNoiseFrames: %llu\r\n"
+		"RxAuthFailed: %llu\r\n"
+		"\r\n",
+		id_text, count,
+		(unsigned long long)total.rx_packets, (unsigned long long)total.rx_bytes,
+		(unsigned long long)total.rx_lost, (unsigned long long)total.rx_reordered,
+		(unsigned long long)total.rx_jitter, rx_queue,
+		(unsigned long long)total.tx_packets, (unsigned long long)total.tx_bytes,
+		(unsigned long long)total.tx_errors, (unsigned long long)total.tx_eagain,
+		tx_queue, (unsigned long long)total.rtt, (unsigned long long)total.remote_lost,
+		(unsigned long long)total.remote_jitter,
+		(unsigned long long)total.video_rx_objects, (unsigned long long)total.video_tx_objects,
+		(unsigned long long)total.reasm_timeouts, (unsigned long long)total.reasm_evicted,
+		(unsigned long long)total.fwd_packets,
+		(unsigned long long)total.tx_suppressed, (unsigned long long)total.tx_cn,
+		(unsigned long long)total.rx_cn, (unsigned long long)total.cn_generated,
+		(unsigned long long)total.rx_auth_failed);
+	
 	return 0;
 }
 
@@ -975,6 +5056,7 @@ static int load_config(int reload)
 	struct ast_config *cfg;
 	struct ast_variable *v;
 	struct ast_flags config_flags = { reload ? CONFIG_FLAG_FILEUNCHANGED : 0 };
+	int res;
 	
 	cfg = ast_config_load(MOQ_CONFIG, config_flags);
 	
@@ -1000,9 +5082,117 @@ static int load_config(int reload)
 			ast_copy_string(moq_config.context, v->value, sizeof(moq_config.context));
 		} else if (!strcasecmp(v->name, "ws_port")) {
 			moq_config.ws_port = atoi(v->value);
+		} else if (!strcasecmp(v->name, "pool_size")) {
+			moq_config.pool_size = atoi(v->value);
+		} else if (!strcasecmp(v->name, "pool_low_water")) {
+			moq_config.pool_low_water = atoi(v->value);
+		} else if (!strcasecmp(v->name, "rr_interval")) {
+			moq_config.rr_interval = atoi(v->value);
+		} else if (!strcasecmp(v->name, "vad")) {
+			moq_config.vad = ast_true(v->value);
+		} else if (!strcasecmp(v->name, "cn_interval")) {
+			moq_config.cn_interval = atoi(v->value);
+		} else if (!strcasecmp(v->name, "relay")) {
+			if (moq_relays.count >= MOQ_MAX_RELAYS) {
+				ast_log(LOG_WARNING, "Too many relays in %s, ignoring %s\n", MOQ_CONFIG, v->value);
+			} else if (moq_relay_parse(v->value, &moq_relays.list[moq_relays.count])) {
+				ast_log(LOG_WARNING, "Invalid relay '%s' at line %d of %s\n",
+					v->value, v->lineno, MOQ_CONFIG);
+			} else {
+				moq_relays.count++;
+			}
+		} else if (!strcasecmp(v->name, "relay_probe_interval")) {
+			moq_config.relay_probe_interval = atoi(v->value);
+		} else if (!strcasecmp(v->name, "relay_timeout")) {
+			moq_config.relay_timeout = atoi(v->value);
+		} else if (!strcasecmp(v->name, "successor")) {
+			ast_copy_string(moq_config.successor, v->value, sizeof(moq_config.successor));
+		} else if (!strcasecmp(v->name, "drain_timeout")) {
+			moq_config.drain_timeout = atoi(v->value);
+		} else if (!strcasecmp(v->name, "handoff_secret")) {
+			ast_copy_string(moq_config.handoff_secret, v->value, sizeof(moq_config.handoff_secret));
+		} else if (!strcasecmp(v->name, "tap")) {
+			moq_config.tap = ast_true(v->value);
+		} else if (!strcasecmp(v->name, "tap_dir")) {
+			ast_copy_string(moq_config.tap_dir, v->value, sizeof(moq_config.tap_dir));
+		} else if (!strcasecmp(v->name, "tap_segment_size")) {
+			moq_config.tap_segment_size = atoi(v->value);
+		} else if (!strcasecmp(v->name, "media_encryption")) {
+			moq_config.media_encryption = ast_true(v->value);
+		} else if (!strcasecmp(v->name, "media_cipher")) {
+			int cipher = moq_cipher_from_name(v->value);
+			
+			if (cipher < 0) {
+				ast_log(LOG_WARNING, "Unknown media_cipher '%s' at line %d of %s, using %s\n",
+					v->value, v->lineno, MOQ_CONFIG, moq_cipher_name(moq_config.media_cipher));
+			} else {
+				moq_config.media_cipher = cipher;
+			}
+		} else if (!strcasecmp(v->name, "xdp_interface")) {
+			ast_copy_string(moq_config.xdp_interface, v->value, sizeof(moq_config.xdp_interface));
+		} else if (!strcasecmp(v->name, "xdp_mode")) {
+			int mode = moq_xdp_mode_from_name(v->value);
+			
+			if (mode < 0) {
+				ast_log(LOG_WARNING, "Unknown xdp_mode '%s' at line %d of %s, using %s\n",
+					v->value, v->lineno, MOQ_CONFIG, moq_xdp_mode_name(moq_config.xdp_mode));
+			} else {
+				moq_config.xdp_mode = mode;
+			}
+		} else if (!strcasecmp(v->name, "xdp_queues")) {
+			moq_config.xdp_queues = atoi(v->value);
+		} else if (!strcasecmp(v->name, "xdp_frames")) {
+			moq_config.xdp_frames = atoi(v->value);
 		}
 	}
 	
+	if (moq_config.pool_size < 0) {
+		moq_config.pool_size = 0;
+	}
+	if (moq_config.pool_low_water < 0) {
+		moq_config.pool_low_water = 0;
+	} else if (moq_config.pool_low_water > moq_config.pool_size) {
+		moq_config.pool_low_water = moq_config.pool_size;
+	}
+	if (moq_config.rr_interval < 0) {
+		moq_config.rr_interval = 0;
+	} else if (moq_config.rr_interval && moq_config.rr_interval < MIN_RR_INTERVAL) {
+		moq_config.rr_interval = MIN_RR_INTERVAL;
+	}
+	if (moq_config.cn_interval < 0) {
+		moq_config.cn_interval = 0;
+	}
+	if (moq_config.relay_probe_interval < 0) {
+		moq_config.relay_probe_interval = 0;
+	} else if (moq_config.relay_probe_interval &&
+		moq_config.relay_probe_interval < MIN_RELAY_PROBE_INTERVAL) {
+		moq_config.relay_probe_interval = MIN_RELAY_PROBE_INTERVAL;
+	}
+	if (moq_config.drain_timeout < 0) {
+		moq_config.drain_timeout = 0;
+	}
+	if (moq_config.xdp_queues < 1) {
+		moq_config.xdp_queues = 1;
+	} else if (moq_config.xdp_queues > MOQ_XDP_MAX_QUEUES) {
+		moq_config.xdp_queues = MOQ_XDP_MAX_QUEUES;
+	}
+	if (moq_config.xdp_frames < 0) {
+		moq_config.xdp_frames = 0;
+	}
+	if (moq_config.tap_segment_size < MOQ_TAP_MIN_SEGMENT / (1024 * 1024)) {
+		moq_config.tap_segment_size = MOQ_TAP_MIN_SEGMENT / (1024 * 1024);
+	} else if (moq_config.tap_segment_size > MOQ_TAP_MAX_SEGMENT / (1024 * 1024)) {
+		moq_config.tap_segment_size = MOQ_TAP_MAX_SEGMENT / (1024 * 1024);
+	}
+	if (moq_config.tap && (res = ast_mkdir(moq_config.tap_dir, 0750))) {
+		ast_log(LOG_WARNING, "Cannot create media tap directory %s: %s\n",
+			moq_config.tap_dir, strerror(res));
+	}
+	/* A relay must miss more than one probe to be declared down */
+	if (moq_config.relay_timeout < 2 * moq_config.relay_probe_interval) {
+		moq_config.relay_timeout = 2 * moq_config.relay_probe_interval;
+	}
+	
 	ast_config_destroy(cfg);
 	
 	return 0;
@@ -1017,12 +5207,61 @@ static int load_module(void)
 	memset(&moq_config, 0, sizeof(moq_config));
 	ast_copy_string(moq_config.context, DEFAULT_CONTEXT, sizeof(moq_config.context));
 	moq_config.ws_port = DEFAULT_WS_PORT;
+	moq_config.pool_size = DEFAULT_POOL_SIZE;
+	moq_config.pool_low_water = DEFAULT_POOL_LOW_WATER;
+	moq_config.rr_interval = DEFAULT_RR_INTERVAL;
+	moq_config.cn_interval = DEFAULT_CN_INTERVAL;
+	moq_config.media_cipher = MOQ_CIPHER_AES_128_GCM;
+	moq_config.relay_probe_interval = DEFAULT_RELAY_PROBE_INTERVAL;
+	moq_config.relay_timeout = DEFAULT_RELAY_TIMEOUT;
+	moq_config.drain_timeout = DEFAULT_DRAIN_TIMEOUT;
+	snprintf(moq_config.tap_dir, sizeof(moq_config.tap_dir), "%s/moq-tap", ast_config_AST_SPOOL_DIR);
+	moq_config.tap_segment_size = DEFAULT_TAP_SEGMENT_SIZE;
+	moq_config.xdp_mode = MOQ_XDP_AUTO;
+	moq_config.xdp_queues = 1;
+	memset(&moq_drain, 0, sizeof(moq_drain));
+	moq_drain.thread = AST_PTHREADT_NULL;
+	moq_pool.thread = AST_PTHREADT_NULL;
+	moq_reaper.thread = AST_PTHREADT_NULL;
+	memset(&moq_relays, 0, sizeof(moq_relays));
+	moq_relays.fd = -1;
+	moq_relays.thread = AST_PTHREADT_NULL;
 	
 	if (load_config(0)) {
 		return AST_MODULE_LOAD_DECLINE;
 	}
 	
-	/* Initialize WebSocket server */
+	/* Without configured relays, use the local one as before */
+	if (!moq_relays.count) {
+		char local[32];
+		
+		snprintf(local, sizeof(local), "127.0.0.1:%d", MOQ_QUIC_PORT);
+		moq_relay_parse(local, &moq_relays.list[0]);
+		moq_relays.count = 1;
+	}
+	
+	/* Pick the G.711 sample kernels for this CPU */
+	ast_log(LOG_NOTICE, "MoQ G.711 kernels: %s\n", moq_g711_name(moq_g711_init()));
+	
+	/* Attach the AF_XDP media path before the pool creates any connection */
+	if (moq_config.xdp_interface[0]) {
+		char err[128];
+		int res = moq_xdp_open(&moq_xdp_path, moq_config.xdp_interface, moq_config.xdp_queues,
+			moq_config.xdp_mode, moq_config.xdp_frames, err, sizeof(err));
+		
+		if (res) {
+			ast_log(LOG_WARNING, "No AF_XDP media path on %s, using sockets: %s\n",
+				moq_config.xdp_interface, err);
+		} else {
+			ast_log(LOG_NOTICE, "MoQ AF_XDP media path on %s (%s), %d queues\n",
+				moq_config.xdp_interface, moq_xdp_describe(moq_xdp_path), moq_config.xdp_queues);
+		}
+	}
+	
+	/* Initialize WebSocket server and the registrar behind it */
+	if (moq_registrar_init(&moq_registrar)) {
+		return AST_MODULE_LOAD_DECLINE;
+	}
 	struct lws_context_creation_info info;
 	memset(&info, 0, sizeof(info));
 	info.port = moq_config.ws_port;
@@ -1033,6 +5272,9 @@ static int load_module(void)
 	moq_config.ws_context = lws_create_context(&info);
 	if (!moq_config.ws_context) {
 		ast_log(LOG_ERROR, "Failed to create WebSocket context\n");
+		moq_registrar_destroy(&moq_registrar);
+		moq_xdp_close(moq_xdp_path);
+		moq_xdp_path = NULL;
 		return AST_MODULE_LOAD_DECLINE;
 	}
 	
@@ -1041,18 +5283,58 @@ static int load_module(void)
 	if (pthread_create(&moq_config.ws_thread, NULL, moq_ws_thread, NULL)) {
 		ast_log(LOG_ERROR, "Failed to create WebSocket thread\n");
 		lws_context_destroy(moq_config.ws_context);
+		moq_registrar_destroy(&moq_registrar);
+		moq_xdp_close(moq_xdp_path);
+		moq_xdp_path = NULL;
+		return AST_MODULE_LOAD_DECLINE;
+	}
+	
+	/* Probe relays, pre-warm sessions and reap ended ones in the background */
+	if (moq_relay_start() || moq_pool_start() || moq_reaper_start()) {
+		moq_pool_stop();
+		moq_relay_stop();
+		moq_config.running = 0;
+		pthread_join(moq_config.ws_thread, NULL);
+		lws_context_destroy(moq_config.ws_context);
+		moq_registrar_destroy(&moq_registrar);
+		moq_xdp_close(moq_xdp_path);
+		moq_xdp_path = NULL;
 		return AST_MODULE_LOAD_DECLINE;
 	}
 	
-	/* Register channel technology */
-	if (ast_channel_register(&moq_tech)) {
+	/* Register channel technology: ulaw audio plus H.264/VP8 video passthrough */
+	moq_tech.capabilities = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
+	if (moq_tech.capabilities) {
+		ast_format_cap_append(moq_tech.capabilities, ast_format_ulaw, 0);
+		ast_format_cap_append(moq_tech.capabilities, ast_format_h264, 0);
+		ast_format_cap_append(moq_tech.capabilities, ast_format_vp8, 0);
+	}
+	if (!moq_tech.capabilities || ast_channel_register(&moq_tech)) {
 		ast_log(LOG_ERROR, "Failed to register channel technology\n");
+		ao2_cleanup(moq_tech.capabilities);
+		moq_tech.capabilities = NULL;
+		moq_reaper_stop();
+		moq_pool_stop();
+		moq_relay_stop();
 		moq_config.running = 0;
 		pthread_join(moq_config.ws_thread, NULL);
 		lws_context_destroy(moq_config.ws_context);
+		moq_registrar_destroy(&moq_registrar);
+		moq_xdp_close(moq_xdp_path);
+		moq_xdp_path = NULL;
 		return AST_MODULE_LOAD_DECLINE;
 	}
 	
+	if (ast_bridge_technology_register(&moq_bridge_tech)) {
+		ast_log(LOG_WARNING, "Failed to register native MoQ bridge; using core bridging\n");
+	}
+	
+	ast_cli_register_multiple(moq_cli, ARRAY_LEN(moq_cli));
+	ast_manager_register_xml("MoQShowSessions", EVENT_FLAG_SYSTEM | EVENT_FLAG_REPORTING,
+		manager_moq_show_sessions);
+	ast_manager_register_xml("MoQShowStats", EVENT_FLAG_SYSTEM | EVENT_FLAG_REPORTING,
+		manager_moq_show_stats);
+	
 	ast_log(LOG_NOTICE, "chan_moq loaded successfully\n");
 	
 	return AST_MODULE_LOAD_SUCCESS;
@@ -1061,8 +5343,31 @@ static int load_module(void)
 /* Module unload */
 static int unload_module(void)
 {
+	int count, waited;
+	
 	ast_log(LOG_NOTICE, "Unloading chan_moq module\n");
 	
+	/* Hang up the calls still up and give them a moment to end, as that takes signaling */
+	moq_hangup_sessions(NULL, AST_SOFTHANGUP_APPUNLOAD);
+	for (waited = 0; ; waited += 100) {
+		ast_mutex_lock(&moq_lock);
+		count = moq_session_count;
+		ast_mutex_unlock(&moq_lock);
+		if (!count || waited >= MOQ_UNLOAD_WAIT_MS) {
+			break;
+		}
+		usleep(100000);
+	}
+	if (count) {
+		ast_log(LOG_WARNING, "%d MoQ calls are still up, not unloading\n", count);
+		return -1;
+	}
+	moq_drain_cancel();
+	
+	ast_cli_unregister_multiple(moq_cli, ARRAY_LEN(moq_cli));
+	ast_manager_unregister("MoQShowSessions");
+	ast_manager_unregister("MoQShowStats");
+	
 	/* Stop WebSocket thread */
 	moq_config.running = 0;
 	pthread_join(moq_config.ws_thread, NULL);
@@ -1071,9 +5376,24 @@ static int unload_module(void)
 	if (moq_config.ws_context) {
 		lws_context_destroy(moq_config.ws_context);
 	}
+	moq_registrar_destroy(&moq_registrar);
+	moq_handoff_forget_all();
+	
+	ast_bridge_technology_unregister(&moq_bridge_tech);
 	
 	/* Unregister channel technology */
 	ast_channel_unregister(&moq_tech);
+	ao2_cleanup(moq_tech.capabilities);
+	moq_tech.capabilities = NULL;
+	
+	/* Finish reaping ended sessions, then free pre-warmed ones */
+	moq_reaper_stop();
+	moq_pool_stop();
+	moq_relay_stop();
+	
+	/* Every connection is closed by now, so detach the AF_XDP program */
+	moq_xdp_close(moq_xdp_path);
+	moq_xdp_path = NULL;
 	
 	ast_log(LOG_NOTICE, "chan_moq unloaded successfully\n");
 	
@@ -0,0 +1,181 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/* Media clocks and drift compensation - see moq_clock.h */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "moq_clock.h"
+
+/* Frames within this distance of the predicted timestamp keep sample continuity */
+#define MOQ_CLOCK_RESYNC_MS 80
+/* Window over which the minimum delay is taken */
+#define MOQ_CLOCK_WINDOW_US 1000000
+/* Drift, in milliseconds of media, tolerated before compensating */
+#define MOQ_CLOCK_DRIFT_MS 0.5
+/*
+ * A step in minimum delay beyond this is a discontinuity (the sender's clock
+ * restarted, or a relay switched sources), not drift: rebase instead of
+ * slowly compensating it away
+ */
+#define MOQ_CLOCK_DISCONTINUITY_MS 80
+
+static inline int64_t moq_clock_samples(unsigned int rate, uint64_t us)
+{
+	return (int64_t)(us * rate / 1000000);
+}
+
+void moq_clock_tx_init(struct moq_clock_tx *clock, unsigned int rate)
+{
+	memset(clock, 0, sizeof(*clock));
+	clock->rate = rate;
+}
+
+uint64_t moq_clock_tx_stamp(struct moq_clock_tx *clock, uint64_t now_us, unsigned int samples)
+{
+	uint64_t ts;
+
+	if (!clock->started) {
+		clock->started = 1;
+		clock->base_us = now_us;
+		ts = 0;
+	} else {
+		int64_t elapsed = moq_clock_samples(clock->rate, now_us - clock->base_us);
+		int64_t error = elapsed - (int64_t)clock->next;
+
+		if (error < 0) {
+			error = -error;
+		}
+		/* On time: stay sample-accurate; after a gap: follow elapsed time */
+		ts = error <= (int64_t)clock->rate * MOQ_CLOCK_RESYNC_MS / 1000 ? clock->next : (uint64_t)elapsed;
+	}
+
+	clock->next = ts + samples;
+
+	return ts;
+}
+
+uint64_t moq_clock_tx_now(struct moq_clock_tx *clock, uint64_t now_us)
+{
+	if (!clock->started) {
+		clock->started = 1;
+		clock->base_us = now_us;
+	}
+
+	return (uint64_t)moq_clock_samples(clock->rate, now_us - clock->base_us);
+}
+
+void moq_clock_tx_resume(struct moq_clock_tx *clock, uint64_t now_us, uint64_t ts)
+{
+	uint64_t elapsed_us = ts * 1000000 / clock->rate;
+
+	clock->started = 1;
+	clock->base_us = now_us - elapsed_us;
+	clock->next = ts;
+}
+
+void moq_clock_rx_init(struct moq_clock_rx *clock, unsigned int rate)
+{
+	memset(clock, 0, sizeof(*clock));
+	clock->rate = rate;
+}
+
+/* Close a delay window: update the skew estimate and schedule any correction */
+static void moq_clock_rx_window(struct moq_clock_rx *clock, uint64_t now_us)
+{
+	int64_t threshold = (int64_t)(clock->rate * MOQ_CLOCK_DRIFT_MS / 1000);
+	int64_t drift;
+
+	if (threshold < 1) {
+		threshold = 1;
+	}
+
+	if (!clock->have_baseline) {
+		clock->have_baseline = 1;
+		clock->baseline = clock->win_min;
+		clock->prev_raw_min = clock->win_raw_min;
+		return;
+	}
+
+	/* Uncorrected delay shrinking means the sender's clock runs fast */
+	double ppm = -(double)(clock->win_raw_min - clock->prev_raw_min) * 1e6 /
+		((double)clock->rate * (now_us - clock->win_start_us) / 1e6);
+	clock->skew_ppm += (ppm - clock->skew_ppm) / 8.0;
+	clock->prev_raw_min = clock->win_raw_min;
+
+	/* Let a correction in progress finish before measuring again */
+	if (clock->pending) {
+		return;
+	}
+
+	drift = clock->win_min - clock->baseline;
+	if (drift > (int64_t)clock->rate * MOQ_CLOCK_DISCONTINUITY_MS / 1000 ||
+		drift < -(int64_t)clock->rate * MOQ_CLOCK_DISCONTINUITY_MS / 1000) {
+		clock->baseline = clock->win_min;
+		return;
+	}
+	if (drift >= threshold || drift <= -threshold) {
+		clock->pending = drift;
+	}
+}
+
+void moq_clock_rx_observe(struct moq_clock_rx *clock, uint64_t now_us, uint64_t ts,
+	uint64_t *playout)
+{
+	int64_t delay;
+
+	if (!clock->started) {
+		clock->started = 1;
+		clock->base_us = now_us;
+		clock->win_start_us = now_us;
+		clock->win_min = INT64_MAX;
+		clock->win_raw_min = INT64_MAX;
+	}
+
+	*playout = ts + clock->adjust;
+
+	/* Delay of this frame after the corrections already applied */
+	delay = moq_clock_samples(clock->rate, now_us - clock->base_us) - (int64_t)*playout;
+
+	if (delay < clock->win_min) {
+		clock->win_min = delay;
+	}
+	if (delay + clock->adjust < clock->win_raw_min) {
+		clock->win_raw_min = delay + clock->adjust;
+	}
+
+	if (now_us - clock->win_start_us >= MOQ_CLOCK_WINDOW_US) {
+		moq_clock_rx_window(clock, now_us);
+		clock->win_start_us = now_us;
+		clock->win_min = INT64_MAX;
+		clock->win_raw_min = INT64_MAX;
+	}
+}
+
+int moq_clock_rx_update(struct moq_clock_rx *clock, uint64_t now_us, uint64_t ts,
+	uint64_t *playout)
+{
+	moq_clock_rx_observe(clock, now_us, ts, playout);
+
+	if (clock->pending > 0) {
+		clock->pending--;
+		clock->adjust++;
+		clock->stretched++;
+		return 1;
+	}
+	if (clock->pending < 0) {
+		clock->pending++;
+		clock->adjust--;
+		clock->dropped++;
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/*
+ * Per-session media clocks in codec sample units.
+ *
+ * The sending side stamps objects from a monotonic clock, advancing by the
+ * exact number of samples in each frame while frames arrive on time and
+ * resynchronising to elapsed time after gaps such as silence or hold. Wall
+ * clock steps (NTP) therefore never reach the wire.
+ *
+ * The receiving side tracks the one-way delay between the sender's media
+ * clock and its own monotonic clock. The minimum delay over each window
+ * filters out network jitter; its trend against the first window is the
+ * clock drift between the two ends. When drift builds up past a threshold
+ * the playout path is asked to drop one sample (sender clock fast) or
+ * stretch by one (sender clock slow) per frame until it is absorbed, so
+ * long calls do not accumulate latency or underrun.
+ *
+ * Like moq_wire and moq_hist this has no Asterisk dependencies. All times
+ * passed in are monotonic microseconds.
+ */
+
+#ifndef MOQ_CLOCK_H
+#define MOQ_CLOCK_H
+
+#include <stdint.h>
+
+struct moq_clock_tx {
+	unsigned int rate;		/* Samples per second */
+	int started;
+	uint64_t base_us;
+	uint64_t next;			/* Timestamp predicted for the next frame */
+};
+
+struct moq_clock_rx {
+	unsigned int rate;
+	int started;
+	uint64_t base_us;
+	int64_t adjust;			/* Samples inserted minus samples dropped */
+	int64_t pending;		/* Correction still to apply; >0 stretch, <0 drop */
+	int have_baseline;
+	int64_t baseline;		/* Minimum delay of the first window */
+	int64_t win_min;
+	int64_t win_raw_min;		/* As win_min, ignoring our corrections */
+	int64_t prev_raw_min;
+	uint64_t win_start_us;
+	double skew_ppm;		/* Sender clock relative to ours, smoothed */
+	uint64_t stretched;
+	uint64_t dropped;
+};
+
+/* Prepare a sending clock running at rate samples per second */
+void moq_clock_tx_init(struct moq_clock_tx *clock, unsigned int rate);
+
+/* Timestamp for a frame of the given number of samples sent at now_us */
+uint64_t moq_clock_tx_stamp(struct moq_clock_tx *clock, uint64_t now_us, unsigned int samples);
+
+/*
+ * Timestamp of now_us on the clock, without sample continuity, for media
+ * such as video whose frames carry no sample count
+ */
+uint64_t moq_clock_tx_now(struct moq_clock_tx *clock, uint64_t now_us);
+
+/*
+ * Start a clock as if it had been running so that now_us is timestamp ts,
+ * to carry on a stream that another sender has been stamping
+ */
+void moq_clock_tx_resume(struct moq_clock_tx *clock, uint64_t now_us, uint64_t ts);
+
+/* Prepare a receiving clock running at rate samples per second */
+void moq_clock_rx_init(struct moq_clock_rx *clock, unsigned int rate);
+
+/*
+ * Account a frame stamped ts by the sender that arrived at now_us, and give
+ * its local playout timestamp in samples. Returns the correction to apply
+ * to this frame's samples: -1 to drop one, 1 to insert one, or 0.
+ */
+int moq_clock_rx_update(struct moq_clock_rx *clock, uint64_t now_us, uint64_t ts,
+	uint64_t *playout);
+
+/*
+ * Account a frame like moq_clock_rx_update, for media with no samples to
+ * correct such as comfort noise: a correction due is left for the next
+ * frame that has them.
+ */
+void moq_clock_rx_observe(struct moq_clock_rx *clock, uint64_t now_us, uint64_t ts,
+	uint64_t *playout);
+
+#endif /* MOQ_CLOCK_H */
@@ -0,0 +1,233 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/* AEAD protection of media object payloads - see moq_crypto.h */
+
+#include <limits.h>
+#include <string.h>
+#include <strings.h>
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+#include "moq_crypto.h"
+
+#define MOQ_CRYPTO_AAD_SIZE 21
+
+static const char *const cipher_names[MOQ_CIPHER_COUNT] = {
+	[MOQ_CIPHER_AES_128_GCM] = "aes-128-gcm",
+	[MOQ_CIPHER_CHACHA20_POLY1305] = "chacha20-poly1305",
+};
+
+static const EVP_CIPHER *cipher_evp(enum moq_cipher cipher)
+{
+	switch (cipher) {
+	case MOQ_CIPHER_AES_128_GCM:
+		return EVP_aes_128_gcm();
+	case MOQ_CIPHER_CHACHA20_POLY1305:
+		return EVP_chacha20_poly1305();
+	default:
+		return NULL;
+	}
+}
+
+static inline void put_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static inline void put_be64(uint8_t *p, uint64_t v)
+{
+	put_be32(p, v >> 32);
+	put_be32(p + 4, (uint32_t)v);
+}
+
+const char *moq_cipher_name(enum moq_cipher cipher)
+{
+	return (unsigned int)cipher < MOQ_CIPHER_COUNT ? cipher_names[cipher] : "unknown";
+}
+
+int moq_cipher_from_name(const char *name)
+{
+	int i;
+
+	for (i = 0; i < MOQ_CIPHER_COUNT; i++) {
+		if (!strcasecmp(name, cipher_names[i])) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+size_t moq_crypto_key_size(enum moq_cipher cipher)
+{
+	switch (cipher) {
+	case MOQ_CIPHER_AES_128_GCM:
+		return 16 + MOQ_CRYPTO_SALT_SIZE;
+	case MOQ_CIPHER_CHACHA20_POLY1305:
+		return 32 + MOQ_CRYPTO_SALT_SIZE;
+	default:
+		return 0;
+	}
+}
+
+int moq_crypto_generate(enum moq_cipher cipher, uint8_t *key)
+{
+	size_t size = moq_crypto_key_size(cipher);
+
+	return size && RAND_bytes(key, size) == 1 ? 0 : -1;
+}
+
+int moq_crypto_init(struct moq_crypto *crypto, enum moq_cipher cipher, const uint8_t *key,
+	int encrypt)
+{
+	const EVP_CIPHER *evp = cipher_evp(cipher);
+	size_t key_len = moq_crypto_key_size(cipher) - MOQ_CRYPTO_SALT_SIZE;
+
+	if (!evp) {
+		return -1;
+	}
+	if (!crypto->ctx) {
+		crypto->ctx = EVP_CIPHER_CTX_new();
+		if (!crypto->ctx) {
+			return -1;
+		}
+	}
+
+	/* Expand the key schedule now; per object only the IV is set */
+	if (!EVP_CipherInit_ex(crypto->ctx, evp, NULL, NULL, NULL, encrypt) ||
+		!EVP_CIPHER_CTX_ctrl(crypto->ctx, EVP_CTRL_AEAD_SET_IVLEN, MOQ_CRYPTO_SALT_SIZE, NULL) ||
+		!EVP_CipherInit_ex(crypto->ctx, NULL, NULL, key, NULL, encrypt)) {
+		return -1;
+	}
+
+	crypto->cipher = cipher;
+	crypto->encrypt = encrypt;
+	memcpy(crypto->salt, key + key_len, MOQ_CRYPTO_SALT_SIZE);
+
+	return 0;
+}
+
+void moq_crypto_clear(struct moq_crypto *crypto)
+{
+	if (crypto->ctx) {
+		EVP_CIPHER_CTX_reset(crypto->ctx);
+	}
+	memset(crypto->salt, 0, sizeof(crypto->salt));
+}
+
+void moq_crypto_destroy(struct moq_crypto *crypto)
+{
+	if (crypto->ctx) {
+		EVP_CIPHER_CTX_free(crypto->ctx);
+		crypto->ctx = NULL;
+	}
+	memset(crypto->salt, 0, sizeof(crypto->salt));
+}
+
+/* Set the per-object nonce and feed the header as associated data */
+static int crypto_begin(struct moq_crypto *crypto, const struct moq_object *obj)
+{
+	uint8_t nonce[MOQ_CRYPTO_SALT_SIZE];
+	uint8_t aad[MOQ_CRYPTO_AAD_SIZE];
+	int i, len;
+
+	put_be32(nonce, obj->track_id);
+	put_be64(nonce + 4, obj->sequence);
+	for (i = 0; i < MOQ_CRYPTO_SALT_SIZE; i++) {
+		nonce[i] ^= crypto->salt[i];
+	}
+
+	aad[0] = obj->type;
+	put_be32(aad + 1, obj->track_id);
+	put_be64(aad + 5, obj->sequence);
+	put_be64(aad + 13, obj->timestamp);
+
+	if (!EVP_CipherInit_ex(crypto->ctx, NULL, NULL, NULL, nonce, crypto->encrypt) ||
+		!EVP_CipherUpdate(crypto->ctx, NULL, &len, aad, sizeof(aad))) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int moq_crypto_seal(struct moq_crypto *crypto, const struct moq_object *obj, uint8_t *out)
+{
+	int len, final_len;
+
+	if (!crypto->ctx || !crypto->encrypt || obj->payload_len > INT_MAX - MOQ_CRYPTO_TAG_SIZE ||
+		crypto_begin(crypto, obj)) {
+		return -1;
+	}
+
+	if (!EVP_CipherUpdate(crypto->ctx, out, &len, obj->payload, (int)obj->payload_len) ||
+		!EVP_CipherFinal_ex(crypto->ctx, out + len, &final_len) ||
+		!EVP_CIPHER_CTX_ctrl(crypto->ctx, EVP_CTRL_AEAD_GET_TAG, MOQ_CRYPTO_TAG_SIZE,
+			out + len + final_len)) {
+		return -1;
+	}
+
+	return len + final_len + MOQ_CRYPTO_TAG_SIZE;
+}
+
+int moq_crypto_open(struct moq_crypto *crypto, const struct moq_object *obj, uint8_t *out)
+{
+	size_t text_len;
+	uint8_t tag[MOQ_CRYPTO_TAG_SIZE];
+	int len, final_len;
+
+	if (!crypto->ctx || crypto->encrypt || obj->payload_len < MOQ_CRYPTO_TAG_SIZE ||
+		obj->payload_len > INT_MAX) {
+		return -1;
+	}
+	text_len = obj->payload_len - MOQ_CRYPTO_TAG_SIZE;
+
+	/* Decryption may run in place, so take the tag out of the way first */
+	memcpy(tag, obj->payload + text_len, MOQ_CRYPTO_TAG_SIZE);
+
+	if (crypto_begin(crypto, obj) ||
+		!EVP_CipherUpdate(crypto->ctx, out, &len, obj->payload, (int)text_len) ||
+		!EVP_CIPHER_CTX_ctrl(crypto->ctx, EVP_CTRL_AEAD_SET_TAG, MOQ_CRYPTO_TAG_SIZE, tag) ||
+		EVP_CipherFinal_ex(crypto->ctx, out + len, &final_len) <= 0) {
+		return -1;
+	}
+
+	return len + final_len;
+}
+
+int moq_crypto_mac(const uint8_t *key, size_t key_len, const uint8_t *data, size_t len,
+	uint8_t *out)
+{
+	unsigned int out_len = 0;
+
+	if (key_len > INT_MAX || !HMAC(EVP_sha256(), key, (int)key_len, data, len, out, &out_len) ||
+		out_len != MOQ_CRYPTO_MAC_SIZE) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int moq_crypto_mac_verify(const uint8_t *key, size_t key_len, const uint8_t *data, size_t len,
+	const uint8_t *mac)
+{
+	uint8_t expected[MOQ_CRYPTO_MAC_SIZE];
+
+	if (moq_crypto_mac(key, key_len, data, len, expected)) {
+		return -1;
+	}
+
+	return CRYPTO_memcmp(expected, mac, MOQ_CRYPTO_MAC_SIZE) ? -1 : 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/*
+ * AEAD protection of media object payloads.
+ *
+ * Each side of a call picks a fresh key and salt for what it sends and hands
+ * them to the peer over signaling. A protected object carries
+ * MOQ_OBJ_FLAG_ENCRYPTED in its type and its payload is the ciphertext
+ * followed by a 16-byte tag:
+ *
+ *   nonce = salt XOR [track_id(4)][sequence(8)]
+ *   aad   = [type(1)][track_id(4)][sequence(8)][timestamp(8)]
+ *
+ * so the object header is authenticated but stays readable, and a nonce is
+ * never reused under one key as long as the sequence on a track only grows.
+ * Objects are protected whole, before fragmentation.
+ *
+ * A context is keyed once per call and only its IV changes per object,
+ * which keeps the per-object cost down to the cipher itself; OpenSSL uses
+ * AES-NI/PCLMUL or the SIMD ChaCha20-Poly1305 code where the CPU has them.
+ * Like moq_wire this has no Asterisk dependencies.
+ */
+
+#ifndef MOQ_CRYPTO_H
+#define MOQ_CRYPTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "moq_wire.h"
+
+#define MOQ_CRYPTO_SALT_SIZE 12
+#define MOQ_CRYPTO_TAG_SIZE 16
+#define MOQ_CRYPTO_KEY_MAX (32 + MOQ_CRYPTO_SALT_SIZE)	/* Largest key plus salt */
+#define MOQ_CRYPTO_MAC_SIZE 32	/* HMAC-SHA256 */
+
+enum moq_cipher {
+	MOQ_CIPHER_AES_128_GCM,
+	MOQ_CIPHER_CHACHA20_POLY1305,
+	MOQ_CIPHER_COUNT
+};
+
+/* One direction of a session's protection; opaque to callers */
+struct moq_crypto {
+	struct evp_cipher_ctx_st *ctx;	/* Allocated on first use, kept across calls */
+	enum moq_cipher cipher;
+	int encrypt;
+	uint8_t salt[MOQ_CRYPTO_SALT_SIZE];
+};
+
+/* Name of a cipher, as used in configuration and signaling */
+const char *moq_cipher_name(enum moq_cipher cipher);
+
+/* Look up a cipher by name; returns -1 if unknown */
+int moq_cipher_from_name(const char *name);
+
+/* Size of the key material (key followed by salt) for a cipher */
+size_t moq_crypto_key_size(enum moq_cipher cipher);
+
+/* Fill key with fresh random key material; returns 0 or -1 */
+int moq_crypto_generate(enum moq_cipher cipher, uint8_t *key);
+
+/*
+ * Key a context for sealing (encrypt != 0) or opening, reusing its cipher
+ * context if it has one. Returns 0 or -1.
+ */
+int moq_crypto_init(struct moq_crypto *crypto, enum moq_cipher cipher, const uint8_t *key,
+	int encrypt);
+
+/*
+ * Forget a context's key and salt but keep its cipher context, so a pooled
+ * session does not carry one call's key into the next
+ */
+void moq_crypto_clear(struct moq_crypto *crypto);
+
+/* Release a context */
+void moq_crypto_destroy(struct moq_crypto *crypto);
+
+/*
+ * Encrypt obj's payload into out, followed by the tag. obj->type must already
+ * carry MOQ_OBJ_FLAG_ENCRYPTED, as the type is authenticated. out may be
+ * obj->payload and needs payload_len + MOQ_CRYPTO_TAG_SIZE bytes.
+ * Returns the number of bytes written, or -1.
+ */
+int moq_crypto_seal(struct moq_crypto *crypto, const struct moq_object *obj, uint8_t *out);
+
+/*
+ * Authenticate and decrypt obj's payload into out, which may be obj->payload.
+ * Returns the plaintext length, or -1 if the object does not authenticate.
+ */
+int moq_crypto_open(struct moq_crypto *crypto, const struct moq_object *obj, uint8_t *out);
+
+/*
+ * HMAC-SHA256 of data under key into out (MOQ_CRYPTO_MAC_SIZE bytes), for
+ * state that is signed by one instance and checked by another.
+ * Returns 0 or -1.
+ */
+int moq_crypto_mac(const uint8_t *key, size_t key_len, const uint8_t *data, size_t len,
+	uint8_t *out);
+
+/* Check a MAC made by moq_crypto_mac() in constant time; returns 0 if it matches */
+int moq_crypto_mac_verify(const uint8_t *key, size_t key_len, const uint8_t *data, size_t len,
+	const uint8_t *mac);
+
+#endif /* MOQ_CRYPTO_H */
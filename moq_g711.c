@@ -0,0 +1,698 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/*
+ * G.711 sample kernels - see moq_g711.h
+ *
+ * The vector versions avoid per-sample table lookups and variable shifts,
+ * neither of which SSE/AVX2 have for 16-bit lanes. Decoding multiplies the
+ * biased mantissa by a power of two looked up with pshufb on the exponent.
+ * Encoding finds the exponent as a log2 assembled from per-nibble pshufb
+ * lookups, then multiplies by the inverse power of two so the mantissa
+ * lands at a fixed bit position.
+ */
+
+#include "moq_g711.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MOQ_G711_X86 1
+#include <immintrin.h>
+#endif
+
+#define ULAW_BIAS 0x84
+#define ULAW_CLIP 32635
+
+struct moq_g711_ops {
+	void (*ulaw_decode)(const uint8_t *in, int16_t *out, size_t len);
+	void (*alaw_decode)(const uint8_t *in, int16_t *out, size_t len);
+	void (*ulaw_encode)(const int16_t *in, uint8_t *out, size_t len);
+	void (*alaw_encode)(const int16_t *in, uint8_t *out, size_t len);
+	void (*mix)(int16_t *acc, const int16_t *in, size_t len);
+	void (*gain)(int16_t *samples, size_t len, int gain);
+	uint64_t (*ulaw_energy)(const uint8_t *in, size_t len);
+};
+
+/* Scalar kernels, also used for the tails of the vector ones */
+
+static inline int16_t ulaw_decode1(uint8_t u)
+{
+	int t;
+
+	u = ~u;
+	t = (((u & 0x0f) << 3) + ULAW_BIAS) << ((u & 0x70) >> 4);
+
+	return (u & 0x80) ? ULAW_BIAS - t : t - ULAW_BIAS;
+}
+
+static inline int16_t alaw_decode1(uint8_t a)
+{
+	int t, seg;
+
+	a ^= 0x55;
+	t = (a & 0x0f) << 4;
+	seg = (a & 0x70) >> 4;
+	if (!seg) {
+		t += 8;
+	} else {
+		t = (t + 0x108) << (seg - 1);
+	}
+
+	return (a & 0x80) ? t : -t;
+}
+
+static inline uint8_t ulaw_encode1(int16_t sample)
+{
+	int sign = 0, mag = sample, exponent, mantissa;
+
+	if (mag < 0) {
+		sign = 0x80;
+		mag = -mag;
+	}
+	if (mag > ULAW_CLIP) {
+		mag = ULAW_CLIP;
+	}
+	mag += ULAW_BIAS;
+
+	exponent = 31 - __builtin_clz(mag >> 7);
+	mantissa = (mag >> (exponent + 3)) & 0x0f;
+
+	return ~(sign | (exponent << 4) | mantissa);
+}
+
+static inline uint8_t alaw_encode1(int16_t sample)
+{
+	int val = sample >> 3, mask = 0xd5, seg;
+
+	if (val < 0) {
+		mask = 0x55;
+		val = -val - 1;
+	}
+
+	seg = val >> 5 ? 32 - __builtin_clz(val >> 5) : 0;
+
+	return ((seg << 4) | ((val >> (seg ? seg : 1)) & 0x0f)) ^ mask;
+}
+
+static inline int16_t saturate16(int32_t v)
+{
+	return v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : v;
+}
+
+static void ulaw_decode_scalar(const uint8_t *in, int16_t *out, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		out[i] = ulaw_decode1(in[i]);
+	}
+}
+
+static void alaw_decode_scalar(const uint8_t *in, int16_t *out, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		out[i] = alaw_decode1(in[i]);
+	}
+}
+
+static void ulaw_encode_scalar(const int16_t *in, uint8_t *out, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		out[i] = ulaw_encode1(in[i]);
+	}
+}
+
+static void alaw_encode_scalar(const int16_t *in, uint8_t *out, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		out[i] = alaw_encode1(in[i]);
+	}
+}
+
+static void mix_scalar(int16_t *acc, const int16_t *in, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		acc[i] = saturate16((int32_t)acc[i] + in[i]);
+	}
+}
+
+static void gain_scalar(int16_t *samples, size_t len, int gain)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		samples[i] = saturate16(((int32_t)samples[i] * gain + 2048) >> 12);
+	}
+}
+
+static uint64_t ulaw_energy_scalar(const uint8_t *in, size_t len)
+{
+	uint64_t energy = 0;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		int32_t s = ulaw_decode1(in[i]);
+
+		energy += (uint64_t)(s * s);
+	}
+
+	return energy;
+}
+
+static const struct moq_g711_ops moq_g711_scalar_ops = {
+	.ulaw_decode = ulaw_decode_scalar,
+	.alaw_decode = alaw_decode_scalar,
+	.ulaw_encode = ulaw_encode_scalar,
+	.alaw_encode = alaw_encode_scalar,
+	.mix = mix_scalar,
+	.gain = gain_scalar,
+	.ulaw_energy = ulaw_energy_scalar,
+};
+
+#ifdef MOQ_G711_X86
+
+/* SSE4.1: 8 samples per step (16 when decoding) */
+
+#define SSE41 __attribute__((target("sse4.1")))
+
+/* Decode 16 ulaw bytes to two vectors of 8 samples */
+static inline SSE41 void ulaw_decode16_sse41(__m128i u, __m128i *lo, __m128i *hi)
+{
+	const __m128i pow2 = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, (char)128, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i bias = _mm_set1_epi16(ULAW_BIAS);
+	__m128i exp, mant, sign, pow, t, s;
+
+	u = _mm_xor_si128(u, _mm_set1_epi8((char)0xff));
+	exp = _mm_and_si128(_mm_srli_epi16(u, 4), _mm_set1_epi8(0x07));
+	mant = _mm_slli_epi16(_mm_and_si128(u, _mm_set1_epi8(0x0f)), 3);
+	sign = _mm_cmplt_epi8(u, _mm_setzero_si128());
+	pow = _mm_shuffle_epi8(pow2, exp);
+
+	t = _mm_mullo_epi16(_mm_add_epi16(_mm_cvtepu8_epi16(mant), bias), _mm_cvtepu8_epi16(pow));
+	t = _mm_sub_epi16(t, bias);
+	s = _mm_cvtepi8_epi16(sign);
+	*lo = _mm_sub_epi16(_mm_xor_si128(t, s), s);
+
+	t = _mm_mullo_epi16(_mm_add_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(mant, 8)), bias),
+		_mm_cvtepu8_epi16(_mm_srli_si128(pow, 8)));
+	t = _mm_sub_epi16(t, bias);
+	s = _mm_cvtepi8_epi16(_mm_srli_si128(sign, 8));
+	*hi = _mm_sub_epi16(_mm_xor_si128(t, s), s);
+}
+
+static SSE41 void ulaw_decode_sse41(const uint8_t *in, int16_t *out, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i lo, hi;
+
+		ulaw_decode16_sse41(_mm_loadu_si128((const __m128i *)(in + i)), &lo, &hi);
+		_mm_storeu_si128((__m128i *)(out + i), lo);
+		_mm_storeu_si128((__m128i *)(out + i + 8), hi);
+	}
+	ulaw_decode_scalar(in + i, out + i, len - i);
+}
+
+static SSE41 void alaw_decode_sse41(const uint8_t *in, int16_t *out, size_t len)
+{
+	const __m128i pow2 = _mm_setr_epi8(1, 1, 2, 4, 8, 16, 32, 64, 0, 0, 0, 0, 0, 0, 0, 0);
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i a = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + i)), _mm_set1_epi8(0x55));
+		__m128i seg = _mm_and_si128(_mm_srli_epi16(a, 4), _mm_set1_epi8(0x07));
+		__m128i mant = _mm_and_si128(a, _mm_set1_epi8(0x0f));
+		__m128i neg = _mm_cmpeq_epi8(_mm_and_si128(a, _mm_set1_epi8((char)0x80)), _mm_setzero_si128());
+		__m128i pow = _mm_shuffle_epi8(pow2, seg);
+		int half;
+
+		for (half = 0; half < 2; half++) {
+			__m128i s16 = _mm_cvtepu8_epi16(seg);
+			/* Segment 0 adds 8, the others 0x108 before shifting */
+			__m128i base = _mm_sub_epi16(_mm_set1_epi16(0x108),
+				_mm_and_si128(_mm_cmpeq_epi16(s16, _mm_setzero_si128()), _mm_set1_epi16(0x100)));
+			__m128i t = _mm_add_epi16(_mm_slli_epi16(_mm_cvtepu8_epi16(mant), 4), base);
+			__m128i s = _mm_cvtepi8_epi16(neg);
+
+			t = _mm_mullo_epi16(t, _mm_cvtepu8_epi16(pow));
+			_mm_storeu_si128((__m128i *)(out + i + half * 8), _mm_sub_epi16(_mm_xor_si128(t, s), s));
+
+			seg = _mm_srli_si128(seg, 8);
+			mant = _mm_srli_si128(mant, 8);
+			neg = _mm_srli_si128(neg, 8);
+			pow = _mm_srli_si128(pow, 8);
+		}
+	}
+	alaw_decode_scalar(in + i, out + i, len - i);
+}
+
+/* floor(log2(v)) of 16-bit lanes holding 1..255; 0 for 0 */
+static inline SSE41 __m128i log2_8_sse41(__m128i v)
+{
+	const __m128i lo = _mm_setr_epi8(0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+	const __m128i hi = _mm_setr_epi8(0, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7, 7, 7, 7, 7);
+	const __m128i nibble = _mm_set1_epi16(0x0f);
+
+	/* The high byte of each lane is zero and looks up entry 0, also zero */
+	return _mm_max_epu8(_mm_shuffle_epi8(lo, _mm_and_si128(v, nibble)),
+		_mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(v, 4), nibble)));
+}
+
+/* Encode 8 samples to ulaw codes in the low bytes of 16-bit lanes */
+static inline SSE41 __m128i ulaw_encode8_sse41(__m128i x)
+{
+	const __m128i pow2 = _mm_setr_epi8((char)128, 64, 32, 16, 8, 4, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0);
+	__m128i sign = _mm_and_si128(_mm_srai_epi16(x, 15), _mm_set1_epi16(0x80));
+	__m128i mag = _mm_add_epi16(_mm_min_epu16(_mm_abs_epi16(x), _mm_set1_epi16(ULAW_CLIP)),
+		_mm_set1_epi16(ULAW_BIAS));
+	__m128i exp = log2_8_sse41(_mm_srli_epi16(mag, 7));
+	__m128i pow, mant;
+
+	/* Shift left by 7 - exponent so the mantissa sits at bits 10-13 */
+	pow = _mm_shuffle_epi8(pow2, _mm_or_si128(exp, _mm_set1_epi16((short)0x8000)));
+	mant = _mm_and_si128(_mm_srli_epi16(_mm_mullo_epi16(mag, pow), 10), _mm_set1_epi16(0x0f));
+
+	return _mm_xor_si128(_mm_or_si128(sign, _mm_or_si128(_mm_slli_epi16(exp, 4), mant)),
+		_mm_set1_epi16(0xff));
+}
+
+static SSE41 void ulaw_encode_sse41(const int16_t *in, uint8_t *out, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i lo = ulaw_encode8_sse41(_mm_loadu_si128((const __m128i *)(in + i)));
+		__m128i hi = ulaw_encode8_sse41(_mm_loadu_si128((const __m128i *)(in + i + 8)));
+
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(lo, hi));
+	}
+	ulaw_encode_scalar(in + i, out + i, len - i);
+}
+
+/* Encode 8 samples to alaw codes in the low bytes of 16-bit lanes */
+static inline SSE41 __m128i alaw_encode8_sse41(__m128i x)
+{
+	const __m128i pow2 = _mm_setr_epi8(0, 64, 32, 16, 8, 4, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0);
+	__m128i val = _mm_srai_epi16(x, 3);
+	__m128i neg = _mm_srai_epi16(val, 15);
+	__m128i seg, shift, pow, mant, mask;
+
+	/* Magnitude -val - 1 for negative samples */
+	val = _mm_xor_si128(val, neg);
+
+	/* Segment: log2(val) - 4, or 0 below 32, which is log2(val >> 4) */
+	seg = log2_8_sse41(_mm_srli_epi16(val, 4));
+
+	/* Shift left by 7 - max(seg, 1) so the mantissa sits at bits 7-10 */
+	shift = _mm_max_epi16(seg, _mm_set1_epi16(1));
+	pow = _mm_shuffle_epi8(pow2, _mm_or_si128(shift, _mm_set1_epi16((short)0x8000)));
+	mant = _mm_and_si128(_mm_srli_epi16(_mm_mullo_epi16(val, pow), 7), _mm_set1_epi16(0x0f));
+	mask = _mm_xor_si128(_mm_set1_epi16(0xd5), _mm_and_si128(neg, _mm_set1_epi16(0x80)));
+
+	return _mm_xor_si128(_mm_or_si128(_mm_slli_epi16(seg, 4), mant), mask);
+}
+
+static SSE41 void alaw_encode_sse41(const int16_t *in, uint8_t *out, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i lo = alaw_encode8_sse41(_mm_loadu_si128((const __m128i *)(in + i)));
+		__m128i hi = alaw_encode8_sse41(_mm_loadu_si128((const __m128i *)(in + i + 8)));
+
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(lo, hi));
+	}
+	alaw_encode_scalar(in + i, out + i, len - i);
+}
+
+static SSE41 void mix_sse41(int16_t *acc, const int16_t *in, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(acc + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(in + i));
+
+		_mm_storeu_si128((__m128i *)(acc + i), _mm_adds_epi16(a, b));
+	}
+	mix_scalar(acc + i, in + i, len - i);
+}
+
+static SSE41 void gain_sse41(int16_t *samples, size_t len, int gain)
+{
+	const __m128i g = _mm_set1_epi16((short)gain);
+	const __m128i round = _mm_set1_epi32(2048);
+	size_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(samples + i));
+		__m128i lo = _mm_mullo_epi16(s, g);
+		__m128i hi = _mm_mulhi_epi16(s, g);
+		__m128i p0 = _mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi16(lo, hi), round), 12);
+		__m128i p1 = _mm_srai_epi32(_mm_add_epi32(_mm_unpackhi_epi16(lo, hi), round), 12);
+
+		_mm_storeu_si128((__m128i *)(samples + i), _mm_packs_epi32(p0, p1));
+	}
+	gain_scalar(samples + i, len - i, gain);
+}
+
+static SSE41 uint64_t ulaw_energy_sse41(const uint8_t *in, size_t len)
+{
+	__m128i acc = _mm_setzero_si128();
+	uint64_t sums[2];
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i lo, hi, sq;
+
+		ulaw_decode16_sse41(_mm_loadu_si128((const __m128i *)(in + i)), &lo, &hi);
+
+		/* Each pair sum is below 2^31; widen to 64 bits before accumulating */
+		sq = _mm_madd_epi16(lo, lo);
+		acc = _mm_add_epi64(acc, _mm_cvtepu32_epi64(sq));
+		acc = _mm_add_epi64(acc, _mm_cvtepu32_epi64(_mm_srli_si128(sq, 8)));
+		sq = _mm_madd_epi16(hi, hi);
+		acc = _mm_add_epi64(acc, _mm_cvtepu32_epi64(sq));
+		acc = _mm_add_epi64(acc, _mm_cvtepu32_epi64(_mm_srli_si128(sq, 8)));
+	}
+	_mm_storeu_si128((__m128i *)sums, acc);
+
+	return sums[0] + sums[1] + ulaw_energy_scalar(in + i, len - i);
+}
+
+static const struct moq_g711_ops moq_g711_sse41_ops = {
+	.ulaw_decode = ulaw_decode_sse41,
+	.alaw_decode = alaw_decode_sse41,
+	.ulaw_encode = ulaw_encode_sse41,
+	.alaw_encode = alaw_encode_sse41,
+	.mix = mix_sse41,
+	.gain = gain_sse41,
+	.ulaw_energy = ulaw_energy_sse41,
+};
+
+/* AVX2: the same arithmetic on 16 samples per step */
+
+#define AVX2 __attribute__((target("avx2")))
+
+static inline AVX2 __m256i ulaw_decode16_avx2(__m128i u)
+{
+	const __m128i pow2 = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, (char)128, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i bias = _mm256_set1_epi16(ULAW_BIAS);
+	__m128i exp, mant, sign;
+	__m256i t, s;
+
+	u = _mm_xor_si128(u, _mm_set1_epi8((char)0xff));
+	exp = _mm_and_si128(_mm_srli_epi16(u, 4), _mm_set1_epi8(0x07));
+	mant = _mm_slli_epi16(_mm_and_si128(u, _mm_set1_epi8(0x0f)), 3);
+	sign = _mm_cmplt_epi8(u, _mm_setzero_si128());
+
+	t = _mm256_mullo_epi16(_mm256_add_epi16(_mm256_cvtepu8_epi16(mant), bias),
+		_mm256_cvtepu8_epi16(_mm_shuffle_epi8(pow2, exp)));
+	t = _mm256_sub_epi16(t, bias);
+	s = _mm256_cvtepi8_epi16(sign);
+
+	return _mm256_sub_epi16(_mm256_xor_si256(t, s), s);
+}
+
+static AVX2 void ulaw_decode_avx2(const uint8_t *in, int16_t *out, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		_mm256_storeu_si256((__m256i *)(out + i),
+			ulaw_decode16_avx2(_mm_loadu_si128((const __m128i *)(in + i))));
+	}
+	ulaw_decode_scalar(in + i, out + i, len - i);
+}
+
+static AVX2 void alaw_decode_avx2(const uint8_t *in, int16_t *out, size_t len)
+{
+	const __m128i pow2 = _mm_setr_epi8(1, 1, 2, 4, 8, 16, 32, 64, 0, 0, 0, 0, 0, 0, 0, 0);
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i a = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + i)), _mm_set1_epi8(0x55));
+		__m128i seg = _mm_and_si128(_mm_srli_epi16(a, 4), _mm_set1_epi8(0x07));
+		__m128i neg = _mm_cmpeq_epi8(_mm_and_si128(a, _mm_set1_epi8((char)0x80)), _mm_setzero_si128());
+		__m256i s16 = _mm256_cvtepu8_epi16(seg);
+		__m256i base = _mm256_sub_epi16(_mm256_set1_epi16(0x108),
+			_mm256_and_si256(_mm256_cmpeq_epi16(s16, _mm256_setzero_si256()), _mm256_set1_epi16(0x100)));
+		__m256i t = _mm256_add_epi16(_mm256_slli_epi16(
+			_mm256_cvtepu8_epi16(_mm_and_si128(a, _mm_set1_epi8(0x0f))), 4), base);
+		__m256i s = _mm256_cvtepi8_epi16(neg);
+
+		t = _mm256_mullo_epi16(t, _mm256_cvtepu8_epi16(_mm_shuffle_epi8(pow2, seg)));
+		_mm256_storeu_si256((__m256i *)(out + i), _mm256_sub_epi16(_mm256_xor_si256(t, s), s));
+	}
+	alaw_decode_scalar(in + i, out + i, len - i);
+}
+
+static inline AVX2 __m256i log2_8_avx2(__m256i v)
+{
+	const __m256i lo = _mm256_setr_epi8(0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3,
+		0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+	const __m256i hi = _mm256_setr_epi8(0, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7, 7, 7, 7, 7,
+		0, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7, 7, 7, 7, 7);
+	const __m256i nibble = _mm256_set1_epi16(0x0f);
+
+	return _mm256_max_epu8(_mm256_shuffle_epi8(lo, _mm256_and_si256(v, nibble)),
+		_mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble)));
+}
+
+/* Pack the low bytes of sixteen 16-bit lanes in order */
+static inline AVX2 __m128i pack16_avx2(__m256i v)
+{
+	return _mm_packus_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+}
+
+static AVX2 void ulaw_encode_avx2(const int16_t *in, uint8_t *out, size_t len)
+{
+	const __m256i pow2 = _mm256_setr_epi8((char)128, 64, 32, 16, 8, 4, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0,
+		(char)128, 64, 32, 16, 8, 4, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0);
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(in + i));
+		__m256i sign = _mm256_and_si256(_mm256_srai_epi16(x, 15), _mm256_set1_epi16(0x80));
+		__m256i mag = _mm256_add_epi16(_mm256_min_epu16(_mm256_abs_epi16(x),
+			_mm256_set1_epi16(ULAW_CLIP)), _mm256_set1_epi16(ULAW_BIAS));
+		__m256i exp = log2_8_avx2(_mm256_srli_epi16(mag, 7));
+		__m256i pow, mant;
+
+		pow = _mm256_shuffle_epi8(pow2, _mm256_or_si256(exp, _mm256_set1_epi16((short)0x8000)));
+		mant = _mm256_and_si256(_mm256_srli_epi16(_mm256_mullo_epi16(mag, pow), 10),
+			_mm256_set1_epi16(0x0f));
+
+		_mm_storeu_si128((__m128i *)(out + i), pack16_avx2(_mm256_xor_si256(
+			_mm256_or_si256(sign, _mm256_or_si256(_mm256_slli_epi16(exp, 4), mant)),
+			_mm256_set1_epi16(0xff))));
+	}
+	ulaw_encode_scalar(in + i, out + i, len - i);
+}
+
+static AVX2 void alaw_encode_avx2(const int16_t *in, uint8_t *out, size_t len)
+{
+	const __m256i pow2 = _mm256_setr_epi8(0, 64, 32, 16, 8, 4, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 64, 32, 16, 8, 4, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0);
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m256i val = _mm256_srai_epi16(_mm256_loadu_si256((const __m256i *)(in + i)), 3);
+		__m256i neg = _mm256_srai_epi16(val, 15);
+		__m256i seg, shift, pow, mant, mask;
+
+		val = _mm256_xor_si256(val, neg);
+		seg = log2_8_avx2(_mm256_srli_epi16(val, 4));
+		shift = _mm256_max_epi16(seg, _mm256_set1_epi16(1));
+		pow = _mm256_shuffle_epi8(pow2, _mm256_or_si256(shift, _mm256_set1_epi16((short)0x8000)));
+		mant = _mm256_and_si256(_mm256_srli_epi16(_mm256_mullo_epi16(val, pow), 7),
+			_mm256_set1_epi16(0x0f));
+		mask = _mm256_xor_si256(_mm256_set1_epi16(0xd5), _mm256_and_si256(neg, _mm256_set1_epi16(0x80)));
+
+		_mm_storeu_si128((__m128i *)(out + i), pack16_avx2(_mm256_xor_si256(
+			_mm256_or_si256(_mm256_slli_epi16(seg, 4), mant), mask)));
+	}
+	alaw_encode_scalar(in + i, out + i, len - i);
+}
+
+static AVX2 void mix_avx2(int16_t *acc, const int16_t *in, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(acc + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(in + i));
+
+		_mm256_storeu_si256((__m256i *)(acc + i), _mm256_adds_epi16(a, b));
+	}
+	mix_scalar(acc + i, in + i, len - i);
+}
+
+static AVX2 void gain_avx2(int16_t *samples, size_t len, int gain)
+{
+	const __m256i g = _mm256_set1_epi16((short)gain);
+	const __m256i round = _mm256_set1_epi32(2048);
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m256i s = _mm256_loadu_si256((const __m256i *)(samples + i));
+		__m256i lo = _mm256_mullo_epi16(s, g);
+		__m256i hi = _mm256_mulhi_epi16(s, g);
+		/* Unpack and pack both work within 128-bit lanes, so the order is kept */
+		__m256i p0 = _mm256_srai_epi32(_mm256_add_epi32(_mm256_unpacklo_epi16(lo, hi), round), 12);
+		__m256i p1 = _mm256_srai_epi32(_mm256_add_epi32(_mm256_unpackhi_epi16(lo, hi), round), 12);
+
+		_mm256_storeu_si256((__m256i *)(samples + i), _mm256_packs_epi32(p0, p1));
+	}
+	gain_scalar(samples + i, len - i, gain);
+}
+
+static AVX2 uint64_t ulaw_energy_avx2(const uint8_t *in, size_t len)
+{
+	__m256i acc = _mm256_setzero_si256();
+	uint64_t sums[4];
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m256i s = ulaw_decode16_avx2(_mm_loadu_si128((const __m128i *)(in + i)));
+		__m256i sq = _mm256_madd_epi16(s, s);
+
+		acc = _mm256_add_epi64(acc, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(sq)));
+		acc = _mm256_add_epi64(acc, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(sq, 1)));
+	}
+	_mm256_storeu_si256((__m256i *)sums, acc);
+
+	return sums[0] + sums[1] + sums[2] + sums[3] + ulaw_energy_scalar(in + i, len - i);
+}
+
+static const struct moq_g711_ops moq_g711_avx2_ops = {
+	.ulaw_decode = ulaw_decode_avx2,
+	.alaw_decode = alaw_decode_avx2,
+	.ulaw_encode = ulaw_encode_avx2,
+	.alaw_encode = alaw_encode_avx2,
+	.mix = mix_avx2,
+	.gain = gain_avx2,
+	.ulaw_energy = ulaw_energy_avx2,
+};
+
+#endif /* MOQ_G711_X86 */
+
+static const struct moq_g711_ops *moq_g711_ops = &moq_g711_scalar_ops;
+static enum moq_g711_isa moq_g711_isa = MOQ_G711_SCALAR;
+
+int moq_g711_select(enum moq_g711_isa isa)
+{
+	const struct moq_g711_ops *ops = NULL;
+
+	switch (isa) {
+	case MOQ_G711_SCALAR:
+		ops = &moq_g711_scalar_ops;
+		break;
+#ifdef MOQ_G711_X86
+	case MOQ_G711_SSE41:
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("sse4.1")) {
+			ops = &moq_g711_sse41_ops;
+		}
+		break;
+	case MOQ_G711_AVX2:
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			ops = &moq_g711_avx2_ops;
+		}
+		break;
+#endif
+	default:
+		break;
+	}
+	if (!ops) {
+		return -1;
+	}
+
+	moq_g711_ops = ops;
+	moq_g711_isa = isa;
+
+	return 0;
+}
+
+enum moq_g711_isa moq_g711_init(void)
+{
+	int isa;
+
+	for (isa = MOQ_G711_ISA_COUNT - 1; isa > MOQ_G711_SCALAR; isa--) {
+		if (!moq_g711_select(isa)) {
+			return isa;
+		}
+	}
+	moq_g711_select(MOQ_G711_SCALAR);
+
+	return MOQ_G711_SCALAR;
+}
+
+enum moq_g711_isa moq_g711_current(void)
+{
+	return moq_g711_isa;
+}
+
+const char *moq_g711_name(enum moq_g711_isa isa)
+{
+	switch (isa) {
+	case MOQ_G711_SCALAR:
+		return "scalar";
+	case MOQ_G711_SSE41:
+		return "sse4.1";
+	case MOQ_G711_AVX2:
+		return "avx2";
+	default:
+		return "unknown";
+	}
+}
+
+void moq_g711_ulaw_decode(const uint8_t *in, int16_t *out, size_t len)
+{
+	moq_g711_ops->ulaw_decode(in, out, len);
+}
+
+void moq_g711_alaw_decode(const uint8_t *in, int16_t *out, size_t len)
+{
+	moq_g711_ops->alaw_decode(in, out, len);
+}
+
+void moq_g711_ulaw_encode(const int16_t *in, uint8_t *out, size_t len)
+{
+	moq_g711_ops->ulaw_encode(in, out, len);
+}
+
+void moq_g711_alaw_encode(const int16_t *in, uint8_t *out, size_t len)
+{
+	moq_g711_ops->alaw_encode(in, out, len);
+}
+
+void moq_g711_mix(int16_t *acc, const int16_t *in, size_t len)
+{
+	moq_g711_ops->mix(acc, in, len);
+}
+
+void moq_g711_gain(int16_t *samples, size_t len, int gain)
+{
+	moq_g711_ops->gain(samples, len, gain < 0 ? 0 : gain > INT16_MAX ? INT16_MAX : gain);
+}
+
+uint64_t moq_g711_ulaw_energy(const uint8_t *in, size_t len)
+{
+	return moq_g711_ops->ulaw_energy(in, len);
+}
@@ -0,0 +1,66 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/*
+ * G.711 sample kernels: ulaw/alaw decode and encode, mixing, gain and
+ * energy, working on whole frames at a time.
+ *
+ * Each kernel has a scalar version and, on x86, SSE4.1 and AVX2 versions
+ * that compute the companding arithmetically instead of through tables,
+ * 8 or 16 samples per step. moq_g711_init() picks the best set the CPU
+ * supports; until then, or on other architectures, the scalar set is used.
+ * All sets produce bit-identical results.
+ *
+ * Encoding is the classic full 16-bit formulation (ulaw bias 0x84 and clip
+ * 32635, alaw on the top 13 bits), without the zero trap. Like moq_wire
+ * this has no Asterisk dependencies.
+ */
+
+#ifndef MOQ_G711_H
+#define MOQ_G711_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MOQ_G711_UNITY_GAIN 4096	/* Gains are Q12 fixed point, up to 8x */
+
+enum moq_g711_isa {
+	MOQ_G711_SCALAR,
+	MOQ_G711_SSE41,
+	MOQ_G711_AVX2,
+	MOQ_G711_ISA_COUNT
+};
+
+/* Select the best kernels for this CPU; returns the set chosen */
+enum moq_g711_isa moq_g711_init(void);
+
+/* Force a kernel set; returns -1 if this build or CPU does not support it */
+int moq_g711_select(enum moq_g711_isa isa);
+
+/* Kernel set in use */
+enum moq_g711_isa moq_g711_current(void);
+
+/* Name of a kernel set */
+const char *moq_g711_name(enum moq_g711_isa isa);
+
+void moq_g711_ulaw_decode(const uint8_t *in, int16_t *out, size_t len);
+void moq_g711_alaw_decode(const uint8_t *in, int16_t *out, size_t len);
+void moq_g711_ulaw_encode(const int16_t *in, uint8_t *out, size_t len);
+void moq_g711_alaw_encode(const int16_t *in, uint8_t *out, size_t len);
+
+/* Add in to acc with saturation */
+void moq_g711_mix(int16_t *acc, const int16_t *in, size_t len);
+
+/* Scale samples by a Q12 gain (clamped to 0..32767) with rounding and saturation */
+void moq_g711_gain(int16_t *samples, size_t len, int gain);
+
+/* Sum of squares of the decoded samples of a ulaw frame */
+uint64_t moq_g711_ulaw_energy(const uint8_t *in, size_t len);
+
+#endif /* MOQ_G711_H */
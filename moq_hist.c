@@ -0,0 +1,105 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/* HDR-style latency histogram - see moq_hist.h */
+
+#include <string.h>
+
+#include "moq_hist.h"
+
+static inline int moq_hist_index(uint64_t value)
+{
+	int msb, shift, index;
+
+	if (value < MOQ_HIST_LINEAR) {
+		return (int)value;
+	}
+
+	msb = 63 - __builtin_clzll(value);
+	shift = msb - MOQ_HIST_SUB_BITS;
+	index = MOQ_HIST_LINEAR + (shift - 1) * MOQ_HIST_SUB_COUNT +
+		(int)((value >> shift) - MOQ_HIST_SUB_COUNT);
+
+	return index < MOQ_HIST_BUCKETS ? index : MOQ_HIST_BUCKETS - 1;
+}
+
+static inline uint64_t moq_hist_bucket_value(int index)
+{
+	int shift;
+
+	if (index < MOQ_HIST_LINEAR) {
+		return index;
+	}
+
+	shift = (index - MOQ_HIST_LINEAR) / MOQ_HIST_SUB_COUNT + 1;
+	return (uint64_t)((index - MOQ_HIST_LINEAR) % MOQ_HIST_SUB_COUNT + MOQ_HIST_SUB_COUNT) << shift;
+}
+
+void moq_hist_record(struct moq_hist *hist, uint64_t value)
+{
+	uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+
+	__atomic_fetch_add(&hist->counts[moq_hist_index(value)], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&hist->total, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&hist->sum, value, __ATOMIC_RELAXED);
+
+	while (value > max &&
+		!__atomic_compare_exchange_n(&hist->max, &max, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		/* max was reloaded by the failed exchange */
+	}
+}
+
+void moq_hist_snapshot(const struct moq_hist *hist, struct moq_hist *copy)
+{
+	int i;
+
+	copy->total = 0;
+	for (i = 0; i < MOQ_HIST_BUCKETS; i++) {
+		copy->counts[i] = __atomic_load_n(&hist->counts[i], __ATOMIC_RELAXED);
+		copy->total += copy->counts[i];
+	}
+	copy->sum = __atomic_load_n(&hist->sum, __ATOMIC_RELAXED);
+	copy->max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+}
+
+void moq_hist_reset(struct moq_hist *hist)
+{
+	int i;
+
+	for (i = 0; i < MOQ_HIST_BUCKETS; i++) {
+		__atomic_store_n(&hist->counts[i], 0, __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&hist->total, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&hist->sum, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&hist->max, 0, __ATOMIC_RELAXED);
+}
+
+uint64_t moq_hist_percentile(const struct moq_hist *hist, double percentile)
+{
+	uint64_t target, seen = 0;
+	int i;
+
+	if (!hist->total) {
+		return 0;
+	}
+
+	target = (uint64_t)(hist->total * percentile / 100.0);
+	if (target >= hist->total) {
+		target = hist->total - 1;
+	}
+
+	for (i = 0; i < MOQ_HIST_BUCKETS; i++) {
+		seen += hist->counts[i];
+		if (seen > target) {
+			return moq_hist_bucket_value(i);
+		}
+	}
+
+	return hist->max;
+}
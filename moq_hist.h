@@ -0,0 +1,50 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/*
+ * HDR-style latency histogram.
+ *
+ * Values (microseconds) below 32 get exact buckets; above that every power
+ * of two is split into 16 linear sub-buckets, giving about 6% relative
+ * precision up to 2^32 us (over an hour). Recording is a single
+ * relaxed atomic increment, so any number of threads can record into one
+ * histogram without locking. Like moq_wire, this has no Asterisk
+ * dependencies.
+ */
+
+#ifndef MOQ_HIST_H
+#define MOQ_HIST_H
+
+#include <stdint.h>
+
+#define MOQ_HIST_SUB_BITS 4
+#define MOQ_HIST_SUB_COUNT (1 << MOQ_HIST_SUB_BITS)
+#define MOQ_HIST_LINEAR (2 * MOQ_HIST_SUB_COUNT)
+#define MOQ_HIST_BUCKETS (MOQ_HIST_LINEAR + 27 * MOQ_HIST_SUB_COUNT)
+
+struct moq_hist {
+	uint64_t counts[MOQ_HIST_BUCKETS];
+	uint64_t total;
+	uint64_t sum;
+	uint64_t max;
+};
+
+/* Record one value; safe to call concurrently */
+void moq_hist_record(struct moq_hist *hist, uint64_t value);
+
+/* Copy a histogram that may be recorded into concurrently */
+void moq_hist_snapshot(const struct moq_hist *hist, struct moq_hist *copy);
+
+/* Clear all counts */
+void moq_hist_reset(struct moq_hist *hist);
+
+/* Value at the given percentile (0-100), reported as its bucket's lower bound */
+uint64_t moq_hist_percentile(const struct moq_hist *hist, double percentile);
+
+#endif /* MOQ_HIST_H */
@@ -0,0 +1,214 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/* Fragmented object reassembly - see moq_reasm.h */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "moq_reasm.h"
+
+static void moq_reasm_release(struct moq_reasm *reasm, struct moq_reasm_slot *slot)
+{
+	free(slot->data);
+	reasm->used -= slot->object_size;
+	slot->data = NULL;
+	slot->in_use = 0;
+}
+
+/* Evict the oldest incomplete object; returns 0 if there was none */
+static int moq_reasm_evict_oldest(struct moq_reasm *reasm)
+{
+	struct moq_reasm_slot *oldest = NULL;
+	int i;
+
+	for (i = 0; i < MOQ_REASM_SLOTS; i++) {
+		struct moq_reasm_slot *slot = &reasm->slots[i];
+
+		if (slot->in_use && (!oldest || slot->started_us < oldest->started_us)) {
+			oldest = slot;
+		}
+	}
+	if (!oldest) {
+		return 0;
+	}
+
+	moq_reasm_release(reasm, oldest);
+	reasm->evicted++;
+
+	return 1;
+}
+
+static int moq_reasm_is_recent(const struct moq_reasm *reasm, const struct moq_fragment *frag)
+{
+	int i;
+
+	for (i = 0; i < MOQ_REASM_SLOTS; i++) {
+		if (reasm->recent[i].track_id == frag->track_id &&
+			reasm->recent[i].sequence == frag->sequence) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Find the slot collecting a fragment's object, starting one if needed */
+static struct moq_reasm_slot *moq_reasm_slot_get(struct moq_reasm *reasm,
+	const struct moq_fragment *frag, uint64_t now_us)
+{
+	struct moq_reasm_slot *free_slot = NULL;
+	int i;
+
+	for (i = 0; i < MOQ_REASM_SLOTS; i++) {
+		struct moq_reasm_slot *slot = &reasm->slots[i];
+
+		if (!slot->in_use) {
+			if (!free_slot) {
+				free_slot = slot;
+			}
+		} else if (slot->track_id == frag->track_id && slot->sequence == frag->sequence) {
+			return slot;
+		}
+	}
+
+	if (frag->object_size > reasm->max_object || frag->object_size > reasm->budget ||
+		frag->count > MOQ_REASM_MAX_FRAGMENTS) {
+		return NULL;
+	}
+
+	while (reasm->used + frag->object_size > reasm->budget && moq_reasm_evict_oldest(reasm)) {
+		/* Make room within the budget */
+	}
+	if (!free_slot) {
+		moq_reasm_evict_oldest(reasm);
+		for (i = 0; i < MOQ_REASM_SLOTS && !free_slot; i++) {
+			if (!reasm->slots[i].in_use) {
+				free_slot = &reasm->slots[i];
+			}
+		}
+	}
+
+	free_slot->data = malloc(frag->object_size);
+	if (!free_slot->data) {
+		return NULL;
+	}
+
+	free_slot->in_use = 1;
+	free_slot->type = frag->type;
+	free_slot->track_id = frag->track_id;
+	free_slot->sequence = frag->sequence;
+	free_slot->timestamp = frag->timestamp;
+	free_slot->object_size = frag->object_size;
+	free_slot->count = frag->count;
+	free_slot->received = 0;
+	free_slot->started_us = now_us;
+	memset(free_slot->have, 0, sizeof(free_slot->have));
+	reasm->used += frag->object_size;
+
+	return free_slot;
+}
+
+void moq_reasm_init(struct moq_reasm *reasm, size_t max_object, size_t budget,
+	uint64_t timeout_us)
+{
+	memset(reasm, 0, sizeof(*reasm));
+	memset(reasm->recent, 0xff, sizeof(reasm->recent));
+	reasm->max_object = max_object;
+	reasm->budget = budget;
+	reasm->timeout_us = timeout_us;
+}
+
+void moq_reasm_clear(struct moq_reasm *reasm)
+{
+	int i;
+
+	for (i = 0; i < MOQ_REASM_SLOTS; i++) {
+		if (reasm->slots[i].in_use || reasm->slots[i].data) {
+			moq_reasm_release(reasm, &reasm->slots[i]);
+		}
+	}
+	reasm->done = NULL;
+	memset(reasm->recent, 0xff, sizeof(reasm->recent));
+}
+
+int moq_reasm_add(struct moq_reasm *reasm, const struct moq_fragment *frag,
+	uint64_t now_us, struct moq_object *obj)
+{
+	struct moq_reasm_slot *slot;
+	size_t offset;
+
+	/* The object handed out last time is no longer referenced */
+	if (reasm->done) {
+		moq_reasm_release(reasm, reasm->done);
+		reasm->done = NULL;
+	}
+
+	/* A late duplicate must not start the object over */
+	if (moq_reasm_is_recent(reasm, frag)) {
+		return 0;
+	}
+
+	slot = moq_reasm_slot_get(reasm, frag, now_us);
+	if (!slot) {
+		reasm->rejected++;
+		return -1;
+	}
+
+	/* Fragments of one object must agree on its shape */
+	if (slot->object_size != frag->object_size || slot->count != frag->count ||
+		slot->type != frag->type) {
+		reasm->rejected++;
+		return -1;
+	}
+
+	if (slot->have[frag->index / 64] & (1ULL << (frag->index % 64))) {
+		return 0;
+	}
+
+	offset = (size_t)frag->index * moq_wire_fragment_chunk(frag->object_size, frag->count);
+	memcpy(slot->data + offset, frag->data, frag->data_len);
+	slot->have[frag->index / 64] |= 1ULL << (frag->index % 64);
+
+	if (++slot->received < slot->count) {
+		return 0;
+	}
+
+	obj->type = slot->type;
+	obj->track_id = slot->track_id;
+	obj->sequence = slot->sequence;
+	obj->timestamp = slot->timestamp;
+	obj->payload_size = slot->object_size > UINT16_MAX ? UINT16_MAX : slot->object_size;
+	obj->payload = slot->data;
+	obj->payload_len = slot->object_size;
+
+	/* Keep the data alive until the next call; the slot itself is free again */
+	slot->in_use = 0;
+	reasm->done = slot;
+	reasm->recent[reasm->recent_next].track_id = slot->track_id;
+	reasm->recent[reasm->recent_next].sequence = slot->sequence;
+	reasm->recent_next = (reasm->recent_next + 1) % MOQ_REASM_SLOTS;
+	reasm->completed++;
+
+	return 1;
+}
+
+void moq_reasm_expire(struct moq_reasm *reasm, uint64_t now_us)
+{
+	int i;
+
+	for (i = 0; i < MOQ_REASM_SLOTS; i++) {
+		struct moq_reasm_slot *slot = &reasm->slots[i];
+
+		if (slot->in_use && now_us - slot->started_us > reasm->timeout_us) {
+			moq_reasm_release(reasm, slot);
+			reasm->timed_out++;
+		}
+	}
+}
@@ -0,0 +1,88 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/*
+ * Object reassembly for fragmented media objects.
+ *
+ * A fixed number of slots each collect the fragments of one object, keyed
+ * by track and sequence, so several objects (audio and video, or a
+ * keyframe overtaken by the next frame) can be in flight at once. Memory
+ * is bounded twice: by a per-object size limit and by a byte budget shared
+ * by all slots; when either a slot or budget is needed the oldest
+ * incomplete object is evicted. Objects not completed within the timeout
+ * are dropped by moq_reasm_expire().
+ *
+ * Not thread-safe; each session's media thread owns its reassembler. Like
+ * moq_wire this has no Asterisk dependencies.
+ */
+
+#ifndef MOQ_REASM_H
+#define MOQ_REASM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "moq_wire.h"
+
+#define MOQ_REASM_SLOTS 8
+#define MOQ_REASM_MAX_FRAGMENTS 1024
+
+struct moq_reasm_slot {
+	int in_use;
+	uint8_t type;
+	uint32_t track_id;
+	uint64_t sequence;
+	uint64_t timestamp;
+	uint32_t object_size;
+	uint16_t count;
+	uint16_t received;
+	uint64_t started_us;
+	uint8_t *data;
+	uint64_t have[MOQ_REASM_MAX_FRAGMENTS / 64];
+};
+
+struct moq_reasm {
+	struct moq_reasm_slot slots[MOQ_REASM_SLOTS];
+	struct moq_reasm_slot *done;	/* Completed slot whose data was handed out */
+	struct {
+		uint32_t track_id;
+		uint64_t sequence;
+	} recent[MOQ_REASM_SLOTS];	/* Recently completed, to ignore late duplicates */
+	int recent_next;
+	size_t max_object;
+	size_t budget;
+	size_t used;
+	uint64_t timeout_us;
+	/* Counters */
+	uint64_t completed;
+	uint64_t timed_out;
+	uint64_t evicted;
+	uint64_t rejected;		/* Fragments refused: too large or inconsistent */
+};
+
+/* Prepare a reassembler; nothing is allocated until fragments arrive */
+void moq_reasm_init(struct moq_reasm *reasm, size_t max_object, size_t budget,
+	uint64_t timeout_us);
+
+/* Drop every partial object and release all memory; counters are kept */
+void moq_reasm_clear(struct moq_reasm *reasm);
+
+/*
+ * Add a fragment received at now_us. Returns 1 when it completes an object,
+ * which is then described by obj with its payload valid until the next
+ * call; 0 if the object is still incomplete or the fragment is a duplicate;
+ * -1 if the fragment was rejected.
+ */
+int moq_reasm_add(struct moq_reasm *reasm, const struct moq_fragment *frag,
+	uint64_t now_us, struct moq_object *obj);
+
+/* Drop objects still incomplete after the timeout */
+void moq_reasm_expire(struct moq_reasm *reasm, uint64_t now_us);
+
+#endif /* MOQ_REASM_H */
@@ -0,0 +1,388 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/* Signaling registrar and call router - see moq_registrar.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "moq_registrar.h"
+
+#define MOQ_REGISTRAR_BUCKETS 64	/* Initial size of each table; both double as they fill */
+
+/* FNV-1a */
+static uint32_t moq_registrar_hash(const char *key)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*key) {
+		hash ^= (uint8_t)*key++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static int moq_registrar_valid_id(const char *id)
+{
+	return id && *id && strlen(id) < MOQ_REGISTRAR_ID_SIZE;
+}
+
+static struct moq_registrar_user **moq_registrar_find_user(struct moq_registrar *reg,
+	const char *user_id)
+{
+	struct moq_registrar_user **user = &reg->users[moq_registrar_hash(user_id) & (reg->user_buckets - 1)];
+
+	while (*user && strcmp((*user)->user_id, user_id)) {
+		user = &(*user)->next;
+	}
+
+	return user;
+}
+
+static struct moq_registrar_route **moq_registrar_find_route(struct moq_registrar *reg,
+	const char *session_id)
+{
+	struct moq_registrar_route **route = &reg->routes[moq_registrar_hash(session_id) & (reg->route_buckets - 1)];
+
+	while (*route && strcmp((*route)->session_id, session_id)) {
+		route = &(*route)->next;
+	}
+
+	return route;
+}
+
+/* Double a table once it holds more entries than buckets; failing to is harmless */
+static void moq_registrar_grow_users(struct moq_registrar *reg)
+{
+	struct moq_registrar_user **users, *user, *next;
+	size_t buckets = reg->user_buckets * 2, i;
+
+	if (reg->user_count <= reg->user_buckets || !(users = calloc(buckets, sizeof(*users)))) {
+		return;
+	}
+	for (i = 0; i < reg->user_buckets; i++) {
+		for (user = reg->users[i]; user; user = next) {
+			size_t bucket = moq_registrar_hash(user->user_id) & (buckets - 1);
+
+			next = user->next;
+			user->next = users[bucket];
+			users[bucket] = user;
+		}
+	}
+	free(reg->users);
+	reg->users = users;
+	reg->user_buckets = buckets;
+}
+
+static void moq_registrar_grow_routes(struct moq_registrar *reg)
+{
+	struct moq_registrar_route **routes, *route, *next;
+	size_t buckets = reg->route_buckets * 2, i;
+
+	if (reg->route_count <= reg->route_buckets || !(routes = calloc(buckets, sizeof(*routes)))) {
+		return;
+	}
+	for (i = 0; i < reg->route_buckets; i++) {
+		for (route = reg->routes[i]; route; route = next) {
+			size_t bucket = moq_registrar_hash(route->session_id) & (buckets - 1);
+
+			next = route->next;
+			route->next = routes[bucket];
+			routes[bucket] = route;
+		}
+	}
+	free(reg->routes);
+	reg->routes = routes;
+	reg->route_buckets = buckets;
+}
+
+/* A call's parties leave it (lock held) */
+static void moq_registrar_release_route(struct moq_registrar *reg, struct moq_registrar_route **link)
+{
+	struct moq_registrar_route *route = *link;
+	struct moq_registrar_user *user;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (*route->party[i] && (user = *moq_registrar_find_user(reg, route->party[i])) && user->calls) {
+			user->calls--;
+		}
+	}
+	*link = route->next;
+	reg->route_count--;
+	free(route);
+}
+
+const char *moq_presence_name(enum moq_presence presence)
+{
+	switch (presence) {
+	case MOQ_PRESENCE_AVAILABLE:
+		return "available";
+	case MOQ_PRESENCE_BUSY:
+		return "busy";
+	default:
+		return "offline";
+	}
+}
+
+int moq_registrar_init(struct moq_registrar *reg)
+{
+	memset(reg, 0, sizeof(*reg));
+	reg->users = calloc(MOQ_REGISTRAR_BUCKETS, sizeof(*reg->users));
+	reg->routes = calloc(MOQ_REGISTRAR_BUCKETS, sizeof(*reg->routes));
+	if (!reg->users || !reg->routes) {
+		free(reg->users);
+		free(reg->routes);
+		return -1;
+	}
+	reg->user_buckets = MOQ_REGISTRAR_BUCKETS;
+	reg->route_buckets = MOQ_REGISTRAR_BUCKETS;
+	pthread_mutex_init(&reg->lock, NULL);
+
+	return 0;
+}
+
+void moq_registrar_destroy(struct moq_registrar *reg)
+{
+	size_t i;
+
+	if (!reg->users) {
+		return;
+	}
+	for (i = 0; i < reg->user_buckets; i++) {
+		while (reg->users[i]) {
+			struct moq_registrar_user *user = reg->users[i];
+
+			reg->users[i] = user->next;
+			free(user);
+		}
+	}
+	for (i = 0; i < reg->route_buckets; i++) {
+		while (reg->routes[i]) {
+			struct moq_registrar_route *route = reg->routes[i];
+
+			reg->routes[i] = route->next;
+			free(route);
+		}
+	}
+	free(reg->users);
+	free(reg->routes);
+	pthread_mutex_destroy(&reg->lock);
+	memset(reg, 0, sizeof(*reg));
+}
+
+int moq_registrar_register(struct moq_registrar *reg, const char *user_id, void *conn,
+	void **replaced)
+{
+	struct moq_registrar_user **link, *user;
+	struct timespec ts;
+
+	*replaced = NULL;
+	if (!moq_registrar_valid_id(user_id)) {
+		return -1;
+	}
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	pthread_mutex_lock(&reg->lock);
+	link = moq_registrar_find_user(reg, user_id);
+	user = *link;
+	if (!user) {
+		user = calloc(1, sizeof(*user));
+		if (!user) {
+			pthread_mutex_unlock(&reg->lock);
+			return -1;
+		}
+		strcpy(user->user_id, user_id);
+		*link = user;
+		reg->user_count++;
+		moq_registrar_grow_users(reg);
+	} else if (user->conn != conn) {
+		*replaced = user->conn;
+	}
+	user->conn = conn;
+	user->registered_us = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	pthread_mutex_unlock(&reg->lock);
+
+	return 0;
+}
+
+void moq_registrar_unregister(struct moq_registrar *reg, const char *user_id, void *conn,
+	moq_registrar_ended_fn ended, void *data)
+{
+	struct moq_registrar_user **link, *user, *other;
+	struct moq_registrar_route **route;
+	size_t i;
+	int p;
+
+	if (!moq_registrar_valid_id(user_id)) {
+		return;
+	}
+
+	pthread_mutex_lock(&reg->lock);
+	link = moq_registrar_find_user(reg, user_id);
+	user = *link;
+	if (!user || user->conn != conn) {
+		pthread_mutex_unlock(&reg->lock);
+		return;
+	}
+
+	/* Only users in calls cost a walk over the calls */
+	for (i = 0; user->calls && i < reg->route_buckets; i++) {
+		route = &reg->routes[i];
+		while (*route) {
+			for (p = 0; p < 2 && strcmp((*route)->party[p], user_id); p++) {
+			}
+			if (p == 2) {
+				route = &(*route)->next;
+				continue;
+			}
+			if (ended) {
+				const char *peer = (*route)->party[!p];
+
+				other = *peer ? *moq_registrar_find_user(reg, peer) : NULL;
+				ended(data, (*route)->session_id, peer, other ? other->conn : NULL);
+			}
+			moq_registrar_release_route(reg, route);
+		}
+	}
+
+	*link = user->next;
+	reg->user_count--;
+	free(user);
+	pthread_mutex_unlock(&reg->lock);
+}
+
+void *moq_registrar_lookup(struct moq_registrar *reg, const char *user_id,
+	enum moq_presence *presence)
+{
+	struct moq_registrar_user *user;
+	void *conn = NULL;
+
+	if (presence) {
+		*presence = MOQ_PRESENCE_OFFLINE;
+	}
+	if (!moq_registrar_valid_id(user_id)) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&reg->lock);
+	user = *moq_registrar_find_user(reg, user_id);
+	if (user) {
+		conn = user->conn;
+		if (presence) {
+			*presence = user->calls ? MOQ_PRESENCE_BUSY : MOQ_PRESENCE_AVAILABLE;
+		}
+	}
+	pthread_mutex_unlock(&reg->lock);
+
+	return conn;
+}
+
+int moq_registrar_route_add(struct moq_registrar *reg, const char *session_id,
+	const char *caller, const char *callee)
+{
+	struct moq_registrar_route **link, *route;
+	struct moq_registrar_user *user;
+	int i;
+
+	if (!moq_registrar_valid_id(session_id) || strlen(caller) >= MOQ_REGISTRAR_ID_SIZE ||
+		strlen(callee) >= MOQ_REGISTRAR_ID_SIZE) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&reg->lock);
+	link = moq_registrar_find_route(reg, session_id);
+	if (*link || !(route = calloc(1, sizeof(*route)))) {
+		pthread_mutex_unlock(&reg->lock);
+		return -1;
+	}
+	strcpy(route->session_id, session_id);
+	strcpy(route->party[0], caller);
+	strcpy(route->party[1], callee);
+	*link = route;
+	reg->route_count++;
+	for (i = 0; i < 2; i++) {
+		if (*route->party[i] && (user = *moq_registrar_find_user(reg, route->party[i]))) {
+			user->calls++;
+		}
+	}
+	moq_registrar_grow_routes(reg);
+	pthread_mutex_unlock(&reg->lock);
+
+	return 0;
+}
+
+int moq_registrar_route_peer(struct moq_registrar *reg, const char *session_id, const char *from,
+	char *peer, size_t peer_len, void **peer_conn)
+{
+	struct moq_registrar_route *route;
+	struct moq_registrar_user *user;
+	int p;
+
+	*peer_conn = NULL;
+	if (!moq_registrar_valid_id(session_id)) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&reg->lock);
+	route = *moq_registrar_find_route(reg, session_id);
+	for (p = 0; route && p < 2 && strcmp(route->party[p], from); p++) {
+	}
+	if (!route || p == 2) {
+		pthread_mutex_unlock(&reg->lock);
+		return -1;
+	}
+	snprintf(peer, peer_len, "%s", route->party[!p]);
+	if (*route->party[!p] && (user = *moq_registrar_find_user(reg, route->party[!p]))) {
+		*peer_conn = user->conn;
+	}
+	pthread_mutex_unlock(&reg->lock);
+
+	return 0;
+}
+
+int moq_registrar_route_remove(struct moq_registrar *reg, const char *session_id)
+{
+	struct moq_registrar_route **link;
+	int res = -1;
+
+	if (!moq_registrar_valid_id(session_id)) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&reg->lock);
+	link = moq_registrar_find_route(reg, session_id);
+	if (*link) {
+		moq_registrar_release_route(reg, link);
+		res = 0;
+	}
+	pthread_mutex_unlock(&reg->lock);
+
+	return res;
+}
+
+size_t moq_registrar_foreach_user(struct moq_registrar *reg, moq_registrar_user_fn fn, void *data)
+{
+	struct moq_registrar_user *user;
+	size_t count, i;
+
+	pthread_mutex_lock(&reg->lock);
+	for (i = 0; i < reg->user_buckets; i++) {
+		for (user = reg->users[i]; user; user = user->next) {
+			fn(data, user);
+		}
+	}
+	count = reg->user_count;
+	pthread_mutex_unlock(&reg->lock);
+
+	return count;
+}
@@ -0,0 +1,125 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/*
+ * Registrar and call router for the signaling server.
+ *
+ * Keeps two hash tables: registered users, each bound to the connection it
+ * registered on, and calls, each with its two parties. Signaling messages
+ * about a call are then delivered to the other party only, found in
+ * constant time, instead of being sent to every connected user. A party
+ * named "" is the local endpoint (calls to or from the PBX itself).
+ *
+ * Connections are opaque pointers owned by the caller, which must
+ * unregister a connection's user before the connection goes away. All
+ * functions are thread-safe. Like moq_wire this has no Asterisk
+ * dependencies, so the routing can be benchmarked on its own.
+ */
+
+#ifndef MOQ_REGISTRAR_H
+#define MOQ_REGISTRAR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define MOQ_REGISTRAR_ID_SIZE 64	/* Largest user or session ID, NUL included */
+
+enum moq_presence {
+	MOQ_PRESENCE_OFFLINE,
+	MOQ_PRESENCE_AVAILABLE,
+	MOQ_PRESENCE_BUSY		/* In at least one call */
+};
+
+struct moq_registrar_user {
+	char user_id[MOQ_REGISTRAR_ID_SIZE];
+	void *conn;
+	unsigned int calls;
+	uint64_t registered_us;		/* Wall clock */
+	struct moq_registrar_user *next;
+};
+
+struct moq_registrar_route {
+	char session_id[MOQ_REGISTRAR_ID_SIZE];
+	char party[2][MOQ_REGISTRAR_ID_SIZE];	/* Caller and callee */
+	struct moq_registrar_route *next;
+};
+
+struct moq_registrar {
+	pthread_mutex_t lock;
+	struct moq_registrar_user **users;
+	size_t user_buckets;
+	size_t user_count;
+	struct moq_registrar_route **routes;
+	size_t route_buckets;
+	size_t route_count;
+};
+
+/* Called for each call a departing user was in, with the other party */
+typedef void (*moq_registrar_ended_fn)(void *data, const char *session_id, const char *peer,
+	void *peer_conn);
+
+/* Called for each registered user, with the registrar locked */
+typedef void (*moq_registrar_user_fn)(void *data, const struct moq_registrar_user *user);
+
+/* Names of presence states, as sent in signaling */
+const char *moq_presence_name(enum moq_presence presence);
+
+/* Returns 0, or -1 if out of memory */
+int moq_registrar_init(struct moq_registrar *reg);
+
+/* Forget every user and call */
+void moq_registrar_destroy(struct moq_registrar *reg);
+
+/*
+ * Bind user_id to conn, taking it over from another connection if need be;
+ * *replaced is then that connection, otherwise NULL.
+ * Returns 0, or -1 if the ID is empty or too long, or out of memory.
+ */
+int moq_registrar_register(struct moq_registrar *reg, const char *user_id, void *conn,
+	void **replaced);
+
+/*
+ * Forget user_id if it is still bound to conn. The calls it was in end:
+ * each is removed after ended, if given, was called for it.
+ */
+void moq_registrar_unregister(struct moq_registrar *reg, const char *user_id, void *conn,
+	moq_registrar_ended_fn ended, void *data);
+
+/*
+ * Connection a user is registered on, or NULL if offline. With presence,
+ * also whether the user is in a call.
+ */
+void *moq_registrar_lookup(struct moq_registrar *reg, const char *user_id,
+	enum moq_presence *presence);
+
+/*
+ * Start routing a call between caller and callee, either of which may be
+ * the local endpoint "". Returns 0, or -1 if the session ID is invalid or
+ * already routed, or out of memory.
+ */
+int moq_registrar_route_add(struct moq_registrar *reg, const char *session_id,
+	const char *caller, const char *callee);
+
+/*
+ * Find the other party of a call for one of its parties, from. The peer's
+ * ID is copied to peer ("" for the local endpoint) and its connection
+ * stored in *peer_conn (NULL for the local endpoint or if it went offline).
+ * Returns 0, or -1 if there is no such call or from is not in it.
+ */
+int moq_registrar_route_peer(struct moq_registrar *reg, const char *session_id, const char *from,
+	char *peer, size_t peer_len, void **peer_conn);
+
+/* Stop routing a call; returns 0, or -1 if it was not routed */
+int moq_registrar_route_remove(struct moq_registrar *reg, const char *session_id);
+
+/* Call fn for every registered user; returns how many there are */
+size_t moq_registrar_foreach_user(struct moq_registrar *reg, moq_registrar_user_fn fn, void *data);
+
+#endif /* MOQ_REGISTRAR_H */
@@ -0,0 +1,322 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/* Media tap segments - see moq_tap.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "moq_tap.h"
+
+#define MOQ_TAP_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+static uint64_t moq_tap_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Create, allocate and map the next segment of a tap; returns 0 or an errno */
+static int moq_tap_segment_create(struct moq_tap *tap)
+{
+	struct moq_tap_header *header;
+	uint32_t index_cap = (tap->segment_size - MOQ_TAP_HEADER_SIZE) / MOQ_TAP_INDEX_RATIO;
+	int err;
+
+	snprintf(tap->path, sizeof(tap->path), "%s/%s-%04u.moqtap", tap->dir, tap->session_id,
+		tap->segment);
+	tap->fd = open(tap->path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0640);
+	if (tap->fd < 0) {
+		return errno;
+	}
+
+	/* Reserve the blocks now: a write fault on a full disk would be SIGBUS */
+	err = posix_fallocate(tap->fd, 0, tap->segment_size);
+	if (err) {
+		goto fail;
+	}
+	tap->map = mmap(NULL, tap->segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, tap->fd, 0);
+	if (tap->map == MAP_FAILED) {
+		err = errno;
+		tap->map = NULL;
+		goto fail;
+	}
+
+	header = (struct moq_tap_header *)tap->map;
+	memcpy(header->magic, MOQ_TAP_MAGIC, sizeof(header->magic));
+	header->version = MOQ_TAP_VERSION;
+	header->byte_order = MOQ_TAP_BYTE_ORDER;
+	header->header_size = MOQ_TAP_HEADER_SIZE;
+	header->segment = tap->segment;
+	header->index_cap = index_cap;
+	header->index_count = 0;
+	header->data_offset = MOQ_TAP_ALIGN(MOQ_TAP_HEADER_SIZE + (size_t)index_cap * sizeof(struct moq_tap_index));
+	header->data_end = header->data_offset;
+	header->created_us = moq_tap_now_us();
+	header->closed = 0;
+	snprintf(header->session_id, sizeof(header->session_id), "%s", tap->session_id);
+	snprintf(header->remote_id, sizeof(header->remote_id), "%s", tap->remote_id);
+
+	tap->header = header;
+	tap->index = (struct moq_tap_index *)(tap->map + MOQ_TAP_HEADER_SIZE);
+	tap->segments++;
+
+	return 0;
+
+fail:
+	close(tap->fd);
+	unlink(tap->path);
+	tap->fd = -1;
+	return err;
+}
+
+/* Mark the current segment complete and cut it down to the space used */
+static void moq_tap_segment_finish(struct moq_tap *tap)
+{
+	size_t used;
+
+	if (!tap->map) {
+		return;
+	}
+
+	used = tap->header->data_end;
+	__atomic_store_n(&tap->header->closed, 1, __ATOMIC_RELEASE);
+	munmap(tap->map, tap->segment_size);
+	if (ftruncate(tap->fd, used)) {
+		/* The segment is still complete, only larger than it needs to be */
+	}
+	close(tap->fd);
+
+	tap->map = NULL;
+	tap->header = NULL;
+	tap->index = NULL;
+	tap->fd = -1;
+}
+
+struct moq_tap *moq_tap_open(const char *dir, const char *session_id, const char *remote_id,
+	size_t segment_size)
+{
+	struct moq_tap *tap = calloc(1, sizeof(*tap));
+	int err;
+
+	if (!tap) {
+		return NULL;
+	}
+
+	if (segment_size < MOQ_TAP_MIN_SEGMENT) {
+		segment_size = MOQ_TAP_MIN_SEGMENT;
+	} else if (segment_size > MOQ_TAP_MAX_SEGMENT) {
+		segment_size = MOQ_TAP_MAX_SEGMENT;
+	}
+
+	pthread_mutex_init(&tap->lock, NULL);
+	snprintf(tap->dir, sizeof(tap->dir), "%s", dir);
+	snprintf(tap->session_id, sizeof(tap->session_id), "%s", session_id);
+	snprintf(tap->remote_id, sizeof(tap->remote_id), "%s", remote_id);
+	tap->segment_size = segment_size;
+	tap->fd = -1;
+
+	err = moq_tap_segment_create(tap);
+	if (err) {
+		pthread_mutex_destroy(&tap->lock);
+		free(tap);
+		errno = err;
+		return NULL;
+	}
+
+	return tap;
+}
+
+int moq_tap_write(struct moq_tap *tap, enum moq_tap_direction direction,
+	const struct moq_object *obj, uint64_t time_us)
+{
+	size_t size = MOQ_TAP_ALIGN(sizeof(struct moq_tap_record) + obj->payload_len);
+	struct moq_tap_record *record;
+	struct moq_tap_index *entry;
+	uint32_t count;
+	int err;
+
+	if (!tap) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&tap->lock);
+	if (!tap->map) {
+		pthread_mutex_unlock(&tap->lock);
+		return -1;
+	}
+
+	count = tap->header->index_count;
+	if (count == tap->header->index_cap || tap->header->data_end + size > tap->segment_size) {
+		/* An object too large for an empty segment would roll over for ever */
+		if (tap->header->data_offset + size > tap->segment_size) {
+			pthread_mutex_unlock(&tap->lock);
+			return 0;
+		}
+		moq_tap_segment_finish(tap);
+		tap->segment++;
+		err = moq_tap_segment_create(tap);
+		if (err) {
+			tap->failed = err;
+			pthread_mutex_unlock(&tap->lock);
+			return -1;
+		}
+		count = 0;
+	}
+
+	record = (struct moq_tap_record *)(tap->map + tap->header->data_end);
+	record->size = size;
+	record->direction = direction;
+	record->type = obj->type;
+	record->reserved = 0;
+	record->track_id = obj->track_id;
+	record->payload_len = obj->payload_len;
+	record->sequence = obj->sequence;
+	record->timestamp = obj->timestamp;
+	record->time_us = time_us;
+	memcpy(record + 1, obj->payload, obj->payload_len);
+
+	entry = &tap->index[count];
+	entry->time_us = time_us;
+	entry->sequence = obj->sequence;
+	entry->offset = tap->header->data_end;
+	entry->direction = direction;
+	entry->type = obj->type;
+	entry->reserved = 0;
+
+	/* Publish to concurrent readers only once the record is complete */
+	tap->header->data_end += size;
+	__atomic_store_n(&tap->header->index_count, count + 1, __ATOMIC_RELEASE);
+
+	tap->objects++;
+	tap->bytes += size;
+	pthread_mutex_unlock(&tap->lock);
+
+	return 0;
+}
+
+void moq_tap_close(struct moq_tap *tap)
+{
+	if (!tap) {
+		return;
+	}
+
+	moq_tap_segment_finish(tap);
+	pthread_mutex_destroy(&tap->lock);
+	free(tap);
+}
+
+int moq_tap_map(const char *path, struct moq_tap_segment *seg)
+{
+	const struct moq_tap_header *header;
+	struct stat st;
+	void *map;
+	int fd;
+
+	memset(seg, 0, sizeof(*seg));
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	if (fstat(fd, &st)) {
+		close(fd);
+		return -1;
+	}
+	if ((size_t)st.st_size < MOQ_TAP_HEADER_SIZE) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+
+	header = map;
+	if (memcmp(header->magic, MOQ_TAP_MAGIC, sizeof(header->magic)) ||
+		header->version != MOQ_TAP_VERSION || header->byte_order != MOQ_TAP_BYTE_ORDER ||
+		header->header_size != MOQ_TAP_HEADER_SIZE ||
+		header->data_offset < MOQ_TAP_HEADER_SIZE + (uint64_t)header->index_cap * sizeof(struct moq_tap_index) ||
+		header->data_offset > (uint64_t)st.st_size) {
+		munmap(map, st.st_size);
+		errno = EINVAL;
+		return -1;
+	}
+
+	seg->map = map;
+	seg->size = st.st_size;
+	seg->header = header;
+	seg->index = (const struct moq_tap_index *)(seg->map + MOQ_TAP_HEADER_SIZE);
+	seg->count = __atomic_load_n(&header->index_count, __ATOMIC_ACQUIRE);
+	if (seg->count > header->index_cap) {
+		seg->count = header->index_cap;
+	}
+
+	return 0;
+}
+
+void moq_tap_unmap(struct moq_tap_segment *seg)
+{
+	if (seg->map) {
+		munmap((void *)seg->map, seg->size);
+	}
+	memset(seg, 0, sizeof(*seg));
+}
+
+const struct moq_tap_record *moq_tap_record(const struct moq_tap_segment *seg, uint32_t entry)
+{
+	const struct moq_tap_record *record;
+	uint64_t offset;
+
+	if (entry >= seg->count) {
+		return NULL;
+	}
+	offset = seg->index[entry].offset;
+	if (offset < seg->header->data_offset || offset + sizeof(*record) > seg->size) {
+		return NULL;
+	}
+	record = (const struct moq_tap_record *)(seg->map + offset);
+	if (record->size < sizeof(*record) + record->payload_len || offset + record->size > seg->size) {
+		return NULL;
+	}
+
+	return record;
+}
+
+uint32_t moq_tap_seek(const struct moq_tap_segment *seg, uint64_t time_us)
+{
+	uint32_t lo = 0, hi = seg->count;
+
+	/*
+	 * Entries are in write order, which the two directions can leave a
+	 * packet or so out of capture order; close enough for seeking.
+	 */
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		if (seg->index[mid].time_us < time_us) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
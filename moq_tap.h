@@ -0,0 +1,160 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/*
+ * Media tap: an append-only recording of a session's media objects.
+ *
+ * Every object a session receives or sends is copied, header fields and
+ * plaintext payload, into a segment file mapped into memory, so recording
+ * costs one memcpy per object and no system call. A segment is laid out as
+ *
+ *   [header, MOQ_TAP_HEADER_SIZE][index, index_cap entries][records]
+ *
+ * and its space is allocated when it is created, so running out of disk
+ * shows up as a failed tap rather than a SIGBUS. Each record gets an index
+ * entry with its capture time and sequence, which lets readers seek without
+ * scanning. When either the records or the index fill up the segment is
+ * closed, truncated to what was used, and the next one is started:
+ *
+ *   <dir>/<session_id>-<segment>.moqtap
+ *
+ * A record and its index entry are written before index_count is advanced,
+ * so a segment can be read while it is still being written. Files are in
+ * host byte order; readers check byte_order. Like moq_wire this has no
+ * Asterisk dependencies.
+ */
+
+#ifndef MOQ_TAP_H
+#define MOQ_TAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "moq_wire.h"
+
+#define MOQ_TAP_MAGIC "MOQTAP\r\n"
+#define MOQ_TAP_VERSION 1
+#define MOQ_TAP_BYTE_ORDER 0x01020304
+#define MOQ_TAP_HEADER_SIZE 4096
+#define MOQ_TAP_INDEX_RATIO 256		/* One index entry per this many bytes of segment */
+#define MOQ_TAP_MIN_SEGMENT (1024 * 1024)
+#define MOQ_TAP_MAX_SEGMENT (1024 * 1024 * 1024)
+
+enum moq_tap_direction {
+	MOQ_TAP_RX = 0,
+	MOQ_TAP_TX = 1
+};
+
+/* Segment header, at the start of the file */
+struct moq_tap_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t header_size;
+	uint32_t segment;		/* Number within the session, from 0 */
+	uint32_t index_cap;
+	uint32_t index_count;		/* Entries (and records) written so far */
+	uint64_t data_offset;		/* Where records start */
+	uint64_t data_end;		/* Where the next record goes */
+	uint64_t created_us;		/* Wall clock, microseconds since the epoch */
+	uint32_t closed;		/* Set once the segment is complete */
+	uint32_t reserved;
+	char session_id[64];
+	char remote_id[64];
+};
+
+/* Index entry, one per record in the order they were written */
+struct moq_tap_index {
+	uint64_t time_us;		/* Capture time, wall clock */
+	uint64_t sequence;
+	uint32_t offset;		/* Of the record, from the start of the file */
+	uint8_t direction;
+	uint8_t type;
+	uint16_t reserved;
+};
+
+/* Record header; the payload follows and the record is padded to 8 bytes */
+struct moq_tap_record {
+	uint32_t size;			/* Whole record, header and padding included */
+	uint8_t direction;
+	uint8_t type;			/* Object type, see moq_wire.h */
+	uint16_t reserved;
+	uint32_t track_id;
+	uint32_t payload_len;
+	uint64_t sequence;
+	uint64_t timestamp;		/* Sender media clock */
+	uint64_t time_us;		/* Capture time, wall clock */
+};
+
+/* Writer for one session */
+struct moq_tap {
+	pthread_mutex_t lock;		/* Receive and send sides write concurrently */
+	char dir[256];
+	char session_id[64];
+	char remote_id[64];
+	size_t segment_size;
+	uint32_t segment;
+	int fd;
+	uint8_t *map;			/* Current segment, NULL once the tap failed */
+	struct moq_tap_header *header;
+	struct moq_tap_index *index;
+	char path[512];			/* Of the current segment */
+	/* Counters */
+	uint64_t objects;
+	uint64_t bytes;
+	uint32_t segments;
+	int failed;			/* Errno of the failure that stopped the tap */
+};
+
+/* Read-only view of a segment */
+struct moq_tap_segment {
+	const uint8_t *map;
+	size_t size;
+	const struct moq_tap_header *header;
+	const struct moq_tap_index *index;
+	uint32_t count;			/* Index entries complete when it was mapped */
+};
+
+/*
+ * Start tapping a session into dir, which must exist, in segments of
+ * segment_size bytes (clamped to the limits above). Returns NULL with errno
+ * set if the first segment cannot be created.
+ */
+struct moq_tap *moq_tap_open(const char *dir, const char *session_id, const char *remote_id,
+	size_t segment_size);
+
+/*
+ * Append an object received or sent at time_us. Safe to call from the
+ * receive and send threads at once, and with a NULL tap, which does
+ * nothing. Returns 0, or -1 once the tap has failed; it then stays failed
+ * and drops everything.
+ */
+int moq_tap_write(struct moq_tap *tap, enum moq_tap_direction direction,
+	const struct moq_object *obj, uint64_t time_us);
+
+/* Finish the current segment and free the tap; NULL is ignored */
+void moq_tap_close(struct moq_tap *tap);
+
+/*
+ * Map a segment for reading and check its header.
+ * Returns 0, or -1 with errno set (EINVAL if it is not a valid segment).
+ */
+int moq_tap_map(const char *path, struct moq_tap_segment *seg);
+
+/* Unmap a segment */
+void moq_tap_unmap(struct moq_tap_segment *seg);
+
+/* Record an index entry points at, or NULL if it lies outside the segment */
+const struct moq_tap_record *moq_tap_record(const struct moq_tap_segment *seg, uint32_t entry);
+
+/* First index entry captured at or after time_us (count if there is none) */
+uint32_t moq_tap_seek(const struct moq_tap_segment *seg, uint64_t time_us);
+
+#endif /* MOQ_TAP_H */
@@ -0,0 +1,48 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/*
+ * Static (USDT) tracepoints.
+ *
+ * When built with HAVE_SYS_SDT_H (the Makefile defines it if <sys/sdt.h>,
+ * from systemtap-sdt-dev, is installed) each MOQ_TRACE point is a single nop
+ * in the binary plus an ELF note, and can be attached at runtime, e.g.:
+ *
+ *   bpftrace -e 'usdt:/usr/lib/asterisk/modules/chan_moq.so:chan_moq:frame_queued
+ *       { @queue_us = hist(arg2); }'
+ *
+ * Probes and arguments:
+ *   frame_received   (session_id, sequence, payload_len, rx_to_parse_us)
+ *   frame_queued     (session_id, sequence, parse_to_queue_us)
+ *   write_begin      (session_id, datalen)
+ *   object_sent      (session_id, sequence, write_to_send_us, result)
+ *   signaling_received (type)
+ *   channel_created  (session_id, signaling_to_channel_us)
+ *
+ * Without <sys/sdt.h> the macros compile to nothing.
+ */
+
+#ifndef MOQ_TRACE_H
+#define MOQ_TRACE_H
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define MOQ_TRACE1(name, a) DTRACE_PROBE1(chan_moq, name, a)
+#define MOQ_TRACE2(name, a, b) DTRACE_PROBE2(chan_moq, name, a, b)
+#define MOQ_TRACE3(name, a, b, c) DTRACE_PROBE3(chan_moq, name, a, b, c)
+#define MOQ_TRACE4(name, a, b, c, d) DTRACE_PROBE4(chan_moq, name, a, b, c, d)
+#else
+#define MOQ_TRACE1(name, a) do { } while (0)
+#define MOQ_TRACE2(name, a, b) do { } while (0)
+#define MOQ_TRACE3(name, a, b, c) do { } while (0)
+#define MOQ_TRACE4(name, a, b, c, d) do { } while (0)
+#endif
+
+#endif /* MOQ_TRACE_H */
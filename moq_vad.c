@@ -0,0 +1,133 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/* Voice activity detection and comfort noise - see moq_vad.h */
+
+#include <math.h>
+
+#include "moq_vad.h"
+#include "moq_g711.h"
+
+#define MOQ_VAD_THRESHOLD 9.0		/* dB above the floor to count as speech */
+#define MOQ_VAD_MIN_SPEECH -55.0	/* Quieter frames are never speech, dBov */
+#define MOQ_VAD_FLOOR_TRACK 0.05	/* Rate the floor follows background noise */
+#define MOQ_VAD_FLOOR_RISE 0.01		/* dB per frame the floor rises under speech */
+#define MOQ_VAD_SILENCE -127.0
+#define MOQ_CN_CHUNK 160
+
+double moq_vad_level(const uint8_t *ulaw, size_t len)
+{
+	uint64_t energy = moq_g711_ulaw_energy(ulaw, len);
+	double level;
+
+	if (!energy) {
+		return MOQ_VAD_SILENCE;
+	}
+
+	level = 10.0 * log10((double)energy / len / (32768.0 * 32768.0));
+
+	return level < MOQ_VAD_SILENCE ? MOQ_VAD_SILENCE : level;
+}
+
+void moq_vad_init(struct moq_vad *vad)
+{
+	vad->started = 0;
+	vad->floor = MOQ_VAD_SILENCE;
+	vad->noise = MOQ_VAD_SILENCE;
+	vad->hangover = 0;
+}
+
+int moq_vad_process(struct moq_vad *vad, double level)
+{
+	int speech;
+
+	if (!vad->started) {
+		vad->floor = level;
+		vad->noise = level;
+		vad->started = 1;
+	}
+
+	speech = level > vad->floor + MOQ_VAD_THRESHOLD && level > MOQ_VAD_MIN_SPEECH;
+
+	/* Follow quiet frames down at once, background noise up gently, speech barely */
+	if (level < vad->floor) {
+		vad->floor = level;
+	} else if (!speech) {
+		vad->floor += (level - vad->floor) * MOQ_VAD_FLOOR_TRACK;
+	} else {
+		vad->floor += MOQ_VAD_FLOOR_RISE;
+	}
+
+	if (speech) {
+		vad->hangover = MOQ_VAD_HANGOVER;
+		return 1;
+	}
+
+	vad->noise += (level - vad->noise) / 8.0;
+	if (vad->hangover) {
+		vad->hangover--;
+		return 1;
+	}
+
+	return 0;
+}
+
+uint8_t moq_vad_noise_level(const struct moq_vad *vad)
+{
+	double level = -vad->noise;
+
+	if (level < 0.0) {
+		return 0;
+	}
+	if (level > 127.0) {
+		return 127;
+	}
+
+	return (uint8_t)(level + 0.5);
+}
+
+void moq_cn_init(struct moq_cn *cn, uint32_t seed)
+{
+	cn->seed = seed ? seed : 1;
+	cn->level = 127;
+	cn->amplitude = 0.0;
+}
+
+void moq_cn_set_level(struct moq_cn *cn, uint8_t level)
+{
+	if (level > 127) {
+		level = 127;
+	}
+	cn->level = level;
+
+	/* Uniform noise over [-a, a] has an RMS of a / sqrt(3) */
+	cn->amplitude = 32768.0 * pow(10.0, -level / 20.0) * sqrt(3.0);
+	if (cn->amplitude > 32767.0) {
+		cn->amplitude = 32767.0;
+	}
+}
+
+void moq_cn_generate(struct moq_cn *cn, uint8_t *ulaw, size_t len)
+{
+	int16_t pcm[MOQ_CN_CHUNK];
+	size_t i, done, n;
+
+	for (done = 0; done < len; done += n) {
+		n = len - done < MOQ_CN_CHUNK ? len - done : MOQ_CN_CHUNK;
+		for (i = 0; i < n; i++) {
+			/* xorshift32 */
+			cn->seed ^= cn->seed << 13;
+			cn->seed ^= cn->seed >> 17;
+			cn->seed ^= cn->seed << 5;
+
+			pcm[i] = (int16_t)(((double)cn->seed / 2147483648.0 - 1.0) * cn->amplitude);
+		}
+		moq_g711_ulaw_encode(pcm, ulaw + done, n);
+	}
+}
@@ -0,0 +1,69 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/*
+ * Voice activity detection and comfort noise for ulaw audio.
+ *
+ * The detector compares each frame's energy against an adaptive noise
+ * floor: the floor follows quiet frames down immediately and creeps up
+ * slowly, so steady background noise is learned while speech is not.
+ * Frames well above the floor are speech; a hangover keeps the decision
+ * on for a few frames after speech ends so word endings are not clipped.
+ *
+ * Levels are in dBov, as carried by RFC 3389 comfort noise payloads: the
+ * payload byte is the negated level, 0 (full scale) to 127 (-127 dBov).
+ * The generator turns such a level back into white noise of that power.
+ *
+ * Samples are processed with the moq_g711 kernels. Like moq_wire and
+ * moq_clock this has no Asterisk dependencies.
+ */
+
+#ifndef MOQ_VAD_H
+#define MOQ_VAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MOQ_VAD_HANGOVER 10		/* Frames kept after speech ends */
+
+struct moq_vad {
+	int started;
+	double floor;			/* Noise floor estimate, dBov */
+	double noise;			/* Level of recent non-speech frames, dBov */
+	int hangover;
+};
+
+struct moq_cn {
+	uint32_t seed;
+	int level;			/* Last level received, -dBov */
+	double amplitude;		/* Peak of the generated noise, linear */
+};
+
+/* Energy of a ulaw frame in dBov, -127 for digital silence */
+double moq_vad_level(const uint8_t *ulaw, size_t len);
+
+/* Prepare a detector */
+void moq_vad_init(struct moq_vad *vad);
+
+/* Classify a frame of the given level; returns 1 for speech, 0 for silence */
+int moq_vad_process(struct moq_vad *vad, double level);
+
+/* Comfort noise level byte describing the current background noise */
+uint8_t moq_vad_noise_level(const struct moq_vad *vad);
+
+/* Prepare a comfort noise generator */
+void moq_cn_init(struct moq_cn *cn, uint32_t seed);
+
+/* Set the noise level from a received comfort noise byte (-dBov) */
+void moq_cn_set_level(struct moq_cn *cn, uint8_t level);
+
+/* Fill len ulaw samples with comfort noise at the current level */
+void moq_cn_generate(struct moq_cn *cn, uint8_t *ulaw, size_t len);
+
+#endif /* MOQ_VAD_H */
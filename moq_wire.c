@@ -0,0 +1,305 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/* MoQ wire format codec - see moq_wire.h for the layout */
+
+#include <string.h>
+
+#include "moq_wire.h"
+
+static inline void put_be16(uint8_t *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static inline void put_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static inline void put_be64(uint8_t *p, uint64_t v)
+{
+	put_be32(p, v >> 32);
+	put_be32(p + 4, (uint32_t)v);
+}
+
+static inline uint16_t get_be16(const uint8_t *p)
+{
+	return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static inline uint32_t get_be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint64_t get_be64(const uint8_t *p)
+{
+	return ((uint64_t)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+const char *moq_wire_strerror(int result)
+{
+	switch (result) {
+	case MOQ_WIRE_OK:
+		return "success";
+	case MOQ_WIRE_ERR_TRUNCATED:
+		return "truncated message";
+	case MOQ_WIRE_ERR_LENGTH:
+		return "invalid length";
+	case MOQ_WIRE_ERR_SPACE:
+		return "buffer too small";
+	case MOQ_WIRE_ERR_TOO_LARGE:
+		return "payload too large";
+	case MOQ_WIRE_ERR_TYPE:
+		return "unexpected type";
+	default:
+		return "unknown error";
+	}
+}
+
+int moq_wire_encode_message(uint8_t *buf, size_t buf_len, uint8_t msg_type,
+	const uint8_t *payload, size_t payload_len)
+{
+	if (payload_len > MOQ_WIRE_MAX_MSG_PAYLOAD) {
+		return MOQ_WIRE_ERR_TOO_LARGE;
+	}
+	if (buf_len < MOQ_WIRE_MSG_HEADER_SIZE + payload_len) {
+		return MOQ_WIRE_ERR_SPACE;
+	}
+
+	buf[0] = msg_type;
+	put_be16(buf + 1, (uint16_t)payload_len);
+	if (payload_len && payload != buf + MOQ_WIRE_MSG_HEADER_SIZE) {
+		memmove(buf + MOQ_WIRE_MSG_HEADER_SIZE, payload, payload_len);
+	}
+
+	return (int)(MOQ_WIRE_MSG_HEADER_SIZE + payload_len);
+}
+
+int moq_wire_encode_object(uint8_t *buf, size_t buf_len, const struct moq_object *obj)
+{
+	size_t msg_len = MOQ_WIRE_OBJECT_HEADER_SIZE + obj->payload_len;
+	uint8_t *hdr = buf + MOQ_WIRE_MSG_HEADER_SIZE;
+
+	if (msg_len > MOQ_WIRE_MAX_MSG_PAYLOAD) {
+		return MOQ_WIRE_ERR_TOO_LARGE;
+	}
+	if (buf_len < MOQ_WIRE_MSG_HEADER_SIZE + msg_len) {
+		return MOQ_WIRE_ERR_SPACE;
+	}
+
+	buf[0] = MOQ_MSG_OBJECT;
+	put_be16(buf + 1, (uint16_t)msg_len);
+
+	hdr[0] = obj->type;
+	put_be32(hdr + 1, obj->track_id);
+	put_be64(hdr + 5, obj->sequence);
+	put_be64(hdr + 13, obj->timestamp);
+	put_be16(hdr + 21, (uint16_t)obj->payload_len);
+
+	if (obj->payload_len && obj->payload != hdr + MOQ_WIRE_OBJECT_HEADER_SIZE) {
+		memcpy(hdr + MOQ_WIRE_OBJECT_HEADER_SIZE, obj->payload, obj->payload_len);
+	}
+
+	return (int)(MOQ_WIRE_MSG_HEADER_SIZE + msg_len);
+}
+
+int moq_wire_decode_message(const uint8_t *buf, size_t len, uint8_t *msg_type,
+	const uint8_t **payload, size_t *payload_len)
+{
+	uint16_t declared;
+
+	if (len < MOQ_WIRE_MSG_HEADER_SIZE) {
+		return MOQ_WIRE_ERR_TRUNCATED;
+	}
+
+	declared = get_be16(buf + 1);
+	if (declared > len - MOQ_WIRE_MSG_HEADER_SIZE) {
+		return MOQ_WIRE_ERR_LENGTH;
+	}
+
+	*msg_type = buf[0];
+	*payload = buf + MOQ_WIRE_MSG_HEADER_SIZE;
+	*payload_len = declared;
+
+	return MOQ_WIRE_OK;
+}
+
+int moq_wire_decode_object(const uint8_t *buf, size_t len, struct moq_object *obj)
+{
+	if (len < MOQ_WIRE_OBJECT_HEADER_SIZE) {
+		return MOQ_WIRE_ERR_TRUNCATED;
+	}
+
+	obj->type = buf[0];
+	obj->track_id = get_be32(buf + 1);
+	obj->sequence = get_be64(buf + 5);
+	obj->timestamp = get_be64(buf + 13);
+	obj->payload_size = get_be16(buf + 21);
+	obj->payload = buf + MOQ_WIRE_OBJECT_HEADER_SIZE;
+	obj->payload_len = len - MOQ_WIRE_OBJECT_HEADER_SIZE;
+
+	return MOQ_WIRE_OK;
+}
+
+int moq_wire_encode_fragment(uint8_t *buf, size_t buf_len, const struct moq_fragment *frag)
+{
+	size_t msg_len = MOQ_WIRE_FRAGMENT_HEADER_SIZE + frag->data_len;
+	uint8_t *hdr = buf + MOQ_WIRE_MSG_HEADER_SIZE;
+
+	if (msg_len > MOQ_WIRE_MAX_MSG_PAYLOAD) {
+		return MOQ_WIRE_ERR_TOO_LARGE;
+	}
+	if (buf_len < MOQ_WIRE_MSG_HEADER_SIZE + msg_len) {
+		return MOQ_WIRE_ERR_SPACE;
+	}
+
+	buf[0] = MOQ_MSG_OBJECT_FRAGMENT;
+	put_be16(buf + 1, (uint16_t)msg_len);
+
+	hdr[0] = frag->type;
+	put_be32(hdr + 1, frag->track_id);
+	put_be64(hdr + 5, frag->sequence);
+	put_be64(hdr + 13, frag->timestamp);
+	put_be32(hdr + 21, frag->object_size);
+	put_be16(hdr + 25, frag->index);
+	put_be16(hdr + 27, frag->count);
+	memcpy(hdr + MOQ_WIRE_FRAGMENT_HEADER_SIZE, frag->data, frag->data_len);
+
+	return (int)(MOQ_WIRE_MSG_HEADER_SIZE + msg_len);
+}
+
+int moq_wire_decode_fragment(const uint8_t *buf, size_t len, struct moq_fragment *frag)
+{
+	size_t chunk, offset, expected;
+
+	if (len < MOQ_WIRE_FRAGMENT_HEADER_SIZE) {
+		return MOQ_WIRE_ERR_TRUNCATED;
+	}
+
+	frag->type = buf[0];
+	frag->track_id = get_be32(buf + 1);
+	frag->sequence = get_be64(buf + 5);
+	frag->timestamp = get_be64(buf + 13);
+	frag->object_size = get_be32(buf + 21);
+	frag->index = get_be16(buf + 25);
+	frag->count = get_be16(buf + 27);
+	frag->data = buf + MOQ_WIRE_FRAGMENT_HEADER_SIZE;
+	frag->data_len = len - MOQ_WIRE_FRAGMENT_HEADER_SIZE;
+
+	if (!frag->count || frag->index >= frag->count || frag->count > frag->object_size) {
+		return MOQ_WIRE_ERR_LENGTH;
+	}
+
+	chunk = moq_wire_fragment_chunk(frag->object_size, frag->count);
+	offset = (size_t)frag->index * chunk;
+	if (offset >= frag->object_size) {
+		return MOQ_WIRE_ERR_LENGTH;
+	}
+	expected = frag->object_size - offset < chunk ? frag->object_size - offset : chunk;
+	if (frag->data_len != expected) {
+		return MOQ_WIRE_ERR_LENGTH;
+	}
+
+	return MOQ_WIRE_OK;
+}
+
+int moq_wire_rewrite_object(uint8_t *buf, size_t len, uint32_t track_id, uint64_t sequence)
+{
+	uint8_t *hdr = buf + MOQ_WIRE_MSG_HEADER_SIZE;
+
+	if (len < MOQ_WIRE_MSG_HEADER_SIZE + MOQ_WIRE_OBJECT_HEADER_SIZE) {
+		return MOQ_WIRE_ERR_TRUNCATED;
+	}
+	if (buf[0] != MOQ_MSG_OBJECT && buf[0] != MOQ_MSG_OBJECT_FRAGMENT) {
+		return MOQ_WIRE_ERR_TYPE;
+	}
+
+	/* Objects and fragments share the leading type, track and sequence fields */
+	put_be32(hdr + 1, track_id);
+	put_be64(hdr + 5, sequence);
+
+	return MOQ_WIRE_OK;
+}
+
+int moq_wire_encode_receiver_report(uint8_t *buf, size_t buf_len,
+	const struct moq_receiver_report *rr)
+{
+	uint8_t *p = buf + MOQ_WIRE_MSG_HEADER_SIZE;
+
+	if (buf_len < MOQ_WIRE_MSG_HEADER_SIZE + MOQ_WIRE_RECEIVER_REPORT_SIZE) {
+		return MOQ_WIRE_ERR_SPACE;
+	}
+
+	buf[0] = MOQ_MSG_RECEIVER_REPORT;
+	put_be16(buf + 1, MOQ_WIRE_RECEIVER_REPORT_SIZE);
+
+	put_be32(p, rr->track_id);
+	put_be64(p + 4, rr->highest_sequence);
+	put_be32(p + 12, rr->cumulative_lost);
+	put_be32(p + 16, rr->jitter_us);
+	put_be32(p + 20, rr->sent_us);
+	put_be32(p + 24, rr->last_report_us);
+	put_be32(p + 28, rr->delay_since_last_report_us);
+
+	return MOQ_WIRE_MSG_HEADER_SIZE + MOQ_WIRE_RECEIVER_REPORT_SIZE;
+}
+
+int moq_wire_decode_receiver_report(const uint8_t *buf, size_t len,
+	struct moq_receiver_report *rr)
+{
+	if (len < MOQ_WIRE_RECEIVER_REPORT_SIZE) {
+		return MOQ_WIRE_ERR_TRUNCATED;
+	}
+
+	rr->track_id = get_be32(buf);
+	rr->highest_sequence = get_be64(buf + 4);
+	rr->cumulative_lost = get_be32(buf + 12);
+	rr->jitter_us = get_be32(buf + 16);
+	rr->sent_us = get_be32(buf + 20);
+	rr->last_report_us = get_be32(buf + 24);
+	rr->delay_since_last_report_us = get_be32(buf + 28);
+
+	return MOQ_WIRE_OK;
+}
+
+int moq_wire_encode_probe(uint8_t *buf, size_t buf_len, uint8_t msg_type,
+	const struct moq_probe *probe)
+{
+	if (msg_type != MOQ_MSG_PING && msg_type != MOQ_MSG_PONG) {
+		return MOQ_WIRE_ERR_TYPE;
+	}
+	if (buf_len < MOQ_WIRE_MSG_HEADER_SIZE + MOQ_WIRE_PROBE_SIZE) {
+		return MOQ_WIRE_ERR_SPACE;
+	}
+
+	buf[0] = msg_type;
+	put_be16(buf + 1, MOQ_WIRE_PROBE_SIZE);
+	put_be32(buf + MOQ_WIRE_MSG_HEADER_SIZE, probe->probe_id);
+	put_be32(buf + MOQ_WIRE_MSG_HEADER_SIZE + 4, probe->sent_us);
+
+	return MOQ_WIRE_MSG_HEADER_SIZE + MOQ_WIRE_PROBE_SIZE;
+}
+
+int moq_wire_decode_probe(const uint8_t *buf, size_t len, struct moq_probe *probe)
+{
+	if (len < MOQ_WIRE_PROBE_SIZE) {
+		return MOQ_WIRE_ERR_TRUNCATED;
+	}
+
+	probe->probe_id = get_be32(buf);
+	probe->sent_us = get_be32(buf + 4);
+
+	return MOQ_WIRE_OK;
+}
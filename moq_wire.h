@@ -0,0 +1,248 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/*
+ * MoQ wire format codec.
+ *
+ * Standalone and allocation-free: every function works on caller-provided
+ * buffers and decoded payloads point into the input buffer. Nothing here
+ * depends on Asterisk, so the codec can be benchmarked and fuzzed on its own.
+ *
+ * Message framing:  [type(1)][length(2, BE)][payload(length)]
+ *
+ * Media object (payload of a MOQ_MSG_OBJECT message):
+ *   [type(1)][track_id(4)][sequence(8)][timestamp(8)][payload_size(2)][payload]
+ *
+ * Object fragment (payload of a MOQ_MSG_OBJECT_FRAGMENT message), used for
+ * objects too large for one datagram:
+ *   [type(1)][track_id(4)][sequence(8)][timestamp(8)][object_size(4)]
+ *   [fragment_index(2)][fragment_count(2)][data]
+ * Fragment i carries bytes [i * chunk, min((i + 1) * chunk, object_size)) of
+ * the object, where chunk = ceil(object_size / fragment_count).
+ *
+ * Receiver report (payload of a MOQ_MSG_RECEIVER_REPORT message):
+ *   [track_id(4)][highest_sequence(8)][cumulative_lost(4)][jitter_us(4)]
+ *   [sent_us(4)][last_report_us(4)][delay_since_last_report_us(4)]
+ *
+ * Announce (payload of a MOQ_MSG_ANNOUNCE), sent to a relay when a session
+ * starts using it so it knows where to deliver the session's tracks:
+ *   [track_id(4)][video_track_id(4)]
+ *
+ * Relay probe (payload of a MOQ_MSG_PING, echoed unchanged by the relay in
+ * a MOQ_MSG_PONG):
+ *   [probe_id(4)][sent_us(4)]
+ *
+ * Go away (payload of a MOQ_MSG_GOAWAY), sent by an endpoint or relay that is
+ * shutting down; the payload is the URI to reconnect to, and may be empty:
+ *   [successor_uri]
+ *
+ * All integers are big-endian.
+ */
+
+#ifndef MOQ_WIRE_H
+#define MOQ_WIRE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MOQ_WIRE_MSG_HEADER_SIZE 3
+#define MOQ_WIRE_MAX_MSG_PAYLOAD 0xFFFF
+#define MOQ_WIRE_OBJECT_HEADER_SIZE 23
+#define MOQ_WIRE_RECEIVER_REPORT_SIZE 32
+#define MOQ_WIRE_FRAGMENT_HEADER_SIZE 29
+#define MOQ_WIRE_PROBE_SIZE 8
+
+/* MoQ message types */
+enum moq_message_type {
+	MOQ_MSG_SUBSCRIBE = 0x01,
+	MOQ_MSG_SUBSCRIBE_OK = 0x02,
+	MOQ_MSG_SUBSCRIBE_ERROR = 0x03,
+	MOQ_MSG_ANNOUNCE = 0x04,
+	MOQ_MSG_ANNOUNCE_OK = 0x05,
+	MOQ_MSG_UNSUBSCRIBE = 0x06,
+	MOQ_MSG_OBJECT = 0x07,
+	MOQ_MSG_GOAWAY = 0x08,
+	MOQ_MSG_RECEIVER_REPORT = 0x09,
+	MOQ_MSG_OBJECT_FRAGMENT = 0x0A,
+	MOQ_MSG_PING = 0x0B,
+	MOQ_MSG_PONG = 0x0C
+};
+
+/*
+ * Object types (first byte of a media object). Audio keeps the value the
+ * object header has always carried; the high bit marks the last object of
+ * a video frame, and the next one an object whose payload is protected
+ * (see moq_crypto.h). A comfort noise object replaces a run of suppressed
+ * audio objects; its payload is the RFC 3389 noise level byte (-dBov).
+ */
+enum moq_object_codec {
+	MOQ_OBJ_AUDIO_ULAW = 0x07,
+	MOQ_OBJ_AUDIO_CN = 0x0D,
+	MOQ_OBJ_VIDEO_H264 = 0x10,
+	MOQ_OBJ_VIDEO_VP8 = 0x11
+};
+
+#define MOQ_OBJ_FLAG_FRAME_END 0x80
+#define MOQ_OBJ_FLAG_ENCRYPTED 0x40
+#define MOQ_OBJ_TYPE(type) ((type) & ~(MOQ_OBJ_FLAG_FRAME_END | MOQ_OBJ_FLAG_ENCRYPTED))
+
+/* Codec results; errors are negative */
+enum moq_wire_result {
+	MOQ_WIRE_OK = 0,
+	MOQ_WIRE_ERR_TRUNCATED = -1,	/* Input shorter than its headers claim */
+	MOQ_WIRE_ERR_LENGTH = -2,	/* Length field exceeds the available data */
+	MOQ_WIRE_ERR_SPACE = -3,	/* Output buffer too small */
+	MOQ_WIRE_ERR_TOO_LARGE = -4,	/* Payload does not fit the length field */
+	MOQ_WIRE_ERR_TYPE = -5		/* Unexpected message or object type */
+};
+
+/* Decoded media object; payload points into the decoded buffer */
+struct moq_object {
+	uint8_t type;
+	uint32_t track_id;
+	uint64_t sequence;
+	uint64_t timestamp;		/* Sender media clock, in samples of the track rate */
+	uint16_t payload_size;		/* Size declared in the header */
+	const uint8_t *payload;
+	size_t payload_len;		/* Bytes actually present */
+};
+
+/* Decoded object fragment; data points into the decoded buffer */
+struct moq_fragment {
+	uint8_t type;
+	uint32_t track_id;
+	uint64_t sequence;
+	uint64_t timestamp;
+	uint32_t object_size;
+	uint16_t index;
+	uint16_t count;
+	const uint8_t *data;
+	size_t data_len;
+};
+
+/*
+ * Receiver report, sent periodically by each side for the track it receives.
+ * Times are the low 32 bits of a microsecond clock local to whoever stamped
+ * them, like RTCP LSR/DLSR: the peer echoes sent_us back as last_report_us
+ * together with how long it held it, so the original sender gets
+ * RTT = now - last_report_us - delay_since_last_report_us (mod 2^32).
+ */
+struct moq_receiver_report {
+	uint32_t track_id;
+	uint64_t highest_sequence;
+	uint32_t cumulative_lost;
+	uint32_t jitter_us;
+	uint32_t sent_us;
+	uint32_t last_report_us;	/* 0 if no report received yet */
+	uint32_t delay_since_last_report_us;
+};
+
+/*
+ * Relay probe. sent_us is the low 32 bits of the prober's microsecond clock,
+ * so RTT = now - sent_us (mod 2^32) when the echo comes back.
+ */
+struct moq_probe {
+	uint32_t probe_id;
+	uint32_t sent_us;
+};
+
+/* Return a static description of a codec result */
+const char *moq_wire_strerror(int result);
+
+/*
+ * Encode a framed message into buf.
+ * Returns the number of bytes written, or a negative moq_wire_result.
+ */
+int moq_wire_encode_message(uint8_t *buf, size_t buf_len, uint8_t msg_type,
+	const uint8_t *payload, size_t payload_len);
+
+/*
+ * Encode a media object as a complete MOQ_MSG_OBJECT message into buf.
+ * obj->payload_len bytes are copied from obj->payload; obj->payload_size is
+ * ignored and written as payload_len. If obj->payload already points at
+ * buf + MOQ_WIRE_MSG_HEADER_SIZE + MOQ_WIRE_OBJECT_HEADER_SIZE the copy is
+ * skipped, so payloads can be built in place.
+ * Returns the number of bytes written, or a negative moq_wire_result.
+ */
+int moq_wire_encode_object(uint8_t *buf, size_t buf_len, const struct moq_object *obj);
+
+/*
+ * Decode a framed message. Trailing bytes after the declared length are
+ * ignored, as a datagram may be padded.
+ * Returns MOQ_WIRE_OK or a negative moq_wire_result.
+ */
+int moq_wire_decode_message(const uint8_t *buf, size_t len, uint8_t *msg_type,
+	const uint8_t **payload, size_t *payload_len);
+
+/*
+ * Decode a media object from the payload of a MOQ_MSG_OBJECT message.
+ * Returns MOQ_WIRE_OK or a negative moq_wire_result. A payload_size that
+ * disagrees with the bytes present is not an error; callers can compare
+ * obj->payload_size with obj->payload_len.
+ */
+int moq_wire_decode_object(const uint8_t *buf, size_t len, struct moq_object *obj);
+
+/*
+ * Encode one fragment as a complete MOQ_MSG_OBJECT_FRAGMENT message.
+ * frag->data_len bytes are copied from frag->data.
+ * Returns the number of bytes written, or a negative moq_wire_result.
+ */
+int moq_wire_encode_fragment(uint8_t *buf, size_t buf_len, const struct moq_fragment *frag);
+
+/*
+ * Decode an object fragment from the payload of a MOQ_MSG_OBJECT_FRAGMENT
+ * message, checking that its index, count and length are consistent with
+ * the declared object size.
+ * Returns MOQ_WIRE_OK or a negative moq_wire_result.
+ */
+int moq_wire_decode_fragment(const uint8_t *buf, size_t len, struct moq_fragment *frag);
+
+/* Size of each fragment but the last when an object is split count ways */
+static inline size_t moq_wire_fragment_chunk(uint32_t object_size, uint16_t count)
+{
+	return count ? ((size_t)object_size + count - 1) / count : 0;
+}
+
+/*
+ * Rewrite the track and sequence of an encoded MOQ_MSG_OBJECT or
+ * MOQ_MSG_OBJECT_FRAGMENT message in place, so it can be relayed without
+ * decoding and re-encoding the rest.
+ * Returns MOQ_WIRE_OK or a negative moq_wire_result.
+ */
+int moq_wire_rewrite_object(uint8_t *buf, size_t len, uint32_t track_id, uint64_t sequence);
+
+/*
+ * Encode a receiver report as a complete MOQ_MSG_RECEIVER_REPORT message.
+ * Returns the number of bytes written, or a negative moq_wire_result.
+ */
+int moq_wire_encode_receiver_report(uint8_t *buf, size_t buf_len,
+	const struct moq_receiver_report *rr);
+
+/*
+ * Decode a receiver report from the payload of a MOQ_MSG_RECEIVER_REPORT
+ * message. Trailing bytes are ignored so the report can be extended.
+ * Returns MOQ_WIRE_OK or a negative moq_wire_result.
+ */
+int moq_wire_decode_receiver_report(const uint8_t *buf, size_t len,
+	struct moq_receiver_report *rr);
+
+/*
+ * Encode a probe as a complete MOQ_MSG_PING or MOQ_MSG_PONG message.
+ * Returns the number of bytes written, or a negative moq_wire_result.
+ */
+int moq_wire_encode_probe(uint8_t *buf, size_t buf_len, uint8_t msg_type,
+	const struct moq_probe *probe);
+
+/*
+ * Decode a probe from the payload of a MOQ_MSG_PING or MOQ_MSG_PONG message.
+ * Returns MOQ_WIRE_OK or a negative moq_wire_result.
+ */
+int moq_wire_decode_probe(const uint8_t *buf, size_t len, struct moq_probe *probe);
+
+#endif /* MOQ_WIRE_H */
@@ -0,0 +1,1148 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/* AF_XDP media path - see moq_xdp.h */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "moq_xdp.h"
+
+const char *moq_xdp_mode_name(enum moq_xdp_mode mode)
+{
+	switch (mode) {
+	case MOQ_XDP_NATIVE:
+		return "native";
+	case MOQ_XDP_GENERIC:
+		return "generic";
+	default:
+		return "auto";
+	}
+}
+
+int moq_xdp_mode_from_name(const char *name)
+{
+	if (!strcasecmp(name, "auto")) {
+		return MOQ_XDP_AUTO;
+	}
+	if (!strcasecmp(name, "native") || !strcasecmp(name, "driver")) {
+		return MOQ_XDP_NATIVE;
+	}
+	if (!strcasecmp(name, "generic") || !strcasecmp(name, "skb")) {
+		return MOQ_XDP_GENERIC;
+	}
+
+	return -1;
+}
+
+#ifdef HAVE_LINUX_IF_XDP_H
+
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+
+#define MOQ_XDP_HEADER_SIZE 42		/* Ethernet, IPv4 without options, UDP */
+#define MOQ_XDP_CHAN_RING 256		/* Datagrams a channel holds before the worker drops */
+#define MOQ_XDP_RX_BATCH 64		/* Descriptors a worker takes per pass */
+#define MOQ_XDP_POLL_MS 10		/* Worker wakeup to recycle frames when idle */
+#define MOQ_XDP_PORTS 65536
+
+/* One of the four rings shared with the kernel */
+struct moq_xdp_ring {
+	uint32_t *producer;
+	uint32_t *consumer;
+	uint32_t *flags;
+	void *desc;
+	uint32_t size;
+	void *map;
+	size_t map_len;
+};
+
+/* A receive queue: its socket, UMEM and worker thread */
+struct moq_xdp_worker {
+	struct moq_xdp *xdp;
+	unsigned int queue;
+	int fd;
+	uint8_t *umem;
+	size_t umem_len;
+	struct moq_xdp_ring fill;
+	struct moq_xdp_ring comp;
+	struct moq_xdp_ring rx;
+	struct moq_xdp_ring tx;
+	pthread_t thread;
+	int started;
+
+	/* Frames the worker gives back to the kernel, from channels; worker lock */
+	pthread_mutex_t lock;
+	uint64_t *recycled;
+	unsigned int recycled_count;
+
+	/* Transmit side, any thread; worker lock */
+	uint64_t *tx_free;
+	unsigned int tx_free_count;
+	uint16_t ip_id;
+
+	struct moq_xdp_stats stats;
+};
+
+struct moq_xdp {
+	int ifindex;
+	char describe[32];
+	int prog_fd;
+	int link_fd;
+	int xsks_fd;
+	int ports_fd;
+	unsigned int frames;
+	unsigned int rx_frames;		/* The rest of each UMEM is for transmit */
+	volatile int running;
+
+	/* Channels by local port, host order */
+	pthread_rwlock_t chans_lock;
+	struct moq_xdp_chan **chans;
+
+	unsigned int queue_count;
+	struct moq_xdp_worker workers[];
+};
+
+struct moq_xdp_chan {
+	struct moq_xdp *xdp;
+	uint16_t port;
+	int event_fd;
+
+	/*
+	 * Received frames. Workers produce under rx_lock, which only matters
+	 * when several queues deliver to one port; the consumer takes them
+	 * without locking.
+	 */
+	pthread_spinlock_t rx_lock;
+	struct moq_xdp_packet ring[MOQ_XDP_CHAN_RING];
+	unsigned int head;
+	unsigned int tail;
+	int armed;			/* Consumer found the ring empty; signal event_fd */
+
+	/* Returned by the last moq_xdp_recv() (consumer only) */
+	struct moq_xdp_packet held[MOQ_XDP_RECV_MAX];
+	int held_count;
+
+	/* Transmit path, mirrored from a datagram from the peer; lock */
+	pthread_mutex_t lock;
+	struct sockaddr_in peer;
+	int path_valid;
+	unsigned int path_queue;
+	uint8_t header[MOQ_XDP_HEADER_SIZE];
+};
+
+static int moq_bpf(int cmd, union bpf_attr *attr)
+{
+	return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+static int moq_bpf_map_create(uint32_t type, uint32_t max_entries)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type = type;
+	attr.key_size = sizeof(uint32_t);
+	attr.value_size = sizeof(uint32_t);
+	attr.max_entries = max_entries;
+
+	return moq_bpf(BPF_MAP_CREATE, &attr);
+}
+
+static int moq_bpf_map_set(int map_fd, uint32_t key, uint32_t value)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = map_fd;
+	attr.key = (uintptr_t)&key;
+	attr.value = (uintptr_t)&value;
+	attr.flags = BPF_ANY;
+
+	return moq_bpf(BPF_MAP_UPDATE_ELEM, &attr);
+}
+
+#define MOQ_BPF_INSN(c, d, s, o, i) \
+	((struct bpf_insn){ .code = (c), .dst_reg = (d), .src_reg = (s), .off = (o), .imm = (i) })
+#define MOQ_BPF_MOV_REG(d, s)		MOQ_BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_X, d, s, 0, 0)
+#define MOQ_BPF_MOV_IMM(d, i)		MOQ_BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_K, d, 0, 0, i)
+#define MOQ_BPF_ADD_IMM(d, i)		MOQ_BPF_INSN(BPF_ALU64 | BPF_ADD | BPF_K, d, 0, 0, i)
+#define MOQ_BPF_AND_IMM(d, i)		MOQ_BPF_INSN(BPF_ALU64 | BPF_AND | BPF_K, d, 0, 0, i)
+#define MOQ_BPF_BE16(d)			MOQ_BPF_INSN(BPF_ALU | BPF_END | BPF_TO_BE, d, 0, 0, 16)
+#define MOQ_BPF_LDX(size, d, s, o)	MOQ_BPF_INSN(BPF_LDX | BPF_MEM | (size), d, s, o, 0)
+#define MOQ_BPF_STX(size, d, s, o)	MOQ_BPF_INSN(BPF_STX | BPF_MEM | (size), d, s, o, 0)
+#define MOQ_BPF_JMP_REG(op, d, s, o)	MOQ_BPF_INSN(BPF_JMP | (op) | BPF_X, d, s, o, 0)
+#define MOQ_BPF_JMP_IMM(op, d, i, o)	MOQ_BPF_INSN(BPF_JMP | (op) | BPF_K, d, 0, o, i)
+#define MOQ_BPF_CALL(f)			MOQ_BPF_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, f)
+#define MOQ_BPF_EXIT()			MOQ_BPF_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+#define MOQ_BPF_LD_MAP(d, fd) \
+	MOQ_BPF_INSN(BPF_LD | BPF_DW | BPF_IMM, d, BPF_PSEUDO_MAP_FD, 0, fd), MOQ_BPF_INSN(0, 0, 0, 0, 0)
+
+/*
+ * The XDP program. In C:
+ *
+ *	if (data + 42 > data_end || eth->h_proto != htons(ETH_P_IP) ||
+ *		ip->version_ihl != 0x45 || ip->protocol != IPPROTO_UDP ||
+ *		(ip->frag_off & htons(IP_MF | IP_OFFSET)))
+ *		return XDP_PASS;
+ *	key = ntohs(udp->dest);
+ *	open = bpf_map_lookup_elem(&ports, &key);
+ *	if (!open || !*open)
+ *		return XDP_PASS;
+ *	return bpf_redirect_map(&xsks, ctx->rx_queue_index, XDP_PASS);
+ *
+ * Jump offsets count instructions from the one after the jump to "pass".
+ */
+static int moq_xdp_load_program(struct moq_xdp *xdp, char *err, size_t err_len)
+{
+	struct bpf_insn prog[] = {
+		/* 0 */ MOQ_BPF_MOV_REG(BPF_REG_6, BPF_REG_1),
+		/* 1 */ MOQ_BPF_LDX(BPF_W, BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, data)),
+		/* 2 */ MOQ_BPF_LDX(BPF_W, BPF_REG_3, BPF_REG_1, offsetof(struct xdp_md, data_end)),
+		/* 3 */ MOQ_BPF_MOV_REG(BPF_REG_4, BPF_REG_2),
+		/* 4 */ MOQ_BPF_ADD_IMM(BPF_REG_4, MOQ_XDP_HEADER_SIZE),
+		/* 5 */ MOQ_BPF_JMP_REG(BPF_JGT, BPF_REG_4, BPF_REG_3, 26),
+		/* 6 */ MOQ_BPF_LDX(BPF_H, BPF_REG_5, BPF_REG_2, 12),
+		/* 7 */ MOQ_BPF_JMP_IMM(BPF_JNE, BPF_REG_5, htons(0x0800), 24),
+		/* 8 */ MOQ_BPF_LDX(BPF_B, BPF_REG_5, BPF_REG_2, 14),
+		/* 9 */ MOQ_BPF_JMP_IMM(BPF_JNE, BPF_REG_5, 0x45, 22),
+		/* 10 */ MOQ_BPF_LDX(BPF_B, BPF_REG_5, BPF_REG_2, 23),
+		/* 11 */ MOQ_BPF_JMP_IMM(BPF_JNE, BPF_REG_5, IPPROTO_UDP, 20),
+		/* 12 */ MOQ_BPF_LDX(BPF_H, BPF_REG_5, BPF_REG_2, 20),
+		/* 13 */ MOQ_BPF_AND_IMM(BPF_REG_5, htons(0x3fff)),
+		/* 14 */ MOQ_BPF_JMP_IMM(BPF_JNE, BPF_REG_5, 0, 17),
+		/* 15 */ MOQ_BPF_LDX(BPF_H, BPF_REG_5, BPF_REG_2, 36),
+		/* 16 */ MOQ_BPF_BE16(BPF_REG_5),
+		/* 17 */ MOQ_BPF_STX(BPF_W, BPF_REG_10, BPF_REG_5, -4),
+		/* 18 */ MOQ_BPF_LD_MAP(BPF_REG_1, xdp->ports_fd),
+		/* 20 */ MOQ_BPF_MOV_REG(BPF_REG_2, BPF_REG_10),
+		/* 21 */ MOQ_BPF_ADD_IMM(BPF_REG_2, -4),
+		/* 22 */ MOQ_BPF_CALL(BPF_FUNC_map_lookup_elem),
+		/* 23 */ MOQ_BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 8),
+		/* 24 */ MOQ_BPF_LDX(BPF_W, BPF_REG_5, BPF_REG_0, 0),
+		/* 25 */ MOQ_BPF_JMP_IMM(BPF_JEQ, BPF_REG_5, 0, 6),
+		/* 26 */ MOQ_BPF_LDX(BPF_W, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, rx_queue_index)),
+		/* 27 */ MOQ_BPF_LD_MAP(BPF_REG_1, xdp->xsks_fd),
+		/* 29 */ MOQ_BPF_MOV_IMM(BPF_REG_3, XDP_PASS),
+		/* 30 */ MOQ_BPF_CALL(BPF_FUNC_redirect_map),
+		/* 31 */ MOQ_BPF_EXIT(),
+		/* 32 pass */ MOQ_BPF_MOV_IMM(BPF_REG_0, XDP_PASS),
+		/* 33 */ MOQ_BPF_EXIT(),
+	};
+	static char log[4096];
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = BPF_PROG_TYPE_XDP;
+	attr.expected_attach_type = BPF_XDP;
+	attr.insns = (uintptr_t)prog;
+	attr.insn_cnt = sizeof(prog) / sizeof(prog[0]);
+	attr.license = (uintptr_t)"GPL";
+	xdp->prog_fd = moq_bpf(BPF_PROG_LOAD, &attr);
+	if (xdp->prog_fd >= 0) {
+		return 0;
+	}
+
+	/* Load again for the verifier's explanation */
+	log[0] = '\0';
+	attr.log_buf = (uintptr_t)log;
+	attr.log_size = sizeof(log);
+	attr.log_level = 1;
+	xdp->prog_fd = moq_bpf(BPF_PROG_LOAD, &attr);
+	if (xdp->prog_fd >= 0) {
+		return 0;
+	}
+	snprintf(err, err_len, "loading XDP program: %s%s%.200s", strerror(errno), *log ? ": " : "", log);
+
+	return -errno;
+}
+
+/* Attach the program in the requested mode, or the best available */
+static int moq_xdp_attach(struct moq_xdp *xdp, enum moq_xdp_mode mode, char *err, size_t err_len)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.link_create.prog_fd = xdp->prog_fd;
+	attr.link_create.target_ifindex = xdp->ifindex;
+	attr.link_create.attach_type = BPF_XDP;
+
+	if (mode != MOQ_XDP_GENERIC) {
+		attr.link_create.flags = XDP_FLAGS_DRV_MODE;
+		xdp->link_fd = moq_bpf(BPF_LINK_CREATE, &attr);
+		if (xdp->link_fd >= 0) {
+			strcpy(xdp->describe, "native");
+			return 0;
+		}
+		if (mode == MOQ_XDP_NATIVE || errno == EBUSY) {
+			snprintf(err, err_len, "attaching XDP program: %s", strerror(errno));
+			return -errno;
+		}
+	}
+
+	attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+	xdp->link_fd = moq_bpf(BPF_LINK_CREATE, &attr);
+	if (xdp->link_fd < 0) {
+		snprintf(err, err_len, "attaching XDP program: %s", strerror(errno));
+		return -errno;
+	}
+	strcpy(xdp->describe, "generic");
+
+	return 0;
+}
+
+static int moq_xdp_ring_map(int fd, struct moq_xdp_ring *ring, const struct xdp_ring_offset *off,
+	uint32_t size, size_t desc_size, off_t pgoff)
+{
+	ring->map_len = off->desc + size * desc_size;
+	ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, pgoff);
+	if (ring->map == MAP_FAILED) {
+		ring->map = NULL;
+		return -1;
+	}
+	ring->producer = (uint32_t *)((uint8_t *)ring->map + off->producer);
+	ring->consumer = (uint32_t *)((uint8_t *)ring->map + off->consumer);
+	ring->flags = (uint32_t *)((uint8_t *)ring->map + off->flags);
+	ring->desc = (uint8_t *)ring->map + off->desc;
+	ring->size = size;
+
+	return 0;
+}
+
+static void moq_xdp_ring_unmap(struct moq_xdp_ring *ring)
+{
+	if (ring->map) {
+		munmap(ring->map, ring->map_len);
+		ring->map = NULL;
+	}
+}
+
+/* Entries the kernel has published on a ring we consume */
+static uint32_t moq_xdp_ring_ready(const struct moq_xdp_ring *ring)
+{
+	return __atomic_load_n(ring->producer, __ATOMIC_ACQUIRE) - *ring->consumer;
+}
+
+/* Entries free on a ring we produce */
+static uint32_t moq_xdp_ring_free(const struct moq_xdp_ring *ring)
+{
+	return ring->size - (*ring->producer - __atomic_load_n(ring->consumer, __ATOMIC_ACQUIRE));
+}
+
+static void moq_xdp_worker_close(struct moq_xdp_worker *w)
+{
+	moq_xdp_ring_unmap(&w->fill);
+	moq_xdp_ring_unmap(&w->comp);
+	moq_xdp_ring_unmap(&w->rx);
+	moq_xdp_ring_unmap(&w->tx);
+	if (w->fd >= 0) {
+		close(w->fd);
+		w->fd = -1;
+	}
+	if (w->umem) {
+		munmap(w->umem, w->umem_len);
+		w->umem = NULL;
+	}
+}
+
+/*
+ * Create a queue's socket and UMEM and bind it. The first rx_frames frames
+ * start out on the fill ring, the rest on the transmit free list.
+ */
+static int moq_xdp_worker_open(struct moq_xdp_worker *w, uint16_t bind_flags)
+{
+	struct moq_xdp *xdp = w->xdp;
+	uint32_t tx_frames = xdp->frames - xdp->rx_frames;
+	struct xdp_umem_reg reg;
+	struct xdp_mmap_offsets off;
+	struct sockaddr_xdp sxdp;
+	socklen_t optlen = sizeof(off);
+	uint32_t i;
+	int err;
+
+	w->fd = socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0);
+	if (w->fd < 0) {
+		return -1;
+	}
+
+	w->umem_len = (size_t)xdp->frames * MOQ_XDP_FRAME_SIZE;
+	w->umem = mmap(NULL, w->umem_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (w->umem == MAP_FAILED) {
+		w->umem = NULL;
+		goto fail;
+	}
+
+	memset(&reg, 0, sizeof(reg));
+	reg.addr = (uintptr_t)w->umem;
+	reg.len = w->umem_len;
+	reg.chunk_size = MOQ_XDP_FRAME_SIZE;
+	if (setsockopt(w->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) ||
+		setsockopt(w->fd, SOL_XDP, XDP_UMEM_FILL_RING, &xdp->frames, sizeof(xdp->frames)) ||
+		setsockopt(w->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &tx_frames, sizeof(tx_frames)) ||
+		setsockopt(w->fd, SOL_XDP, XDP_RX_RING, &xdp->frames, sizeof(xdp->frames)) ||
+		setsockopt(w->fd, SOL_XDP, XDP_TX_RING, &tx_frames, sizeof(tx_frames)) ||
+		getsockopt(w->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen)) {
+		goto fail;
+	}
+	if (moq_xdp_ring_map(w->fd, &w->fill, &off.fr, xdp->frames, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING) ||
+		moq_xdp_ring_map(w->fd, &w->comp, &off.cr, tx_frames, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING) ||
+		moq_xdp_ring_map(w->fd, &w->rx, &off.rx, xdp->frames, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) ||
+		moq_xdp_ring_map(w->fd, &w->tx, &off.tx, tx_frames, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING)) {
+		goto fail;
+	}
+
+	for (i = 0; i < xdp->rx_frames; i++) {
+		((uint64_t *)w->fill.desc)[i] = (uint64_t)i * MOQ_XDP_FRAME_SIZE;
+	}
+	__atomic_store_n(w->fill.producer, xdp->rx_frames, __ATOMIC_RELEASE);
+	for (i = 0; i < tx_frames; i++) {
+		w->tx_free[i] = (uint64_t)(xdp->rx_frames + i) * MOQ_XDP_FRAME_SIZE;
+	}
+	w->tx_free_count = tx_frames;
+	w->recycled_count = 0;
+
+	memset(&sxdp, 0, sizeof(sxdp));
+	sxdp.sxdp_family = AF_XDP;
+	sxdp.sxdp_ifindex = xdp->ifindex;
+	sxdp.sxdp_queue_id = w->queue;
+	sxdp.sxdp_flags = bind_flags | XDP_USE_NEED_WAKEUP;
+	if (bind(w->fd, (struct sockaddr *)&sxdp, sizeof(sxdp))) {
+		goto fail;
+	}
+
+	return 0;
+
+fail:
+	err = errno;
+	moq_xdp_worker_close(w);
+	errno = err;
+	return -1;
+}
+
+/* Return frames to a worker (consumer side) */
+static void moq_xdp_return(struct moq_xdp *xdp, const struct moq_xdp_packet *packets, int count)
+{
+	struct moq_xdp_worker *w = NULL;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (w != &xdp->workers[packets[i].queue]) {
+			if (w) {
+				pthread_mutex_unlock(&w->lock);
+			}
+			w = &xdp->workers[packets[i].queue];
+			pthread_mutex_lock(&w->lock);
+		}
+		w->recycled[w->recycled_count++] = packets[i].frame;
+	}
+	if (w) {
+		pthread_mutex_unlock(&w->lock);
+	}
+}
+
+/* Give recycled frames back to the kernel (worker only) */
+static void moq_xdp_refill(struct moq_xdp_worker *w)
+{
+	uint32_t prod = *w->fill.producer;
+	unsigned int i;
+
+	if (!__atomic_load_n(&w->recycled_count, __ATOMIC_RELAXED)) {
+		return;
+	}
+
+	/* The fill ring holds every receive frame, so there is always room */
+	pthread_mutex_lock(&w->lock);
+	for (i = 0; i < w->recycled_count; i++) {
+		((uint64_t *)w->fill.desc)[(prod + i) & (w->fill.size - 1)] = w->recycled[i];
+	}
+	w->recycled_count = 0;
+	pthread_mutex_unlock(&w->lock);
+	__atomic_store_n(w->fill.producer, prod + i, __ATOMIC_RELEASE);
+}
+
+/* Take transmitted frames back from the completion ring (worker lock held) */
+static void moq_xdp_reap(struct moq_xdp_worker *w)
+{
+	uint32_t cons = *w->comp.consumer;
+	uint32_t ready = moq_xdp_ring_ready(&w->comp);
+	uint32_t i;
+
+	for (i = 0; i < ready; i++) {
+		w->tx_free[w->tx_free_count++] = ((uint64_t *)w->comp.desc)[(cons + i) & (w->comp.size - 1)];
+	}
+	__atomic_store_n(w->comp.consumer, cons + ready, __ATOMIC_RELEASE);
+}
+
+/* Have the kernel send what is on the transmit ring, if it waits to be told */
+static void moq_xdp_kick(struct moq_xdp_worker *w)
+{
+	if (__atomic_load_n(w->tx.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP) {
+		sendto(w->fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+	}
+}
+
+/* Remember how to reach the peer from a datagram it sent (worker only) */
+static void moq_xdp_learn(struct moq_xdp_chan *chan, struct moq_xdp_worker *w, const uint8_t *frame,
+	const uint8_t *ip, const uint8_t *udp)
+{
+	uint8_t *hdr = chan->header;
+
+	pthread_mutex_lock(&chan->lock);
+	if (!chan->path_valid && chan->peer.sin_port &&
+		!memcmp(ip + 12, &chan->peer.sin_addr, 4) && !memcmp(udp, &chan->peer.sin_port, 2)) {
+		memcpy(hdr, frame + 6, 6);		/* Ethernet: back to the sender... */
+		memcpy(hdr + 6, frame, 6);		/* ...from the address it used */
+		hdr[12] = 0x08;
+		hdr[13] = 0x00;
+		memset(hdr + 14, 0, 20);
+		hdr[14] = 0x45;
+		hdr[20] = 0x40;				/* Don't fragment */
+		hdr[22] = 64;				/* TTL */
+		hdr[23] = IPPROTO_UDP;
+		memcpy(hdr + 26, ip + 16, 4);
+		memcpy(hdr + 30, ip + 12, 4);
+		memcpy(hdr + 34, udp + 2, 2);
+		memcpy(hdr + 36, udp, 2);
+		memset(hdr + 38, 0, 4);			/* Length per datagram, no checksum */
+		chan->path_queue = w->queue;
+		__atomic_store_n(&chan->path_valid, 1, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&chan->lock);
+}
+
+/* Hand a batch of received frames to their channels (worker only) */
+static void moq_xdp_receive(struct moq_xdp_worker *w, uint32_t ready)
+{
+	struct moq_xdp *xdp = w->xdp;
+	uint32_t cons = *w->rx.consumer;
+	uint32_t fill = *w->fill.producer;
+	uint64_t received = 0, dropped = 0, invalid = 0;
+	struct timespec ts;
+	uint64_t rx_us;
+	uint32_t i;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	rx_us = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+	pthread_rwlock_rdlock(&xdp->chans_lock);
+	for (i = 0; i < ready; i++) {
+		const struct xdp_desc *desc = &((struct xdp_desc *)w->rx.desc)[(cons + i) & (w->rx.size - 1)];
+		uint8_t *frame = w->umem + desc->addr;
+		uint64_t base = desc->addr & ~(uint64_t)(MOQ_XDP_FRAME_SIZE - 1);
+		uint8_t *ip = frame + 14, *udp;
+		struct moq_xdp_chan *chan;
+		struct moq_xdp_packet *packet;
+		size_t ihl, total, udp_len;
+
+		/* The program checked the fixed headers, but not the lengths */
+		ihl = (ip[0] & 0x0f) * 4;
+		total = desc->len >= MOQ_XDP_HEADER_SIZE ? (ip[2] << 8 | ip[3]) : 0;
+		udp = ip + ihl;
+		udp_len = total >= ihl + 8 ? (udp[4] << 8 | udp[5]) : 0;
+		if (total < ihl + 8 || 14 + total > desc->len || udp_len < 8 || udp_len > total - ihl) {
+			invalid++;
+			((uint64_t *)w->fill.desc)[fill++ & (w->fill.size - 1)] = base;
+			continue;
+		}
+
+		chan = xdp->chans[udp[2] << 8 | udp[3]];
+		if (!chan) {
+			dropped++;
+			((uint64_t *)w->fill.desc)[fill++ & (w->fill.size - 1)] = base;
+			continue;
+		}
+		if (xdp->queue_count > 1) {
+			pthread_spin_lock(&chan->rx_lock);
+		}
+		if (chan->head - __atomic_load_n(&chan->tail, __ATOMIC_ACQUIRE) >= MOQ_XDP_CHAN_RING) {
+			if (xdp->queue_count > 1) {
+				pthread_spin_unlock(&chan->rx_lock);
+			}
+			dropped++;
+			((uint64_t *)w->fill.desc)[fill++ & (w->fill.size - 1)] = base;
+			continue;
+		}
+		packet = &chan->ring[chan->head % MOQ_XDP_CHAN_RING];
+		packet->data = udp + 8;
+		packet->len = udp_len - 8;
+		packet->rx_us = rx_us;
+		packet->frame = base;
+		packet->queue = w->queue;
+		__atomic_store_n(&chan->head, chan->head + 1, __ATOMIC_RELEASE);
+		if (xdp->queue_count > 1) {
+			pthread_spin_unlock(&chan->rx_lock);
+		}
+		received++;
+
+		if (!__atomic_load_n(&chan->path_valid, __ATOMIC_ACQUIRE)) {
+			moq_xdp_learn(chan, w, frame, ip, udp);
+		}
+		if (__atomic_exchange_n(&chan->armed, 0, __ATOMIC_SEQ_CST)) {
+			uint64_t one = 1;
+
+			if (write(chan->event_fd, &one, sizeof(one)) < 0) {
+				/* Cannot overflow; the consumer reads it before rearming */
+			}
+		}
+	}
+	pthread_rwlock_unlock(&xdp->chans_lock);
+
+	__atomic_store_n(w->rx.consumer, cons + ready, __ATOMIC_RELEASE);
+	if (fill != *w->fill.producer) {
+		__atomic_store_n(w->fill.producer, fill, __ATOMIC_RELEASE);
+	}
+
+	__atomic_fetch_add(&w->stats.rx_packets, received, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&w->stats.rx_dropped, dropped, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&w->stats.rx_invalid, invalid, __ATOMIC_RELAXED);
+}
+
+static void *moq_xdp_worker_thread(void *data)
+{
+	struct moq_xdp_worker *w = data;
+	struct pollfd pfd = { .fd = w->fd, .events = POLLIN };
+
+	while (w->xdp->running) {
+		uint32_t ready;
+
+		moq_xdp_refill(w);
+
+		/* Frames sent while the kernel was not looking would otherwise wait */
+		if (*w->tx.producer != __atomic_load_n(w->tx.consumer, __ATOMIC_ACQUIRE)) {
+			moq_xdp_kick(w);
+		}
+
+		ready = moq_xdp_ring_ready(&w->rx);
+		if (!ready) {
+			poll(&pfd, 1, MOQ_XDP_POLL_MS);
+			continue;
+		}
+		moq_xdp_receive(w, ready < MOQ_XDP_RX_BATCH ? ready : MOQ_XDP_RX_BATCH);
+	}
+
+	return NULL;
+}
+
+int moq_xdp_open(struct moq_xdp **xdpp, const char *ifname, unsigned int queues,
+	enum moq_xdp_mode mode, unsigned int frames, char *err, size_t err_len)
+{
+	struct moq_xdp *xdp;
+	pthread_rwlockattr_t attr;
+	unsigned int i;
+	int res;
+
+	*xdpp = NULL;
+	if (!frames) {
+		frames = MOQ_XDP_DEFAULT_FRAMES;
+	}
+	if (!queues || queues > MOQ_XDP_MAX_QUEUES || frames < 64 || (frames & (frames - 1))) {
+		snprintf(err, err_len, "invalid queue or frame count");
+		return -EINVAL;
+	}
+
+	xdp = calloc(1, sizeof(*xdp) + queues * sizeof(xdp->workers[0]));
+	if (!xdp || !(xdp->chans = calloc(MOQ_XDP_PORTS, sizeof(*xdp->chans)))) {
+		free(xdp);
+		snprintf(err, err_len, "out of memory");
+		return -ENOMEM;
+	}
+	xdp->prog_fd = xdp->link_fd = xdp->xsks_fd = xdp->ports_fd = -1;
+	xdp->queue_count = queues;
+	xdp->frames = frames;
+	xdp->rx_frames = frames - frames / 4;
+	pthread_rwlockattr_init(&attr);
+	pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+	pthread_rwlock_init(&xdp->chans_lock, &attr);
+	pthread_rwlockattr_destroy(&attr);
+	for (i = 0; i < queues; i++) {
+		xdp->workers[i].xdp = xdp;
+		xdp->workers[i].queue = i;
+		xdp->workers[i].fd = -1;
+		pthread_mutex_init(&xdp->workers[i].lock, NULL);
+	}
+	for (i = 0; i < queues; i++) {
+		struct moq_xdp_worker *w = &xdp->workers[i];
+
+		w->recycled = calloc(xdp->rx_frames, sizeof(*w->recycled));
+		w->tx_free = calloc(frames - xdp->rx_frames, sizeof(*w->tx_free));
+		if (!w->recycled || !w->tx_free) {
+			snprintf(err, err_len, "out of memory");
+			moq_xdp_close(xdp);
+			return -ENOMEM;
+		}
+	}
+
+	xdp->ifindex = if_nametoindex(ifname);
+	if (!xdp->ifindex) {
+		res = -errno;
+		snprintf(err, err_len, "no interface %s", ifname);
+		moq_xdp_close(xdp);
+		return res;
+	}
+
+	xdp->xsks_fd = moq_bpf_map_create(BPF_MAP_TYPE_XSKMAP, queues);
+	xdp->ports_fd = moq_bpf_map_create(BPF_MAP_TYPE_ARRAY, MOQ_XDP_PORTS);
+	if (xdp->xsks_fd < 0 || xdp->ports_fd < 0) {
+		res = -errno;
+		snprintf(err, err_len, "creating BPF maps: %s", strerror(errno));
+		moq_xdp_close(xdp);
+		return res;
+	}
+	if ((res = moq_xdp_load_program(xdp, err, err_len)) ||
+		(res = moq_xdp_attach(xdp, mode, err, err_len))) {
+		moq_xdp_close(xdp);
+		return res;
+	}
+
+	/* Zero copy needs driver support; copy mode works everywhere */
+	for (i = 0; i < queues; i++) {
+		struct moq_xdp_worker *w = &xdp->workers[i];
+		int zerocopy = !strcmp(xdp->describe, "native");
+
+		if (zerocopy && moq_xdp_worker_open(w, XDP_ZEROCOPY)) {
+			zerocopy = 0;
+		}
+		if (!zerocopy && moq_xdp_worker_open(w, XDP_COPY)) {
+			res = -errno;
+			snprintf(err, err_len, "binding AF_XDP socket to queue %u: %s", i, strerror(errno));
+			moq_xdp_close(xdp);
+			return res;
+		}
+		if (!i) {
+			strcat(xdp->describe, zerocopy ? ", zero copy" : ", copy");
+		}
+		if (moq_bpf_map_set(xdp->xsks_fd, i, w->fd)) {
+			res = -errno;
+			snprintf(err, err_len, "registering AF_XDP socket: %s", strerror(errno));
+			moq_xdp_close(xdp);
+			return res;
+		}
+	}
+
+	xdp->running = 1;
+	for (i = 0; i < queues; i++) {
+		struct moq_xdp_worker *w = &xdp->workers[i];
+
+		if (pthread_create(&w->thread, NULL, moq_xdp_worker_thread, w)) {
+			snprintf(err, err_len, "starting worker thread");
+			moq_xdp_close(xdp);
+			return -EAGAIN;
+		}
+		w->started = 1;
+	}
+
+	*xdpp = xdp;
+
+	return 0;
+}
+
+void moq_xdp_close(struct moq_xdp *xdp)
+{
+	unsigned int i;
+
+	if (!xdp) {
+		return;
+	}
+
+	xdp->running = 0;
+	for (i = 0; i < xdp->queue_count; i++) {
+		if (xdp->workers[i].started) {
+			pthread_join(xdp->workers[i].thread, NULL);
+		}
+	}
+
+	/* Detaching first passes everything to the stack again */
+	if (xdp->link_fd >= 0) {
+		close(xdp->link_fd);
+	}
+	for (i = 0; i < xdp->queue_count; i++) {
+		struct moq_xdp_worker *w = &xdp->workers[i];
+
+		moq_xdp_worker_close(w);
+		pthread_mutex_destroy(&w->lock);
+		free(w->recycled);
+		free(w->tx_free);
+	}
+	if (xdp->prog_fd >= 0) {
+		close(xdp->prog_fd);
+	}
+	if (xdp->xsks_fd >= 0) {
+		close(xdp->xsks_fd);
+	}
+	if (xdp->ports_fd >= 0) {
+		close(xdp->ports_fd);
+	}
+	pthread_rwlock_destroy(&xdp->chans_lock);
+	free(xdp->chans);
+	free(xdp);
+}
+
+const char *moq_xdp_describe(const struct moq_xdp *xdp)
+{
+	return xdp->describe;
+}
+
+void moq_xdp_get_stats(struct moq_xdp *xdp, struct moq_xdp_stats *stats)
+{
+	struct xdp_statistics kernel;
+	socklen_t len;
+	unsigned int i;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < xdp->queue_count; i++) {
+		const struct moq_xdp_stats *s = &xdp->workers[i].stats;
+
+		stats->rx_packets += __atomic_load_n(&s->rx_packets, __ATOMIC_RELAXED);
+		stats->rx_dropped += __atomic_load_n(&s->rx_dropped, __ATOMIC_RELAXED);
+		stats->rx_invalid += __atomic_load_n(&s->rx_invalid, __ATOMIC_RELAXED);
+		stats->tx_packets += __atomic_load_n(&s->tx_packets, __ATOMIC_RELAXED);
+		stats->tx_busy += __atomic_load_n(&s->tx_busy, __ATOMIC_RELAXED);
+
+		/* Older kernels fill in less of this */
+		memset(&kernel, 0, sizeof(kernel));
+		len = sizeof(kernel);
+		if (!getsockopt(xdp->workers[i].fd, SOL_XDP, XDP_STATISTICS, &kernel, &len)) {
+			stats->rx_ring_full += kernel.rx_ring_full;
+			stats->fill_empty += kernel.rx_fill_ring_empty_descs;
+		}
+	}
+}
+
+struct moq_xdp_chan *moq_xdp_chan_open(struct moq_xdp *xdp, int socket_fd)
+{
+	struct moq_xdp_chan *chan;
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	int err;
+
+	if (getsockname(socket_fd, (struct sockaddr *)&addr, &addr_len)) {
+		return NULL;
+	}
+	if (addr.sin_family != AF_INET || !addr.sin_port) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	chan = calloc(1, sizeof(*chan));
+	if (!chan) {
+		return NULL;
+	}
+	chan->xdp = xdp;
+	chan->port = ntohs(addr.sin_port);
+	chan->armed = 1;
+	chan->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (chan->event_fd < 0) {
+		free(chan);
+		return NULL;
+	}
+	pthread_spin_init(&chan->rx_lock, PTHREAD_PROCESS_PRIVATE);
+	pthread_mutex_init(&chan->lock, NULL);
+
+	pthread_rwlock_wrlock(&xdp->chans_lock);
+	if (xdp->chans[chan->port]) {
+		pthread_rwlock_unlock(&xdp->chans_lock);
+		err = EADDRINUSE;
+		goto fail;
+	}
+	xdp->chans[chan->port] = chan;
+	pthread_rwlock_unlock(&xdp->chans_lock);
+
+	if (moq_bpf_map_set(xdp->ports_fd, chan->port, 1)) {
+		err = errno;
+		pthread_rwlock_wrlock(&xdp->chans_lock);
+		xdp->chans[chan->port] = NULL;
+		pthread_rwlock_unlock(&xdp->chans_lock);
+		goto fail;
+	}
+
+	return chan;
+
+fail:
+	close(chan->event_fd);
+	pthread_spin_destroy(&chan->rx_lock);
+	pthread_mutex_destroy(&chan->lock);
+	free(chan);
+	errno = err;
+	return NULL;
+}
+
+void moq_xdp_chan_close(struct moq_xdp_chan *chan)
+{
+	struct moq_xdp *xdp;
+
+	if (!chan) {
+		return;
+	}
+	xdp = chan->xdp;
+
+	/* Once out of the table no worker can be delivering to it */
+	moq_bpf_map_set(xdp->ports_fd, chan->port, 0);
+	pthread_rwlock_wrlock(&xdp->chans_lock);
+	xdp->chans[chan->port] = NULL;
+	pthread_rwlock_unlock(&xdp->chans_lock);
+
+	moq_xdp_chan_drain(chan);
+	close(chan->event_fd);
+	pthread_spin_destroy(&chan->rx_lock);
+	pthread_mutex_destroy(&chan->lock);
+	free(chan);
+}
+
+int moq_xdp_chan_fd(const struct moq_xdp_chan *chan)
+{
+	return chan->event_fd;
+}
+
+void moq_xdp_chan_connect(struct moq_xdp_chan *chan, const struct sockaddr_in *peer)
+{
+	pthread_mutex_lock(&chan->lock);
+	chan->peer = *peer;
+	__atomic_store_n(&chan->path_valid, 0, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&chan->lock);
+}
+
+int moq_xdp_recv(struct moq_xdp_chan *chan, struct moq_xdp_packet *packets, int max)
+{
+	unsigned int tail = chan->tail;
+	unsigned int head = __atomic_load_n(&chan->head, __ATOMIC_ACQUIRE);
+	int count = 0;
+
+	moq_xdp_release(chan);
+	if (max > MOQ_XDP_RECV_MAX) {
+		max = MOQ_XDP_RECV_MAX;
+	}
+
+	if (head == tail) {
+		uint64_t value;
+
+		/* Clear the wakeup, then ask for another and look once more */
+		if (read(chan->event_fd, &value, sizeof(value)) < 0) {
+			/* Nothing to clear */
+		}
+		__atomic_store_n(&chan->armed, 1, __ATOMIC_SEQ_CST);
+		head = __atomic_load_n(&chan->head, __ATOMIC_SEQ_CST);
+	}
+
+	while (tail != head && count < max) {
+		packets[count] = chan->ring[tail % MOQ_XDP_CHAN_RING];
+		chan->held[count] = packets[count];
+		count++;
+		tail++;
+	}
+	__atomic_store_n(&chan->tail, tail, __ATOMIC_RELEASE);
+	chan->held_count = count;
+
+	return count;
+}
+
+void moq_xdp_release(struct moq_xdp_chan *chan)
+{
+	if (chan->held_count) {
+		moq_xdp_return(chan->xdp, chan->held, chan->held_count);
+		chan->held_count = 0;
+	}
+}
+
+void moq_xdp_chan_drain(struct moq_xdp_chan *chan)
+{
+	struct moq_xdp_packet packets[MOQ_XDP_RECV_MAX];
+
+	while (moq_xdp_recv(chan, packets, MOQ_XDP_RECV_MAX) > 0) {
+		/* Keep draining */
+	}
+}
+
+/* RFC 1071 checksum of an IPv4 header without options */
+static uint16_t moq_xdp_ip_checksum(const uint8_t *ip)
+{
+	uint32_t sum = 0;
+	int i;
+
+	for (i = 0; i < 20; i += 2) {
+		sum += ip[i] << 8 | ip[i + 1];
+	}
+	while (sum >> 16) {
+		sum = (sum & 0xffff) + (sum >> 16);
+	}
+
+	return ~sum & 0xffff;
+}
+
+int moq_xdp_send(struct moq_xdp_chan *chan, const struct iovec *iov, int count)
+{
+	struct moq_xdp_worker *w;
+	uint8_t header[MOQ_XDP_HEADER_SIZE];
+	uint32_t prod, room;
+	int i;
+
+	if (!__atomic_load_n(&chan->path_valid, __ATOMIC_ACQUIRE)) {
+		return 0;
+	}
+	pthread_mutex_lock(&chan->lock);
+	if (!chan->path_valid) {
+		pthread_mutex_unlock(&chan->lock);
+		return 0;
+	}
+	memcpy(header, chan->header, sizeof(header));
+	w = &chan->xdp->workers[chan->path_queue];
+	pthread_mutex_unlock(&chan->lock);
+
+	pthread_mutex_lock(&w->lock);
+	moq_xdp_reap(w);
+	prod = *w->tx.producer;
+	room = moq_xdp_ring_free(&w->tx);
+	for (i = 0; i < count && (uint32_t)i < room && w->tx_free_count; i++) {
+		struct xdp_desc *desc = &((struct xdp_desc *)w->tx.desc)[(prod + i) & (w->tx.size - 1)];
+		size_t len = iov[i].iov_len;
+		uint64_t frame;
+		uint8_t *pkt;
+		uint16_t sum;
+
+		if (len > MOQ_XDP_FRAME_SIZE - MOQ_XDP_HEADER_SIZE) {
+			break;
+		}
+		frame = w->tx_free[--w->tx_free_count];
+		pkt = w->umem + frame;
+		memcpy(pkt, header, MOQ_XDP_HEADER_SIZE);
+		pkt[16] = (20 + 8 + len) >> 8;
+		pkt[17] = (20 + 8 + len) & 0xff;
+		pkt[18] = w->ip_id >> 8;
+		pkt[19] = w->ip_id++ & 0xff;
+		sum = moq_xdp_ip_checksum(pkt + 14);
+		pkt[24] = sum >> 8;
+		pkt[25] = sum & 0xff;
+		pkt[38] = (8 + len) >> 8;
+		pkt[39] = (8 + len) & 0xff;
+		memcpy(pkt + MOQ_XDP_HEADER_SIZE, iov[i].iov_base, len);
+
+		desc->addr = frame;
+		desc->len = MOQ_XDP_HEADER_SIZE + len;
+		desc->options = 0;
+	}
+	if (i) {
+		__atomic_store_n(w->tx.producer, prod + i, __ATOMIC_RELEASE);
+		moq_xdp_kick(w);
+	}
+	w->stats.tx_packets += i;
+	w->stats.tx_busy += count - i;
+	pthread_mutex_unlock(&w->lock);
+
+	return i;
+}
+
+#else /* HAVE_LINUX_IF_XDP_H */
+
+int moq_xdp_open(struct moq_xdp **xdp, const char *ifname, unsigned int queues,
+	enum moq_xdp_mode mode, unsigned int frames, char *err, size_t err_len)
+{
+	(void)ifname;
+	(void)queues;
+	(void)mode;
+	(void)frames;
+	*xdp = NULL;
+	snprintf(err, err_len, "built without AF_XDP support");
+
+	return -ENOTSUP;
+}
+
+void moq_xdp_close(struct moq_xdp *xdp)
+{
+	(void)xdp;
+}
+
+const char *moq_xdp_describe(const struct moq_xdp *xdp)
+{
+	(void)xdp;
+
+	return "unavailable";
+}
+
+void moq_xdp_get_stats(struct moq_xdp *xdp, struct moq_xdp_stats *stats)
+{
+	(void)xdp;
+	memset(stats, 0, sizeof(*stats));
+}
+
+struct moq_xdp_chan *moq_xdp_chan_open(struct moq_xdp *xdp, int socket_fd)
+{
+	(void)xdp;
+	(void)socket_fd;
+	errno = ENOTSUP;
+
+	return NULL;
+}
+
+void moq_xdp_chan_close(struct moq_xdp_chan *chan)
+{
+	(void)chan;
+}
+
+int moq_xdp_chan_fd(const struct moq_xdp_chan *chan)
+{
+	(void)chan;
+
+	return -1;
+}
+
+void moq_xdp_chan_connect(struct moq_xdp_chan *chan, const struct sockaddr_in *peer)
+{
+	(void)chan;
+	(void)peer;
+}
+
+int moq_xdp_recv(struct moq_xdp_chan *chan, struct moq_xdp_packet *packets, int max)
+{
+	(void)chan;
+	(void)packets;
+	(void)max;
+
+	return 0;
+}
+
+void moq_xdp_release(struct moq_xdp_chan *chan)
+{
+	(void)chan;
+}
+
+void moq_xdp_chan_drain(struct moq_xdp_chan *chan)
+{
+	(void)chan;
+}
+
+int moq_xdp_send(struct moq_xdp_chan *chan, const struct iovec *iov, int count)
+{
+	(void)chan;
+	(void)iov;
+	(void)count;
+
+	return 0;
+}
+
+#endif /* HAVE_LINUX_IF_XDP_H */
@@ -0,0 +1,141 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/*
+ * AF_XDP media path.
+ *
+ * On a dedicated media node the per-datagram cost of the kernel UDP stack
+ * dominates even with recvmmsg()/sendmmsg() batching. This backend attaches
+ * a small XDP program to the media interface that redirects IPv4 UDP
+ * datagrams addressed to a registered media port into AF_XDP sockets, one
+ * per receive queue, and passes everything else to the stack untouched.
+ *
+ * Each queue has a worker thread owning its UMEM and rings. The worker
+ * hands received frames to the channel registered for the destination port
+ * through a lock-free ring, and the channel's consumer parses them in place
+ * in the UMEM: no copy is made until a frame reaches the Asterisk core.
+ * Frames go back to their worker when the consumer reads its next batch.
+ *
+ * Each channel shadows an ordinary UDP socket bound to the same port, which
+ * keeps the port reserved and still receives anything the XDP program lets
+ * through (other queues, IP options, fragments). Datagrams are sent from
+ * the UMEM once the path to the peer is known, mirrored from the first
+ * datagram received from it; until then, and whenever the transmit ring is
+ * full, callers send through the socket.
+ *
+ * The program is assembled here and loaded with the bpf() system call, so
+ * neither libbpf nor a BPF compiler is needed; Linux 5.9 or later is
+ * required. Built as a stub that always fails to open unless
+ * HAVE_LINUX_IF_XDP_H is defined. Like moq_wire this has no Asterisk
+ * dependencies, so it can be benchmarked on its own (bench/moq_xdp.c).
+ */
+
+#ifndef MOQ_XDP_H
+#define MOQ_XDP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+#define MOQ_XDP_MAX_QUEUES 64
+#define MOQ_XDP_FRAME_SIZE 2048		/* UMEM frame, one datagram each */
+#define MOQ_XDP_RECV_MAX 64		/* Most datagrams one moq_xdp_recv() returns */
+#define MOQ_XDP_DEFAULT_FRAMES 4096	/* UMEM frames per queue */
+
+enum moq_xdp_mode {
+	MOQ_XDP_AUTO,		/* Driver mode if supported, else generic */
+	MOQ_XDP_NATIVE,		/* In the driver, before an skb is allocated */
+	MOQ_XDP_GENERIC		/* After skb allocation; works with any driver */
+};
+
+struct moq_xdp;
+struct moq_xdp_chan;
+
+/* A received datagram; data points into the UMEM */
+struct moq_xdp_packet {
+	uint8_t *data;		/* UDP payload, which may be modified in place */
+	size_t len;
+	uint64_t rx_us;		/* Wall clock when the worker read it */
+	uint64_t frame;		/* Owned by moq_xdp */
+	unsigned int queue;	/* Owned by moq_xdp */
+};
+
+struct moq_xdp_stats {
+	uint64_t rx_packets;	/* Handed to a channel */
+	uint64_t rx_dropped;	/* Port not open or its channel full */
+	uint64_t rx_invalid;	/* Redirected but not a well-formed datagram */
+	uint64_t tx_packets;	/* Sent from the UMEM */
+	uint64_t tx_busy;	/* Left to the socket: no free frame or ring full */
+	uint64_t rx_ring_full;	/* Dropped by the kernel: a worker fell behind */
+	uint64_t fill_empty;	/* Dropped by the kernel: every frame held by channels */
+};
+
+/* Names of attach modes, as used in configuration */
+const char *moq_xdp_mode_name(enum moq_xdp_mode mode);
+
+/* Mode from its name; returns -1 if unknown */
+int moq_xdp_mode_from_name(const char *name);
+
+/*
+ * Attach to ifname with one worker per receive queue 0 .. queues - 1, each
+ * with a UMEM of frames frames (a power of two, 0 for the default).
+ * Returns 0, or a negative errno. err, if given, receives a description of
+ * the step that failed.
+ */
+int moq_xdp_open(struct moq_xdp **xdp, const char *ifname, unsigned int queues,
+	enum moq_xdp_mode mode, unsigned int frames, char *err, size_t err_len);
+
+/* Detach and free; every channel must be closed first */
+void moq_xdp_close(struct moq_xdp *xdp);
+
+/* How the program and sockets ended up attached, e.g. "native, copy" */
+const char *moq_xdp_describe(const struct moq_xdp *xdp);
+
+void moq_xdp_get_stats(struct moq_xdp *xdp, struct moq_xdp_stats *stats);
+
+/*
+ * Start steering datagrams for the port socket_fd is bound to (an IPv4 UDP
+ * socket) to a new channel. Returns NULL with errno set on failure.
+ */
+struct moq_xdp_chan *moq_xdp_chan_open(struct moq_xdp *xdp, int socket_fd);
+
+/* Stop steering and free the channel, returning any frames it holds */
+void moq_xdp_chan_close(struct moq_xdp_chan *chan);
+
+/* Descriptor that polls readable when moq_xdp_recv() has datagrams to return */
+int moq_xdp_chan_fd(const struct moq_xdp_chan *chan);
+
+/*
+ * Set the peer datagrams are sent to. The path to it is learned again from
+ * the next datagram it sends, so until then moq_xdp_send() sends nothing.
+ */
+void moq_xdp_chan_connect(struct moq_xdp_chan *chan, const struct sockaddr_in *peer);
+
+/*
+ * Return up to max (at most MOQ_XDP_RECV_MAX) waiting datagrams. Frames
+ * returned by the previous call are released first, so packets stay valid
+ * until the next call or moq_xdp_release(). Single consumer per channel.
+ */
+int moq_xdp_recv(struct moq_xdp_chan *chan, struct moq_xdp_packet *packets, int max);
+
+/* Release the frames returned by the last moq_xdp_recv() */
+void moq_xdp_release(struct moq_xdp_chan *chan);
+
+/* Discard everything waiting */
+void moq_xdp_chan_drain(struct moq_xdp_chan *chan);
+
+/*
+ * Send count datagrams to the channel's peer from the UMEM. Returns how
+ * many were queued, from the first, leaving the rest to the caller's
+ * socket; 0 if the path to the peer is not known yet. Thread-safe.
+ */
+int moq_xdp_send(struct moq_xdp_chan *chan, const struct iovec *iov, int count);
+
+#endif /* MOQ_XDP_H */
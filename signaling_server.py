@@ -21,8 +21,8 @@ logger = logging.getLogger(__name__)
 clients: Set[WebSocketServerProtocol] = set()
 sessions: Dict[str, dict] = {}
 
-async def handle_client(websocket: WebSocketServerProtocol, path: str):
-    """Handle WebSocket client connection"""
+async def handle_client(websocket: WebSocketServerProtocol, path: str = None):
+    """Handle WebSocket client connection (newer websockets no longer pass path)"""
     client_id = f"{websocket.remote_address[0]}:{websocket.remote_address[1]}"
     logger.info(f"Client connected: {client_id}")
     
@@ -61,11 +61,16 @@ async def handle_client(websocket: WebSocketServerProtocol, path: str):
                     if dest in sessions:
                         # Route call to destination user
                         dest_ws = sessions[dest]['websocket']
-                        await dest_ws.send(json.dumps({
+                        incoming = {
                             'type': 'incoming_call',
                             'session_id': session_id,
                             'from': from_user
-                        }))
+                        }
+                        # Media keys are opaque to the server, passed through as offered
+                        for field in ('media_key', 'media_cipher'):
+                            if field in data:
+                                incoming[field] = data[field]
+                        await dest_ws.send(json.dumps(incoming))
                         logger.info(f"Call routed: {from_user} -> {dest}")
                         
                         # Send ringing to caller
@@ -86,13 +91,18 @@ async def handle_client(websocket: WebSocketServerProtocol, path: str):
                     # Answer incoming call
                     session_id = data.get('session_id')
                     
+                    answered = {
+                        'type': 'call_answered',
+                        'session_id': session_id
+                    }
+                    for field in ('media_key', 'media_cipher'):
+                        if field in data:
+                            answered[field] = data[field]
+                    
                     # Notify other party that call was answered
                     for user_id, session in sessions.items():
                         if session['websocket'] != websocket:
-                            await session['websocket'].send(json.dumps({
-                                'type': 'call_answered',
-                                'session_id': session_id
-                            }))
+                            await session['websocket'].send(json.dumps(answered))
                     
                     logger.info(f"Call answered: session {session_id}")
                 
@@ -0,0 +1,1178 @@
+/*
+ * moq_driver_test - Tests of chan_moq's own media paths
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ *
+ * The driver is built into this program against the Asterisk stand-in in
+ * test/shim, loaded with load_module() and called through its channel and
+ * bridge technology callbacks the way the core would. Relays are UDP
+ * sockets on loopback owned by the tests, which answer the driver's probes
+ * and decode what it puts on the wire:
+ *
+ *   make check                       # every test
+ *   ./test/moq_driver_test write     # the tests whose names contain "write"
+ *
+ * Set MOQ_TEST_VERBOSE=1 to see the driver's log.
+ */
+
+#include "shim/shim.h"
+#include "../chan_moq.c"
+
+#include <poll.h>
+
+#define TEST_TIMEOUT_MS 2000
+
+#define CHECK(cond) do { \
+		if (!(cond)) { \
+			fprintf(stderr, "    %s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			return -1; \
+		} \
+	} while (0)
+
+/* A relay the driver sends through */
+struct test_relay {
+	int fd;
+	struct sockaddr_in addr;
+	int answer_probes;		/* Reply to PINGs, so the driver sees it as healthy */
+	struct sockaddr_in from;	/* Sender of the last message returned */
+	struct sockaddr_in clients[4];	/* Sessions heard from, when forwarding */
+	int client_count;
+	uint8_t buf[MOQ_MAX_PACKET_SIZE];
+};
+
+/* Signaling connections users register on; only their addresses matter */
+static char alice_conn, bob_conn;
+
+static uint64_t test_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static int relay_open(struct test_relay *relay, int answer_probes)
+{
+	socklen_t len = sizeof(relay->addr);
+
+	memset(relay, 0, sizeof(*relay));
+	relay->answer_probes = answer_probes;
+	relay->addr.sin_family = AF_INET;
+	relay->addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	relay->fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (relay->fd < 0 || bind(relay->fd, (struct sockaddr *)&relay->addr, sizeof(relay->addr)) ||
+		getsockname(relay->fd, (struct sockaddr *)&relay->addr, &len)) {
+		return -1;
+	}
+
+	return 0;
+}
+
+static void relay_close(struct test_relay *relay)
+{
+	close(relay->fd);
+}
+
+/*
+ * Wait up to timeout_ms for a message of the given type, answering probes
+ * while waiting and skipping anything else. Returns its payload length, or
+ * -1 on timeout; *msg points into relay->buf.
+ */
+static int relay_next(struct test_relay *relay, uint8_t type, const uint8_t **msg, int timeout_ms)
+{
+	uint64_t deadline = test_now_ms() + timeout_ms;
+
+	for (;;) {
+		struct pollfd pfd = { .fd = relay->fd, .events = POLLIN };
+		uint64_t now = test_now_ms();
+		socklen_t fromlen = sizeof(relay->from);
+		const uint8_t *payload;
+		size_t payload_len;
+		uint8_t got;
+		ssize_t len;
+
+		if (now >= deadline || poll(&pfd, 1, deadline - now) <= 0) {
+			return -1;
+		}
+		len = recvfrom(relay->fd, relay->buf, sizeof(relay->buf), 0,
+			(struct sockaddr *)&relay->from, &fromlen);
+		if (len <= 0 || moq_wire_decode_message(relay->buf, len, &got, &payload, &payload_len) != MOQ_WIRE_OK) {
+			continue;
+		}
+		if (got == MOQ_MSG_PING) {
+			if (relay->answer_probes) {
+				relay->buf[0] = MOQ_MSG_PONG;
+				sendto(relay->fd, relay->buf, len, 0, (struct sockaddr *)&relay->from, fromlen);
+			}
+			continue;
+		}
+		if (got == type) {
+			*msg = payload;
+			return payload_len;
+		}
+	}
+}
+
+/* Wait for the next media object on a track */
+static int relay_next_object(struct test_relay *relay, uint32_t track_id, struct moq_object *obj)
+{
+	uint64_t deadline = test_now_ms() + TEST_TIMEOUT_MS;
+	const uint8_t *msg;
+	int len;
+
+	while (test_now_ms() < deadline) {
+		len = relay_next(relay, MOQ_MSG_OBJECT, &msg, deadline - test_now_ms());
+		if (len >= 0 && moq_wire_decode_object(msg, len, obj) == MOQ_WIRE_OK && obj->track_id == track_id) {
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+/* The first track announced in an ANNOUNCE payload */
+static uint32_t announced_track(const uint8_t *msg)
+{
+	uint32_t track;
+
+	memcpy(&track, msg, sizeof(track));
+
+	return ntohl(track);
+}
+
+/*
+ * Behave like a relay between the sessions using it for ms milliseconds:
+ * answer probes and forward everything else to every other session heard
+ * from. Returns the number of messages forwarded.
+ */
+static int relay_forward(struct test_relay *relay, int ms)
+{
+	uint64_t deadline = test_now_ms() + ms;
+	int forwarded = 0;
+
+	for (;;) {
+		struct pollfd pfd = { .fd = relay->fd, .events = POLLIN };
+		uint64_t now = test_now_ms();
+		struct sockaddr_in from;
+		socklen_t fromlen = sizeof(from);
+		ssize_t len;
+		int i, known = 0;
+
+		if (now >= deadline || poll(&pfd, 1, deadline - now) <= 0) {
+			return forwarded;
+		}
+		len = recvfrom(relay->fd, relay->buf, sizeof(relay->buf), 0, (struct sockaddr *)&from, &fromlen);
+		if (len < MOQ_WIRE_MSG_HEADER_SIZE) {
+			continue;
+		}
+		if (relay->buf[0] == MOQ_MSG_PING) {
+			relay->buf[0] = MOQ_MSG_PONG;
+			sendto(relay->fd, relay->buf, len, 0, (struct sockaddr *)&from, fromlen);
+			continue;
+		}
+		for (i = 0; i < relay->client_count; i++) {
+			if (relay->clients[i].sin_port == from.sin_port) {
+				known = 1;
+			} else {
+				sendto(relay->fd, relay->buf, len, 0, (struct sockaddr *)&relay->clients[i],
+					sizeof(relay->clients[i]));
+				forwarded++;
+			}
+		}
+		if (!known && relay->client_count < (int)ARRAY_LEN(relay->clients)) {
+			relay->clients[relay->client_count++] = from;
+		}
+	}
+}
+
+/* Run a CLI command handler, returning what it printed (static buffer) */
+static const char *cli_run(char *(*handler)(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a),
+	int argc, const char *const *argv)
+{
+	static char output[8192];
+	struct ast_cli_entry entry = { .handler = handler };
+	FILE *out = tmpfile();
+	struct ast_cli_args args = { .argc = argc, .argv = argv };
+	size_t len;
+
+	output[0] = '\0';
+	if (!out) {
+		return output;
+	}
+	args.fd = fileno(out);
+	handler(&entry, 0, &args);
+	rewind(out);
+	len = fread(output, 1, sizeof(output) - 1, out);
+	output[len] = '\0';
+	fclose(out);
+
+	return output;
+}
+
+/* The value in a column of the line of "moq show sessions" for a session */
+static const char *show_sessions_column(const struct moq_session *session, int column)
+{
+	static const char *const argv[] = { "moq", "show", "sessions" };
+	static char value[32];
+	const char *line = strstr(cli_run(handle_moq_show_sessions, 3, argv), session->session_id);
+	int i;
+
+	value[0] = '\0';
+	for (i = 0; line && i < column; i++) {
+		line += strcspn(line, " ");
+		line += strspn(line, " ");
+	}
+	if (line) {
+		snprintf(value, sizeof(value), "%.*s", (int)strcspn(line, " \n"), line);
+	}
+
+	return value;
+}
+
+/* A counter from "moq show stats", by the start of its line */
+static unsigned long long show_stats_value(const char *label)
+{
+	static const char *const argv[] = { "moq", "show", "stats" };
+	const char *line = strstr(cli_run(handle_moq_show_stats, 3, argv), label);
+
+	return line ? strtoull(line + strlen(label), NULL, 10) : 0;
+}
+
+/* Send a media object to a session from its relay */
+static int relay_send_object(struct test_relay *relay, const struct sockaddr_in *to, const struct moq_object *obj)
+{
+	uint8_t buf[MOQ_MAX_PACKET_SIZE];
+	int len = moq_wire_encode_object(buf, sizeof(buf), obj);
+
+	if (len < 0 || sendto(relay->fd, buf, len, 0, (const struct sockaddr *)to, sizeof(*to)) != len) {
+		return -1;
+	}
+
+	return 0;
+}
+
+static int driver_load(const char *config)
+{
+	shim_config = config;
+
+	return load_module() == AST_MODULE_LOAD_SUCCESS ? 0 : -1;
+}
+
+static int driver_unload(void)
+{
+	shim_ws_clear();
+
+	return unload_module();
+}
+
+/*
+ * Place a call from the dialplan to a user registered on conn, as
+ * Dial(MOQ/user) would. With a peer, the call sends and receives on the
+ * peer's tracks, so the two calls hear each other through a relay.
+ */
+static struct ast_channel *driver_call(const char *user, void *conn, const struct ast_channel *peer)
+{
+	struct ast_channel *chan;
+	void *replaced;
+	int cause;
+
+	if (moq_registrar_register(&moq_registrar, user, conn, &replaced)) {
+		return NULL;
+	}
+	chan = moq_tech.requester("MOQ", moq_tech.capabilities, NULL, NULL, user, &cause);
+	if (!chan) {
+		return NULL;
+	}
+	if (peer) {
+		struct moq_session *session = ast_channel_tech_pvt(chan);
+		const struct moq_session *other = ast_channel_tech_pvt(peer);
+
+		session->track_id = other->track_id;
+		session->video_track_id = other->video_track_id;
+	}
+	if (moq_tech.call(chan, user, 30000)) {
+		ast_hangup(chan);
+		return NULL;
+	}
+
+	return chan;
+}
+
+/* A 20 ms ulaw frame that is not silence */
+static void ulaw_frame(struct ast_frame *frame, uint8_t *data)
+{
+	int i;
+
+	for (i = 0; i < 160; i++) {
+		data[i] = i & 1 ? 0x20 : 0xa0;
+	}
+	memset(frame, 0, sizeof(*frame));
+	frame->frametype = AST_FRAME_VOICE;
+	frame->subclass.format = ast_format_ulaw;
+	frame->data.ptr = data;
+	frame->datalen = 160;
+	frame->samples = 160;
+}
+
+/* Audio written to a channel leaves through its relay as a media object */
+static int test_write_reaches_relay(void)
+{
+	struct test_relay relay;
+	struct ast_channel *chan;
+	struct moq_session *session;
+	struct moq_object obj;
+	struct ast_frame frame;
+	uint8_t data[160];
+	const uint8_t *msg;
+	char config[128];
+
+	CHECK(!relay_open(&relay, 1));
+	snprintf(config, sizeof(config), "relay=127.0.0.1:%d\n", ntohs(relay.addr.sin_port));
+	CHECK(!driver_load(config));
+	CHECK((chan = driver_call("alice", &alice_conn, NULL)));
+	session = ast_channel_tech_pvt(chan);
+
+	CHECK(session->quic_conn->connected);
+	CHECK(relay_next(&relay, MOQ_MSG_ANNOUNCE, &msg, TEST_TIMEOUT_MS) == 8);
+	CHECK(announced_track(msg) == session->track_id);
+
+	ulaw_frame(&frame, data);
+	CHECK(!moq_tech.write(chan, &frame));
+	CHECK(!relay_next_object(&relay, session->track_id, &obj));
+	CHECK(obj.type == MOQ_OBJ_AUDIO_ULAW);
+	CHECK(obj.sequence == 0);
+	CHECK(obj.payload_len == 160 && !memcmp(obj.payload, data, 160));
+	CHECK(!moq_tech.write(chan, &frame));
+	CHECK(!relay_next_object(&relay, session->track_id, &obj));
+	CHECK(obj.sequence == 1);
+	CHECK(obj.timestamp == 160);
+	CHECK(MOQ_STAT_GET(&session->stats, tx_packets) == 2);
+
+	ast_hangup(chan);
+	CHECK(!driver_unload());
+	relay_close(&relay);
+
+	return 0;
+}
+
+/* A call whose relay stops answering moves to another, and its media follows */
+static int test_write_follows_failover(void)
+{
+	struct test_relay first, second;
+	struct ast_channel *chan;
+	struct moq_session *session;
+	struct moq_object obj;
+	struct ast_frame frame;
+	uint8_t data[160];
+	const uint8_t *msg;
+	char config[160];
+	uint64_t deadline;
+	int relay, announced = 0;
+
+	CHECK(!relay_open(&first, 0));
+	CHECK(!relay_open(&second, 1));
+	snprintf(config, sizeof(config),
+		"relay=127.0.0.1:%d\nrelay=127.0.0.1:%d\nrelay_probe_interval=50\nrelay_timeout=100\n",
+		ntohs(first.addr.sin_port), ntohs(second.addr.sin_port));
+	CHECK(!driver_load(config));
+
+	/* No relay has answered yet, so the call starts on the first */
+	CHECK((chan = driver_call("alice", &alice_conn, NULL)));
+	session = ast_channel_tech_pvt(chan);
+	CHECK(session->relay == 0);
+	ulaw_frame(&frame, data);
+	CHECK(!moq_tech.write(chan, &frame));
+	CHECK(!relay_next_object(&first, session->track_id, &obj));
+
+	/* Only the second answers its probes; the call moves there and announces itself */
+	deadline = test_now_ms() + TEST_TIMEOUT_MS;
+	do {
+		if (relay_next(&second, MOQ_MSG_ANNOUNCE, &msg, 20) == 8) {
+			announced |= announced_track(msg) == session->track_id;
+		}
+		ast_mutex_lock(&moq_lock);
+		relay = session->relay;
+		ast_mutex_unlock(&moq_lock);
+	} while ((relay != 1 || !announced) && test_now_ms() < deadline);
+	CHECK(relay == 1);
+	CHECK(announced);
+	CHECK(session->quic_conn->connected);
+
+	CHECK(!moq_tech.write(chan, &frame));
+	CHECK(!relay_next_object(&second, session->track_id, &obj));
+	CHECK(obj.sequence == 1);
+
+	ast_hangup(chan);
+	CHECK(!driver_unload());
+	relay_close(&first);
+	relay_close(&second);
+
+	return 0;
+}
+
+/* Both ends of a call send receiver reports, and each gets an RTT from the other's echo */
+static int test_receiver_reports_both_ways(void)
+{
+	struct test_relay relay;
+	struct ast_channel *alice, *bob;
+	struct moq_session *a, *b;
+	struct ast_frame frame;
+	uint8_t data[160];
+	char config[128];
+	uint64_t deadline;
+
+	CHECK(!relay_open(&relay, 1));
+	snprintf(config, sizeof(config), "relay=127.0.0.1:%d\nrr_interval=100\n", ntohs(relay.addr.sin_port));
+	CHECK(!driver_load(config));
+	CHECK((alice = driver_call("alice", &alice_conn, NULL)));
+	CHECK((bob = driver_call("bob", &bob_conn, alice)));
+	a = ast_channel_tech_pvt(alice);
+	b = ast_channel_tech_pvt(bob);
+
+	/* Talk both ways until each side has an RTT */
+	ulaw_frame(&frame, data);
+	deadline = test_now_ms() + 3 * TEST_TIMEOUT_MS;
+	do {
+		CHECK(!moq_tech.write(alice, &frame));
+		CHECK(!moq_tech.write(bob, &frame));
+		relay_forward(&relay, 20);
+	} while ((!MOQ_STAT_GET(&a->stats, rtt) || !MOQ_STAT_GET(&b->stats, rtt)) && test_now_ms() < deadline);
+
+	CHECK(MOQ_STAT_GET(&a->stats, rr_sent) && MOQ_STAT_GET(&a->stats, rr_received));
+	CHECK(MOQ_STAT_GET(&b->stats, rr_sent) && MOQ_STAT_GET(&b->stats, rr_received));
+	CHECK(MOQ_STAT_GET(&a->stats, rtt) > 0 && MOQ_STAT_GET(&a->stats, rtt) < MOQ_MAX_RTT_US);
+	CHECK(MOQ_STAT_GET(&b->stats, rtt) > 0 && MOQ_STAT_GET(&b->stats, rtt) < MOQ_MAX_RTT_US);
+	CHECK(MOQ_STAT_GET(&a->stats, rx_packets) && MOQ_STAT_GET(&b->stats, rx_packets));
+	CHECK(shim_channel_frames(alice, AST_FRAME_VOICE) && shim_channel_frames(bob, AST_FRAME_VOICE));
+
+	/* The RTT column is filled in rather than "-" */
+	CHECK(atoi(show_sessions_column(a, 8)) > 0);
+	CHECK(atoi(show_sessions_column(b, 8)) > 0);
+	if (getenv("MOQ_TEST_VERBOSE")) {
+		static const char *const argv[] = { "moq", "show", "sessions" };
+
+		fputs(cli_run(handle_moq_show_sessions, 3, argv), stderr);
+	}
+
+	ast_hangup(alice);
+	ast_hangup(bob);
+	CHECK(!driver_unload());
+	relay_close(&relay);
+
+	return 0;
+}
+
+/* Video frames leave on the video track, fragmented when larger than a datagram */
+static int test_write_video(void)
+{
+	struct test_relay relay;
+	struct ast_channel *chan;
+	struct moq_session *session;
+	struct moq_fragment frag;
+	struct moq_object obj, first;
+	struct ast_frame frame;
+	static uint8_t picture[5000], received[5000];
+	size_t chunk = 0, got = 0;
+	const uint8_t *msg;
+	char config[128];
+	int i, len, count = 0, seen = 0;
+
+	CHECK(!relay_open(&relay, 1));
+	snprintf(config, sizeof(config), "relay=127.0.0.1:%d\n", ntohs(relay.addr.sin_port));
+	CHECK(!driver_load(config));
+	CHECK((chan = driver_call("alice", &alice_conn, NULL)));
+	session = ast_channel_tech_pvt(chan);
+
+	for (i = 0; i < (int)sizeof(picture); i++) {
+		picture[i] = random();
+	}
+	memset(&frame, 0, sizeof(frame));
+	frame.frametype = AST_FRAME_VIDEO;
+	frame.subclass.format = ast_format_h264;
+	frame.subclass.frame_ending = 1;
+	frame.data.ptr = picture;
+	frame.datalen = sizeof(picture);
+	CHECK(!moq_tech.write(chan, &frame));
+
+	/* One picture, one object, in fragments that put it back together */
+	do {
+		CHECK((len = relay_next(&relay, MOQ_MSG_OBJECT_FRAGMENT, &msg, TEST_TIMEOUT_MS)) >= 0);
+		CHECK(moq_wire_decode_fragment(msg, len, &frag) == MOQ_WIRE_OK);
+		CHECK(frag.track_id == session->video_track_id);
+		CHECK(frag.type == (MOQ_OBJ_VIDEO_H264 | MOQ_OBJ_FLAG_FRAME_END));
+		CHECK(frag.sequence == 0);
+		CHECK(frag.object_size == sizeof(picture));
+		if (!count) {
+			count = frag.count;
+			chunk = moq_wire_fragment_chunk(frag.object_size, frag.count);
+		}
+		CHECK(frag.count == count && frag.index < count && !(seen & (1 << frag.index)));
+		memcpy(received + frag.index * chunk, frag.data, frag.data_len);
+		got += frag.data_len;
+		seen |= 1 << frag.index;
+	} while (seen != (1 << count) - 1);
+	CHECK(count > 1);
+	CHECK(got == sizeof(picture) && !memcmp(received, picture, sizeof(picture)));
+
+	/* A picture in two frames: one timestamp, the end marked on the last */
+	frame.subclass.format = ast_format_vp8;
+	frame.subclass.frame_ending = 0;
+	frame.datalen = 600;
+	CHECK(!moq_tech.write(chan, &frame));
+	frame.subclass.frame_ending = 1;
+	frame.data.ptr = picture + 600;
+	CHECK(!moq_tech.write(chan, &frame));
+	CHECK(!relay_next_object(&relay, session->video_track_id, &first));
+	CHECK(first.type == MOQ_OBJ_VIDEO_VP8 && first.sequence == 1);
+	CHECK(first.payload_len == 600 && !memcmp(first.payload, picture, 600));
+	CHECK(!relay_next_object(&relay, session->video_track_id, &obj));
+	CHECK(obj.type == (MOQ_OBJ_VIDEO_VP8 | MOQ_OBJ_FLAG_FRAME_END) && obj.sequence == 2);
+	CHECK(obj.timestamp == first.timestamp);
+	CHECK(MOQ_STAT_GET(&session->stats, video_tx_objects) == 3);
+
+	ast_hangup(chan);
+	CHECK(!driver_unload());
+	relay_close(&relay);
+
+	return 0;
+}
+
+/*
+ * A MoQ to MoQ call goes on the native bridge, and objects from one side
+ * are relayed to the other below the core, with the other side's track.
+ */
+static int test_native_bridge_skips_core(void)
+{
+	struct test_relay relay;
+	struct ast_channel *alice, *bob;
+	struct moq_session *a, *b;
+	struct sockaddr_in alice_addr, bob_addr;
+	struct ast_bridge_channel bc0 = { 0 }, bc1 = { 0 };
+	struct ast_bridge bridge = { .num_channels = 2 };
+	struct moq_object obj, out;
+	uint8_t data[160];
+	const uint8_t *msg;
+	char config[128];
+	unsigned long long relayed;
+	int i;
+
+	CHECK(!relay_open(&relay, 1));
+	snprintf(config, sizeof(config), "relay=127.0.0.1:%d\n", ntohs(relay.addr.sin_port));
+	CHECK(!driver_load(config));
+	relayed = show_stats_value("Relayed objects:");
+
+	/* Where each session is, from its announcement */
+	CHECK((alice = driver_call("alice", &alice_conn, NULL)));
+	a = ast_channel_tech_pvt(alice);
+	CHECK(relay_next(&relay, MOQ_MSG_ANNOUNCE, &msg, TEST_TIMEOUT_MS) == 8 && announced_track(msg) == a->track_id);
+	alice_addr = relay.from;
+	CHECK((bob = driver_call("bob", &bob_conn, NULL)));
+	b = ast_channel_tech_pvt(bob);
+	CHECK(relay_next(&relay, MOQ_MSG_ANNOUNCE, &msg, TEST_TIMEOUT_MS) == 8 && announced_track(msg) == b->track_id);
+	bob_addr = relay.from;
+
+	/* The core offers the bridge to us, and we take it */
+	bc0.chan = alice;
+	bc1.chan = bob;
+	bc0.entry.next = &bc1;
+	bridge.channels.first = &bc0;
+	bridge.channels.last = &bc1;
+	CHECK(moq_bridge_tech.compatible(&bridge));
+	CHECK(!moq_bridge_tech.join(&bridge, &bc1));
+
+	/* What Alice's end sends arrives at Bob's end as Bob's, without passing the core */
+	for (i = 0; i < (int)sizeof(data); i++) {
+		data[i] = random();
+	}
+	memset(&obj, 0, sizeof(obj));
+	obj.type = MOQ_OBJ_AUDIO_ULAW;
+	obj.track_id = a->track_id;
+	obj.payload = data;
+	obj.payload_len = sizeof(data);
+	for (i = 0; i < 10; i++) {
+		obj.sequence = i;
+		obj.timestamp = i * 160;
+		CHECK(!relay_send_object(&relay, &alice_addr, &obj));
+		CHECK(!relay_next_object(&relay, b->track_id, &out));
+		CHECK(relay.from.sin_port == bob_addr.sin_port);
+		CHECK(out.sequence == (uint64_t)i && out.timestamp == obj.timestamp);
+		CHECK(out.payload_len == sizeof(data) && !memcmp(out.payload, data, sizeof(data)));
+	}
+	/* Counted once sent, so the last may reach the relay just before it is */
+	for (i = 0; i < 100 && MOQ_STAT_GET(&a->stats, fwd_packets) < 10; i++) {
+		usleep(10000);
+	}
+	CHECK(MOQ_STAT_GET(&a->stats, fwd_packets) == 10);
+	CHECK(shim_channel_frames(alice, AST_FRAME_VOICE) == 0);
+	CHECK(shim_channel_frames(bob, AST_FRAME_VOICE) == 0);
+	CHECK(shim_bridge_frames() == 0);
+	CHECK(show_stats_value("Relayed objects:") == relayed + 10);
+	if (getenv("MOQ_TEST_VERBOSE")) {
+		static const char *const argv[] = { "moq", "show", "stats" };
+
+		fputs(cli_run(handle_moq_show_stats, 3, argv), stderr);
+	}
+
+	/* Once the bridge is left, media goes to the core again */
+	moq_bridge_tech.leave(&bridge, &bc0);
+	moq_bridge_tech.leave(&bridge, &bc1);
+	obj.sequence = 10;
+	CHECK(!relay_send_object(&relay, &alice_addr, &obj));
+	for (i = 0; i < 100 && !shim_channel_frames(alice, AST_FRAME_VOICE); i++) {
+		usleep(10000);
+	}
+	CHECK(shim_channel_frames(alice, AST_FRAME_VOICE) == 1);
+	CHECK(MOQ_STAT_GET(&a->stats, fwd_packets) == 10);
+
+	ast_hangup(alice);
+	ast_hangup(bob);
+	CHECK(!driver_unload());
+	relay_close(&relay);
+
+	return 0;
+}
+
+/* Write a frame when it is due, 20 ms after the last, as the core would */
+static int write_paced(struct ast_channel *chan, struct ast_frame *frame, uint64_t *due_ms)
+{
+	uint64_t now = test_now_ms();
+
+	if (!*due_ms) {
+		*due_ms = now;
+	} else if (*due_ms > now) {
+		usleep((*due_ms - now) * 1000);
+	}
+	*due_ms += 20;
+
+	return moq_tech.write(chan, frame);
+}
+
+/* Collect the objects a relay receives on a track until none comes for timeout_ms */
+static int relay_collect_objects(struct test_relay *relay, uint32_t track_id, struct moq_object *objs,
+	uint8_t (*payloads)[MOQ_MAX_PACKET_SIZE], int max, int timeout_ms)
+{
+	const uint8_t *msg;
+	int len, count = 0;
+
+	while (count < max && (len = relay_next(relay, MOQ_MSG_OBJECT, &msg, timeout_ms)) >= 0) {
+		if (moq_wire_decode_object(msg, len, &objs[count]) != MOQ_WIRE_OK || objs[count].track_id != track_id) {
+			continue;
+		}
+		memcpy(payloads[count], objs[count].payload, objs[count].payload_len);
+		objs[count].payload = payloads[count];
+		count++;
+	}
+
+	return count;
+}
+
+/*
+ * With VAD, silence written to a channel is not sent: one comfort noise
+ * object takes its place, then one every cn_interval, and suppressed
+ * frames leave no gap in the sequence, only in the timestamps.
+ */
+static int test_write_dtx(void)
+{
+	struct test_relay relay;
+	struct ast_channel *chan;
+	struct moq_session *session;
+	struct ast_frame speech, silence;
+	static struct moq_object objs[64];
+	static uint8_t payloads[64][MOQ_MAX_PACKET_SIZE];
+	uint8_t speech_data[160], silence_data[160];
+	char config[128];
+	uint64_t due = 0;
+	int i, count;
+
+	CHECK(!relay_open(&relay, 1));
+	snprintf(config, sizeof(config), "relay=127.0.0.1:%d\nvad=yes\ncn_interval=500\n",
+		ntohs(relay.addr.sin_port));
+	CHECK(!driver_load(config));
+	CHECK((chan = driver_call("alice", &alice_conn, NULL)));
+	session = ast_channel_tech_pvt(chan);
+
+	ulaw_frame(&speech, speech_data);
+	silence = speech;
+	silence.data.ptr = silence_data;
+	memset(silence_data, 0xff, sizeof(silence_data));
+
+	/* Silence, speech, then silence again for 20 frames, all within cn_interval */
+	for (i = 0; i < 5; i++) {
+		CHECK(!write_paced(chan, &silence, &due));
+	}
+	for (i = 0; i < 10; i++) {
+		CHECK(!write_paced(chan, &speech, &due));
+	}
+	for (i = 0; i < 20; i++) {
+		CHECK(!write_paced(chan, &silence, &due));
+	}
+	count = relay_collect_objects(&relay, session->track_id, objs, payloads, ARRAY_LEN(objs), 200);
+
+	/*
+	 * Comfort noise for the first silence, speech and the hangover after
+	 * it, then comfort noise again. The four frames after the first are
+	 * skipped in the timestamps only.
+	 */
+	CHECK(count > 12 && count < 35);
+	for (i = 0; i < count; i++) {
+		CHECK(objs[i].sequence == (uint64_t)i);
+		if (!i || i == count - 1) {
+			CHECK(MOQ_OBJ_TYPE(objs[i].type) == MOQ_OBJ_AUDIO_CN);
+			CHECK(objs[i].payload_len == 1);
+		} else {
+			CHECK(objs[i].type == MOQ_OBJ_AUDIO_ULAW && objs[i].payload_len == 160);
+			CHECK(objs[i].timestamp == (uint64_t)(i + 4) * 160);
+		}
+	}
+	CHECK(objs[0].timestamp == 0);
+	CHECK(MOQ_STAT_GET(&session->stats, tx_suppressed) == (uint64_t)(35 - (count - 2)));
+	CHECK(MOQ_STAT_GET(&session->stats, tx_cn) == 2);
+
+	/* Still silent after cn_interval: the noise level is refreshed */
+	due += 500;
+	CHECK(!write_paced(chan, &silence, &due));
+	CHECK(relay_collect_objects(&relay, session->track_id, objs, payloads, 1, 200) == 1);
+	CHECK(MOQ_OBJ_TYPE(objs[0].type) == MOQ_OBJ_AUDIO_CN);
+	CHECK(objs[0].sequence == (uint64_t)count);
+	CHECK(MOQ_STAT_GET(&session->stats, tx_cn) == 3);
+
+	/* Speech again continues the sequence, with the silence showing in the timestamp */
+	CHECK(!write_paced(chan, &speech, &due));
+	CHECK(relay_collect_objects(&relay, session->track_id, objs, payloads, 1, 200) == 1);
+	CHECK(objs[0].type == MOQ_OBJ_AUDIO_ULAW);
+	CHECK(objs[0].sequence == (uint64_t)count + 1);
+	CHECK(objs[0].timestamp > (uint64_t)(count + 1) * 160);
+
+	ast_hangup(chan);
+	CHECK(!driver_unload());
+	relay_close(&relay);
+
+	return 0;
+}
+
+/* Hand one session's media key to another, as signaling would */
+static void give_media_key(const struct moq_session *from, struct moq_session *to)
+{
+	struct json_object *jobj = json_object_new_object();
+	char key[MOQ_CRYPTO_KEY_MAX * 2];
+
+	ast_base64encode(key, from->tx_key, from->tx_key_len, sizeof(key));
+	json_object_object_add(jobj, "media_key", json_object_new_string(key));
+	json_object_object_add(jobj, "media_cipher", json_object_new_string(moq_cipher_name(from->tx_cipher)));
+	moq_set_peer_key(to, jobj);
+	json_object_put(jobj);
+}
+
+/*
+ * With media_encryption, once keys are exchanged everything written leaves
+ * sealed under the session's key, large objects sealed whole and then
+ * fragmented, and the receiving end drops what does not open.
+ */
+static int test_write_sealed(void)
+{
+	struct test_relay relay;
+	struct ast_channel *alice, *bob;
+	struct moq_session *a, *b;
+	struct moq_crypto crypto = { 0 };
+	struct sockaddr_in bob_addr;
+	struct moq_fragment frag;
+	struct moq_object obj;
+	struct ast_frame frame;
+	uint8_t data[160], opened[160];
+	static uint8_t picture[5000], received[5000 + MOQ_CRYPTO_TAG_SIZE];
+	static uint8_t sealed[MOQ_MAX_PACKET_SIZE];
+	size_t chunk = 0, got = 0;
+	const uint8_t *msg;
+	char config[128];
+	int i, len, count = 0, seen = 0;
+
+	CHECK(!relay_open(&relay, 1));
+	snprintf(config, sizeof(config), "relay=127.0.0.1:%d\nmedia_encryption=yes\n",
+		ntohs(relay.addr.sin_port));
+	CHECK(!driver_load(config));
+	CHECK((alice = driver_call("alice", &alice_conn, NULL)));
+	a = ast_channel_tech_pvt(alice);
+	CHECK(relay_next(&relay, MOQ_MSG_ANNOUNCE, &msg, TEST_TIMEOUT_MS) == 8);
+	CHECK((bob = driver_call("bob", &bob_conn, alice)));
+	b = ast_channel_tech_pvt(bob);
+	CHECK(relay_next(&relay, MOQ_MSG_ANNOUNCE, &msg, TEST_TIMEOUT_MS) == 8);
+	bob_addr = relay.from;
+
+	CHECK(a->tx_key_len && b->tx_key_len);
+	give_media_key(a, b);
+	give_media_key(b, a);
+	CHECK(a->tx_protected && a->rx_protected && b->tx_protected && b->rx_protected);
+
+	/* Audio leaves sealed, with the header readable, and opens under Alice's key */
+	ulaw_frame(&frame, data);
+	CHECK(!moq_tech.write(alice, &frame));
+	CHECK(!relay_next_object(&relay, a->track_id, &obj));
+	CHECK(obj.type == (MOQ_OBJ_AUDIO_ULAW | MOQ_OBJ_FLAG_ENCRYPTED));
+	CHECK(obj.sequence == 0);
+	CHECK(obj.payload_len == sizeof(data) + MOQ_CRYPTO_TAG_SIZE);
+	CHECK(memcmp(obj.payload, data, sizeof(data)));
+	CHECK(!moq_crypto_init(&crypto, a->tx_cipher, a->tx_key, 0));
+	CHECK(moq_crypto_open(&crypto, &obj, opened) == sizeof(data));
+	CHECK(!memcmp(opened, data, sizeof(data)));
+
+	/* Bob's end drops a tampered or unsealed copy, then opens the real one */
+	memcpy(sealed, obj.payload, obj.payload_len);
+	obj.payload = sealed;
+	sealed[0] ^= 1;
+	CHECK(!relay_send_object(&relay, &bob_addr, &obj));
+	sealed[0] ^= 1;
+	obj.type = MOQ_OBJ_AUDIO_ULAW;
+	obj.payload = data;
+	obj.payload_len = sizeof(data);
+	CHECK(!relay_send_object(&relay, &bob_addr, &obj));
+	for (i = 0; i < 100 && MOQ_STAT_GET(&b->stats, rx_auth_failed) < 2; i++) {
+		usleep(10000);
+	}
+	CHECK(MOQ_STAT_GET(&b->stats, rx_auth_failed) == 2);
+	CHECK(shim_channel_frames(bob, AST_FRAME_VOICE) == 0);
+	obj.type |= MOQ_OBJ_FLAG_ENCRYPTED;
+	obj.payload = sealed;
+	obj.payload_len = sizeof(data) + MOQ_CRYPTO_TAG_SIZE;
+	CHECK(!relay_send_object(&relay, &bob_addr, &obj));
+	for (i = 0; i < 100 && !shim_channel_frames(bob, AST_FRAME_VOICE); i++) {
+		usleep(10000);
+	}
+	CHECK(shim_channel_frames(bob, AST_FRAME_VOICE) == 1);
+	CHECK(MOQ_STAT_GET(&b->stats, rx_auth_failed) == 2);
+
+	/* A picture larger than a datagram is sealed whole, then fragmented */
+	for (i = 0; i < (int)sizeof(picture); i++) {
+		picture[i] = random();
+	}
+	memset(&frame, 0, sizeof(frame));
+	frame.frametype = AST_FRAME_VIDEO;
+	frame.subclass.format = ast_format_h264;
+	frame.subclass.frame_ending = 1;
+	frame.data.ptr = picture;
+	frame.datalen = sizeof(picture);
+	CHECK(!moq_tech.write(alice, &frame));
+	do {
+		CHECK((len = relay_next(&relay, MOQ_MSG_OBJECT_FRAGMENT, &msg, TEST_TIMEOUT_MS)) >= 0);
+		CHECK(moq_wire_decode_fragment(msg, len, &frag) == MOQ_WIRE_OK);
+		CHECK(frag.type == (MOQ_OBJ_VIDEO_H264 | MOQ_OBJ_FLAG_FRAME_END | MOQ_OBJ_FLAG_ENCRYPTED));
+		CHECK(frag.object_size == sizeof(received));
+		if (!count) {
+			count = frag.count;
+			chunk = moq_wire_fragment_chunk(frag.object_size, frag.count);
+		}
+		CHECK(frag.count == count && frag.index < count && !(seen & (1 << frag.index)));
+		memcpy(received + frag.index * chunk, frag.data, frag.data_len);
+		got += frag.data_len;
+		seen |= 1 << frag.index;
+	} while (seen != (1 << count) - 1);
+	CHECK(count > 1 && got == sizeof(received));
+	memset(&obj, 0, sizeof(obj));
+	obj.type = frag.type;
+	obj.track_id = frag.track_id;
+	obj.sequence = frag.sequence;
+	obj.timestamp = frag.timestamp;
+	obj.payload = received;
+	obj.payload_len = sizeof(received);
+	CHECK(moq_crypto_open(&crypto, &obj, received) == sizeof(picture));
+	CHECK(!memcmp(received, picture, sizeof(picture)));
+	moq_crypto_destroy(&crypto);
+
+	ast_hangup(alice);
+	ast_hangup(bob);
+	CHECK(!driver_unload());
+	relay_close(&relay);
+
+	return 0;
+}
+
+/*
+ * With tap, what a call sends and receives is mirrored into its segment
+ * file, readable while the call is up and closed when it ends.
+ */
+static int test_write_tapped(void)
+{
+	struct test_relay relay;
+	struct ast_channel *chan;
+	struct moq_session *session;
+	struct moq_tap_segment seg;
+	const struct moq_tap_record *rec;
+	struct sockaddr_in alice_addr;
+	struct moq_object obj;
+	struct ast_frame frame;
+	uint8_t data[160];
+	char dir[] = "/tmp/moq_tap_test.XXXXXX";
+	char config[256], path[512];
+	const uint8_t *msg;
+	int i;
+
+	CHECK(mkdtemp(dir));
+	CHECK(!relay_open(&relay, 1));
+	snprintf(config, sizeof(config), "relay=127.0.0.1:%d\ntap=yes\ntap_dir=%s\n",
+		ntohs(relay.addr.sin_port), dir);
+	CHECK(!driver_load(config));
+	CHECK((chan = driver_call("alice", &alice_conn, NULL)));
+	session = ast_channel_tech_pvt(chan);
+	CHECK(session->tap);
+	CHECK(relay_next(&relay, MOQ_MSG_ANNOUNCE, &msg, TEST_TIMEOUT_MS) == 8);
+	alice_addr = relay.from;
+	ast_copy_string(path, session->tap->path, sizeof(path));
+
+	/* Three frames out, one object in */
+	ulaw_frame(&frame, data);
+	for (i = 0; i < 3; i++) {
+		data[0] = i;
+		CHECK(!moq_tech.write(chan, &frame));
+		CHECK(!relay_next_object(&relay, session->track_id, &obj));
+	}
+	memset(&obj, 0, sizeof(obj));
+	obj.type = MOQ_OBJ_AUDIO_ULAW;
+	obj.track_id = session->track_id;
+	obj.sequence = 7;
+	obj.timestamp = 1120;
+	obj.payload = data;
+	obj.payload_len = sizeof(data);
+	CHECK(!relay_send_object(&relay, &alice_addr, &obj));
+	for (i = 0; i < 100 && !shim_channel_frames(chan, AST_FRAME_VOICE); i++) {
+		usleep(10000);
+	}
+	CHECK(shim_channel_frames(chan, AST_FRAME_VOICE) == 1);
+
+	/* The open segment already holds all four, payloads included */
+	CHECK(!moq_tap_map(path, &seg));
+	CHECK(seg.count == 4 && !seg.header->closed);
+	CHECK(!strcmp(seg.header->session_id, session->session_id));
+	for (i = 0; i < 3; i++) {
+		CHECK((rec = moq_tap_record(&seg, i)));
+		CHECK(rec->direction == MOQ_TAP_TX && rec->type == MOQ_OBJ_AUDIO_ULAW);
+		CHECK(rec->track_id == session->track_id);
+		CHECK(rec->sequence == (uint64_t)i && rec->timestamp == (uint64_t)i * 160);
+		CHECK(rec->payload_len == sizeof(data));
+		CHECK(((const uint8_t *)(rec + 1))[0] == i);
+		CHECK(seg.index[i].sequence == (uint64_t)i && seg.index[i].direction == MOQ_TAP_TX);
+	}
+	CHECK((rec = moq_tap_record(&seg, 3)));
+	CHECK(rec->direction == MOQ_TAP_RX && rec->sequence == 7 && rec->timestamp == 1120);
+	CHECK(!memcmp(rec + 1, data, sizeof(data)));
+	CHECK(moq_tap_seek(&seg, seg.index[1].time_us) <= 1);
+	CHECK(moq_tap_seek(&seg, seg.index[3].time_us + 1) == 4);
+	moq_tap_unmap(&seg);
+
+	/* Hanging up closes the segment */
+	ast_hangup(chan);
+	CHECK(!driver_unload());
+	CHECK(!moq_tap_map(path, &seg));
+	CHECK(seg.count == 4 && seg.header->closed);
+	moq_tap_unmap(&seg);
+	relay_close(&relay);
+	unlink(path);
+	rmdir(dir);
+
+	return 0;
+}
+
+/* Whether a session is idle in the pool, waiting at most timeout_ms for the reaper to put it there */
+static int pool_holds(const struct moq_session *session, int timeout_ms)
+{
+	uint64_t deadline = test_now_ms() + timeout_ms;
+	struct moq_session *idle;
+	int found = 0;
+
+	do {
+		ast_mutex_lock(&moq_pool_lock);
+		AST_LIST_TRAVERSE(&moq_pool.idle, idle, pool_entry) {
+			found |= idle == session;
+		}
+		ast_mutex_unlock(&moq_pool_lock);
+	} while (!found && !usleep(10000) && test_now_ms() < deadline);
+
+	return found;
+}
+
+/* A session recycled into the pool keeps no key of the call it served */
+static int test_pool_forgets_keys(void)
+{
+	static const uint8_t zero[MOQ_CRYPTO_KEY_MAX];
+	struct test_relay relay;
+	struct ast_channel *alice, *bob;
+	struct moq_session *a, *b;
+	uint8_t old_key[MOQ_CRYPTO_KEY_MAX];
+	char config[128];
+	uint64_t deadline;
+	int idle;
+
+	CHECK(!relay_open(&relay, 1));
+	snprintf(config, sizeof(config), "relay=127.0.0.1:%d\nmedia_encryption=yes\npool_size=4\n",
+		ntohs(relay.addr.sin_port));
+	CHECK(!driver_load(config));
+
+	/* Once the pool is warm, a session hung up goes back to it rather than being freed */
+	deadline = test_now_ms() + TEST_TIMEOUT_MS;
+	do {
+		ast_mutex_lock(&moq_pool_lock);
+		idle = moq_pool.count;
+		ast_mutex_unlock(&moq_pool_lock);
+	} while (idle < 4 && !usleep(10000) && test_now_ms() < deadline);
+	CHECK(idle == 4);
+	CHECK((alice = driver_call("alice", &alice_conn, NULL)));
+	CHECK((bob = driver_call("bob", &bob_conn, alice)));
+	a = ast_channel_tech_pvt(alice);
+	b = ast_channel_tech_pvt(bob);
+	give_media_key(a, b);
+	give_media_key(b, a);
+	CHECK(a->tx_protected && a->rx_protected && a->tx_crypto.ctx && a->rx_crypto.ctx);
+	memcpy(old_key, a->tx_key, sizeof(old_key));
+
+	ast_hangup(alice);
+	CHECK(pool_holds(a, TEST_TIMEOUT_MS));
+	CHECK(!a->tx_protected && !a->rx_protected);
+	CHECK(!a->tx_key_len && !memcmp(a->tx_key, zero, sizeof(zero)));
+	CHECK(!a->rx_key_len && !memcmp(a->rx_key, zero, sizeof(zero)));
+	CHECK(!memcmp(a->tx_crypto.salt, zero, MOQ_CRYPTO_SALT_SIZE));
+	CHECK(!memcmp(a->rx_crypto.salt, zero, MOQ_CRYPTO_SALT_SIZE));
+
+	/* Taken again, it gets a key of its own and waits for the new peer's */
+	CHECK((alice = driver_call("alice", &alice_conn, NULL)));
+	CHECK(ast_channel_tech_pvt(alice) == a);
+	CHECK(a->tx_key_len && memcmp(a->tx_key, old_key, sizeof(old_key)));
+	CHECK(!a->tx_protected && !a->rx_protected);
+
+	ast_hangup(alice);
+	ast_hangup(bob);
+	CHECK(!driver_unload());
+	relay_close(&relay);
+
+	return 0;
+}
+
+/* Offers and answers name the relay tracks of the call, for endpoints that reach it through the relay */
+static int test_call_names_tracks(void)
+{
+	struct test_relay relay;
+	struct ast_channel *chan;
+	struct moq_session *session;
+	struct json_object *jobj;
+	char config[128], msg[1024];
+
+	CHECK(!relay_open(&relay, 1));
+	snprintf(config, sizeof(config), "relay=127.0.0.1:%d\n", ntohs(relay.addr.sin_port));
+	CHECK(!driver_load(config));
+	CHECK((chan = driver_call("alice", &alice_conn, NULL)));
+	session = ast_channel_tech_pvt(chan);
+
+	CHECK(shim_ws_take(&alice_conn, msg, sizeof(msg)) > 0);
+	CHECK((jobj = json_tokener_parse(msg)));
+	CHECK(!strcmp(json_object_get_string(json_object_object_get(jobj, "type")), "incoming_call"));
+	CHECK(moq_json_int64(jobj, "track_id") == session->track_id);
+	CHECK(moq_json_int64(jobj, "video_track_id") == session->video_track_id);
+	json_object_put(jobj);
+
+	CHECK(!moq_send_answer(session));
+	CHECK(shim_ws_take(&alice_conn, msg, sizeof(msg)) > 0);
+	CHECK((jobj = json_tokener_parse(msg)));
+	CHECK(!strcmp(json_object_get_string(json_object_object_get(jobj, "type")), "call_answered"));
+	CHECK(moq_json_int64(jobj, "track_id") == session->track_id);
+	json_object_put(jobj);
+
+	ast_hangup(chan);
+	CHECK(!driver_unload());
+	relay_close(&relay);
+
+	return 0;
+}
+
+/* A handoff resumes its call once; presented again, even after that call ended, it is refused */
+static int test_handoff_used_once(void)
+{
+	struct test_relay relay;
+	struct ast_channel *chan;
+	struct json_object *handoff, *resume, *jobj;
+	char config[128], session_id[64], msg[1024];
+	int refused = 0;
+
+	CHECK(!relay_open(&relay, 1));
+	snprintf(config, sizeof(config), "relay=127.0.0.1:%d\nhandoff_secret=secret\n",
+		ntohs(relay.addr.sin_port));
+	CHECK(!driver_load(config));
+	CHECK((chan = driver_call("alice", &alice_conn, NULL)));
+	ast_copy_string(session_id, ((struct moq_session *)ast_channel_tech_pvt(chan))->session_id,
+		sizeof(session_id));
+	CHECK((handoff = moq_handoff_create(ast_channel_tech_pvt(chan), time(NULL) + MOQ_HANDOFF_TTL)));
+	ast_hangup(chan);
+	CHECK(!moq_session_exists(session_id));
+	shim_ws_clear();
+
+	resume = json_object_new_object();
+	json_object_object_add(resume, "type", json_object_new_string("resume"));
+	json_object_object_add(resume, "handoff", handoff);
+	moq_handle_resume((void *)&bob_conn, resume, moq_monotonic_us());
+	CHECK(shim_ws_take(&bob_conn, msg, sizeof(msg)) <= 0);
+	CHECK((chan = moq_session_owner_ref(session_id, NULL)));
+	ast_hangup(chan);
+	ast_channel_unref(chan);
+	CHECK(!moq_session_exists(session_id));
+	shim_ws_clear();
+	moq_handle_resume((void *)&bob_conn, resume, moq_monotonic_us());
+	CHECK(shim_ws_take(&bob_conn, msg, sizeof(msg)) > 0);
+	CHECK((jobj = json_tokener_parse(msg)));
+	refused = !strcmp(json_object_get_string(json_object_object_get(jobj, "type")), "resume_failed") &&
+		!strcmp(json_object_get_string(json_object_object_get(jobj, "reason")), "used");
+	json_object_put(jobj);
+	json_object_put(resume);
+	CHECK(refused);
+	CHECK(!moq_session_exists(session_id));
+
+	CHECK(!driver_unload());
+	relay_close(&relay);
+
+	return 0;
+}
+
+static const struct {
+	const char *name;
+	int (*run)(void);
+} tests[] = {
+	{ "write_reaches_relay", test_write_reaches_relay },
+	{ "write_follows_failover", test_write_follows_failover },
+	{ "receiver_reports_both_ways", test_receiver_reports_both_ways },
+	{ "write_video", test_write_video },
+	{ "native_bridge_skips_core", test_native_bridge_skips_core },
+	{ "write_dtx", test_write_dtx },
+	{ "write_sealed", test_write_sealed },
+	{ "write_tapped", test_write_tapped },
+	{ "pool_forgets_keys", test_pool_forgets_keys },
+	{ "call_names_tracks", test_call_names_tracks },
+	{ "handoff_used_once", test_handoff_used_once },
+};
+
+int main(int argc, char *argv[])
+{
+	int i, j, run = 0, failed = 0;
+
+	srandom(time(NULL) ^ getpid());
+
+	for (i = 0; i < (int)ARRAY_LEN(tests); i++) {
+		int selected = argc < 2;
+
+		for (j = 1; j < argc; j++) {
+			selected |= strstr(tests[i].name, argv[j]) != NULL;
+		}
+		if (!selected) {
+			continue;
+		}
+		run++;
+		if (tests[i].run()) {
+			printf("FAIL %s\n", tests[i].name);
+			failed++;
+		} else {
+			printf("ok   %s\n", tests[i].name);
+		}
+	}
+
+	printf("%d of %d tests passed\n", run - failed, run);
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,521 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/*
+ * Stand-in for the parts of the Asterisk API chan_moq uses, so the driver
+ * can be built and driven by test/moq_driver_test.c without an Asterisk
+ * tree. Every <asterisk/...> header chan_moq includes resolves to this one.
+ * Types the driver looks inside (frames, bridges, CLI arguments) follow the
+ * real layouts closely enough for its use; the rest are opaque and
+ * implemented in shim.c. Nothing here is meant for anything but the tests.
+ */
+
+#ifndef MOQ_TEST_SHIM_ASTERISK_H
+#define MOQ_TEST_SHIM_ASTERISK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+
+#define ASTERISK_GPL_KEY "shim"
+#define AST_MAX_CONTEXT 80
+#define AST_MAX_EXTENSION 80
+
+/* Logging */
+#define __LOG_DEBUG 0
+#define __LOG_NOTICE 2
+#define __LOG_WARNING 3
+#define __LOG_ERROR 4
+#define LOG_DEBUG __LOG_DEBUG, __FILE__, __LINE__, __func__
+#define LOG_NOTICE __LOG_NOTICE, __FILE__, __LINE__, __func__
+#define LOG_WARNING __LOG_WARNING, __FILE__, __LINE__, __func__
+#define LOG_ERROR __LOG_ERROR, __FILE__, __LINE__, __func__
+void ast_log(int level, const char *file, int line, const char *function, const char *fmt, ...)
+	__attribute__((format(printf, 5, 6)));
+#define ast_debug(level, ...) do { (void)(level); ast_log(LOG_DEBUG, __VA_ARGS__); } while (0)
+#define ast_verb(level, ...) do { (void)(level); ast_log(LOG_NOTICE, __VA_ARGS__); } while (0)
+
+/* Memory and strings */
+#define ast_calloc(n, s) calloc(n, s)
+#define ast_malloc(s) malloc(s)
+#define ast_realloc(p, s) realloc(p, s)
+#define ast_free(p) free(p)
+#define ast_strdup(s) strdup(s)
+#define ast_strlen_zero(s) (!(s) || !*(s))
+#define ARRAY_LEN(a) (sizeof(a) / sizeof((a)[0]))
+#define S_OR(a, b) (!ast_strlen_zero(a) ? (a) : (b))
+#define S_COR(a, b, c) ({ int __x = !!(a); (__x && !ast_strlen_zero(b)) ? (b) : (c); })
+#define attribute_unused __attribute__((unused))
+#define ast_test_flag(p, f) ((p)->flags & (f))
+#define ast_set_flag(p, f) ((p)->flags |= (f))
+#define ast_clear_flag(p, f) ((p)->flags &= ~(f))
+void ast_copy_string(char *dst, const char *src, size_t size);
+long ast_random(void);
+int ast_true(const char *val);
+int ast_false(const char *val);
+int ast_base64encode(char *dst, const unsigned char *src, int srclen, int max);
+int ast_base64decode(unsigned char *dst, const char *src, int max);
+int ast_mkdir(const char *path, int mode);
+
+/* Locking and threads */
+typedef pthread_mutex_t ast_mutex_t;
+typedef pthread_cond_t ast_cond_t;
+#define AST_MUTEX_DEFINE_STATIC(m) static ast_mutex_t m = PTHREAD_MUTEX_INITIALIZER
+#define ast_mutex_init(m) pthread_mutex_init(m, NULL)
+#define ast_mutex_destroy(m) pthread_mutex_destroy(m)
+#define ast_mutex_lock(m) pthread_mutex_lock(m)
+#define ast_mutex_unlock(m) pthread_mutex_unlock(m)
+#define ast_mutex_trylock(m) pthread_mutex_trylock(m)
+#define ast_cond_init(c, a) pthread_cond_init(c, a)
+#define ast_cond_destroy(c) pthread_cond_destroy(c)
+#define ast_cond_wait(c, m) pthread_cond_wait(c, m)
+#define ast_cond_timedwait(c, m, t) pthread_cond_timedwait(c, m, t)
+#define ast_cond_signal(c) pthread_cond_signal(c)
+#define ast_cond_broadcast(c) pthread_cond_broadcast(c)
+#define AST_PTHREADT_NULL (pthread_t)~0
+#define ast_pthread_create_background(t, a, f, d) pthread_create(t, a, f, d)
+#define ast_pthread_create(t, a, f, d) pthread_create(t, a, f, d)
+
+/* Time */
+struct timeval ast_tvnow(void);
+int64_t ast_tvdiff_ms(struct timeval end, struct timeval start);
+int64_t ast_tvdiff_us(struct timeval end, struct timeval start);
+int ast_tvzero(struct timeval t);
+struct timeval ast_tvadd(struct timeval a, struct timeval b);
+struct timeval ast_tv(long sec, long usec);
+
+/* Addresses */
+struct ast_sockaddr {
+	struct sockaddr_storage ss;
+	socklen_t len;
+};
+
+/* Reference counted objects */
+#define AO2_ALLOC_OPT_LOCK_MUTEX 0
+#define AO2_ALLOC_OPT_LOCK_NOLOCK 2
+typedef void (*ao2_destructor_fn)(void *obj);
+struct ao2_container;
+void *ao2_alloc_options(size_t size, ao2_destructor_fn destructor, unsigned int options);
+#define ao2_alloc(size, destructor) ao2_alloc_options(size, destructor, AO2_ALLOC_OPT_LOCK_MUTEX)
+int ao2_ref(void *obj, int delta);
+#define ao2_bump(obj) ({ __typeof__(obj) __o = (obj); if (__o) { ao2_ref(__o, +1); } __o; })
+#define ao2_cleanup(obj) do { void *__o = (obj); if (__o) { ao2_ref(__o, -1); } } while (0)
+int ao2_container_count(struct ao2_container *c);
+
+/* Lists */
+#define AST_LIST_HEAD_NOLOCK(name, type) struct name { struct type *first; struct type *last; }
+#define AST_LIST_HEAD_NOLOCK_INIT_VALUE { NULL, NULL }
+#define AST_LIST_HEAD_INIT_NOLOCK(head) do { (head)->first = NULL; (head)->last = NULL; } while (0)
+#define AST_LIST_ENTRY(type) struct { struct type *next; }
+#define AST_LIST_FIRST(head) ((head)->first)
+#define AST_LIST_LAST(head) ((head)->last)
+#define AST_LIST_EMPTY(head) (AST_LIST_FIRST(head) == NULL)
+#define AST_LIST_NEXT(elm, field) ((elm)->field.next)
+#define AST_LIST_TRAVERSE(head, var, field) \
+	for ((var) = (head)->first; (var); (var) = (var)->field.next)
+#define AST_LIST_INSERT_HEAD(head, elm, field) do { \
+		(elm)->field.next = (head)->first; \
+		(head)->first = (elm); \
+		if (!(head)->last) { \
+			(head)->last = (elm); \
+		} \
+	} while (0)
+#define AST_LIST_INSERT_TAIL(head, elm, field) do { \
+		__typeof__(elm) __e = (elm); \
+		__e->field.next = NULL; \
+		if (!(head)->first) { \
+			(head)->first = __e; \
+		} else { \
+			(head)->last->field.next = __e; \
+		} \
+		(head)->last = __e; \
+	} while (0)
+#define AST_LIST_APPEND_LIST(head, list, field) do { \
+		if ((list)->first) { \
+			if (!(head)->first) { \
+				(head)->first = (list)->first; \
+			} else { \
+				(head)->last->field.next = (list)->first; \
+			} \
+			(head)->last = (list)->last; \
+			(list)->first = NULL; \
+			(list)->last = NULL; \
+		} \
+	} while (0)
+#define AST_LIST_TRAVERSE_SAFE_BEGIN(head, var, field) { \
+		__typeof__(head) __list_head = (head); \
+		__typeof__(__list_head->first) __list_prev = NULL, __list_current, __list_next; \
+		for ((var) = __list_head->first; \
+			(__list_current = (var)) && ((__list_next = (var)->field.next), 1); \
+			__list_prev = __list_current ? __list_current : __list_prev, (var) = __list_next) {
+#define AST_LIST_REMOVE_CURRENT(field) do { \
+		if (__list_prev) { \
+			__list_prev->field.next = __list_next; \
+		} else { \
+			__list_head->first = __list_next; \
+		} \
+		if (__list_head->last == __list_current) { \
+			__list_head->last = __list_prev; \
+		} \
+		__list_current->field.next = NULL; \
+		__list_current = NULL; \
+	} while (0)
+#define AST_LIST_TRAVERSE_SAFE_END } }
+#define AST_LIST_REMOVE_HEAD(head, field) ({ \
+		__typeof__((head)->first) __cur = (head)->first; \
+		if (__cur) { \
+			(head)->first = __cur->field.next; \
+			__cur->field.next = NULL; \
+			if ((head)->last == __cur) { \
+				(head)->last = NULL; \
+			} \
+		} \
+		__cur; \
+	})
+#define AST_LIST_REMOVE(head, elm, field) ({ \
+		__typeof__(elm) __found = NULL, __prev = NULL, __cur; \
+		for (__cur = (head)->first; __cur; __prev = __cur, __cur = __cur->field.next) { \
+			if (__cur == (elm)) { \
+				__found = __cur; \
+				if (__prev) { \
+					__prev->field.next = __cur->field.next; \
+				} else { \
+					(head)->first = __cur->field.next; \
+				} \
+				if ((head)->last == __cur) { \
+					(head)->last = __prev; \
+				} \
+				__cur->field.next = NULL; \
+				break; \
+			} \
+		} \
+		__found; \
+	})
+
+/* Modules */
+enum ast_module_load_result {
+	AST_MODULE_LOAD_SUCCESS = 0,
+	AST_MODULE_LOAD_DECLINE = 1,
+	AST_MODULE_LOAD_FAILURE = -1
+};
+/* The tests call load_module() and unload_module() themselves */
+#define AST_MODULE_INFO_STANDARD(key, desc) \
+	static int (*const __moq_shim_module[2])(void) attribute_unused = { load_module, unload_module }
+
+/* Configuration */
+struct ast_config;
+struct ast_variable {
+	const char *name;
+	const char *value;
+	struct ast_variable *next;
+	int lineno;
+};
+struct ast_flags {
+	unsigned int flags;
+};
+#define CONFIG_FLAG_FILEUNCHANGED (1 << 1)
+#define CONFIG_STATUS_FILEUNCHANGED ((struct ast_config *)-1)
+#define CONFIG_STATUS_FILEINVALID ((struct ast_config *)-2)
+struct ast_config *ast_config_load(const char *filename, struct ast_flags flags);
+struct ast_variable *ast_variable_browse(const struct ast_config *config, const char *category);
+void ast_config_destroy(struct ast_config *config);
+extern const char *ast_config_AST_SPOOL_DIR;
+
+/* Formats */
+struct ast_format;
+struct ast_format_cap;
+extern struct ast_format *ast_format_ulaw, *ast_format_alaw, *ast_format_h264, *ast_format_vp8,
+	*ast_format_slin;
+#define AST_FORMAT_CAP_FLAG_DEFAULT 0
+enum ast_media_type {
+	AST_MEDIA_TYPE_UNKNOWN,
+	AST_MEDIA_TYPE_AUDIO,
+	AST_MEDIA_TYPE_VIDEO
+};
+enum ast_format_cmp_res {
+	AST_FORMAT_CMP_NOT_EQUAL = 0,
+	AST_FORMAT_CMP_EQUAL,
+	AST_FORMAT_CMP_SUBSET
+};
+struct ast_format_cap *ast_format_cap_alloc(int flags);
+int ast_format_cap_append(struct ast_format_cap *cap, struct ast_format *format, unsigned int framing);
+struct ast_format *ast_format_cap_get_best_by_type(const struct ast_format_cap *cap,
+	enum ast_media_type type);
+enum ast_format_cmp_res ast_format_cmp(const struct ast_format *a, const struct ast_format *b);
+
+/* Frames */
+enum ast_frame_type {
+	AST_FRAME_DTMF_END = 1,
+	AST_FRAME_VOICE,
+	AST_FRAME_VIDEO,
+	AST_FRAME_CONTROL,
+	AST_FRAME_NULL,
+	AST_FRAME_IAX,
+	AST_FRAME_TEXT,
+	AST_FRAME_IMAGE,
+	AST_FRAME_HTML,
+	AST_FRAME_CNG,
+	AST_FRAME_MODEM,
+	AST_FRAME_DTMF_BEGIN
+};
+enum {
+	AST_FRFLAG_HAS_TIMING_INFO = (1 << 0)
+};
+struct ast_frame_subclass {
+	int integer;
+	struct ast_format *format;
+	unsigned int frame_ending;
+};
+struct ast_frame {
+	enum ast_frame_type frametype;
+	struct ast_frame_subclass subclass;
+	int datalen;
+	int samples;
+	int mallocd;
+	size_t mallocd_hdr_len;
+	int offset;
+	const char *src;
+	union {
+		void *ptr;
+		uint32_t uint32;
+	} data;
+	struct timeval delivery;
+	unsigned int flags;
+	long ts;
+	long len;
+	int seqno;
+	int stream_num;
+};
+extern struct ast_frame ast_null_frame;
+
+/* Channels */
+struct ast_channel;
+struct ast_assigned_ids;
+enum ast_channel_state {
+	AST_STATE_DOWN,
+	AST_STATE_RESERVED,
+	AST_STATE_OFFHOOK,
+	AST_STATE_DIALING,
+	AST_STATE_RING,
+	AST_STATE_RINGING,
+	AST_STATE_UP,
+	AST_STATE_BUSY
+};
+enum ast_control_frame_type {
+	AST_CONTROL_HANGUP = 1,
+	AST_CONTROL_RING,
+	AST_CONTROL_RINGING,
+	AST_CONTROL_ANSWER,
+	AST_CONTROL_BUSY,
+	AST_CONTROL_CONGESTION = 8,
+	AST_CONTROL_PROGRESS = 14,
+	AST_CONTROL_PROCEEDING = 15,
+	AST_CONTROL_VIDUPDATE = 18,
+	AST_CONTROL_SRCUPDATE = 20,
+	AST_CONTROL_SRCCHANGE = 26
+};
+enum {
+	AST_SOFTHANGUP_DEV = 1,
+	AST_SOFTHANGUP_SHUTDOWN = 8,
+	AST_SOFTHANGUP_APPUNLOAD = 16,
+	AST_SOFTHANGUP_EXPLICIT = 32
+};
+struct ast_channel_tech {
+	const char *type;
+	const char *description;
+	struct ast_format_cap *capabilities;
+	unsigned int properties;
+	struct ast_channel *(*requester)(const char *type, struct ast_format_cap *cap,
+		const struct ast_assigned_ids *assignedids, const struct ast_channel *requestor,
+		const char *addr, int *cause);
+	int (*call)(struct ast_channel *chan, const char *addr, int timeout);
+	int (*hangup)(struct ast_channel *chan);
+	int (*answer)(struct ast_channel *chan);
+	struct ast_frame *(*read)(struct ast_channel *chan);
+	int (*write)(struct ast_channel *chan, struct ast_frame *frame);
+	int (*write_video)(struct ast_channel *chan, struct ast_frame *frame);
+	int (*indicate)(struct ast_channel *chan, int condition, const void *data, size_t datalen);
+	int (*fixup)(struct ast_channel *oldchan, struct ast_channel *newchan);
+};
+/* Returns the channel locked, as the real one does */
+#define ast_channel_alloc(needqueue, state, cid_num, cid_name, acctcode, exten, context, \
+	assignedids, requestor, amaflag, ...) \
+	__ast_channel_alloc(state, cid_num, exten, context, __VA_ARGS__)
+struct ast_channel *__ast_channel_alloc(int state, const char *cid_num, const char *exten,
+	const char *context, const char *name_fmt, ...) __attribute__((format(printf, 5, 6)));
+int ast_channel_register(const struct ast_channel_tech *tech);
+void ast_channel_unregister(const struct ast_channel_tech *tech);
+void ast_channel_tech_set(struct ast_channel *chan, const struct ast_channel_tech *tech);
+const struct ast_channel_tech *ast_channel_tech(const struct ast_channel *chan);
+void ast_channel_nativeformats_set(struct ast_channel *chan, struct ast_format_cap *cap);
+void ast_channel_set_writeformat(struct ast_channel *chan, struct ast_format *format);
+void ast_channel_set_readformat(struct ast_channel *chan, struct ast_format *format);
+void ast_channel_set_rawwriteformat(struct ast_channel *chan, struct ast_format *format);
+void ast_channel_set_rawreadformat(struct ast_channel *chan, struct ast_format *format);
+struct ast_format *ast_channel_rawreadformat(struct ast_channel *chan);
+struct ast_format *ast_channel_rawwriteformat(struct ast_channel *chan);
+void *ast_channel_tech_pvt(const struct ast_channel *chan);
+void ast_channel_tech_pvt_set(struct ast_channel *chan, void *pvt);
+void ast_channel_lock(struct ast_channel *chan);
+void ast_channel_unlock(struct ast_channel *chan);
+const char *ast_channel_name(const struct ast_channel *chan);
+struct ast_channel *ast_channel_ref(struct ast_channel *chan);
+struct ast_channel *ast_channel_unref(struct ast_channel *chan);
+int ast_channel_has_audio_frame_or_monitor(struct ast_channel *chan);
+int ast_channel_has_hook_requiring_audio(struct ast_channel *chan);
+int ast_setstate(struct ast_channel *chan, enum ast_channel_state state);
+int ast_queue_frame(struct ast_channel *chan, const struct ast_frame *frame);
+int ast_queue_control(struct ast_channel *chan, enum ast_control_frame_type control);
+int ast_queue_hangup_with_cause(struct ast_channel *chan, int cause);
+int ast_softhangup(struct ast_channel *chan, int reason);
+int ast_hangup(struct ast_channel *chan);
+int ast_pbx_start(struct ast_channel *chan);
+int ast_exists_extension(struct ast_channel *chan, const char *context, const char *exten,
+	int priority, const char *callerid);
+int pbx_builtin_setvar_helper(struct ast_channel *chan, const char *name, const char *value);
+struct ast_party_name {
+	char *str;
+	int valid;
+};
+struct ast_party_number {
+	char *str;
+	int valid;
+};
+struct ast_party_id {
+	struct ast_party_name name;
+	struct ast_party_number number;
+};
+struct ast_party_caller {
+	struct ast_party_id id;
+};
+struct ast_party_caller *ast_channel_caller(struct ast_channel *chan);
+#define AST_CAUSE_NO_ROUTE_DESTINATION 3
+#define AST_CAUSE_NORMAL_CLEARING 16
+#define AST_CAUSE_USER_BUSY 17
+#define AST_CAUSE_SUBSCRIBER_ABSENT 20
+#define AST_CAUSE_CONGESTION 34
+#define AST_CAUSE_FAILURE 38
+#define AST_CAUSE_REQUESTED_CHAN_UNAVAIL 44
+
+/* CLI */
+enum {
+	CLI_INIT = -2,
+	CLI_GENERATE = -3
+};
+#define CLI_SUCCESS ((char *)0)
+#define CLI_SHOWUSAGE ((char *)1)
+#define CLI_FAILURE ((char *)2)
+struct ast_cli_args {
+	int fd;
+	int argc;
+	const char *const *argv;
+	const char *line;
+	const char *word;
+	int pos;
+	int n;
+};
+struct ast_cli_entry {
+	const char *command;
+	const char *usage;
+	char *(*handler)(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a);
+	const char *summary;
+};
+#define AST_CLI_DEFINE(fn, txt, ...) { .handler = fn, .summary = txt }
+int ast_cli_register_multiple(struct ast_cli_entry *e, int len);
+int ast_cli_unregister_multiple(struct ast_cli_entry *e, int len);
+void ast_cli(int fd, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/* Manager */
+#define EVENT_FLAG_SYSTEM (1 << 0)
+#define EVENT_FLAG_CALL (1 << 1)
+#define EVENT_FLAG_REPORTING (1 << 6)
+struct mansession;
+struct message;
+#define manager_event(category, event, ...) __manager_event(category, event, __VA_ARGS__)
+int __manager_event(int category, const char *event, const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+const char *astman_get_header(const struct message *m, const char *var);
+void astman_send_listack(struct mansession *s, const struct message *m, const char *msg,
+	const char *listflag);
+void astman_send_list_complete_start(struct mansession *s, const struct message *m,
+	const char *event_name, int count);
+void astman_send_list_complete_end(struct mansession *s);
+void astman_append(struct mansession *s, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+int ast_manager_register_xml(const char *action, int authority,
+	int (*func)(struct mansession *s, const struct message *m));
+int ast_manager_unregister(const char *action);
+
+/* Bridging */
+struct ast_bridge_features {
+	struct ao2_container *dtmf_hooks;
+	unsigned int dtmf_passthrough:1;
+};
+struct ast_bridge_channel {
+	struct ast_channel *chan;
+	struct ast_bridge_features *features;
+	void *tech_pvt;
+	struct {
+		struct ast_bridge_channel *next;
+	} entry;
+};
+struct ast_bridge {
+	unsigned int num_channels;
+	struct {
+		struct ast_bridge_channel *first;
+		struct ast_bridge_channel *last;
+	} channels;
+	const char *uniqueid;
+};
+enum {
+	AST_BRIDGE_CAPABILITY_HOLDING = (1 << 0),
+	AST_BRIDGE_CAPABILITY_EARLY = (1 << 1),
+	AST_BRIDGE_CAPABILITY_NATIVE = (1 << 2),
+	AST_BRIDGE_CAPABILITY_1TO1MIX = (1 << 3),
+	AST_BRIDGE_CAPABILITY_MULTIMIX = (1 << 4)
+};
+enum {
+	AST_BRIDGE_PREFERENCE_BASE_HOLDING = 50,
+	AST_BRIDGE_PREFERENCE_BASE_EARLY = 100,
+	AST_BRIDGE_PREFERENCE_BASE_NATIVE = 90,
+	AST_BRIDGE_PREFERENCE_BASE_1TO1MIX = 50
+};
+struct ast_bridge_technology {
+	const char *name;
+	uint32_t capabilities;
+	int preference;
+	int (*create)(struct ast_bridge *bridge);
+	int (*start)(struct ast_bridge *bridge);
+	void (*stop)(struct ast_bridge *bridge);
+	void (*destroy)(struct ast_bridge *bridge);
+	int (*join)(struct ast_bridge *bridge, struct ast_bridge_channel *bridge_channel);
+	void (*leave)(struct ast_bridge *bridge, struct ast_bridge_channel *bridge_channel);
+	void (*suspend)(struct ast_bridge *bridge, struct ast_bridge_channel *bridge_channel);
+	void (*unsuspend)(struct ast_bridge *bridge, struct ast_bridge_channel *bridge_channel);
+	int (*compatible)(struct ast_bridge *bridge);
+	int (*write)(struct ast_bridge *bridge, struct ast_bridge_channel *bridge_channel,
+		struct ast_frame *frame);
+};
+#define ast_bridge_technology_register(tech) __ast_bridge_technology_register(tech, NULL)
+int __ast_bridge_technology_register(struct ast_bridge_technology *tech, void *module);
+int ast_bridge_technology_unregister(struct ast_bridge_technology *tech);
+int ast_bridge_queue_everyone_else(struct ast_bridge *bridge, struct ast_bridge_channel *bridge_channel,
+	struct ast_frame *frame);
+
+#endif /* MOQ_TEST_SHIM_ASTERISK_H */
@@ -0,0 +1,27 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+struct json_object;
+struct json_object *json_object_new_object(void);
+struct json_object *json_object_new_string(const char *);
+struct json_object *json_object_new_int(int32_t);
+struct json_object *json_object_new_int64(int64_t);
+struct json_object *json_object_new_boolean(int);
+struct json_object *json_object_new_array(void);
+int json_object_array_add(struct json_object *, struct json_object *);
+size_t json_object_array_length(const struct json_object *);
+struct json_object *json_object_array_get_idx(const struct json_object *, size_t);
+int json_object_object_add(struct json_object *, const char *, struct json_object *);
+struct json_object *json_object_object_get(const struct json_object *, const char *);
+const char *json_object_get_string(struct json_object *);
+int32_t json_object_get_int(const struct json_object *);
+int64_t json_object_get_int64(const struct json_object *);
+int json_object_get_boolean(const struct json_object *);
+const char *json_object_to_json_string(struct json_object *);
+int json_object_put(struct json_object *);
+struct json_object *json_object_get(struct json_object *);
+struct json_object *json_tokener_parse(const char *);
+struct json_tokener;
+struct json_tokener *json_tokener_new(void);
+void json_tokener_free(struct json_tokener *);
+struct json_object *json_tokener_parse_ex(struct json_tokener *, const char *, int);
@@ -0,0 +1,28 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#define LWS_PRE 16
+struct lws; struct lws_context; struct lws_vhost;
+enum lws_callback_reasons { LWS_CALLBACK_ESTABLISHED, LWS_CALLBACK_RECEIVE, LWS_CALLBACK_CLOSED,
+ LWS_CALLBACK_CLIENT_ESTABLISHED, LWS_CALLBACK_CLIENT_RECEIVE, LWS_CALLBACK_CLIENT_CONNECTION_ERROR,
+ LWS_CALLBACK_CLIENT_CLOSED, LWS_CALLBACK_CLIENT_WRITEABLE, LWS_CALLBACK_SERVER_WRITEABLE, LWS_CALLBACK_EVENT_WAIT_CANCELLED };
+enum lws_write_protocol { LWS_WRITE_TEXT, LWS_WRITE_BINARY };
+typedef int lws_callback_function(struct lws *, enum lws_callback_reasons, void *, void *, size_t);
+struct lws_protocols { const char *name; lws_callback_function *callback; size_t per_session_data_size; size_t rx_buffer_size; unsigned int id; void *user; size_t tx_packet_size; };
+struct lws_context_creation_info { int port; const struct lws_protocols *protocols; int gid; int uid; unsigned int options; void *user; };
+struct lws_client_connect_info { struct lws_context *context; const char *address; int port; int ssl_connection; const char *path; const char *host; const char *origin; const char *protocol; struct lws **pwsi; void *userdata; };
+struct lws_context *lws_create_context(const struct lws_context_creation_info *);
+void lws_context_destroy(struct lws_context *);
+int lws_service(struct lws_context *, int);
+int lws_write(struct lws *, unsigned char *, size_t, enum lws_write_protocol);
+struct lws *lws_client_connect_via_info(const struct lws_client_connect_info *);
+int lws_callback_on_writable(struct lws *);
+void lws_cancel_service(struct lws_context *);
+int lws_is_final_fragment(struct lws *);
+int lws_is_first_fragment(struct lws *);
+size_t lws_remaining_packet_payload(struct lws *);
+struct lws_context *lws_get_context(const struct lws *);
+void *lws_wsi_user(struct lws *);
+int lws_parse_uri(char *p, const char **prot, const char **ads, int *port, const char **path);
+void lws_close_reason(struct lws *, int, unsigned char *, size_t);
@@ -0,0 +1,790 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/*
+ * Just enough of Asterisk for chan_moq to run in a test process: reference
+ * counted objects, channels that count what is queued to them, formats,
+ * configuration from a string and a WebSocket layer that keeps what is
+ * written to it. Logging is quiet unless MOQ_TEST_VERBOSE is set.
+ */
+
+#include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "asterisk.h"
+#include "libwebsockets.h"
+#include "shim.h"
+
+const char *shim_config;
+const char *ast_config_AST_SPOOL_DIR = "/tmp";
+struct ast_frame ast_null_frame = { .frametype = AST_FRAME_NULL };
+
+/* Logging */
+
+void ast_log(int level, const char *file, int line, const char *function, const char *fmt, ...)
+{
+	static const char *const names[] = { "DEBUG", "", "NOTICE", "WARNING", "ERROR" };
+	va_list ap;
+
+	if (!getenv("MOQ_TEST_VERBOSE")) {
+		return;
+	}
+	fprintf(stderr, "[%s] %s:%d %s: ", names[level], file, line, function);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+/* Utilities */
+
+void ast_copy_string(char *dst, const char *src, size_t size)
+{
+	if (!size) {
+		return;
+	}
+	strncpy(dst, src, size - 1);
+	dst[size - 1] = '\0';
+}
+
+long ast_random(void)
+{
+	return random();
+}
+
+int ast_true(const char *val)
+{
+	return val && (!strcasecmp(val, "yes") || !strcasecmp(val, "true") || !strcasecmp(val, "y") ||
+		!strcasecmp(val, "t") || !strcasecmp(val, "1") || !strcasecmp(val, "on"));
+}
+
+int ast_false(const char *val)
+{
+	return val && (!strcasecmp(val, "no") || !strcasecmp(val, "false") || !strcasecmp(val, "n") ||
+		!strcasecmp(val, "f") || !strcasecmp(val, "0") || !strcasecmp(val, "off"));
+}
+
+static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+int ast_base64encode(char *dst, const unsigned char *src, int srclen, int max)
+{
+	int i, len = 0;
+
+	for (i = 0; i < srclen && len + 4 < max; i += 3) {
+		uint32_t n = src[i] << 16;
+
+		if (i + 1 < srclen) {
+			n |= src[i + 1] << 8;
+		}
+		if (i + 2 < srclen) {
+			n |= src[i + 2];
+		}
+		dst[len++] = base64[(n >> 18) & 63];
+		dst[len++] = base64[(n >> 12) & 63];
+		dst[len++] = i + 1 < srclen ? base64[(n >> 6) & 63] : '=';
+		dst[len++] = i + 2 < srclen ? base64[n & 63] : '=';
+	}
+	dst[len] = '\0';
+
+	return len;
+}
+
+int ast_base64decode(unsigned char *dst, const char *src, int max)
+{
+	uint32_t n = 0;
+	int bits = 0, len = 0;
+
+	for (; *src && *src != '='; src++) {
+		const char *p = strchr(base64, *src);
+
+		if (!p) {
+			break;
+		}
+		n = (n << 6) | (p - base64);
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			if (len == max) {
+				break;
+			}
+			dst[len++] = (n >> bits) & 0xff;
+		}
+	}
+
+	return len;
+}
+
+int ast_mkdir(const char *path, int mode)
+{
+	char buf[PATH_MAX];
+	char *p;
+
+	ast_copy_string(buf, path, sizeof(buf));
+	for (p = buf + 1; *p; p++) {
+		if (*p == '/') {
+			*p = '\0';
+			if (mkdir(buf, mode) && errno != EEXIST) {
+				return errno;
+			}
+			*p = '/';
+		}
+	}
+	if (mkdir(buf, mode) && errno != EEXIST) {
+		return errno;
+	}
+
+	return 0;
+}
+
+/* Time */
+
+struct timeval ast_tvnow(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv;
+}
+
+int64_t ast_tvdiff_us(struct timeval end, struct timeval start)
+{
+	return (end.tv_sec - start.tv_sec) * (int64_t)1000000 + (end.tv_usec - start.tv_usec);
+}
+
+int64_t ast_tvdiff_ms(struct timeval end, struct timeval start)
+{
+	return ast_tvdiff_us(end, start) / 1000;
+}
+
+int ast_tvzero(struct timeval t)
+{
+	return !t.tv_sec && !t.tv_usec;
+}
+
+struct timeval ast_tv(long sec, long usec)
+{
+	struct timeval t = { .tv_sec = sec, .tv_usec = usec };
+
+	return t;
+}
+
+struct timeval ast_tvadd(struct timeval a, struct timeval b)
+{
+	a.tv_sec += b.tv_sec;
+	a.tv_usec += b.tv_usec;
+	if (a.tv_usec >= 1000000) {
+		a.tv_sec++;
+		a.tv_usec -= 1000000;
+	}
+
+	return a;
+}
+
+/* Reference counted objects: a header in front of the user data */
+
+struct ao2_obj {
+	int refs;
+	ao2_destructor_fn destructor;
+	long long data[];
+};
+
+#define AO2_OBJ(user) ((struct ao2_obj *)((char *)(user) - offsetof(struct ao2_obj, data)))
+
+void *ao2_alloc_options(size_t size, ao2_destructor_fn destructor, unsigned int options)
+{
+	struct ao2_obj *obj = calloc(1, sizeof(*obj) + size);
+
+	if (!obj) {
+		return NULL;
+	}
+	obj->refs = 1;
+	obj->destructor = destructor;
+
+	return obj->data;
+}
+
+int ao2_ref(void *user, int delta)
+{
+	struct ao2_obj *obj = AO2_OBJ(user);
+	int old = __atomic_fetch_add(&obj->refs, delta, __ATOMIC_ACQ_REL);
+
+	if (old + delta == 0) {
+		if (obj->destructor) {
+			obj->destructor(user);
+		}
+		free(obj);
+	} else if (old + delta < 0) {
+		fprintf(stderr, "ao2_ref: %p released too often\n", user);
+		abort();
+	}
+
+	return old;
+}
+
+int ao2_container_count(struct ao2_container *c)
+{
+	return 0;
+}
+
+/* Configuration: [general] comes from shim_config */
+
+struct ast_config {
+	struct ast_variable *general;
+};
+
+struct ast_config *ast_config_load(const char *filename, struct ast_flags flags)
+{
+	struct ast_config *cfg;
+	struct ast_variable **tail;
+	const char *line;
+	int lineno = 0;
+
+	if (!shim_config) {
+		return NULL;
+	}
+	cfg = calloc(1, sizeof(*cfg));
+	tail = &cfg->general;
+	for (line = shim_config; *line; ) {
+		const char *end = strchrnul(line, '\n');
+		const char *eq = memchr(line, '=', end - line);
+
+		lineno++;
+		if (eq) {
+			struct ast_variable *v = calloc(1, sizeof(*v));
+
+			v->name = strndup(line, eq - line);
+			v->value = strndup(eq + 1, end - eq - 1);
+			v->lineno = lineno;
+			*tail = v;
+			tail = &v->next;
+		}
+		line = *end ? end + 1 : end;
+	}
+
+	return cfg;
+}
+
+struct ast_variable *ast_variable_browse(const struct ast_config *config, const char *category)
+{
+	return !strcmp(category, "general") ? config->general : NULL;
+}
+
+void ast_config_destroy(struct ast_config *config)
+{
+	struct ast_variable *v, *next;
+
+	for (v = config->general; v; v = next) {
+		next = v->next;
+		free((char *)v->name);
+		free((char *)v->value);
+		free(v);
+	}
+	free(config);
+}
+
+/* Formats: one object per format, compared by identity */
+
+struct ast_format {
+	const char *name;
+	enum ast_media_type type;
+};
+
+#define MAX_CAP_FORMATS 8
+
+struct ast_format_cap {
+	struct ast_format *formats[MAX_CAP_FORMATS];
+	int count;
+};
+
+struct ast_format *ast_format_ulaw, *ast_format_alaw, *ast_format_h264, *ast_format_vp8,
+	*ast_format_slin;
+
+static struct ast_format *format_new(const char *name, enum ast_media_type type)
+{
+	struct ast_format *format = ao2_alloc(sizeof(*format), NULL);
+
+	format->name = name;
+	format->type = type;
+
+	return format;
+}
+
+__attribute__((constructor))
+static void formats_init(void)
+{
+	ast_format_ulaw = format_new("ulaw", AST_MEDIA_TYPE_AUDIO);
+	ast_format_alaw = format_new("alaw", AST_MEDIA_TYPE_AUDIO);
+	ast_format_slin = format_new("slin", AST_MEDIA_TYPE_AUDIO);
+	ast_format_h264 = format_new("h264", AST_MEDIA_TYPE_VIDEO);
+	ast_format_vp8 = format_new("vp8", AST_MEDIA_TYPE_VIDEO);
+}
+
+static void format_cap_destructor(void *obj)
+{
+	struct ast_format_cap *cap = obj;
+	int i;
+
+	for (i = 0; i < cap->count; i++) {
+		ao2_ref(cap->formats[i], -1);
+	}
+}
+
+struct ast_format_cap *ast_format_cap_alloc(int flags)
+{
+	return ao2_alloc(sizeof(struct ast_format_cap), format_cap_destructor);
+}
+
+int ast_format_cap_append(struct ast_format_cap *cap, struct ast_format *format, unsigned int framing)
+{
+	if (cap->count == MAX_CAP_FORMATS) {
+		return -1;
+	}
+	cap->formats[cap->count++] = ao2_bump(format);
+
+	return 0;
+}
+
+struct ast_format *ast_format_cap_get_best_by_type(const struct ast_format_cap *cap,
+	enum ast_media_type type)
+{
+	int i;
+
+	for (i = 0; cap && i < cap->count; i++) {
+		if (cap->formats[i]->type == type) {
+			return ao2_bump(cap->formats[i]);
+		}
+	}
+
+	return NULL;
+}
+
+enum ast_format_cmp_res ast_format_cmp(const struct ast_format *a, const struct ast_format *b)
+{
+	return a == b ? AST_FORMAT_CMP_EQUAL : AST_FORMAT_CMP_NOT_EQUAL;
+}
+
+/* Channels */
+
+#define MAX_FRAME_TYPES 16
+#define MAX_CONTROLS 32
+
+struct ast_channel {
+	char name[80];
+	pthread_mutex_t lock;
+	const struct ast_channel_tech *tech;
+	void *tech_pvt;
+	enum ast_channel_state state;
+	struct ast_party_caller caller;
+	struct ast_format_cap *nativeformats;
+	struct ast_format *rawreadformat;
+	struct ast_format *rawwriteformat;
+	int frames[MAX_FRAME_TYPES];
+	int controls[MAX_CONTROLS];
+	int softhangup;
+	int hangupcause;
+};
+
+static void channel_destructor(void *obj)
+{
+	struct ast_channel *chan = obj;
+
+	ao2_cleanup(chan->nativeformats);
+	ao2_cleanup(chan->rawreadformat);
+	ao2_cleanup(chan->rawwriteformat);
+	free(chan->caller.id.number.str);
+	pthread_mutex_destroy(&chan->lock);
+}
+
+struct ast_channel *__ast_channel_alloc(int state, const char *cid_num, const char *exten,
+	const char *context, const char *name_fmt, ...)
+{
+	struct ast_channel *chan = ao2_alloc(sizeof(*chan), channel_destructor);
+	pthread_mutexattr_t attr;
+	va_list ap;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&chan->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+	va_start(ap, name_fmt);
+	vsnprintf(chan->name, sizeof(chan->name), name_fmt, ap);
+	va_end(ap);
+	chan->state = state;
+	if (cid_num) {
+		chan->caller.id.number.str = strdup(cid_num);
+		chan->caller.id.number.valid = 1;
+	}
+	pthread_mutex_lock(&chan->lock);
+
+	return chan;
+}
+
+int ast_channel_register(const struct ast_channel_tech *tech)
+{
+	return 0;
+}
+
+void ast_channel_unregister(const struct ast_channel_tech *tech)
+{
+}
+
+void ast_channel_tech_set(struct ast_channel *chan, const struct ast_channel_tech *tech)
+{
+	chan->tech = tech;
+}
+
+const struct ast_channel_tech *ast_channel_tech(const struct ast_channel *chan)
+{
+	return chan->tech;
+}
+
+void ast_channel_nativeformats_set(struct ast_channel *chan, struct ast_format_cap *cap)
+{
+	if (cap) {
+		ao2_ref(cap, +1);
+	}
+	ao2_cleanup(chan->nativeformats);
+	chan->nativeformats = cap;
+}
+
+void ast_channel_set_writeformat(struct ast_channel *chan, struct ast_format *format)
+{
+}
+
+void ast_channel_set_readformat(struct ast_channel *chan, struct ast_format *format)
+{
+}
+
+void ast_channel_set_rawwriteformat(struct ast_channel *chan, struct ast_format *format)
+{
+	ao2_ref(format, +1);
+	ao2_cleanup(chan->rawwriteformat);
+	chan->rawwriteformat = format;
+}
+
+void ast_channel_set_rawreadformat(struct ast_channel *chan, struct ast_format *format)
+{
+	ao2_ref(format, +1);
+	ao2_cleanup(chan->rawreadformat);
+	chan->rawreadformat = format;
+}
+
+struct ast_format *ast_channel_rawreadformat(struct ast_channel *chan)
+{
+	return chan->rawreadformat;
+}
+
+struct ast_format *ast_channel_rawwriteformat(struct ast_channel *chan)
+{
+	return chan->rawwriteformat;
+}
+
+void *ast_channel_tech_pvt(const struct ast_channel *chan)
+{
+	return __atomic_load_n(&chan->tech_pvt, __ATOMIC_ACQUIRE);
+}
+
+void ast_channel_tech_pvt_set(struct ast_channel *chan, void *pvt)
+{
+	__atomic_store_n(&chan->tech_pvt, pvt, __ATOMIC_RELEASE);
+}
+
+void ast_channel_lock(struct ast_channel *chan)
+{
+	pthread_mutex_lock(&chan->lock);
+}
+
+void ast_channel_unlock(struct ast_channel *chan)
+{
+	pthread_mutex_unlock(&chan->lock);
+}
+
+const char *ast_channel_name(const struct ast_channel *chan)
+{
+	return chan->name;
+}
+
+struct ast_channel *ast_channel_ref(struct ast_channel *chan)
+{
+	ao2_ref(chan, +1);
+
+	return chan;
+}
+
+struct ast_channel *ast_channel_unref(struct ast_channel *chan)
+{
+	if (chan) {
+		ao2_ref(chan, -1);
+	}
+
+	return NULL;
+}
+
+struct ast_party_caller *ast_channel_caller(struct ast_channel *chan)
+{
+	return &chan->caller;
+}
+
+int ast_channel_has_audio_frame_or_monitor(struct ast_channel *chan)
+{
+	return 0;
+}
+
+int ast_channel_has_hook_requiring_audio(struct ast_channel *chan)
+{
+	return 0;
+}
+
+int ast_setstate(struct ast_channel *chan, enum ast_channel_state state)
+{
+	chan->state = state;
+
+	return 0;
+}
+
+int ast_queue_frame(struct ast_channel *chan, const struct ast_frame *frame)
+{
+	if (frame->frametype < MAX_FRAME_TYPES) {
+		__atomic_fetch_add(&chan->frames[frame->frametype], 1, __ATOMIC_RELAXED);
+	}
+	if (frame->frametype == AST_FRAME_CONTROL && frame->subclass.integer < MAX_CONTROLS) {
+		__atomic_fetch_add(&chan->controls[frame->subclass.integer], 1, __ATOMIC_RELAXED);
+	}
+
+	return 0;
+}
+
+int ast_queue_control(struct ast_channel *chan, enum ast_control_frame_type control)
+{
+	struct ast_frame frame = { .frametype = AST_FRAME_CONTROL, .subclass.integer = control };
+
+	return ast_queue_frame(chan, &frame);
+}
+
+int ast_queue_hangup_with_cause(struct ast_channel *chan, int cause)
+{
+	chan->hangupcause = cause;
+
+	return ast_queue_control(chan, AST_CONTROL_HANGUP);
+}
+
+int ast_softhangup(struct ast_channel *chan, int reason)
+{
+	__atomic_or_fetch(&chan->softhangup, reason, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+int ast_hangup(struct ast_channel *chan)
+{
+	if (chan->tech && chan->tech->hangup) {
+		chan->tech->hangup(chan);
+	}
+	ao2_ref(chan, -1);
+
+	return 0;
+}
+
+int ast_pbx_start(struct ast_channel *chan)
+{
+	return 0;
+}
+
+int ast_exists_extension(struct ast_channel *chan, const char *context, const char *exten,
+	int priority, const char *callerid)
+{
+	return 1;
+}
+
+int pbx_builtin_setvar_helper(struct ast_channel *chan, const char *name, const char *value)
+{
+	return 0;
+}
+
+int shim_channel_frames(struct ast_channel *chan, int frametype)
+{
+	return __atomic_load_n(&chan->frames[frametype], __ATOMIC_RELAXED);
+}
+
+int shim_channel_controls(struct ast_channel *chan, int control)
+{
+	return __atomic_load_n(&chan->controls[control], __ATOMIC_RELAXED);
+}
+
+/* CLI and manager */
+
+int ast_cli_register_multiple(struct ast_cli_entry *e, int len)
+{
+	return 0;
+}
+
+int ast_cli_unregister_multiple(struct ast_cli_entry *e, int len)
+{
+	return 0;
+}
+
+void ast_cli(int fd, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vdprintf(fd, fmt, ap);
+	va_end(ap);
+}
+
+int __manager_event(int category, const char *event, const char *fmt, ...)
+{
+	return 0;
+}
+
+const char *astman_get_header(const struct message *m, const char *var)
+{
+	return "";
+}
+
+void astman_send_listack(struct mansession *s, const struct message *m, const char *msg,
+	const char *listflag)
+{
+}
+
+void astman_send_list_complete_start(struct mansession *s, const struct message *m,
+	const char *event_name, int count)
+{
+}
+
+void astman_send_list_complete_end(struct mansession *s)
+{
+}
+
+void astman_append(struct mansession *s, const char *fmt, ...)
+{
+}
+
+int ast_manager_register_xml(const char *action, int authority,
+	int (*func)(struct mansession *s, const struct message *m))
+{
+	return 0;
+}
+
+int ast_manager_unregister(const char *action)
+{
+	return 0;
+}
+
+/* Bridging */
+
+static int bridge_frames;
+
+int __ast_bridge_technology_register(struct ast_bridge_technology *tech, void *module)
+{
+	return 0;
+}
+
+int ast_bridge_technology_unregister(struct ast_bridge_technology *tech)
+{
+	return 0;
+}
+
+int ast_bridge_queue_everyone_else(struct ast_bridge *bridge, struct ast_bridge_channel *bridge_channel,
+	struct ast_frame *frame)
+{
+	__atomic_fetch_add(&bridge_frames, 1, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+int shim_bridge_frames(void)
+{
+	return __atomic_load_n(&bridge_frames, __ATOMIC_RELAXED);
+}
+
+/* WebSockets: messages written are queued per connection for the tests */
+
+struct ws_message {
+	const void *wsi;
+	char *text;
+	struct ws_message *next;
+};
+
+static pthread_mutex_t ws_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct ws_message *ws_head, **ws_tail = &ws_head;
+static int ws_context;
+
+struct lws_context *lws_create_context(const struct lws_context_creation_info *info)
+{
+	return (struct lws_context *)&ws_context;
+}
+
+void lws_context_destroy(struct lws_context *context)
+{
+}
+
+int lws_service(struct lws_context *context, int timeout_ms)
+{
+	usleep(timeout_ms * 1000);
+
+	return 0;
+}
+
+int lws_write(struct lws *wsi, unsigned char *buf, size_t len, enum lws_write_protocol protocol)
+{
+	struct ws_message *msg = calloc(1, sizeof(*msg));
+
+	msg->wsi = wsi;
+	msg->text = strndup((const char *)buf, len);
+	pthread_mutex_lock(&ws_lock);
+	*ws_tail = msg;
+	ws_tail = &msg->next;
+	pthread_mutex_unlock(&ws_lock);
+
+	return len;
+}
+
+int shim_ws_take(const void *wsi, char *buf, size_t len)
+{
+	struct ws_message **p, *msg = NULL;
+
+	pthread_mutex_lock(&ws_lock);
+	for (p = &ws_head; *p; p = &(*p)->next) {
+		if ((*p)->wsi == wsi) {
+			msg = *p;
+			*p = msg->next;
+			if (ws_tail == &msg->next) {
+				ws_tail = p;
+			}
+			break;
+		}
+	}
+	pthread_mutex_unlock(&ws_lock);
+
+	if (!msg) {
+		return 0;
+	}
+	ast_copy_string(buf, msg->text, len);
+	free(msg->text);
+	free(msg);
+
+	return 1;
+}
+
+void shim_ws_clear(void)
+{
+	struct ws_message *msg;
+
+	pthread_mutex_lock(&ws_lock);
+	while ((msg = ws_head)) {
+		ws_head = msg->next;
+		free(msg->text);
+		free(msg);
+	}
+	ws_tail = &ws_head;
+	pthread_mutex_unlock(&ws_lock);
+}
@@ -0,0 +1,40 @@
+/*
+ * chan_moq - Media over QUIC (MoQ) channel driver with WebSocket signaling
+ *
+ * Copyright (C) 2025
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2.
+ */
+
+/*
+ * What the driver tests can see of the Asterisk stand-in: the configuration
+ * the driver loads, the signaling it sends and what it queues to channels.
+ */
+
+#ifndef MOQ_TEST_SHIM_H
+#define MOQ_TEST_SHIM_H
+
+#include <stddef.h>
+
+struct ast_channel;
+
+/* moq.conf [general] as "name=value" lines; NULL loads no file at all */
+extern const char *shim_config;
+
+/* Pop the oldest WebSocket message written to a connection, 0 if there is none */
+int shim_ws_take(const void *wsi, char *buf, size_t len);
+
+/* Drop every WebSocket message not taken yet */
+void shim_ws_clear(void);
+
+/* Frames of a type (AST_FRAME_*) queued to a channel so far */
+int shim_channel_frames(struct ast_channel *chan, int frametype);
+
+/* Control frames of a kind (AST_CONTROL_*) queued to a channel so far */
+int shim_channel_controls(struct ast_channel *chan, int control);
+
+/* Frames queued to the core by bridges through ast_bridge_queue_everyone_else() */
+int shim_bridge_frames(void);
+
+#endif /* MOQ_TEST_SHIM_H */